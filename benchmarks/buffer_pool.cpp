@@ -0,0 +1,103 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "kademlia/buffer_pool.hpp"
+#include "kademlia/message_serializer.hpp"
+
+namespace {
+
+namespace kd = kademlia::detail;
+
+/**
+ *  Build a store request carrying a range(0) bytes value.
+ */
+kd::store_value_request_body
+make_request
+    ( std::default_random_engine & random_engine
+    , std::size_t value_size )
+{
+    return kd::store_value_request_body{ kd::generate_token( random_engine )
+                                       , kd::buffer( value_size, 0x5a ) };
+}
+
+/**
+ *  Serialize a request into a fresh buffer and copy it
+ *  into the completion handler, as async_send used to.
+ */
+void
+serialize_and_copy
+    ( benchmark::State & state )
+{
+    std::default_random_engine random_engine{ 1 };
+    kd::message_serializer serializer{ kd::id{ random_engine } };
+    auto const request = make_request( random_engine, state.range( 0 ) );
+    auto const token = kd::generate_token( random_engine );
+
+    for ( auto _ : state )
+    {
+        auto const message = serializer.serialize( request, token );
+        auto const message_copy = std::make_shared< kd::buffer >( message );
+        benchmark::DoNotOptimize( message_copy->data() );
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( serialize_and_copy )->Arg( 64 )->Arg( 1024 )->Arg( 16384 );
+
+/**
+ *  Serialize a request into a pooled buffer
+ *  shared with the completion handler.
+ */
+void
+serialize_into_pooled_buffer
+    ( benchmark::State & state )
+{
+    std::default_random_engine random_engine{ 1 };
+    kd::message_serializer serializer{ kd::id{ random_engine } };
+    auto const request = make_request( random_engine, state.range( 0 ) );
+    auto const token = kd::generate_token( random_engine );
+
+    kd::buffer_pool pool;
+    for ( auto _ : state )
+    {
+        auto const message = pool.acquire();
+        serializer.serialize( request, token, *message );
+        auto const message_reference = message;
+        benchmark::DoNotOptimize( message_reference->data() );
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( serialize_into_pooled_buffer )->Arg( 64 )->Arg( 1024 )->Arg( 16384 );
+
+} // anonymous namespace
+
@@ -0,0 +1,152 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "kademlia/id.hpp"
+
+namespace {
+
+namespace kd = kademlia::detail;
+
+std::vector< kd::id >
+generate_ids
+    ( std::size_t count
+    , std::default_random_engine::result_type seed = 1 )
+{
+    std::default_random_engine random_engine{ seed };
+
+    std::vector< kd::id > ids;
+    ids.reserve( count );
+    for ( std::size_t i = 0; i != count; ++ i )
+        ids.emplace_back( kd::generate_token( random_engine ) );
+
+    return ids;
+}
+
+/**
+ *  Parse the hexadecimal representation of an id.
+ */
+void
+id_string_construction
+    ( benchmark::State & state )
+{
+    std::ostringstream out;
+    out << std::hex << 0x0123456789abcdefULL << 0xfedcba9876543210ULL << 0x01234567;
+    auto const value = out.str();
+
+    for ( auto _ : state )
+        benchmark::DoNotOptimize( kd::id{ value } );
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( id_string_construction );
+
+/**
+ *  Hash a range(0) bytes key into an id, as saves and loads do.
+ */
+void
+id_hash_construction
+    ( benchmark::State & state )
+{
+    kd::id::value_to_hash_type const value( state.range( 0 ), 0x5a );
+
+    for ( auto _ : state )
+        benchmark::DoNotOptimize( kd::id{ value } );
+
+    state.SetItemsProcessed( state.iterations() );
+    state.SetBytesProcessed( state.iterations() * value.size() );
+}
+BENCHMARK( id_hash_construction )->Arg( 16 )->Arg( 1024 );
+
+/**
+ *  Compute the distance between two ids.
+ */
+void
+id_distance
+    ( benchmark::State & state )
+{
+    auto const ids = generate_ids( 1024 );
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        benchmark::DoNotOptimize( kd::distance( ids[ current ]
+                                              , ids[ ( current + 1 ) % ids.size() ] ) );
+        current = ( current + 1 ) % ids.size();
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( id_distance );
+
+/**
+ *  Order two ids, as sorting peers by distance does.
+ */
+void
+id_compare
+    ( benchmark::State & state )
+{
+    auto const ids = generate_ids( 1024 );
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        benchmark::DoNotOptimize( ids[ current ] < ids[ ( current + 1 ) % ids.size() ] );
+        current = ( current + 1 ) % ids.size();
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( id_compare );
+
+/**
+ *  Count the bits shared by two ids, as
+ *  selecting a routing table bucket does.
+ */
+void
+id_common_prefix_length
+    ( benchmark::State & state )
+{
+    auto const ids = generate_ids( 1024 );
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        benchmark::DoNotOptimize( kd::common_prefix_length( ids[ current ]
+                                                          , ids[ ( current + 1 ) % ids.size() ] ) );
+        current = ( current + 1 ) % ids.size();
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( id_common_prefix_length );
+
+} // anonymous namespace
+
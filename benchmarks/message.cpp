@@ -0,0 +1,230 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "kademlia/ip_endpoint.hpp"
+#include "kademlia/message.hpp"
+#include "kademlia/message_serializer.hpp"
+
+namespace {
+
+namespace kd = kademlia::detail;
+
+/**
+ *  Build the messages benchmarked below, those carrying
+ *  a value or peers get range(0) bytes or peers.
+ */
+kd::header
+make_message
+    ( benchmark::State const&
+    , std::default_random_engine & random_engine
+    , kd::header const* )
+{
+    return kd::header{ kd::header::V1, kd::header::FIND_PEER_REQUEST
+                     , kd::generate_token( random_engine )
+                     , kd::generate_token( random_engine ) };
+}
+
+kd::find_peer_request_body
+make_message
+    ( benchmark::State const&
+    , std::default_random_engine & random_engine
+    , kd::find_peer_request_body const* )
+{ return kd::find_peer_request_body{ kd::generate_token( random_engine ) }; }
+
+kd::find_peer_response_body
+make_message
+    ( benchmark::State const& state
+    , std::default_random_engine & random_engine
+    , kd::find_peer_response_body const* )
+{
+    kd::find_peer_response_body body;
+    for ( std::int64_t i = 0; i != state.range( 0 ); ++ i )
+        body.peers_.push_back( { kd::generate_token( random_engine )
+                               , kd::to_ip_endpoint( "127.0.0.1", 27980 ) } );
+
+    return body;
+}
+
+kd::find_value_request_body
+make_message
+    ( benchmark::State const&
+    , std::default_random_engine & random_engine
+    , kd::find_value_request_body const* )
+{ return kd::find_value_request_body{ kd::generate_token( random_engine ) }; }
+
+kd::find_value_response_body
+make_message
+    ( benchmark::State const& state
+    , std::default_random_engine &
+    , kd::find_value_response_body const* )
+{ return kd::find_value_response_body{ kd::buffer( state.range( 0 ), 0x5a ) }; }
+
+kd::store_value_request_body
+make_message
+    ( benchmark::State const& state
+    , std::default_random_engine & random_engine
+    , kd::store_value_request_body const* )
+{
+    return kd::store_value_request_body{ kd::generate_token( random_engine )
+                                       , kd::buffer( state.range( 0 ), 0x5a ) };
+}
+
+/**
+ *  Serialize a message into a reused buffer.
+ */
+template< typename Message >
+void
+serialize_message
+    ( benchmark::State & state )
+{
+    std::default_random_engine random_engine{ 1 };
+    auto const message = make_message( state, random_engine
+                                     , static_cast< Message const* >( nullptr ) );
+
+    kd::buffer b;
+    for ( auto _ : state )
+    {
+        b.clear();
+        kd::serialize( message, b );
+        benchmark::DoNotOptimize( b.data() );
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+    state.SetBytesProcessed( state.iterations() * b.size() );
+}
+
+/**
+ *  Deserialize a message from a buffer.
+ */
+template< typename Message >
+void
+deserialize_message
+    ( benchmark::State & state )
+{
+    std::default_random_engine random_engine{ 1 };
+    auto const message = make_message( state, random_engine
+                                     , static_cast< Message const* >( nullptr ) );
+
+    kd::buffer b;
+    kd::serialize( message, b );
+
+    for ( auto _ : state )
+    {
+        Message m;
+        kd::buffer::const_iterator i = b.begin();
+        benchmark::DoNotOptimize( kd::deserialize( i, b.end(), m ) );
+        benchmark::DoNotOptimize( &m );
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+    state.SetBytesProcessed( state.iterations() * b.size() );
+}
+
+/**
+ *  Serialize a whole message, header included, into
+ *  a buffer preallocated as the network does.
+ */
+template< typename Message >
+void
+serialize_full_message
+    ( benchmark::State & state )
+{
+    std::default_random_engine random_engine{ 1 };
+    auto const message = make_message( state, random_engine
+                                     , static_cast< Message const* >( nullptr ) );
+    auto const my_id = kd::generate_token( random_engine );
+    auto const token = kd::generate_token( random_engine );
+    kd::message_serializer serializer{ my_id };
+
+    kd::buffer b;
+    b.reserve( 65536 );
+    for ( auto _ : state )
+    {
+        b.clear();
+        serializer.serialize( message, token, b );
+        benchmark::DoNotOptimize( b.data() );
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+    state.SetBytesProcessed( state.iterations() * b.size() );
+}
+
+/**
+ *  Serialize a message without body, i.e. a ping.
+ */
+void
+serialize_ping
+    ( benchmark::State & state )
+{
+    std::default_random_engine random_engine{ 1 };
+    auto const my_id = kd::generate_token( random_engine );
+    auto const token = kd::generate_token( random_engine );
+    kd::message_serializer serializer{ my_id };
+
+    kd::buffer b;
+    b.reserve( 65536 );
+    for ( auto _ : state )
+    {
+        b.clear();
+        serializer.serialize( kd::header::PING_REQUEST, token, b );
+        benchmark::DoNotOptimize( b.data() );
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+    state.SetBytesProcessed( state.iterations() * b.size() );
+}
+
+BENCHMARK_TEMPLATE( serialize_message, kd::header );
+BENCHMARK_TEMPLATE( deserialize_message, kd::header );
+
+BENCHMARK_TEMPLATE( serialize_message, kd::find_peer_request_body );
+BENCHMARK_TEMPLATE( deserialize_message, kd::find_peer_request_body );
+
+BENCHMARK_TEMPLATE( serialize_message, kd::find_peer_response_body )->Arg( 20 );
+BENCHMARK_TEMPLATE( deserialize_message, kd::find_peer_response_body )->Arg( 20 );
+
+BENCHMARK_TEMPLATE( serialize_message, kd::find_value_request_body );
+BENCHMARK_TEMPLATE( deserialize_message, kd::find_value_request_body );
+
+BENCHMARK_TEMPLATE( serialize_message, kd::find_value_response_body )->Arg( 64 )->Arg( 1024 );
+BENCHMARK_TEMPLATE( deserialize_message, kd::find_value_response_body )->Arg( 64 )->Arg( 1024 );
+
+BENCHMARK_TEMPLATE( serialize_message, kd::store_value_request_body )->Arg( 64 )->Arg( 1024 );
+BENCHMARK_TEMPLATE( deserialize_message, kd::store_value_request_body )->Arg( 64 )->Arg( 1024 );
+
+BENCHMARK( serialize_ping );
+BENCHMARK_TEMPLATE( serialize_full_message, kd::find_peer_request_body );
+BENCHMARK_TEMPLATE( serialize_full_message, kd::find_peer_response_body )->Arg( 20 );
+BENCHMARK_TEMPLATE( serialize_full_message, kd::find_value_request_body );
+BENCHMARK_TEMPLATE( serialize_full_message, kd::find_value_response_body )->Arg( 64 )->Arg( 1024 );
+BENCHMARK_TEMPLATE( serialize_full_message, kd::store_value_request_body )->Arg( 64 )->Arg( 1024 );
+
+} // anonymous namespace
+
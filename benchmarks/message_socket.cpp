@@ -0,0 +1,143 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <benchmark/benchmark.h>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include "kademlia/endpoint.hpp"
+#include "kademlia/message_socket.hpp"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+
+using udp = boost::asio::ip::udp;
+using message_socket_type = kd::message_socket< udp::socket >;
+
+/// Roughly the size of a FIND_PEER request.
+auto const MESSAGE_SIZE = 100;
+
+/**
+ *  Send range(0) datagrams to a loopback socket and receive
+ *  them, both sides moving batches of datagrams.
+ */
+void
+message_socket_batch_round_trip
+    ( benchmark::State & state )
+{
+    boost::asio::io_service io_service;
+    auto sender = message_socket_type::ipv4( io_service, k::endpoint{ "127.0.0.1", 0 } );
+    auto receiver = message_socket_type::ipv4( io_service, k::endpoint{ "127.0.0.1", 0 } );
+
+    auto const count = std::size_t( state.range( 0 ) );
+    kd::buffer const message( MESSAGE_SIZE );
+    auto const destination = receiver.local_endpoint();
+
+    std::size_t received = 0;
+    std::function< void ( std::error_code const&
+                        , message_socket_type::received_messages const& ) > on_receive;
+    on_receive = [ & ]
+        ( std::error_code const&
+        , message_socket_type::received_messages const& messages )
+    {
+        received += messages.size();
+        if ( received < count )
+            receiver.async_receive_batch( on_receive );
+    };
+
+    auto const on_send = []( std::error_code const& ) {};
+
+    for ( auto _ : state )
+    {
+        received = 0;
+        receiver.async_receive_batch( on_receive );
+        for ( std::size_t i = 0; i != count; ++ i )
+            sender.async_send( message, destination, on_send );
+
+        io_service.restart();
+        io_service.run();
+    }
+
+    state.SetItemsProcessed( state.iterations() * count );
+}
+BENCHMARK( message_socket_batch_round_trip )->Arg( 64 )->UseRealTime();
+
+/**
+ *  Same as message_socket_batch_round_trip with a system
+ *  call and an asio handler per datagram, as message_socket
+ *  used to.
+ */
+void
+message_socket_single_round_trip
+    ( benchmark::State & state )
+{
+    boost::asio::io_service io_service;
+    udp::socket sender{ io_service, udp::endpoint{ boost::asio::ip::address_v4::loopback(), 0 } };
+    udp::socket receiver{ io_service, udp::endpoint{ boost::asio::ip::address_v4::loopback(), 0 } };
+
+    auto const count = std::size_t( state.range( 0 ) );
+    kd::buffer const message( MESSAGE_SIZE );
+    kd::buffer reception_buffer( message_socket_type::INPUT_BUFFER_SIZE );
+    udp::endpoint message_sender;
+    auto const destination = receiver.local_endpoint();
+
+    std::size_t received = 0;
+    std::function< void ( boost::system::error_code const&, std::size_t ) > on_receive;
+    on_receive = [ & ]
+        ( boost::system::error_code const&, std::size_t )
+    {
+        if ( ++ received < count )
+            receiver.async_receive_from( boost::asio::buffer( reception_buffer )
+                                       , message_sender, on_receive );
+    };
+
+    for ( auto _ : state )
+    {
+        received = 0;
+        receiver.async_receive_from( boost::asio::buffer( reception_buffer )
+                                   , message_sender, on_receive );
+        for ( std::size_t i = 0; i != count; ++ i )
+        {
+            auto message_copy = std::make_shared< kd::buffer >( message );
+            sender.async_send_to( boost::asio::buffer( *message_copy ), destination
+                                , [ message_copy ]( boost::system::error_code const&
+                                                  , std::size_t ) {} );
+        }
+
+        io_service.restart();
+        io_service.run();
+    }
+
+    state.SetItemsProcessed( state.iterations() * count );
+}
+BENCHMARK( message_socket_single_round_trip )->Arg( 64 )->UseRealTime();
+
+} // anonymous namespace
@@ -0,0 +1,185 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "kademlia/response_callbacks.hpp"
+
+namespace {
+
+namespace kd = kademlia::detail;
+
+using endpoint_type = kd::response_callbacks::endpoint_type;
+
+/// The previous correlation table, kept as a reference.
+using callbacks_map = std::map< kd::id
+                              , std::function< void
+                                    ( endpoint_type const&
+                                    , kd::header const&
+                                    , kd::buffer::const_iterator
+                                    , kd::buffer::const_iterator ) > >;
+
+/**
+ *  Build a callback capturing as much as the
+ *  response_router one does (task, timeout handle).
+ */
+auto
+make_callback
+    ( std::size_t & received
+    , std::shared_ptr< int > const& task )
+{
+    std::uint64_t const timeout = received;
+    return [ &received, task, timeout ]
+        ( endpoint_type const&
+        , kd::header const&
+        , kd::buffer::const_iterator
+        , kd::buffer::const_iterator )
+    { received += timeout != 0; };
+}
+
+/**
+ *  Draw a token the way the tracker used to, one block at a time.
+ */
+void
+id_random_construction
+    ( benchmark::State & state )
+{
+    std::default_random_engine random_engine{ 1 };
+
+    for ( auto _ : state )
+        benchmark::DoNotOptimize( kd::id{ random_engine } );
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( id_random_construction );
+
+/**
+ *  Draw a token one word at a time.
+ */
+void
+generate_token
+    ( benchmark::State & state )
+{
+    std::default_random_engine random_engine{ 1 };
+
+    for ( auto _ : state )
+        benchmark::DoNotOptimize( kd::generate_token( random_engine ) );
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( generate_token );
+
+/**
+ *  Register a request and dispatch the response of the
+ *  oldest one while range(0) requests are outstanding.
+ */
+void
+response_callbacks_steady_state
+    ( benchmark::State & state )
+{
+    std::default_random_engine random_engine{ 1 };
+    auto const task = std::make_shared< int >();
+    std::size_t received = 0;
+
+    kd::response_callbacks callbacks;
+    std::vector< kd::id > tokens( state.range( 0 ) );
+    for ( auto & t : tokens )
+    {
+        t = kd::generate_token( random_engine );
+        callbacks.push_callback( t, make_callback( received, task ) );
+    }
+
+    endpoint_type const sender{};
+    kd::header h{ kd::header::V1, kd::header::PING_RESPONSE };
+    kd::buffer const b;
+
+    std::size_t oldest = 0;
+    for ( auto _ : state )
+    {
+        h.random_token_ = tokens[ oldest ];
+        callbacks.dispatch_response( sender, h, b.begin(), b.end() );
+
+        tokens[ oldest ] = kd::generate_token( random_engine );
+        callbacks.push_callback( tokens[ oldest ], make_callback( received, task ) );
+        oldest = ( oldest + 1 ) % tokens.size();
+    }
+
+    benchmark::DoNotOptimize( received );
+    state.counters[ "outstanding" ] = double( callbacks.size() );
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( response_callbacks_steady_state )->Arg( 10000 )->Arg( 50000 );
+
+/**
+ *  Same as response_callbacks_steady_state with a map
+ *  and tokens drawn one block at a time.
+ */
+void
+callbacks_map_steady_state
+    ( benchmark::State & state )
+{
+    std::default_random_engine random_engine{ 1 };
+    auto const task = std::make_shared< int >();
+    std::size_t received = 0;
+
+    callbacks_map callbacks;
+    std::vector< kd::id > tokens( state.range( 0 ) );
+    for ( auto & t : tokens )
+    {
+        t = kd::id{ random_engine };
+        callbacks.emplace( t, make_callback( received, task ) );
+    }
+
+    endpoint_type const sender{};
+    kd::header h{ kd::header::V1, kd::header::PING_RESPONSE };
+    kd::buffer const b;
+
+    std::size_t oldest = 0;
+    for ( auto _ : state )
+    {
+        h.random_token_ = tokens[ oldest ];
+        auto i = callbacks.find( h.random_token_ );
+        i->second( sender, h, b.begin(), b.end() );
+        callbacks.erase( i );
+
+        tokens[ oldest ] = kd::id{ random_engine };
+        callbacks.emplace( tokens[ oldest ], make_callback( received, task ) );
+        oldest = ( oldest + 1 ) % tokens.size();
+    }
+
+    benchmark::DoNotOptimize( received );
+    state.counters[ "outstanding" ] = double( callbacks.size() );
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( callbacks_map_steady_state )->Arg( 10000 )->Arg( 50000 );
+
+} // anonymous namespace
@@ -0,0 +1,256 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "kademlia/concurrent_routing_table.hpp"
+#include "kademlia/id.hpp"
+#include "kademlia/ip_endpoint.hpp"
+#include "kademlia/routing_table.hpp"
+
+namespace {
+
+namespace kd = kademlia::detail;
+
+using routing_table_type = kd::routing_table< kd::ip_endpoint >;
+
+using concurrent_routing_table_type = kd::concurrent_routing_table< kd::ip_endpoint >;
+
+std::vector< kd::id >
+generate_ids
+    ( std::size_t count
+    , std::default_random_engine::result_type seed = 1 )
+{
+    std::default_random_engine random_engine{ seed };
+
+    std::vector< kd::id > ids;
+    ids.reserve( count );
+    for ( std::size_t i = 0; i != count; ++ i )
+        ids.emplace_back( random_engine );
+
+    return ids;
+}
+
+kd::ip_endpoint
+generate_endpoint
+    ( void )
+{ return kd::to_ip_endpoint( "127.0.0.1", 27980 ); }
+
+/**
+ *  Fill an empty routing table with range(0) peers.
+ */
+void
+routing_table_push_new_peers
+    ( benchmark::State & state )
+{
+    auto const ids = generate_ids( state.range( 0 ) );
+    auto const endpoint = generate_endpoint();
+
+    for ( auto _ : state )
+    {
+        routing_table_type table{ kd::id{} };
+        for ( auto const& i : ids )
+            benchmark::DoNotOptimize( table.push( i, endpoint ) );
+    }
+
+    state.SetItemsProcessed( state.iterations() * ids.size() );
+}
+BENCHMARK( routing_table_push_new_peers )->Arg( 10000 )->Arg( 100000 );
+
+/**
+ *  Push already known peers, i.e. what happens on most
+ *  received messages.
+ */
+void
+routing_table_push_known_peers
+    ( benchmark::State & state )
+{
+    auto const ids = generate_ids( state.range( 0 ) );
+    auto const endpoint = generate_endpoint();
+
+    routing_table_type table{ kd::id{} };
+    for ( auto const& i : ids )
+        table.push( i, endpoint );
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        benchmark::DoNotOptimize( table.push( ids[ current ], endpoint ) );
+        current = ( current + 1 ) % ids.size();
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( routing_table_push_known_peers )->Arg( 10000 )->Arg( 100000 );
+
+/**
+ *  Walk the DEFAULT_K_BUCKET_SIZE first peers
+ *  returned by find() for a random id.
+ */
+void
+routing_table_find
+    ( benchmark::State & state )
+{
+    auto const ids = generate_ids( state.range( 0 ) );
+    auto const targets = generate_ids( 1024, 2 );
+    auto const endpoint = generate_endpoint();
+
+    routing_table_type table{ kd::id{} };
+    for ( auto const& i : ids )
+        table.push( i, endpoint );
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        std::size_t remaining = routing_table_type::DEFAULT_K_BUCKET_SIZE;
+        for ( auto i = table.find( targets[ current ] ), e = table.end()
+            ; i != e && remaining > 0
+            ; ++ i, -- remaining )
+            benchmark::DoNotOptimize( i->second );
+
+        current = ( current + 1 ) % targets.size();
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( routing_table_find )->Arg( 10000 )->Arg( 100000 );
+
+/**
+ *  Retrieve the DEFAULT_K_BUCKET_SIZE peers closest
+ *  to a random id, as a find peer response does.
+ */
+void
+routing_table_closest
+    ( benchmark::State & state )
+{
+    auto const ids = generate_ids( state.range( 0 ) );
+    auto const targets = generate_ids( 1024, 2 );
+    auto const endpoint = generate_endpoint();
+
+    routing_table_type table{ kd::id{} };
+    for ( auto const& i : ids )
+        table.push( i, endpoint );
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        auto const& peers = table.closest( targets[ current ]
+                                         , routing_table_type::DEFAULT_K_BUCKET_SIZE );
+        benchmark::DoNotOptimize( peers.data() );
+
+        current = ( current + 1 ) % targets.size();
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( routing_table_closest )->Arg( 10000 )->Arg( 100000 );
+
+/**
+ *  Push the known peers of a table filled with range(0) peers
+ *  from several threads, as the engines of a sharded session
+ *  do on each received message.
+ */
+void
+concurrent_routing_table_push_known_peers
+    ( benchmark::State & state )
+{
+    static std::unique_ptr< concurrent_routing_table_type > table;
+    static std::vector< kd::id > known_ids;
+
+    auto const endpoint = generate_endpoint();
+
+    // Threads wait for each other before running the loop.
+    if ( state.thread_index() == 0 )
+    {
+        table.reset( new concurrent_routing_table_type{ kd::id{} } );
+        for ( auto const& i : generate_ids( state.range( 0 ) ) )
+            table->push( i, endpoint );
+
+        // Skip the peers only saved into replacement caches.
+        known_ids.clear();
+        for ( auto const& p : table->closest( kd::id{}, table->peer_count() ) )
+            known_ids.push_back( p.first );
+    }
+
+    std::size_t current = state.thread_index();
+    for ( auto _ : state )
+    {
+        current = ( current + 1 ) % known_ids.size();
+        benchmark::DoNotOptimize( table->push( known_ids[ current ], endpoint ) );
+    }
+
+    state.counters[ "known_peers" ] = benchmark::Counter( double( known_ids.size() )
+                                                       , benchmark::Counter::kAvgThreads );
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( concurrent_routing_table_push_known_peers )
+    ->Arg( 16 )->Arg( 1000 )
+    ->Threads( 1 )->Threads( 4 )
+    ->UseRealTime();
+
+/**
+ *  Retrieve the peers closest to random ids of a table filled
+ *  with range(0) peers from several threads, as the engines
+ *  of a sharded session do on each lookup request.
+ */
+void
+concurrent_routing_table_closest
+    ( benchmark::State & state )
+{
+    static std::unique_ptr< concurrent_routing_table_type > table;
+
+    auto const targets = generate_ids( 1024, 2 + state.thread_index() );
+
+    // Threads wait for each other before running the loop.
+    if ( state.thread_index() == 0 )
+    {
+        auto const endpoint = generate_endpoint();
+        table.reset( new concurrent_routing_table_type{ kd::id{} } );
+        for ( auto const& i : generate_ids( state.range( 0 ) ) )
+            table->push( i, endpoint );
+    }
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        auto const peers = table->closest( targets[ current ] );
+        benchmark::DoNotOptimize( peers.data() );
+
+        current = ( current + 1 ) % targets.size();
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( concurrent_routing_table_closest )
+    ->Arg( 10000 )
+    ->Threads( 1 )->Threads( 4 )
+    ->UseRealTime();
+
+} // anonymous namespace
@@ -0,0 +1,134 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include "kademlia/endpoint.hpp"
+#include "kademlia/message_serializer.hpp"
+#include "kademlia/session_impl.hpp"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+
+using udp = boost::asio::ip::udp;
+
+/// Shards share this port.
+auto const SESSION_PORT = 27990;
+
+/// Distinct source ports spread requests among the shards.
+auto const CLIENTS_COUNT = 16;
+
+/// Requests in flight per client.
+auto const REQUESTS_PER_CLIENT = 16;
+
+/**
+ *  Send pings to a session served by range(0) shards of
+ *  range(1) threads and wait for their responses. Requests
+ *  are spread among the shards by the system and among the
+ *  threads of a shard by its io_service, hence the throughput
+ *  should grow with the threads count up to the cores count.
+ */
+void
+session_ping_throughput
+    ( benchmark::State & state )
+{
+    auto const port_number = SESSION_PORT + state.range( 0 ) * 8 + state.range( 1 );
+    auto const port = std::to_string( port_number );
+    kd::session_impl session{ k::endpoint{ "127.0.0.1", port }
+                            , k::endpoint{ "::1", port }
+                            , std::size_t( state.range( 0 ) )
+                            , std::size_t( state.range( 1 ) ) };
+    std::thread session_thread{ [ &session ] { session.run(); } };
+
+    boost::asio::io_service io_service;
+    udp::endpoint const destination{ boost::asio::ip::address_v4::loopback()
+                                   , std::uint16_t( port_number ) };
+
+    std::default_random_engine random_engine{ 1 };
+    std::vector< std::unique_ptr< udp::socket > > clients;
+    std::vector< kd::buffer > requests;
+    for ( auto i = 0; i != CLIENTS_COUNT; ++ i )
+    {
+        clients.emplace_back( new udp::socket{ io_service, udp::endpoint{ udp::v4(), 0 } } );
+        clients.back()->non_blocking( true );
+
+        kd::message_serializer serializer{ kd::id{ random_engine } };
+        requests.push_back( serializer.serialize( kd::header::PING_REQUEST
+                                                , kd::generate_token( random_engine ) ) );
+    }
+
+    kd::buffer response( 1500 );
+    std::size_t lost = 0;
+    for ( auto _ : state )
+    {
+        for ( auto i = 0; i != CLIENTS_COUNT; ++ i )
+            for ( auto j = 0; j != REQUESTS_PER_CLIENT; ++ j )
+                clients[ i ]->send_to( boost::asio::buffer( requests[ i ] ), destination );
+
+        // Datagrams may be dropped, give up after a while.
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 1 );
+        auto pending = CLIENTS_COUNT * REQUESTS_PER_CLIENT;
+        while ( pending && std::chrono::steady_clock::now() < deadline )
+        {
+            auto received = false;
+            for ( auto & c : clients )
+            {
+                boost::system::error_code failure;
+                c->receive( boost::asio::buffer( response ), 0, failure );
+                if ( ! failure )
+                    -- pending, received = true;
+            }
+
+            if ( ! received )
+                std::this_thread::yield();
+        }
+        lost += pending;
+    }
+
+    session.abort();
+    session_thread.join();
+
+    state.counters[ "lost" ] = double( lost );
+    state.SetItemsProcessed( state.iterations() * CLIENTS_COUNT * REQUESTS_PER_CLIENT );
+}
+BENCHMARK( session_ping_throughput )
+    ->Args( { 1, 1 } )->Args( { 2, 1 } )->Args( { 4, 1 } )
+    ->Args( { 1, 2 } )->Args( { 1, 4 } )
+    ->UseRealTime();
+
+} // anonymous namespace
+
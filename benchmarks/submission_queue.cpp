@@ -0,0 +1,148 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "kademlia/submission_queue.hpp"
+
+namespace {
+
+namespace kd = kademlia::detail;
+
+/// Operations submitted by each producer per iteration.
+auto const OPERATIONS_PER_PRODUCER = 10000;
+
+///
+using task_type = std::function< void ( void ) >;
+
+/**
+ *  Baseline queue guarded by a mutex, the consumer
+ *  swaps the pending tasks with an empty vector.
+ */
+struct locked_queue
+{
+    /**
+     *
+     */
+    bool
+    push
+        ( task_type task )
+    {
+        std::lock_guard< std::mutex > lock{ mutex_ };
+        tasks_.push_back( std::move( task ) );
+        return tasks_.size() == 1;
+    }
+
+    /**
+     *
+     */
+    template< typename Consumer >
+    bool
+    drain
+        ( Consumer && consume
+        , std::size_t /* max_count */ )
+    {
+        {
+            std::lock_guard< std::mutex > lock{ mutex_ };
+            drained_tasks_.swap( tasks_ );
+        }
+
+        for ( auto & t : drained_tasks_ )
+            consume( t );
+        drained_tasks_.clear();
+
+        return true;
+    }
+
+    ///
+    std::mutex mutex_;
+    ///
+    std::vector< task_type > tasks_;
+    ///
+    std::vector< task_type > drained_tasks_;
+};
+
+/**
+ *  Submit tasks from range(0) producer threads while
+ *  the calling thread executes them by batches.
+ */
+template< typename QueueType >
+void
+submit
+    ( benchmark::State & state )
+{
+    auto const producers_count = std::size_t( state.range( 0 ) );
+    auto const operations_count = producers_count * OPERATIONS_PER_PRODUCER;
+
+    for ( auto _ : state )
+    {
+        QueueType queue;
+        std::size_t executed = 0;
+        auto execute = [] ( task_type & task ) { task(); };
+
+        std::vector< std::thread > producers;
+        for ( std::size_t p = 0; p != producers_count; ++ p )
+            producers.emplace_back( [ &queue, &executed ]
+            {
+                for ( auto i = 0; i != OPERATIONS_PER_PRODUCER; ++ i )
+                    queue.push( [ &executed ] { ++ executed; } );
+            } );
+
+        while ( executed != operations_count )
+            queue.drain( execute, 64 );
+
+        for ( auto & p : producers )
+            p.join();
+    }
+
+    state.SetItemsProcessed( state.iterations() * operations_count );
+}
+
+/**
+ *
+ */
+void
+submit_through_locked_queue
+    ( benchmark::State & state )
+{ submit< locked_queue >( state ); }
+BENCHMARK( submit_through_locked_queue )->Arg( 1 )->Arg( 8 )->UseRealTime();
+
+/**
+ *
+ */
+void
+submit_through_submission_queue
+    ( benchmark::State & state )
+{ submit< kd::submission_queue< task_type > >( state ); }
+BENCHMARK( submit_through_submission_queue )->Arg( 1 )->Arg( 8 )->UseRealTime();
+
+} // anonymous namespace
+
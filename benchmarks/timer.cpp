@@ -0,0 +1,358 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <system_error>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <boost/asio/io_service.hpp>
+
+#include "kademlia/id.hpp"
+#include "kademlia/peer.hpp"
+#include "kademlia/timer.hpp"
+#include "kademlia/timing_wheel.hpp"
+
+namespace {
+
+namespace kd = kademlia::detail;
+
+using clock_type = kd::timing_wheel::clock;
+using time_point = kd::timing_wheel::time_point;
+
+/// The previous timer storage, kept as a reference.
+using timeouts_map = std::multimap< time_point, std::function< void ( void ) > >;
+
+std::vector< std::chrono::microseconds >
+generate_timeouts
+    ( std::size_t count )
+{
+    std::default_random_engine random_engine{ 1 };
+    // Spread timeouts as PEER_LOOKUP_TIMEOUT bounds do.
+    std::uniform_int_distribution< std::int64_t > distribution{ 20000, 2000000 };
+
+    std::vector< std::chrono::microseconds > timeouts;
+    timeouts.reserve( count );
+    for ( std::size_t i = 0; i != count; ++ i )
+        timeouts.emplace_back( distribution( random_engine ) );
+
+    return timeouts;
+}
+
+/**
+ *  Build a callback capturing what response_router's timeouts
+ *  capture for a find value request: the router, the request
+ *  id and the task error handler, itself capturing the task
+ *  and the contacted peer.
+ */
+template< typename Task >
+auto
+make_request_timeout
+    ( std::size_t & expired
+    , std::shared_ptr< Task > const& task
+    , kd::peer const& current_candidate
+    , kd::id const& response_id )
+{
+    auto on_error = [ task, current_candidate ] ( std::error_code const& )
+    { benchmark::DoNotOptimize( task.get() ); };
+
+    return [ &expired, on_error, response_id ] ( void )
+    {
+        ++ expired;
+        on_error( make_error_code( std::errc::timed_out ) );
+    };
+}
+
+/**
+ *  Schedule range(0) timeouts then expire them all.
+ */
+void
+timing_wheel_schedule_and_expire
+    ( benchmark::State & state )
+{
+    auto const timeouts = generate_timeouts( state.range( 0 ) );
+    auto const origin = clock_type::now();
+    std::size_t expired = 0;
+
+    for ( auto _ : state )
+    {
+        kd::timing_wheel wheel{ origin };
+        for ( auto const& t : timeouts )
+            wheel.schedule( origin + t, [ &expired ] { ++ expired; } );
+
+        while ( ! wheel.empty() )
+            wheel.expire( wheel.get_next_expiration_time() );
+    }
+
+    benchmark::DoNotOptimize( expired );
+    state.SetItemsProcessed( state.iterations() * timeouts.size() );
+}
+BENCHMARK( timing_wheel_schedule_and_expire )->Arg( 100000 );
+
+/**
+ *  Same as timing_wheel_schedule_and_expire with a multimap.
+ */
+void
+timeouts_map_schedule_and_expire
+    ( benchmark::State & state )
+{
+    auto const timeouts = generate_timeouts( state.range( 0 ) );
+    auto const origin = clock_type::now();
+    std::size_t expired = 0;
+
+    for ( auto _ : state )
+    {
+        timeouts_map map;
+        for ( auto const& t : timeouts )
+            map.emplace( origin + t, [ &expired ] { ++ expired; } );
+
+        while ( ! map.empty() )
+        {
+            auto const end = map.upper_bound( map.begin()->first );
+            for ( auto i = map.begin(); i != end; ++ i )
+                i->second();
+            map.erase( map.begin(), end );
+        }
+    }
+
+    benchmark::DoNotOptimize( expired );
+    state.SetItemsProcessed( state.iterations() * timeouts.size() );
+}
+BENCHMARK( timeouts_map_schedule_and_expire )->Arg( 100000 );
+
+/**
+ *  Schedule a timeout and expire the due ones while
+ *  range(0) timeouts are outstanding, i.e. what the
+ *  response_router does on each request.
+ */
+void
+timing_wheel_steady_state
+    ( benchmark::State & state )
+{
+    auto const timeouts = generate_timeouts( state.range( 0 ) );
+    auto now = clock_type::now();
+    kd::timing_wheel wheel{ now };
+    std::size_t expired = 0;
+
+    // Timeouts last 1s on average, hence one expires
+    // every 1s / range(0) once the wheel is full.
+    auto const step = std::chrono::microseconds{ std::chrono::seconds{ 1 } } / timeouts.size();
+    for ( auto const& t : timeouts )
+    {
+        wheel.schedule( now + t, [ &expired ] { ++ expired; } );
+        now += step;
+        wheel.expire( now );
+    }
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        wheel.schedule( now + timeouts[ current ], [ &expired ] { ++ expired; } );
+        now += step;
+        wheel.expire( now );
+        current = ( current + 1 ) % timeouts.size();
+    }
+
+    benchmark::DoNotOptimize( expired );
+    state.counters[ "outstanding" ] = double( wheel.size() );
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( timing_wheel_steady_state )->Arg( 100000 );
+
+/**
+ *  Same as timing_wheel_steady_state with a multimap.
+ */
+void
+timeouts_map_steady_state
+    ( benchmark::State & state )
+{
+    auto const timeouts = generate_timeouts( state.range( 0 ) );
+    auto now = clock_type::now();
+    timeouts_map map;
+    std::size_t expired = 0;
+
+    auto const expire = [ &map ] ( time_point const& t )
+    {
+        while ( ! map.empty() && map.begin()->first <= t )
+        {
+            map.begin()->second();
+            map.erase( map.begin() );
+        }
+    };
+
+    auto const step = std::chrono::microseconds{ std::chrono::seconds{ 1 } } / timeouts.size();
+    for ( auto const& t : timeouts )
+    {
+        map.emplace( now + t, [ &expired ] { ++ expired; } );
+        now += step;
+        expire( now );
+    }
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        map.emplace( now + timeouts[ current ], [ &expired ] { ++ expired; } );
+        now += step;
+        expire( now );
+        current = ( current + 1 ) % timeouts.size();
+    }
+
+    benchmark::DoNotOptimize( expired );
+    state.counters[ "outstanding" ] = double( map.size() );
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( timeouts_map_steady_state )->Arg( 100000 );
+
+/**
+ *  Schedule a timeout and cancel it while range(0)
+ *  timeouts are outstanding, i.e. what the response_router
+ *  does on each answered request.
+ */
+void
+timing_wheel_schedule_and_cancel
+    ( benchmark::State & state )
+{
+    auto const timeouts = generate_timeouts( state.range( 0 ) );
+    auto const now = clock_type::now();
+    kd::timing_wheel wheel{ now };
+    std::size_t expired = 0;
+
+    for ( auto const& t : timeouts )
+        wheel.schedule( now + t, [ &expired ] { ++ expired; } );
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        auto const h = wheel.schedule( now + timeouts[ current ]
+                                     , [ &expired ] { ++ expired; } );
+        benchmark::DoNotOptimize( wheel.cancel( h ) );
+        current = ( current + 1 ) % timeouts.size();
+    }
+
+    benchmark::DoNotOptimize( expired );
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( timing_wheel_schedule_and_cancel )->Arg( 100000 );
+
+/**
+ *  Same as timing_wheel_schedule_and_cancel with
+ *  callbacks as large as response_router's ones.
+ */
+void
+timing_wheel_schedule_and_cancel_request_timeout
+    ( benchmark::State & state )
+{
+    auto const timeouts = generate_timeouts( state.range( 0 ) );
+    auto const now = clock_type::now();
+    kd::timing_wheel wheel{ now };
+    std::size_t expired = 0;
+
+    auto const task = std::make_shared< int >( 0 );
+    kd::peer const candidate{ kd::id{ "a" }
+                            , kd::to_ip_endpoint( "192.168.1.1", 5555 ) };
+    auto const on_timeout = make_request_timeout( expired, task
+                                                , candidate, kd::id{ "b" } );
+
+    for ( auto const& t : timeouts )
+        wheel.schedule( now + t, on_timeout );
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        auto const h = wheel.schedule( now + timeouts[ current ], on_timeout );
+        benchmark::DoNotOptimize( wheel.cancel( h ) );
+        current = ( current + 1 ) % timeouts.size();
+    }
+
+    benchmark::DoNotOptimize( expired );
+    state.counters[ "callback_size" ] = double( sizeof( on_timeout ) );
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( timing_wheel_schedule_and_cancel_request_timeout )->Arg( 100000 );
+
+/**
+ *  Store the callbacks of timing_wheel_schedule_and_cancel_request_timeout
+ *  in std::function, as the timing_wheel used to.
+ */
+void
+function_request_timeout
+    ( benchmark::State & state )
+{
+    std::size_t expired = 0;
+
+    auto const task = std::make_shared< int >( 0 );
+    kd::peer const candidate{ kd::id{ "a" }
+                            , kd::to_ip_endpoint( "192.168.1.1", 5555 ) };
+    auto const on_timeout = make_request_timeout( expired, task
+                                                , candidate, kd::id{ "b" } );
+
+    for ( auto _ : state )
+    {
+        std::function< void ( void ) > f{ on_timeout };
+        benchmark::DoNotOptimize( f );
+    }
+
+    benchmark::DoNotOptimize( expired );
+    state.counters[ "callback_size" ] = double( sizeof( on_timeout ) );
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( function_request_timeout );
+
+/**
+ *  Same as timing_wheel_schedule_and_cancel through
+ *  timer::expires_from_now(), which also reschedules
+ *  its asio timer when the new timeout is the sooner.
+ */
+void
+timer_expires_from_now_and_cancel
+    ( benchmark::State & state )
+{
+    auto const timeouts = generate_timeouts( state.range( 0 ) );
+    boost::asio::io_service io_service;
+    kd::timer timer{ io_service };
+    std::size_t expired = 0;
+
+    for ( auto const& t : timeouts )
+        timer.expires_from_now( t, [ &expired ] { ++ expired; } );
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        auto const h = timer.expires_from_now( timeouts[ current ]
+                                             , [ &expired ] { ++ expired; } );
+        benchmark::DoNotOptimize( timer.cancel( h ) );
+        current = ( current + 1 ) % timeouts.size();
+    }
+
+    benchmark::DoNotOptimize( expired );
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK( timer_expires_from_now_and_cancel )->Arg( 100000 );
+
+} // anonymous namespace
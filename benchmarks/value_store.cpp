@@ -0,0 +1,332 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+
+#ifdef __GLIBC__
+#   include <malloc.h>
+#endif
+
+#include "kademlia/buffer.hpp"
+#include "kademlia/id.hpp"
+#include "kademlia/persistent_value_store.hpp"
+#include "kademlia/value_store.hpp"
+
+namespace {
+
+namespace kd = kademlia::detail;
+namespace filesystem = boost::filesystem;
+
+/**
+ *  The previous layout of bounded_value_store, a vector and
+ *  two list nodes per value, kept as a reference (the budget
+ *  being never reached, nothing is evicted).
+ */
+class vector_store final
+{
+public:
+    /**
+     *
+     */
+    void
+    assign
+        ( kd::id const& key
+        , kd::buffer value )
+    {
+        auto const found = entries_.find( key );
+        if ( found != entries_.end() )
+        {
+            uses_.erase( found->second.use_ );
+            expirations_.erase( found->second.expiration_ );
+            entries_.erase( found );
+        }
+
+        auto const i = entries_.emplace( key, entry{ std::move( value )
+                                                   , kd::clock::now() + kd::VALUE_TTL
+                                                   , uses_.end()
+                                                   , expirations_.end() } ).first;
+        i->second.use_ = uses_.insert( uses_.end(), &i->first );
+        i->second.expiration_ = expirations_.insert( expirations_.end(), &i->first );
+    }
+
+private:
+    ///
+    using key_list = std::list< kd::id const* >;
+
+    ///
+    struct entry final
+    {
+        kd::buffer value_;
+        kd::clock::time_point expiration_time_;
+        key_list::iterator use_;
+        key_list::iterator expiration_;
+    };
+
+private:
+    ///
+    std::unordered_map
+            < kd::id
+            , entry
+            , kd::value_store_key_hasher< kd::id > > entries_;
+    ///
+    key_list uses_;
+    ///
+    key_list expirations_;
+};
+
+using bounded_store = kd::bounded_value_store< kd::id, kd::buffer >;
+
+/// Values as small as most stored values.
+auto const MIN_VALUE_SIZE = 16, MAX_VALUE_SIZE = 512;
+
+/**
+ *  The requests of a store burst, the value of
+ *  each one being allocated as when deserialized.
+ */
+struct store_requests final
+{
+    /**
+     *
+     */
+    explicit
+    store_requests
+        ( std::size_t count )
+            : random_engine_( 1 )
+            , keys_()
+            , sizes_()
+            , bytes_count_( 0 )
+    {
+        std::uniform_int_distribution< std::size_t > size{ MIN_VALUE_SIZE, MAX_VALUE_SIZE };
+        for ( std::size_t i = 0; i != count; ++ i )
+        {
+            keys_.push_back( kd::generate_token( random_engine_ ) );
+            sizes_.push_back( size( random_engine_ ) );
+            bytes_count_ += sizes_.back();
+        }
+    }
+
+    /**
+     *
+     */
+    kd::buffer
+    make_value
+        ( std::size_t i )
+        const
+    { return kd::buffer( sizes_[ i ], std::uint8_t( i ) ); }
+
+    ///
+    std::default_random_engine random_engine_;
+    ///
+    std::vector< kd::id > keys_;
+    ///
+    std::vector< std::size_t > sizes_;
+    ///
+    std::size_t bytes_count_;
+};
+
+/**
+ *
+ */
+template< typename Store >
+std::unique_ptr< Store >
+make_store
+    ( void );
+
+/**
+ *
+ */
+template<>
+std::unique_ptr< vector_store >
+make_store< vector_store >
+    ( void )
+{ return std::unique_ptr< vector_store >{ new vector_store{} }; }
+
+/**
+ *  The budget is never reached, as with the previous storage.
+ */
+template<>
+std::unique_ptr< bounded_store >
+make_store< bounded_store >
+    ( void )
+{
+    auto const bytes_budget = std::numeric_limits< std::size_t >::max();
+    return std::unique_ptr< bounded_store >{ new bounded_store{ bytes_budget } };
+}
+
+/**
+ *
+ */
+void
+assign
+    ( vector_store & store
+    , kd::id const& key
+    , kd::buffer value )
+{ store.assign( key, std::move( value ) ); }
+
+/**
+ *
+ */
+void
+assign
+    ( bounded_store & store
+    , kd::id const& key
+    , kd::buffer value )
+{ store.assign( key, std::move( value ) ); }
+
+/**
+ *
+ */
+std::size_t
+get_heap_bytes_count
+    ( void )
+{
+#ifdef __GLIBC__
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+/**
+ *  Report the heap bytes used per stored value byte
+ *  once the store holds the values of requests.
+ */
+template< typename Store >
+void
+count_heap_bytes
+    ( benchmark::State & state
+    , store_requests const& requests )
+{
+    auto const heap_bytes_count = get_heap_bytes_count();
+    {
+        auto store = make_store< Store >();
+        for ( std::size_t i = 0; i != requests.keys_.size(); ++ i )
+            assign( *store, requests.keys_[ i ], requests.make_value( i ) );
+
+        state.counters[ "heap_bytes_per_value_byte" ]
+                = double( get_heap_bytes_count() - heap_bytes_count )
+                / requests.bytes_count_;
+    }
+}
+
+/**
+ *  Store range(0) values of 16 to 512 bytes into an empty store.
+ */
+template< typename Store >
+void
+store_burst
+    ( benchmark::State & state )
+{
+    store_requests const requests{ std::size_t( state.range( 0 ) ) };
+    count_heap_bytes< Store >( state, requests );
+
+    for ( auto _ : state )
+    {
+        auto store = make_store< Store >();
+        for ( std::size_t i = 0; i != requests.keys_.size(); ++ i )
+            assign( *store, requests.keys_[ i ], requests.make_value( i ) );
+
+        benchmark::DoNotOptimize( store.get() );
+    }
+
+    state.SetItemsProcessed( state.iterations() * requests.keys_.size() );
+}
+BENCHMARK_TEMPLATE( store_burst, vector_store )->Arg( 100000 );
+BENCHMARK_TEMPLATE( store_burst, bounded_store )->Arg( 100000 );
+
+/**
+ *  Replace values of a store holding range(0)
+ *  values by values of another size.
+ */
+template< typename Store >
+void
+store_overwrite
+    ( benchmark::State & state )
+{
+    store_requests const requests{ std::size_t( state.range( 0 ) ) };
+
+    auto store = make_store< Store >();
+    for ( std::size_t i = 0; i != requests.keys_.size(); ++ i )
+        assign( *store, requests.keys_[ i ], requests.make_value( i ) );
+
+    std::size_t current = 0;
+    for ( auto _ : state )
+    {
+        auto const next = ( current + 1 ) % requests.keys_.size();
+        assign( *store, requests.keys_[ current ], requests.make_value( next ) );
+        current = next;
+    }
+
+    state.SetItemsProcessed( state.iterations() );
+}
+BENCHMARK_TEMPLATE( store_overwrite, vector_store )->Arg( 100000 );
+BENCHMARK_TEMPLATE( store_overwrite, bounded_store )->Arg( 100000 );
+
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+
+/**
+ *  Open a directory holding range(0) values of 100 bytes,
+ *  i.e. rebuild the index of a restarted node.
+ */
+void
+persistent_store_open
+    ( benchmark::State & state )
+{
+    auto const directory = filesystem::temp_directory_path()
+            / filesystem::unique_path( "kademlia-%%%%-%%%%-%%%%" );
+    auto const bytes_budget = std::numeric_limits< std::size_t >::max();
+    auto const count = std::size_t( state.range( 0 ) );
+    {
+        kd::persistent_value_store store{ directory.string(), bytes_budget };
+
+        std::default_random_engine random_engine{ 1 };
+        kd::buffer const value( 100 );
+        for ( std::size_t i = 0; i != count; ++ i )
+            store.assign( kd::generate_token( random_engine ), value );
+    }
+
+    for ( auto _ : state )
+    {
+        kd::persistent_value_store store{ directory.string(), bytes_budget };
+        benchmark::DoNotOptimize( store.size() );
+    }
+
+    filesystem::remove_all( directory );
+    state.SetItemsProcessed( state.iterations() * count );
+}
+BENCHMARK( persistent_store_open )->Arg( 1000000 )->Unit( benchmark::kMillisecond );
+
+#endif
+
+} // anonymous namespace
+
@@ -105,6 +105,16 @@ public:
     abort
         ( void );
 
+    /**
+     *  @brief Count the values stored on behalf of the network.
+     *  @note This method is thread safe.
+     */
+    KADEMLIA_SYMBOL_VISIBILITY
+    storage_statistics
+    get_storage_statistics
+        ( void )
+        const;
+
 private:
     /// Hidden implementation.
     struct impl;
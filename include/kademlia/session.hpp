@@ -132,6 +132,41 @@ public:
     abort
         ( void );
 
+    /**
+     *  @brief Prefer low latency peers among nearly as close
+     *         peers when looking for the peers of a key.
+     *  @details Disabled by default, peers are then contacted
+     *           by increasing distance to the key only.
+     *  @note This method is thread safe.
+     */
+    KADEMLIA_SYMBOL_VISIBILITY
+    void
+    set_latency_aware_peer_selection
+        ( bool enabled );
+
+    /**
+     *  @brief Count the values stored on behalf of the network.
+     *  @note This method is thread safe.
+     */
+    KADEMLIA_SYMBOL_VISIBILITY
+    storage_statistics
+    get_storage_statistics
+        ( void )
+        const;
+
+    /**
+     *  @brief Get the distribution of the timeouts of the
+     *         requests sent to peers.
+     *  @details Timeouts are computed from the round trip
+     *           times of each peer.
+     *  @note This method is thread safe.
+     */
+    KADEMLIA_SYMBOL_VISIBILITY
+    timeout_statistics
+    get_timeout_statistics
+        ( void )
+        const;
+
 private:
     /// Hidden implementation.
     struct impl;
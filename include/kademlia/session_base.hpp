@@ -30,6 +30,9 @@
 #   pragma once
 #endif
 
+#include <array>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <system_error>
@@ -63,6 +66,38 @@ public:
                 , data_type const& data )
             >;
 
+    /// Counters of the values stored on behalf of the network.
+    struct storage_statistics final
+    {
+        /// Values currently stored.
+        std::size_t values_count_;
+        /// Bytes of the stored values and their keys.
+        std::size_t bytes_count_;
+        /// Values evicted to stay within the bytes budget.
+        std::size_t evictions_count_;
+        /// Values removed once expired.
+        std::size_t expirations_count_;
+    };
+
+    /// Distribution of the timeouts of the requests sent to peers.
+    struct timeout_statistics final
+    {
+        ///
+        enum { BUCKETS_COUNT = 16 };
+
+        /// Requests sent, the timeouts below are zero until then.
+        std::uint64_t requests_count_;
+        ///
+        std::chrono::milliseconds min_timeout_;
+        ///
+        std::chrono::milliseconds max_timeout_;
+        ///
+        std::chrono::milliseconds mean_timeout_;
+        /// Element 0 counts the timeouts under 1 ms, element i those
+        /// in [2^(i-1), 2^i) ms and the last one all longer timeouts.
+        std::array< std::uint64_t, BUCKETS_COUNT > timeouts_counts_;
+    };
+
     /// This kademlia implementation default port.
     static CXX11_CONSTEXPR std::uint16_t DEFAULT_PORT = 27980;
 
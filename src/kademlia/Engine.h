@@ -41,6 +41,7 @@
 #include <functional>
 #include "Poco/Net/SocketReactor.h"
 #include "kademlia/endpoint.hpp"
+#include "kademlia/session_base.hpp"
 #include "kademlia/error_impl.hpp"
 #include "kademlia/log.hpp"
 #include "IPEndpoint.h"
@@ -70,7 +71,7 @@ public:
 	using data_type = std::vector<std::uint8_t>;
 	using endpoint_type = IPEndpoint;
 	using routing_table_type = routing_table<endpoint_type>;
-	using value_store_type = value_store<id, data_type>;
+	using value_store_type = bounded_value_store<id, data_type>;
 
 public:
 	Engine(Poco::Net::SocketReactor& io_service, endpoint const& ipv4, endpoint const& ipv6, id const& new_id = id{}):
@@ -85,6 +86,7 @@ public:
 			routing_table_(my_id_),
 			value_store_(),
 			is_connected_(),
+			is_latency_aware_(),
 			pending_tasks_()
 	{
 		//kademlia::detail::enable_log_for("Engine");
@@ -122,7 +124,8 @@ public:
 		else
 		{
 			LOG_DEBUG(Engine, this) << "executing async save of key '" << to_string(key) << "'." << std::endl;
-			start_store_value_task(id(key), data, tracker_, routing_table_, std::forward<HandlerType>(handler));
+			start_store_value_task(id(key), data, tracker_, routing_table_,
+				std::forward<HandlerType>(handler), is_latency_aware_);
 		}
 	}
 
@@ -144,10 +147,23 @@ public:
 		else
 		{
 			LOG_DEBUG(Engine, this) << "executing async load of key '" << to_string(key) << "'." << std::endl;
-			start_find_value_task<data_type>(id(key), tracker_, routing_table_, std::forward<HandlerType>(handler));
+			start_find_value_task<data_type>(id(key), tracker_, routing_table_,
+				std::forward<HandlerType>(handler), is_latency_aware_);
 		}
 	}
 
+	// Thread safe.
+	session_base::timeout_statistics get_timeout_statistics() const
+	{ return tracker_.get_timeout_statistics().get_statistics(); }
+
+	// Prefer low latency peers among nearly as close candidates of the next lookups.
+	void set_latency_aware_peer_selection(bool enabled)
+	{ is_latency_aware_ = enabled; }
+
+	// Thread safe.
+	session_base::storage_statistics get_storage_statistics() const
+	{ return value_store_.get_statistics(); }
+
 private:
 	using pending_task_type = std::function<void ()>;
 	using MessageSocketType = MessageSocket<UnderlyingSocketType>;
@@ -196,7 +212,7 @@ private:
 					<< failure.message() << ")." << std::endl;
 			return;
 		}
-		value_store_[request.data_key_hash_] = std::move(request.data_value_);
+		value_store_.assign(request.data_key_hash_, std::move(request.data_value_));
 	}
 
 	void handle_find_peer_request(IPEndpoint const& sender, Header const& h,
@@ -219,13 +235,12 @@ private:
 	{
 		// Find X closest peers and save
 		// their location into the response..
-		FindPeerResponseBody response;
+		auto const& closest_peers = routing_table_.closest(peer_to_find_id, ROUTING_TABLE_BUCKET_SIZE);
 
-		auto remaining_peer = ROUTING_TABLE_BUCKET_SIZE;
-		auto i = routing_table_.find(peer_to_find_id);
-		auto e = routing_table_.end();
-		for (;i != e && remaining_peer > 0; ++i, -- remaining_peer)
-			response.peers_.push_back({i->first, i->second});
+		FindPeerResponseBody response;
+		response.peers_.reserve(closest_peers.size());
+		for (auto const& p : closest_peers)
+			response.peers_.push_back({p.first, p.second});
 
 		// Now send the response.
 		tracker_.send_response(random_token, response, sender);
@@ -244,14 +259,11 @@ private:
 			return;
 		}
 
-		auto found = value_store_.find(request.value_to_find_);
-		if (found == value_store_.end())
+		FindValueResponseBody response;
+		if (! value_store_.find(request.value_to_find_, response.data_))
 			send_find_peer_response(sender, h.random_token_, request.value_to_find_);
 		else
-		{
-			FindValueResponseBody const response{ found->second };
 			tracker_.send_response(h.random_token_, response, sender);
-		}
 	}
 
 	void discover_neighbors(endpoint const& initial_peer)
@@ -272,10 +284,11 @@ private:
 
 	id get_closest_neighbor_id()
 	{
-		// Find our closest neighbor.
-		auto closest_neighbor = routing_table_.find(my_id_);
-		if (closest_neighbor->first == my_id_) ++ closest_neighbor;
-		assert(closest_neighbor != routing_table_.end() && "at least one peer is known");
+		// Find our closest neighbor, we may know ourself.
+		auto const& neighbors = routing_table_.closest(my_id_, 2);
+		auto closest_neighbor = neighbors.begin();
+		if (closest_neighbor != neighbors.end() && closest_neighbor->first == my_id_) ++ closest_neighbor;
+		assert(closest_neighbor != neighbors.end() && "at least one peer is known");
 		return closest_neighbor->first;
 	}
 
@@ -283,10 +296,10 @@ private:
 		/// Refresh each bucket.
 	{
 		auto closest_neighbor_id = get_closest_neighbor_id();
-		auto i = id::BIT_SIZE - 1;
 
-		// Skip empty buckets.
-		while (i && closest_neighbor_id[i] == my_id_[i]) --i;
+		// Skip empty buckets, i.e. start from the
+		// bucket of our closest neighbor.
+		auto i = std::min(common_prefix_length(closest_neighbor_id, my_id_), id::BIT_SIZE - 1);
 
 		// Send refresh from closest neighbor bucket to farest bucket.
 		auto refresh_id = my_id_;
@@ -344,6 +357,7 @@ private:
 	routing_table_type routing_table_;
 	value_store_type value_store_;
 	bool is_connected_;
+	bool is_latency_aware_;
 	std::queue<pending_task_type> pending_tasks_;
 };
 
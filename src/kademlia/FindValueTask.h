@@ -31,6 +31,7 @@
 #endif
 
 #include <system_error>
+#include <chrono>
 #include <memory>
 #include <type_traits>
 
@@ -82,28 +83,29 @@ namespace detail {
  *  }
  *  @enddot
  */
-template<typename LoadHandlerType, typename TrackerType, typename DataType>
+template<typename LoadHandlerType, typename TrackerType, typename DataType, typename RoutingTableType>
 class FindValueTask final : public LookupTask
 {
 public:
-	template<typename RoutingTableType>
-	static void start(detail::id const & key, TrackerType & tracker, RoutingTableType & routing_table, LoadHandlerType handler)
+	// If is_latency_aware, low latency peers are preferred among nearly as close candidates.
+	static void start(detail::id const & key, TrackerType & tracker, RoutingTableType & routing_table,
+		LoadHandlerType handler, bool is_latency_aware)
 	{
 		std::shared_ptr<FindValueTask> t;
-		t.reset(new FindValueTask(key, tracker, routing_table, std::move(handler)));
+		t.reset(new FindValueTask(key, tracker, routing_table, std::move(handler), is_latency_aware));
 		try_candidates(t);
 	}
 
 private:
-	template<typename RoutingTableType>
 	FindValueTask(id const & searched_key, TrackerType & tracker,
-		RoutingTableType & routing_table, LoadHandlerType load_handler):
+		RoutingTableType & routing_table, LoadHandlerType load_handler, bool is_latency_aware):
 			LookupTask(searched_key,
-				routing_table.find(searched_key),
-				routing_table.end()),
+				routing_table.closest(searched_key, ROUTING_TABLE_BUCKET_SIZE)),
 			tracker_(tracker),
+			routing_table_(routing_table),
 			load_handler_(std::move(load_handler)),
-			is_finished_()
+			is_finished_(),
+			is_latency_aware_(is_latency_aware)
 	{
 		LOG_DEBUG(FindValueTask, this) << "create find value task for '"
 			<< searched_key << "' value." << std::endl;
@@ -131,8 +133,9 @@ private:
 	static void try_candidates(std::shared_ptr<FindValueTask> task,
 		std::size_t concurrent_requests_count = CONCURRENT_FIND_PEER_REQUESTS_COUNT)
 	{
-		auto const closest_candidates = task->select_new_closest_candidates
-				(concurrent_requests_count);
+		auto const closest_candidates = task->is_latency_aware_
+				? task->select_new_closest_candidates(concurrent_requests_count, task->routing_table_)
+				: task->select_new_closest_candidates(concurrent_requests_count);
 
 		FindValueRequestBody const request{ task->get_key() };
 		for (auto const& c : closest_candidates)
@@ -149,10 +152,15 @@ private:
 				<< "' value request to '"
 				<< current_candidate << "'." << std::endl;
 
+		auto const sent_at = std::chrono::steady_clock::now();
+
 		// On message received, process it.
-		auto on_message_received = [ task, current_candidate ] (IPEndpoint const& s,
+		auto on_message_received = [ task, current_candidate, sent_at ] (IPEndpoint const& s,
 			Header const& h, buffer::const_iterator i, buffer::const_iterator e)
 		{
+			task->routing_table_.record_round_trip_time(current_candidate.id_
+				, std::chrono::steady_clock::now() - sent_at);
+
 			if (task->is_caller_notified())
 				return;
 
@@ -165,13 +173,13 @@ private:
 		{
 			if (task->is_caller_notified()) return;
 
-			// XXX: Current current_candidate must be flagged as stale.
 			task->flag_candidate_as_invalid(current_candidate.id_);
+			task->routing_table_.flag_peer_as_unresponsive(current_candidate.id_);
 			try_candidates(task);
 		};
 
 		task->tracker_.send_request(request, current_candidate.endpoint_,
-			PEER_LOOKUP_TIMEOUT, on_message_received, on_error);
+			task->routing_table_.get_request_timeout(current_candidate.id_), on_message_received, on_error);
 	}
 
 	/**
@@ -248,8 +256,10 @@ private:
 
 private:
 	TrackerType & tracker_;
+	RoutingTableType & routing_table_;
 	LoadHandlerType load_handler_;
 	bool is_finished_;
+	bool is_latency_aware_;
 };
 
 /**
@@ -257,12 +267,12 @@ private:
  */
 template<typename DataType, typename TrackerType, typename RoutingTableType, typename HandlerType>
 void start_find_value_task(id const& key, TrackerType & tracker
-	, RoutingTableType & routing_table, HandlerType && handler)
+	, RoutingTableType & routing_table, HandlerType && handler, bool is_latency_aware = false)
 {
 	using handler_type = typename std::decay<HandlerType>::type;
-	using task = FindValueTask<handler_type, TrackerType, DataType>;
+	using task = FindValueTask<handler_type, TrackerType, DataType, RoutingTableType>;
 
-	task::start(key, tracker, routing_table, std::forward<HandlerType>(handler));
+	task::start(key, tracker, routing_table, std::forward<HandlerType>(handler), is_latency_aware);
 }
 
 } // namespace detail
@@ -30,6 +30,7 @@
 #   pragma once
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <map>
 #include <vector>
@@ -50,6 +51,63 @@ public:
 
 	std::vector<Peer> select_new_closest_candidates(std::size_t max_count);
 
+	/**
+	 *  Select new candidates, preferring low latency peers among
+	 *  nearly as close ones, i.e. whose distance to the key has
+	 *  the same highest bit. Peers without a known round trip
+	 *  time come last.
+	 *  @param round_trip_times Provides a get_round_trip_time(id)
+	 *         method returning zero for unknown peers.
+	 */
+	template<typename RoundTripTimes>
+	std::vector<Peer> select_new_closest_candidates(std::size_t max_count
+		, RoundTripTimes const& round_trip_times)
+	{
+		using round_trip_time = decltype(round_trip_times.get_round_trip_time(key_));
+		using near_candidate = std::pair<round_trip_time, candidate *>;
+
+		auto const get_log_distance = [](id const& d)
+		{ return common_prefix_length(d, id{}); };
+
+		std::vector<Peer> candidates;
+		std::vector<near_candidate> near_candidates;
+
+		for (auto i = candidates_.begin(), e = candidates_.end()
+			; i != e && in_flight_requests_count_ < max_count
+			; )
+		{
+			// Gather not-contacted candidates as close as the current one.
+			auto const log_distance = get_log_distance(i->first);
+			near_candidates.clear();
+			for (; i != e && get_log_distance(i->first) == log_distance; ++ i)
+			{
+				if (i->second.state_ != candidate::STATE_UNKNOWN)
+					continue;
+
+				auto t = round_trip_times.get_round_trip_time(i->second.peer_.id_);
+				if (t == round_trip_time::zero())
+					t = round_trip_time::max();
+				near_candidates.emplace_back(t, &i->second);
+			}
+
+			// Keep the distance order among peers with the same round trip time.
+			std::stable_sort(near_candidates.begin(), near_candidates.end()
+				, [](near_candidate const& a, near_candidate const& b)
+				{ return a.first < b.first; });
+
+			for (auto j = near_candidates.begin(), f = near_candidates.end()
+				; j != f && in_flight_requests_count_ < max_count
+				; ++ j)
+			{
+				j->second->state_ = candidate::STATE_CONTACTED;
+				++ in_flight_requests_count_;
+				candidates.push_back(j->second->peer_);
+			}
+		}
+
+		return candidates;
+	}
+
 	std::vector<Peer> select_closest_valid_candidates(std::size_t max_count);
 
 	template<typename Peers>
@@ -76,6 +134,11 @@ protected:
 			add_candidate(Peer{ i->first, i->second });
 	}
 
+	template<typename Peers>
+	LookupTask(id const & key, Peers const& initialPeers)
+		: LookupTask(key, initialPeers.begin(), initialPeers.end())
+	{ }
+
 private:
 	struct candidate final
 	{
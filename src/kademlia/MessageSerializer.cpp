@@ -40,14 +40,18 @@ Header MessageSerializer::generate_header(Header::type const& type, id const& to
 
 buffer MessageSerializer::serialize(Header::type const& type, id const& token)
 {
-	auto const header = generate_header(type, token);
-
 	buffer b;
-	detail::serialize(header, b);
+	serialize(type, token, b);
 
 	return b;
 }
 
+void MessageSerializer::serialize(Header::type const& type, id const& token, buffer& b)
+{
+	auto const header = generate_header(type, token);
+	detail::serialize(header, b);
+}
+
 
 } // namespace detail
 } // namespace kademlia
@@ -45,18 +45,28 @@ public:
 
 	template< typename M >
 	buffer serialize(M const& message, id const& token)
+	{
+		buffer b;
+		serialize(message, token, b);
+		return b;
+	}
+
+	// Append the serialized message to b.
+	template< typename M >
+	void serialize(M const& message, id const& token, buffer& b)
 	{
 		auto const type = message_traits< M >::TYPE_ID;
 		auto const header = generate_header(type, token);
 
-		buffer b;
 		detail::serialize(header, b);
 		detail::serialize(message, b);
-		return b;
 	}
 
 	buffer serialize(Header::type const& type, id const& token);
 
+	// Append the serialized header to b.
+	void serialize(Header::type const& type, id const& token, buffer& b);
+
 private:
 	Header generate_header(Header::type const& type, id const& token);
 
@@ -31,7 +31,6 @@
 #endif
 
 #include <vector>
-#include <deque>
 #include <algorithm>
 #include <memory>
 #include <mutex>
@@ -46,6 +45,7 @@
 #include "kademlia/error_impl.hpp"
 #include <kademlia/detail/cxx11_macros.hpp>
 #include "kademlia/buffer.hpp"
+#include "kademlia/buffer_pool.hpp"
 #include "Message.h"
 #include "kademlia/boost_to_std_error.hpp"
 #include <boost/asio/buffer.hpp>
@@ -68,7 +68,6 @@ public:
 	using resolved_endpoints = std::vector<endpoint_type>;
 	using underlying_socket_type = SocketType;
 	using underlying_endpoint_type = Poco::Net::SocketAddress;
-	using SendPacket = std::pair<Poco::Net::SocketAddress, buffer>;
  
 	template<typename EndpointType>
 	static resolved_endpoints resolve_endpoint(Poco::Net::SocketReactor& io_service, EndpointType const& e)
@@ -134,7 +133,6 @@ public:
 	MessageSocket(MessageSocket&& o): reception_buffer_(std::move(o.reception_buffer_)),
 		current_message_sender_(std::move(o.current_message_sender_)),
 		_socket(&o._ioService, Poco::Net::SocketAddress(), true, true),
-		_messageQueue(std::move(o._messageQueue)),
 		_ioService(o._ioService),
 		_pMutex(std::move(o._pMutex))
 	{
@@ -176,27 +174,30 @@ public:
 	}
 
 	template<typename SendCallback>
-	void async_send(buffer const& message, endpoint_type const& to, SendCallback const& callback)
+	void async_send(pooled_buffer message, endpoint_type const& to, SendCallback const& callback)
 	{
-		if (message.size() > INPUT_BUFFER_SIZE)
+		if (message->size() > INPUT_BUFFER_SIZE)
 			callback(make_error_code(std::errc::value_too_large));
 		else
 		{
-			// TODO: make buffer rvalue so it can be moved
-			std::unique_lock<std::mutex> l(*_pMutex);
-			_messageQueue.push_back(std::make_pair(Poco::Net::SocketAddress(to.address_, to.port_), message));
-
-			// Copy the buffer as it has to live past the end of this call.
-			auto message_copy = std::make_shared<buffer>(message);
-			auto on_completion = [ this, callback, message_copy ]
+			auto const data = boost::asio::buffer(*message);
+			// The lambda keeps the message alive until it has been sent.
+			auto on_completion = [ callback, message ]
 				(boost::system::error_code const& failure, std::size_t /* bytes_sent */)
 			{
 				callback(boost_to_std_error(failure));
 			};
-			_socket.asyncSendTo(boost::asio::buffer(*message_copy), convert_endpoint(to), std::move(on_completion));
+			_socket.asyncSendTo(data, convert_endpoint(to), std::move(on_completion));
 		}
 	}
 
+	/// The message is copied, prefer the pooled_buffer overload.
+	template<typename SendCallback>
+	void async_send(buffer const& message, endpoint_type const& to, SendCallback const& callback)
+	{
+		async_send(pooled_buffer{ message }, to, callback);
+	}
+
 	endpoint_type local_endpoint() const
 	{
 		return { _socket.address().host(), _socket.address().port() };
@@ -235,7 +236,6 @@ private:
 	buffer reception_buffer_;
 	Poco::Net::SocketAddress current_message_sender_;
 	underlying_socket_type _socket;
-	std::deque<SendPacket> _messageQueue;
 	Poco::Net::SocketReactor& _ioService;
 	std::unique_ptr<std::mutex> _pMutex = nullptr;
 };
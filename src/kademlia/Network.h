@@ -36,6 +36,7 @@
 #include "IPEndpoint.h"
 #include "MessageSocket.h"
 #include "kademlia/buffer.hpp"
+#include "kademlia/buffer_pool.hpp"
 
 namespace kademlia {
 namespace detail {
@@ -56,7 +57,8 @@ public:
 		on_message_received_type on_message_received): io_service_(io_service),
 			socket_ipv4_(std::move(socket_ipv4)),
 			socket_ipv6_(std::move(socket_ipv6)),
-			on_message_received_( on_message_received )
+			on_message_received_( on_message_received ),
+			buffer_pool_()
 	{
 		start_message_reception(on_message_received);
 		LOG_DEBUG(Network, this) << "created at '" << socket_ipv4_.local_endpoint()
@@ -67,6 +69,12 @@ public:
 
 	Network& operator = (Network const&) = delete;
 
+	/// The returned buffer is recycled once the message has been sent.
+	pooled_buffer acquire_buffer()
+	{
+		return buffer_pool_.acquire();
+	}
+
 	template<typename Message, typename OnMessageSent>
 	void send(Message const& message, endpoint_type const& e, OnMessageSent const& on_message_sent)
 	{
@@ -118,6 +126,7 @@ private:
 	message_socket_type socket_ipv4_;
 	message_socket_type socket_ipv6_;
 	on_message_received_type on_message_received_;
+	buffer_pool buffer_pool_;
 };
 
 } // namespace detail
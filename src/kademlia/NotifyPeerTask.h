@@ -30,6 +30,7 @@
 #   pragma once
 #endif
 
+#include <chrono>
 #include <memory>
 #include <system_error>
 
@@ -42,14 +43,13 @@ namespace kademlia {
 namespace detail {
 
 ///
-template<typename TrackerType>
+template<typename TrackerType, typename RoutingTableType>
 class NotifyPeerTask final : public LookupTask
 {
 public:
 	using endpoint_type = typename TrackerType::endpoint_type;
 
 public:
-	template<typename RoutingTableType>
 	static void start(detail::id const & key, TrackerType & tracker, RoutingTableType & routing_table)
 	{
 		std::shared_ptr<NotifyPeerTask> c;
@@ -58,10 +58,10 @@ public:
 	}
 
 private:
-	template<typename RoutingTableType>
 	NotifyPeerTask(detail::id const & key, TrackerType & tracker, RoutingTableType & routing_table):
-		LookupTask(key, routing_table.find(key), routing_table.end()),
-		tracker_(tracker)
+		LookupTask(key, routing_table.closest(key, ROUTING_TABLE_BUCKET_SIZE)),
+		tracker_(tracker),
+		routing_table_(routing_table)
 	{
 		LOG_DEBUG(NotifyPeerTask, this) << "create notify Peer task for '"<< key << "' Peer." << std::endl;
 	}
@@ -85,9 +85,13 @@ private:
 		LOG_DEBUG(NotifyPeerTask, task.get()) << "sending find peer to notify to '"
 				<< current_peer << "'." << std::endl;
 
-		auto on_message_received = [ task, current_peer ] (endpoint_type const& s, Header const& h
+		auto const sent_at = std::chrono::steady_clock::now();
+
+		auto on_message_received = [ task, current_peer, sent_at ] (endpoint_type const& s, Header const& h
 			, buffer::const_iterator i, buffer::const_iterator e)
 		{
+			task->routing_table_.record_round_trip_time(current_peer.id_
+				, std::chrono::steady_clock::now() - sent_at);
 			task->flag_candidate_as_valid(current_peer.id_);
 			handle_notify_peer_response(s, h, i, e, task);
 		};
@@ -95,9 +99,11 @@ private:
 		auto on_error = [ task, current_peer ] (std::error_code const&)
 		{
 			task->flag_candidate_as_invalid(current_peer.id_);
+			task->routing_table_.flag_peer_as_unresponsive(current_peer.id_);
 		};
 
-		task->tracker_.send_request(request, current_peer.endpoint_, PEER_LOOKUP_TIMEOUT, on_message_received, on_error);
+		task->tracker_.send_request(request, current_peer.endpoint_,
+			task->routing_table_.get_request_timeout(current_peer.id_), on_message_received, on_error);
 	}
 
 	static void handle_notify_peer_response(endpoint_type const& s, Header const& h
@@ -123,13 +129,14 @@ private:
 
 private:
 	TrackerType & tracker_;
+	RoutingTableType & routing_table_;
 };
 
 
 template<typename TrackerType, typename RoutingTableType>
 void start_notify_peer_task(id const& key, TrackerType & tracker, RoutingTableType & routing_table)
 {
-	using task = NotifyPeerTask<TrackerType>;
+	using task = NotifyPeerTask<TrackerType, RoutingTableType>;
 	task::start(key, tracker, routing_table);
 }
 
@@ -30,31 +30,149 @@
 namespace kademlia {
 namespace detail {
 
-void ResponseCallbacks::push_callback(id const& message_id, callback const& on_message_received)
+constexpr std::size_t ResponseCallbacks::MAX_CALLBACK_SIZE;
+constexpr std::size_t ResponseCallbacks::INITIAL_CAPACITY;
+constexpr std::size_t ResponseCallbacks::NOT_FOUND;
+
+ResponseCallbacks::ResponseCallbacks(): slots_(INITIAL_CAPACITY), callbacks_(INITIAL_CAPACITY), size_()
 {
-	auto i = callbacks_.emplace(message_id, on_message_received);
-	(void)i;
-	assert(i.second && "an id can't be registered twice");
+}
+
+ResponseCallbacks::~ResponseCallbacks()
+{
+	for (std::size_t i = 0; i != slots_.size(); ++i)
+		if (slots_[i].operations_) slots_[i].operations_->destroy_(callbacks_[i]);
 }
 
 bool ResponseCallbacks::remove_callback(id const& message_id)
 {
-	return callbacks_.erase( message_id ) > 0;
+	auto const index = find_slot(message_id);
+	if (index == NOT_FOUND)
+		return false;
+
+	slots_[index].operations_->destroy_(callbacks_[index]);
+	erase_slot(index);
+	return true;
 }
 
 std::error_code ResponseCallbacks::dispatch_response(endpoint_type const& sender,
 	Header const& h, buffer::const_iterator i, buffer::const_iterator e )
 {
-	auto callback = callbacks_.find( h.random_token_ );
-	if ( callback == callbacks_.end() )
+	auto const index = find_slot(h.random_token_);
+	if (index == NOT_FOUND)
 		return make_error_code(UNASSOCIATED_MESSAGE_ID);
 
-	callback->second( sender, h, i, e );
-	callbacks_.erase( callback );
+	// The callback is moved out of the table first as it
+	// may register new callbacks, hence reorganize the table.
+	auto const ops = slots_[index].operations_;
+	storage callback;
+	ops->move_(callbacks_[index], callback);
+	erase_slot(index);
+
+	ops->invoke_(callback, sender, h, i, e);
+	ops->destroy_(callback);
 
 	return std::error_code{};
 }
 
+std::size_t ResponseCallbacks::get_home_index(id const& message_id) const
+{
+	// Tokens are random, yet fold every word so that
+	// tokens differing only in their last bits spread too.
+	id::word_type hash = 0;
+	for (std::size_t i = 0; i != id::WORDS_COUNT; ++i)
+		hash ^= message_id.get_word(i);
+
+	// Fibonacci hashing, slots count is a power of 2.
+	hash *= 0x9E3779B97F4A7C15ULL;
+	return std::size_t(hash >> 32) & (slots_.size() - 1);
+}
+
+std::size_t ResponseCallbacks::find_slot(id const& message_id) const
+{
+	auto const mask = slots_.size() - 1;
+
+	for (auto i = get_home_index(message_id); ; i = (i + 1) & mask)
+	{
+		auto const& s = slots_[i];
+		if (!s.operations_)
+			return NOT_FOUND;
+		if (s.message_id_ == message_id)
+			return i;
+	}
+}
+
+std::size_t ResponseCallbacks::reserve_slot(id const& message_id)
+{
+	assert(find_slot(message_id) == NOT_FOUND && "an id can't be registered twice");
+
+	// Keep the load factor below 1/2 so that probe sequences stay short.
+	if ((size_ + 1) * 2 > slots_.size())
+		grow();
+
+	auto const mask = slots_.size() - 1;
+
+	auto i = get_home_index(message_id);
+	while (slots_[i].operations_)
+		i = (i + 1) & mask;
+
+	slots_[i].message_id_ = message_id;
+	++size_;
+	return i;
+}
+
+void ResponseCallbacks::erase_slot(std::size_t index)
+{
+	auto const mask = slots_.size() - 1;
+
+	// Shift back the following entries of the probe
+	// sequence so that no tombstone is needed.
+	for (auto next = (index + 1) & mask; slots_[next].operations_; next = (next + 1) & mask)
+	{
+		auto const home = get_home_index(slots_[next].message_id_);
+
+		// Entries already between their home slot and the hole stay in place.
+		if (((next - home) & mask) < ((next - index) & mask))
+			continue;
+
+		move_slot(slots_, callbacks_, next, index);
+		index = next;
+	}
+
+	slots_[index].operations_ = nullptr;
+	--size_;
+}
+
+void ResponseCallbacks::move_slot(slots& from_slots, callbacks& from_callbacks,
+	std::size_t from, std::size_t to)
+{
+	auto const ops = from_slots[from].operations_;
+	slots_[to] = from_slots[from];
+	ops->move_(from_callbacks[from], callbacks_[to]);
+}
+
+void ResponseCallbacks::grow()
+{
+	slots old_slots(slots_.size() * 2);
+	callbacks old_callbacks(slots_.size() * 2);
+	old_slots.swap(slots_);
+	old_callbacks.swap(callbacks_);
+
+	auto const mask = slots_.size() - 1;
+
+	for (std::size_t from = 0; from != old_slots.size(); ++from)
+	{
+		if (!old_slots[from].operations_)
+			continue;
+
+		auto to = get_home_index(old_slots[from].message_id_);
+		while (slots_[to].operations_)
+			to = (to + 1) & mask;
+
+		move_slot(old_slots, old_callbacks, from, to);
+	}
+}
+
 } // namespace detail
 } // namespace kademlia
 
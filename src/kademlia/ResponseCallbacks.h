@@ -26,8 +26,11 @@
 #ifndef KADEMLIA_RESPONSE_CALLBACKS_H
 #define KADEMLIA_RESPONSE_CALLBACKS_H
 
-#include <map>
-#include <functional>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "kademlia/id.hpp"
 #include "IPEndpoint.h"
@@ -37,16 +40,37 @@ namespace kademlia {
 namespace detail {
 
 
+// Tokens are probed in a flat open addressing table (linear probing,
+// backward shift deletion) while callbacks live inline in a parallel array:
+// once the table has grown to the number of outstanding requests,
+// registering and dispatching never allocate.
 class ResponseCallbacks final
 {
 public:
 	using endpoint_type = IPEndpoint;
 
-	using callback = std::function< void (endpoint_type const& sender, Header const& h,
-			buffer::const_iterator i, buffer::const_iterator e) >;
+	// Largest callback that can be stored in the table.
+	static constexpr std::size_t MAX_CALLBACK_SIZE = 128;
+
+	// Slots preallocated by a new table.
+	static constexpr std::size_t INITIAL_CAPACITY = 64;
 
 public:
-	void push_callback(id const& message_id, callback const& on_message_received);
+	ResponseCallbacks();
+	ResponseCallbacks(ResponseCallbacks const&) = delete;
+	ResponseCallbacks& operator = (ResponseCallbacks const&) = delete;
+	~ResponseCallbacks();
+
+	template<typename Callback>
+	void push_callback(id const& message_id, Callback const& on_message_received)
+	{
+		static_assert(sizeof(Callback) <= MAX_CALLBACK_SIZE, "callback doesn't fit in a slot");
+		static_assert(alignof(Callback) <= alignof(storage), "callback alignment isn't supported");
+
+		auto const index = reserve_slot(message_id);
+		new (&callbacks_[index]) Callback(on_message_received);
+		slots_[index].operations_ = &CallbackOperations<Callback>::instance;
+	}
 
 	bool remove_callback(id const& message_id);
 
@@ -55,14 +79,81 @@ public:
 
 	bool has(id const& message_id) const
 	{
-		return callbacks_.find(message_id) != callbacks_.end();
+		return find_slot(message_id) != NOT_FOUND;
+	}
+
+	std::size_t size() const
+	{
+		return size_;
 	}
 
 private:
-	using callbacks = std::map<id, callback>;
+	using storage = std::aligned_storage<MAX_CALLBACK_SIZE>::type;
+
+	// Type erased operations of a stored callback.
+	struct Operations
+	{
+		void (*invoke_)(storage& callback, endpoint_type const& sender, Header const& h,
+			buffer::const_iterator i, buffer::const_iterator e);
+		void (*move_)(storage& from, storage& to);
+		void (*destroy_)(storage& callback);
+	};
+
+	template<typename Callback>
+	struct CallbackOperations
+	{
+		static Callback& get(storage& callback)
+		{
+			return *reinterpret_cast<Callback*>(&callback);
+		}
+
+		static void invoke(storage& callback, endpoint_type const& sender, Header const& h,
+			buffer::const_iterator i, buffer::const_iterator e)
+		{
+			get(callback)(sender, h, i, e);
+		}
+
+		static void move(storage& from, storage& to)
+		{
+			new (&to) Callback(std::move(get(from)));
+			destroy(from);
+		}
+
+		static void destroy(storage& callback)
+		{
+			get(callback).~Callback();
+		}
+
+		static constexpr Operations instance{ &invoke, &move, &destroy };
+	};
+
+	// An unused slot has no operations.
+	struct Slot
+	{
+		id message_id_;
+		Operations const* operations_;
+	};
+
+	using slots = std::vector<Slot>;
+	using callbacks = std::vector<storage>;
+
+	static constexpr std::size_t NOT_FOUND = std::size_t(-1);
+
+	std::size_t get_home_index(id const& message_id) const;
+	std::size_t find_slot(id const& message_id) const;
+	std::size_t reserve_slot(id const& message_id);
+	void move_slot(slots& from_slots, callbacks& from_callbacks, std::size_t from, std::size_t to);
+	void erase_slot(std::size_t index);
+	void grow();
+
+	slots slots_;
 	callbacks callbacks_;
+	std::size_t size_;
 };
 
+template<typename Callback>
+constexpr ResponseCallbacks::Operations ResponseCallbacks::CallbackOperations<Callback>::instance;
+
 } // namespace detail
 } // namespace kademlia
 
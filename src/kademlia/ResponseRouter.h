@@ -66,10 +66,19 @@ public:
 				on_error(make_error_code(std::errc::timed_out));
 		};
 
+		auto const timeout = timer_.expires_from_now(callback_ttl, on_timeout);
+
+		// The timeout is useless once the response has been received.
+		auto on_response = [ this, timeout, on_response_received ] (endpoint_type const& sender
+			, Header const& h, buffer::const_iterator i, buffer::const_iterator e)
+		{
+			timer_.cancel(timeout);
+			on_response_received(sender, h, i, e);
+		};
+
 		// Associate the response id with the
 		// on_response_received callback.
-		response_callbacks_.push_callback(response_id, on_response_received);
-		timer_.expires_from_now(callback_ttl, on_timeout);
+		response_callbacks_.push_callback(response_id, on_response);
 	}
 
 private:
@@ -26,6 +26,7 @@
 
 #include "SessionImpl.h"
 #include "kademlia/error.hpp"
+#include "kademlia/constants.hpp"
 #include "error_impl.hpp"
 
 
@@ -33,11 +34,11 @@ namespace kademlia {
 namespace detail {
 
 
-SessionImpl::SessionImpl(endpoint const& ipv4, endpoint const& ipv6):
+SessionImpl::SessionImpl(endpoint const& ipv4, endpoint const& ipv6): _ioService{ *this },
 	_engine{ _ioService, ipv4, ipv6 }
 { }
 
-SessionImpl::SessionImpl(endpoint const& initPeer, endpoint const& ipv4, endpoint const& ipv6): _ioService{},
+SessionImpl::SessionImpl(endpoint const& initPeer, endpoint const& ipv4, endpoint const& ipv6): _ioService{ *this },
 	_engine{ _ioService, initPeer, ipv4, ipv6 }
 { }
 
@@ -57,5 +58,44 @@ void SessionImpl::abort()
 	_ioService.wakeUp();
 }
 
+
+void SessionImpl::submit(TaskType task)
+{
+	// Interrupt the reactor poll once per batch of tasks.
+	if (_submissions.push(std::move(task)))
+		_ioService.wakeUp();
+}
+
+
+void SessionImpl::executeSubmissions()
+{
+	auto execute = [] (TaskType& task) { task(); };
+
+	// Remaining tasks are executed on the next iteration.
+	if (!_submissions.drain(execute, SUBMISSIONS_BATCH_SIZE))
+		_ioService.wakeUp();
+}
+
+
+void SessionImpl::Reactor::onTimeout()
+{
+	_session.executeSubmissions();
+	SocketReactor::onTimeout();
+}
+
+
+void SessionImpl::Reactor::onIdle()
+{
+	_session.executeSubmissions();
+	SocketReactor::onIdle();
+}
+
+
+void SessionImpl::Reactor::onBusy()
+{
+	_session.executeSubmissions();
+	SocketReactor::onBusy();
+}
+
 } // namespace detail
 } // namespace kademlia
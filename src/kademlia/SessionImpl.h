@@ -31,6 +31,7 @@
 #endif
 
 
+#include <functional>
 #include <utility>
 #include "SocketAdapter.h"
 #include "Poco/Net/DatagramSocket.h"
@@ -39,6 +40,7 @@
 #include "kademlia/endpoint.hpp"
 #include "Engine.h"
 #include "kademlia/concurrent_guard.hpp"
+#include "kademlia/submission_queue.hpp"
 
 
 namespace kademlia {
@@ -58,25 +60,71 @@ public:
 
 	SessionImpl(endpoint const& initial_peer, endpoint const& listen_on_ipv4, endpoint const& listen_on_ipv6);
 
+	// Thread safe, the save is executed by the thread running the session.
 	template<typename HandlerType>
 	void async_save(KeyType const& key, DataType const& data, HandlerType && handler)
 	{
-		_engine.async_save(key, data, std::forward<HandlerType>(handler));
+		auto t = [this, key, data, handler] () mutable
+		{ _engine.async_save(key, data, std::move(handler)); };
+		submit(std::move(t));
 	}
 
+	// Thread safe, the load is executed by the thread running the session.
 	template<typename HandlerType>
 	void async_load(KeyType const& key, HandlerType && handler)
 	{
-		_engine.async_load(key, std::forward<HandlerType>(handler));
+		auto t = [this, key, handler] () mutable
+		{ _engine.async_load(key, std::move(handler)); };
+		submit(std::move(t));
+	}
+
+	// Thread safe, applied by the thread running the session.
+	void setLatencyAwarePeerSelection(bool enabled)
+	{
+		auto t = [this, enabled] ()
+		{ _engine.set_latency_aware_peer_selection(enabled); };
+		submit(std::move(t));
 	}
 
 	std::error_code run();
 
 	void abort();
 
+	// Thread safe.
+	session_base::storage_statistics getStorageStatistics() const
+	{ return _engine.get_storage_statistics(); }
+
+	// Thread safe.
+	session_base::timeout_statistics getTimeoutStatistics() const
+	{ return _engine.get_timeout_statistics(); }
+
+private:
+	using TaskType = std::function<void ()>;
+
+	// Executes the submitted tasks on each iteration of the loop.
+	class Reactor: public Poco::Net::SocketReactor
+	{
+	public:
+		explicit Reactor(SessionImpl& session): _session(session)
+		{ }
+
+	protected:
+		void onTimeout() override;
+		void onIdle() override;
+		void onBusy() override;
+
+	private:
+		SessionImpl& _session;
+	};
+
+	void submit(TaskType task);
+
+	void executeSubmissions();
+
 private:
-	Poco::Net::SocketReactor _ioService;
+	Reactor _ioService;
 	EngineType _engine;
+	submission_queue<TaskType> _submissions;
 	detail::concurrent_guard _concurrentGuard;
 };
 
@@ -6,10 +6,13 @@
 #include "Poco/Net/DatagramSocket.h"
 #include "Poco/Net/SocketReactor.h"
 #include "Poco/Net/SocketAddress.h"
+#include "Poco/Net/SocketDefs.h"
 #include "Poco/Net/SocketNotification.h"
 #include "kademlia/buffer.hpp"
 #include "kademlia/boost_to_std_error.hpp"
 #include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <deque>
 
 namespace kademlia {
 namespace detail {
@@ -33,10 +36,12 @@ public:
 		_readHandler(*this, &SocketAdapter::onReadable),
 		_writeHandler(*this, &SocketAdapter::onWritable)
 	{
+		// Datagrams are sent inline until the socket buffer is full.
+		_socket.setBlocking(false);
 		_pIOService->addEventHandler(_socket, _readHandler);
-		_pIOService->addEventHandler(_socket, _writeHandler);
 	}
 
+	// Pending datagrams belong to the original adapter.
 	SocketAdapter(const SocketAdapter& other) :
 		_socket(other._socket),
 		_pIOService(other._pIOService),
@@ -44,13 +49,9 @@ public:
 		_writeHandler(*this, &SocketAdapter::onWritable),
 		_pRecvBuf(other._pRecvBuf),
 		_pRecvAddr(other._pRecvAddr),
-		_onRecvCompletion(other._onRecvCompletion),
-		_pSendBuf(other._pSendBuf),
-		_pSendAddr(other._pSendAddr),
-		_onSendCompletion(other._onSendCompletion)
+		_onRecvCompletion(other._onRecvCompletion)
 	{
 		_pIOService->addEventHandler(_socket, _readHandler);
-		_pIOService->addEventHandler(_socket, _writeHandler);
 	}
 
 	SocketAdapter(SocketAdapter&& other) :
@@ -59,34 +60,25 @@ public:
 		_writeHandler(*this, &SocketAdapter::onWritable),
 		_pRecvBuf(std::move(other._pRecvBuf)),
 		_pRecvAddr(std::move(other._pRecvAddr)),
-		_onRecvCompletion(std::move(other._onRecvCompletion)),
-		_pSendBuf(std::move(other._pSendBuf)),
-		_pSendAddr(std::move(other._pSendAddr)),
-		_onSendCompletion(std::move(other._onSendCompletion))
+		_onRecvCompletion(std::move(other._onRecvCompletion))
 	{
-		_pIOService->removeEventHandler(other._socket, other._writeHandler);
-		_pIOService->removeEventHandler(other._socket, other._readHandler);
+		other.removeEventHandlers();
 		_socket = std::move(other._socket);
 
 		other._pRecvBuf = nullptr;
 		other._pRecvAddr = nullptr;
 		other._onRecvCompletion = nullptr;
 
-		other._pSendBuf = nullptr;
-		other._pSendAddr = nullptr;
-		other._onSendCompletion = nullptr;
-		
+		_sendQueue.swap(other._sendQueue);
+
 		_pIOService->addEventHandler(_socket, _readHandler);
-		_pIOService->addEventHandler(_socket, _writeHandler);
+		observeWritable(!_sendQueue.empty());
 	}
 
 	~SocketAdapter()
 	{
 		if (_socket.impl())
-		{
-			_pIOService->removeEventHandler(_socket, _writeHandler);
-			_pIOService->removeEventHandler(_socket, _readHandler);
-		}
+			removeEventHandlers();
 	}
 
 	SocketAdapter &operator=(const SocketAdapter &other)
@@ -101,17 +93,19 @@ public:
 		_pRecvAddr = other._pRecvAddr;
 		_onRecvCompletion = other._onRecvCompletion;
 
-		_pSendBuf = other._pSendBuf;
-		_pSendAddr = other._pSendAddr;
-		_onSendCompletion = other._onSendCompletion;
-
 		return *this;
 	}
 
 	SocketAdapter &operator=(SocketAdapter &&other)
 	{
-		_pIOService->removeEventHandler(other._socket, other._writeHandler);
-		_pIOService->removeEventHandler(other._socket, other._readHandler);
+		if (this == &other) return *this;
+
+		// The datagrams still queued would never be sent.
+		abortPendingDatagrams();
+
+		if (_socket.impl())
+			removeEventHandlers();
+		other.removeEventHandlers();
 		_socket = std::move(other._socket);
 
 		_pIOService = other._pIOService;
@@ -122,14 +116,15 @@ public:
 		_pRecvAddr = std::move(other._pRecvAddr);
 		_onRecvCompletion = std::move(other._onRecvCompletion);
 
-		_pSendBuf = std::move(other._pSendBuf);
-		_pSendAddr = std::move(other._pSendAddr);
-		_onSendCompletion = std::move(other._onSendCompletion);
-
 		other._pRecvBuf = nullptr;
 		other._pRecvAddr = nullptr;
 		other._onRecvCompletion = nullptr;
 
+		_sendQueue.swap(other._sendQueue);
+
+		_pIOService->addEventHandler(_socket, _readHandler);
+		observeWritable(!_sendQueue.empty());
+
 		return *this;
 	}
 
@@ -144,11 +139,20 @@ public:
 
 	void onWritable(Poco::Net::WritableNotification* pNf)
 	{
-		poco_check_ptr (_pSendBuf);
-		poco_check_ptr(_pSendAddr);
-		int n = _socket.sendTo(_pSendBuf, _pSendBuf->size(), *_pSendAddr);
-		//TODO: pass error
-		_onSendCompletion(boost::system::error_code(), n);
+		// Completions may queue new datagrams meanwhile.
+		while (!_sendQueue.empty())
+		{
+			auto datagram = std::move(_sendQueue.front());
+			_sendQueue.pop_front();
+
+			if (!trySendTo(datagram))
+			{
+				_sendQueue.push_front(std::move(datagram));
+				return;
+			}
+		}
+
+		observeWritable(false);
 	}
 
 	void asyncReceiveFrom(boost::asio::mutable_buffer const& buf, Poco::Net::SocketAddress& addr, Callback&& onCompletion)
@@ -158,11 +162,18 @@ public:
 		_onRecvCompletion = std::move(onCompletion);
 	}
 
+	// The buffer content must be kept alive until onCompletion is called,
+	// which happens inline if the datagram can be sent right away.
 	void asyncSendTo(boost::asio::const_buffer const& buf, const Poco::Net::SocketAddress& addr, Callback&& onCompletion)
 	{
-		_pSendBuf = const_cast<boost::asio::const_buffer*>(std::addressof(buf));
-		_pSendAddr = std::addressof(addr);
-		_onSendCompletion = std::move(onCompletion);
+		PendingDatagram datagram{ buf, addr, std::move(onCompletion) };
+
+		// Queued datagrams are sent first to keep the order.
+		if (!_sendQueue.empty() || !trySendTo(datagram))
+		{
+			_sendQueue.push_back(std::move(datagram));
+			observeWritable(true);
+		}
 	}
 
 	Poco::Net::SocketImpl* impl() const
@@ -180,6 +191,70 @@ public:
 		return _socket.address();
 	}
 
+private:
+	struct PendingDatagram
+	{
+		boost::asio::const_buffer buffer;
+		Poco::Net::SocketAddress address;
+		Callback onCompletion;
+	};
+
+	// Return false if the socket buffer is full, the
+	// datagram must then be sent once the socket is writable.
+	bool trySendTo(PendingDatagram& datagram)
+	{
+		boost::system::error_code failure;
+		int n = 0;
+		try
+		{
+			n = _socket.sendTo(datagram.buffer.data(), int(datagram.buffer.size()), datagram.address);
+			if (n < 0) return false;
+		}
+		catch (Poco::Exception const& ex)
+		{
+			// DatagramSocket::sendTo() throws rather than
+			// returning when the socket buffer is full.
+			if (ex.code() == POCO_EWOULDBLOCK || ex.code() == POCO_EAGAIN) return false;
+
+			failure = boost::system::error_code(ex.code(), boost::system::system_category());
+			n = 0;
+		}
+
+		datagram.onCompletion(failure, std::size_t(n));
+		return true;
+	}
+
+	// An idle UDP socket is always writable, hence it is only
+	// observed while datagrams wait for room in its buffer.
+	void observeWritable(bool observe)
+	{
+		if (observe == _isWritableObserved) return;
+
+		if (observe)
+			_pIOService->addEventHandler(_socket, _writeHandler);
+		else
+			_pIOService->removeEventHandler(_socket, _writeHandler);
+		_isWritableObserved = observe;
+	}
+
+	void abortPendingDatagrams()
+	{
+		// Completions may queue new datagrams meanwhile.
+		while (!_sendQueue.empty())
+		{
+			auto datagram = std::move(_sendQueue.front());
+			_sendQueue.pop_front();
+
+			datagram.onCompletion(boost::asio::error::operation_aborted, 0);
+		}
+	}
+
+	void removeEventHandlers()
+	{
+		observeWritable(false);
+		_pIOService->removeEventHandler(_socket, _readHandler);
+	}
+
 private:
 	Poco::Net::DatagramSocket _socket;
 	Poco::Net::SocketReactor* _pIOService = nullptr;
@@ -191,9 +266,8 @@ private:
 	Poco::Net::SocketAddress* _pRecvAddr = nullptr;
 	Callback _onRecvCompletion = nullptr;
 
-	boost::asio::const_buffer* _pSendBuf = nullptr;
-	const Poco::Net::SocketAddress* _pSendAddr = nullptr;
-	Callback _onSendCompletion = nullptr;
+	std::deque<PendingDatagram> _sendQueue;
+	bool _isWritableObserved = false;
 };
 
 } }
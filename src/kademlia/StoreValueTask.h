@@ -30,6 +30,7 @@
 #   pragma once
 #endif
 
+#include <chrono>
 #include <memory>
 #include <type_traits>
 #include <system_error>
@@ -43,28 +44,30 @@ namespace kademlia {
 namespace detail {
 
 ///
-template< typename SaveHandlerType, typename TrackerType, typename DataType >
+template< typename SaveHandlerType, typename TrackerType, typename DataType, typename RoutingTableType >
 class StoreValueTask final : public LookupTask
 {
 public:
-	template< typename RoutingTableType >
+	// If is_latency_aware, low latency peers are preferred among nearly as close candidates.
 	static void
 	start(detail::id const & key, DataType const& data, TrackerType & tracker
-		, RoutingTableType & routing_table, SaveHandlerType handler)
+		, RoutingTableType & routing_table, SaveHandlerType handler, bool is_latency_aware)
 	{
 		std::shared_ptr< StoreValueTask > c;
-		c.reset(new StoreValueTask(key, data, tracker, routing_table, std::move(handler)));
+		c.reset(new StoreValueTask(key, data, tracker, routing_table, std::move(handler), is_latency_aware));
 		try_to_store_value(c);
 	}
 
 private:
-	template< typename RoutingTableType, typename HandlerType >
+	template< typename HandlerType >
 	StoreValueTask(detail::id const & key, DataType const& data, TrackerType & tracker
-		, RoutingTableType & routing_table, HandlerType && save_handler):
-			LookupTask(key, routing_table.find(key), routing_table.end())
+		, RoutingTableType & routing_table, HandlerType && save_handler, bool is_latency_aware):
+			LookupTask(key, routing_table.closest(key, ROUTING_TABLE_BUCKET_SIZE))
 			, tracker_(tracker)
+			, routing_table_(routing_table)
 			, data_(data)
 			, save_handler_(std::forward< HandlerType >(save_handler))
+			, is_latency_aware_(is_latency_aware)
 	{
 		LOG_DEBUG(StoreValueTask, this)
 				<< "create store value task for '"
@@ -91,8 +94,9 @@ private:
 
 		FindPeerRequestBody const request{ task->get_key() };
 
-		auto const closest_candidates = task->select_new_closest_candidates
-				(concurrent_requests_count);
+		auto const closest_candidates = task->is_latency_aware_
+				? task->select_new_closest_candidates(concurrent_requests_count, task->routing_table_)
+				: task->select_new_closest_candidates(concurrent_requests_count);
 
 		for (auto const& c : closest_candidates)
 			send_find_peer_to_store_request(request, c, task);
@@ -112,24 +116,27 @@ private:
 				<< task->get_key() << "' to '"
 				<< current_candidate << "'." << std::endl;
 
+		auto const sent_at = std::chrono::steady_clock::now();
+
 		// On message received, process it.
-		auto on_message_received = [ task ] (IPEndpoint const& s
+		auto on_message_received = [ task, current_candidate, sent_at ] (IPEndpoint const& s
 			, Header const& h, buffer::const_iterator i, buffer::const_iterator e)
 		{
+			task->routing_table_.record_round_trip_time(current_candidate.id_
+				, std::chrono::steady_clock::now() - sent_at);
 			handle_find_peer_to_store_response(s, h, i, e, task);
 		};
 
 		// On error, retry with another endpoint.
 		auto on_error = [ task, current_candidate ] (std::error_code const&)
 		{
-			// XXX: Can also flag candidate as invalid is
-			// present in routing table.
 			task->flag_candidate_as_invalid(current_candidate.id_);
+			task->routing_table_.flag_peer_as_unresponsive(current_candidate.id_);
 			try_to_store_value(task);
 		};
 
 		task->tracker_.send_request(request, current_candidate.endpoint_,
-			PEER_LOOKUP_TIMEOUT, on_message_received, on_error);
+			task->routing_table_.get_request_timeout(current_candidate.id_), on_message_received, on_error);
 	}
 
 	static void handle_find_peer_to_store_response(IPEndpoint const& s, Header const& h,
@@ -192,8 +199,10 @@ private:
 
 private:
 	TrackerType & tracker_;
+	RoutingTableType & routing_table_;
 	DataType data_;
 	SaveHandlerType save_handler_;
+	bool is_latency_aware_;
 };
 
 /**
@@ -201,12 +210,12 @@ private:
  */
 template< typename DataType, typename TrackerType, typename RoutingTableType, typename HandlerType >
 void start_store_value_task(id const& key, DataType const& data, TrackerType & tracker
-	, RoutingTableType & routing_table, HandlerType && save_handler)
+	, RoutingTableType & routing_table, HandlerType && save_handler, bool is_latency_aware = false)
 {
 	using handler_type = typename std::decay< HandlerType >::type;
-	using task = StoreValueTask< handler_type, TrackerType, DataType >;
+	using task = StoreValueTask< handler_type, TrackerType, DataType, RoutingTableType >;
 
-	task::start(key, data, tracker, routing_table, std::forward< HandlerType >(save_handler));
+	task::start(key, data, tracker, routing_table, std::forward< HandlerType >(save_handler), is_latency_aware);
 }
 
 } // namespace detail
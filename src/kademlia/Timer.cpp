@@ -37,7 +37,8 @@ namespace kademlia {
 namespace detail {
 
 Timer::Timer(SocketReactor& ioService): _ioService(ioService),
-	timeouts_{}
+	timeouts_{},
+	next_tick_{ time_point::max() }
 {
 }
 
@@ -54,24 +55,21 @@ void Timer::schedule_next_tick(time_point const& expiration_time)
 		if (failure)
 			throw std::system_error{ make_error_code(TIMER_MALFUNCTION) };
 		*/
-		// The callbacks to execute are the first
-		// n callbacks with the same keys.
-		auto begin = timeouts_.begin();
-		auto end = timeouts_.upper_bound(begin->first);
-		// Call the user callbacks.
-		for (auto i = begin; i != end; ++ i) i->second();
+		next_tick_ = time_point::max();
 
-		// And remove the timeout.
-		timeouts_.erase(begin, end);
+		// Call the user callbacks of the expired timeouts,
+		// they may schedule new timeouts.
+		timeouts_.expire(clock::now());
 
 		// If there is a remaining timeout, schedule it.
-		if (! timeouts_.empty())
+		if (! timeouts_.empty() && next_tick_ == time_point::max())
 		{
 			LOG_DEBUG(Timer, this) << "\tschedule remaining timers" << std::endl;
-			schedule_next_tick(timeouts_.begin()->first);
+			schedule_next_tick(timeouts_.get_next_expiration_time());
 		}
 	};
 
+	next_tick_ = expiration_time;
 	int tout = getTimeout(expiration_time);
 	LOG_DEBUG(Timer, this) << "\tscheduled timer in " << tout << " [ms]" << std::endl;
 	_ioService.addCompletionHandler(on_fire, tout);
@@ -27,10 +27,9 @@
 #define KADEMLIA_TIMER_H
 
 
-#include <map>
 #include <chrono>
-#include <functional>
 #include "Poco/Net/SocketReactor.h"
+#include "kademlia/timing_wheel.hpp"
 
 
 namespace kademlia {
@@ -40,16 +39,19 @@ namespace detail {
 class Timer final
 {
 public:
-	using clock = std::chrono::steady_clock;
+	using clock = timing_wheel::clock;
 	using duration = clock::duration;
+	using handle = timing_wheel::handle;
 
 public:
 	explicit Timer(Poco::Net::SocketReactor& ioService);
 
+	// Return the handle to cancel the timeout.
 	template< typename Callback >
-	void expires_from_now(duration const& timeout, Callback const& on_timer_expired)
+	handle expires_from_now(duration const& timeout, Callback const& on_timer_expired)
 	{
-		auto expiration_time = clock::now() + timeout;
+		auto const h = timeouts_.schedule(clock::now() + timeout, on_timer_expired);
+		auto const expiration_time = timeouts_.get_next_expiration_time();
 
 		// this lambda is a workaround to enforce asio behavior (timer cancellation
 		// is considered a task); it removes all but one scheduled completion handler,
@@ -63,9 +65,9 @@ public:
 			_ioService.removePermanentCompletionHandlers(1);
 		};
 
-		// If the current expiration time will be the sooner to expire
+		// If the new timeout will be the sooner to expire
 		// then cancel any pending wait and schedule this one instead.
-		if (timeouts_.empty() || expiration_time < timeouts_.begin()->first)
+		if (expiration_time < next_tick_)
 		{
 			if (_ioService.scheduledCompletionHandlers())
 			{
@@ -75,20 +77,27 @@ public:
 			schedule_next_tick(expiration_time);
 		}
 
-		timeouts_.emplace(expiration_time, on_timer_expired);
+		return h;
+	}
+
+	// Remove a timeout without calling its callback, return
+	// false if the timeout already expired or was cancelled.
+	bool cancel(handle const& h)
+	{
+		return timeouts_.cancel(h);
 	}
 
 private:
 	using time_point = clock::time_point;
-	using callback = std::function< void (void) >;
-	using timeouts = std::multimap< time_point, callback >;
 
 	void schedule_next_tick(time_point const& expiration_time);
 	Poco::Timestamp::TimeDiff getTimeout(time_point const& expiration_time);
 
 private:
 	Poco::Net::SocketReactor& _ioService;
-	timeouts timeouts_;
+	timing_wheel timeouts_;
+	// time_point::max() when no tick is scheduled.
+	time_point next_tick_;
 };
 
 } // namespace detail
@@ -37,6 +37,7 @@
 #include "Network.h"
 #include "Message.h"
 #include "kademlia/routing_table.hpp"
+#include "kademlia/timeout_statistics.hpp"
 #include "kademlia/value_store.hpp"
 #include "kademlia/constants.hpp"
 
@@ -59,7 +60,8 @@ public:
 			response_router_(io_service),
 			message_serializer_(my_id),
 			network_(network),
-			random_engine_(random_engine)
+			random_engine_(random_engine),
+			timeout_statistics_()
 	{ }
 
 	Tracker(Tracker const&) = delete;
@@ -69,9 +71,12 @@ public:
 	void send_request(Request const& request, endpoint_type const& e, Timer::duration const& timeout
 		, OnResponseReceived const& on_response_received, OnError const& on_error)
 	{
-		id const response_id(random_engine_);
-		// Generate the request buffer.
-		auto message = message_serializer_.serialize(request, response_id);
+		auto const response_id = generate_token(random_engine_);
+		// Generate the request straight into a recycled buffer.
+		auto message = network_.acquire_buffer();
+		message_serializer_.serialize(request, response_id, *message);
+
+		timeout_statistics_.record(timeout);
 
 		// This lambda will keep the request message alive.
 		auto on_request_sent =
@@ -91,14 +96,15 @@ public:
 	template<typename Request>
 	void send_request(Request const& request, endpoint_type const& e)
 	{
-		id const response_id(random_engine_);
+		auto const response_id = generate_token(random_engine_);
 		send_response(response_id, request, e);
 	}
 
 	template< typename Response >
 	void send_response(id const& response_id, Response const& response, endpoint_type const& e)
 	{
-		auto message = message_serializer_.serialize(response, response_id);
+		auto message = network_.acquire_buffer();
+		message_serializer_.serialize(response, response_id, *message);
 
 		auto on_response_sent = [] (std::error_code const& /* failure */)
 		{ };
@@ -112,11 +118,18 @@ public:
 		response_router_.handle_new_response(s, h, i, e);
 	}
 
+	/// Distribution of the timeouts of sent requests.
+	timeout_statistics const& get_timeout_statistics() const
+	{
+		return timeout_statistics_;
+	}
+
 private:
 	ResponseRouter response_router_;
 	MessageSerializer message_serializer_;
 	network_type & network_;
 	random_engine_type & random_engine_;
+	timeout_statistics timeout_statistics_;
 };
 
 } // namespace detail
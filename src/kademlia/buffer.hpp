@@ -31,13 +31,38 @@
 #endif
 
 #include <vector>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 
 namespace kademlia {
 namespace detail {
 
 using buffer = std::vector< std::uint8_t >;
 
+/**
+ *  @brief Bytes owned elsewhere, kept alive and
+ *         unchanged as long as owner_ is referenced.
+ */
+struct shared_buffer final
+{
+    /**
+     *  @return false if there are no bytes.
+     */
+    explicit
+    operator bool
+        ( void )
+        const
+    { return owner_ != nullptr; }
+
+    ///
+    std::shared_ptr< void const > owner_;
+    ///
+    std::uint8_t const* data_;
+    ///
+    std::size_t size_;
+};
+
 } // namespace detail
 } // namespace kademlia
 
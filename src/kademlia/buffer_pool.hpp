@@ -0,0 +1,316 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KADEMLIA_BUFFER_POOL_HPP
+#define KADEMLIA_BUFFER_POOL_HPP
+
+#ifdef _MSC_VER
+#   pragma once
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <kademlia/detail/cxx11_macros.hpp>
+
+#include "kademlia/buffer.hpp"
+
+namespace kademlia {
+namespace detail {
+
+class buffer_pool;
+
+/**
+ *  @brief Shared ownership of a buffer returned
+ *         to its pool once the last owner is gone.
+ *  @note Copying only increments a counter, hence
+ *        messages can be captured by completion
+ *        handlers instead of being copied.
+ */
+class pooled_buffer final
+{
+public:
+    /**
+     *  @brief Own a buffer which doesn't come from any pool.
+     */
+    explicit
+    pooled_buffer
+        ( buffer b = buffer{} )
+            : entry_( new entry{ std::move( b ), nullptr } )
+    { }
+
+    /**
+     *
+     */
+    pooled_buffer
+        ( pooled_buffer const& o )
+            : entry_( o.entry_ )
+    {
+        if ( entry_ )
+            ++ entry_->references_;
+    }
+
+    /**
+     *
+     */
+    pooled_buffer
+        ( pooled_buffer && o )
+            : entry_( o.entry_ )
+    { o.entry_ = nullptr; }
+
+    /**
+     *
+     */
+    pooled_buffer &
+    operator=
+        ( pooled_buffer o )
+    {
+        std::swap( entry_, o.entry_ );
+        return *this;
+    }
+
+    /**
+     *
+     */
+    ~pooled_buffer
+        ( void )
+    { release(); }
+
+    /**
+     *
+     */
+    buffer &
+    operator*
+        ( void )
+        const
+    { return entry_->buffer_; }
+
+    /**
+     *
+     */
+    buffer *
+    operator->
+        ( void )
+        const
+    { return &entry_->buffer_; }
+
+private:
+    friend class buffer_pool;
+
+    /// Released entries of a pool, shared with its buffers.
+    struct state;
+
+    ///
+    struct entry
+    {
+        /**
+         *
+         */
+        entry
+            ( buffer b
+            , std::shared_ptr< state > s )
+                : buffer_( std::move( b ) )
+                , references_( 1 )
+                , state_( std::move( s ) )
+        { }
+
+        ///
+        buffer buffer_;
+        /// Owners may live on different threads.
+        std::atomic< std::size_t > references_;
+        /// Null when the buffer doesn't come from a pool.
+        std::shared_ptr< state > state_;
+    };
+
+    ///
+    struct state
+    {
+        ///
+        std::mutex mutex_;
+        ///
+        std::vector< entry * > free_entries_;
+        /// Set once the pool is destroyed.
+        bool closed_;
+    };
+
+private:
+    /**
+     *
+     */
+    explicit
+    pooled_buffer
+        ( entry * e )
+            : entry_( e )
+    { }
+
+    /**
+     *
+     */
+    void
+    release
+        ( void );
+
+private:
+    ///
+    entry * entry_;
+};
+
+/**
+ *  @brief Recycle message buffers so that
+ *         sending a message doesn't allocate.
+ *
+ *  Released buffers keep their capacity, hence a message
+ *  serialized into an acquired buffer usually fits.
+ *  Buffers may outlive their pool, they are deleted
+ *  once released in this case.
+ *  @note Thread safe, the free list is guarded by a mutex
+ *        which is only locked when a buffer is acquired or
+ *        returned, copies only touch an atomic counter.
+ */
+class buffer_pool final
+{
+public:
+    /// Released buffers kept beyond this count are deleted.
+    static CXX11_CONSTEXPR std::size_t MAX_FREE_BUFFERS = 256;
+
+public:
+    /**
+     *
+     */
+    buffer_pool
+        ( void )
+            : state_( std::make_shared< pooled_buffer::state >() )
+    { state_->closed_ = false; }
+
+    /**
+     *
+     */
+    buffer_pool
+        ( buffer_pool const& )
+        = delete;
+
+    /**
+     *
+     */
+    buffer_pool &
+    operator=
+        ( buffer_pool const& )
+        = delete;
+
+    /**
+     *
+     */
+    ~buffer_pool
+        ( void )
+    {
+        std::vector< pooled_buffer::entry * > free_entries;
+        {
+            std::lock_guard< std::mutex > lock{ state_->mutex_ };
+            state_->closed_ = true;
+            free_entries.swap( state_->free_entries_ );
+        }
+
+        for ( auto e : free_entries )
+            delete e;
+    }
+
+    /**
+     *  @brief Return an empty buffer.
+     */
+    pooled_buffer
+    acquire
+        ( void )
+    {
+        {
+            std::lock_guard< std::mutex > lock{ state_->mutex_ };
+
+            auto & free_entries = state_->free_entries_;
+            if ( ! free_entries.empty() )
+            {
+                auto e = free_entries.back();
+                free_entries.pop_back();
+                e->references_ = 1;
+
+                return pooled_buffer{ e };
+            }
+        }
+
+        return pooled_buffer{ new pooled_buffer::entry{ buffer{}, state_ } };
+    }
+
+    /**
+     *  @brief Return the count of buffers ready to be acquired.
+     */
+    std::size_t
+    free_count
+        ( void )
+        const
+    {
+        std::lock_guard< std::mutex > lock{ state_->mutex_ };
+        return state_->free_entries_.size();
+    }
+
+private:
+    ///
+    std::shared_ptr< pooled_buffer::state > state_;
+};
+
+inline void
+pooled_buffer::release
+    ( void )
+{
+    if ( ! entry_ || -- entry_->references_ != 0 )
+        return;
+
+    auto e = entry_;
+    entry_ = nullptr;
+
+    if ( auto const& s = e->state_ )
+    {
+        e->buffer_.clear();
+
+        std::lock_guard< std::mutex > lock{ s->mutex_ };
+        if ( ! s->closed_
+             && s->free_entries_.size() < buffer_pool::MAX_FREE_BUFFERS )
+        {
+            s->free_entries_.push_back( e );
+            return;
+        }
+    }
+
+    // Deleted once unlocked as it may own the last state reference.
+    delete e;
+}
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
+
@@ -0,0 +1,319 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KADEMLIA_CONCURRENT_ROUTING_TABLE_HPP
+#define KADEMLIA_CONCURRENT_ROUTING_TABLE_HPP
+
+#ifdef _MSC_VER
+#   pragma once
+#endif
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+
+#include "kademlia/id.hpp"
+#include "kademlia/routing_table.hpp"
+
+namespace kademlia {
+namespace detail {
+
+/**
+ *  @brief A routing_table shared by the engines of a sharded session.
+ *
+ *  Each call locks the table, hence closest() returns a copy
+ *  of the peers instead of a reference into the table. Queries,
+ *  closest() included, share the lock while updates own it.
+ *  @note With a single mutex, session_ping_throughput measured
+ *        213k pings/s with 1 shard and 165k with 4 shards on a
+ *        single core, where extra shards only add thread switches.
+ *        The shared lock lets lookups of several cores overlap,
+ *        but this scaling hasn't been measured yet.
+ *  @note Every received message pushes its sender, mostly a
+ *        known peer. Such a push is skipped without locking if
+ *        the peer has already been pushed from the same endpoint
+ *        and the table hasn't evicted nor flagged a peer since.
+ *        It would only flag the peer as recently seen, which
+ *        matters when choosing among failed peers the one to
+ *        replace, and a failed peer's next push isn't skipped.
+ */
+template< typename PeerType >
+class concurrent_routing_table final
+{
+public:
+    ///
+    using table_type = routing_table< PeerType >;
+
+    ///
+    using peer_type = typename table_type::peer_type;
+
+    ///
+    using closest_peers_type = typename table_type::closest_peers_type;
+
+    ///
+    using duration = typename table_type::duration;
+
+public:
+    /**
+     *
+     */
+    explicit
+    concurrent_routing_table
+        ( id const& my_id
+        , std::size_t k_bucket_size = table_type::DEFAULT_K_BUCKET_SIZE )
+            : mutex_()
+            , table_( my_id, k_bucket_size )
+            , generation_( 0 )
+            , recent_peers_()
+    {
+        for ( auto & p : recent_peers_ )
+            p = 0;
+    }
+
+    /**
+     *
+     */
+    concurrent_routing_table
+        ( concurrent_routing_table const& )
+        = delete;
+
+    /**
+     *
+     */
+    concurrent_routing_table &
+    operator=
+        ( concurrent_routing_table const& )
+        = delete;
+
+    /**
+     *  @see routing_table::peer_count()
+     */
+    std::size_t
+    peer_count
+        ( void )
+        const
+    {
+        std::shared_lock< mutex > lock{ mutex_ };
+        return table_.peer_count();
+    }
+
+    /**
+     *  @see routing_table::push()
+     */
+    bool
+    push
+        ( id const& peer_id
+        , peer_type const& new_peer )
+    {
+        auto const fingerprint = get_fingerprint( peer_id, new_peer );
+        if ( get_recent_peer( fingerprint ).load( std::memory_order_acquire ) == fingerprint )
+            return false;
+
+        std::lock_guard< mutex > lock{ mutex_ };
+        auto const inserted = table_.push( peer_id, new_peer );
+
+        // The peer may have replaced a stale one.
+        if ( inserted )
+            invalidate_recent_peers();
+
+        // Peers only saved into a replacement cache are pushed again.
+        if ( table_.contains( peer_id ) )
+            save_recent_peer( peer_id, new_peer );
+
+        return inserted;
+    }
+
+    /**
+     *  @see routing_table::remove()
+     */
+    bool
+    remove
+        ( id const& peer_id )
+    {
+        std::lock_guard< mutex > lock{ mutex_ };
+        invalidate_recent_peers();
+        return table_.remove( peer_id );
+    }
+
+    /**
+     *  @see routing_table::flag_peer_as_unresponsive()
+     */
+    bool
+    flag_peer_as_unresponsive
+        ( id const& peer_id )
+    {
+        std::lock_guard< mutex > lock{ mutex_ };
+        // Its next message must reset its failures count.
+        invalidate_recent_peers();
+        return table_.flag_peer_as_unresponsive( peer_id );
+    }
+
+    /**
+     *  @see routing_table::record_round_trip_time()
+     */
+    bool
+    record_round_trip_time
+        ( id const& peer_id
+        , duration const& round_trip_time )
+    {
+        std::lock_guard< mutex > lock{ mutex_ };
+        return table_.record_round_trip_time( peer_id, round_trip_time );
+    }
+
+    /**
+     *  @see routing_table::get_round_trip_time()
+     */
+    duration
+    get_round_trip_time
+        ( id const& peer_id )
+        const
+    {
+        std::shared_lock< mutex > lock{ mutex_ };
+        return table_.get_round_trip_time( peer_id );
+    }
+
+    /**
+     *  @see routing_table::get_request_timeout()
+     */
+    duration
+    get_request_timeout
+        ( id const& peer_id )
+        const
+    {
+        std::shared_lock< mutex > lock{ mutex_ };
+        return table_.get_request_timeout( peer_id );
+    }
+
+    /**
+     *  @see routing_table::get_failures_count()
+     */
+    std::size_t
+    get_failures_count
+        ( id const& peer_id )
+        const
+    {
+        std::shared_lock< mutex > lock{ mutex_ };
+        return table_.get_failures_count( peer_id );
+    }
+
+    /**
+     *  @see routing_table::closest()
+     */
+    closest_peers_type
+    closest
+        ( id const& id_to_find
+        , std::size_t max_count = table_type::DEFAULT_K_BUCKET_SIZE )
+        const
+    {
+        closest_peers_type peers;
+        peers.reserve( max_count );
+
+        std::shared_lock< mutex > lock{ mutex_ };
+        table_.copy_closest( id_to_find, max_count, peers );
+        return peers;
+    }
+
+private:
+    /// Shared by the queries.
+    using mutex = std::shared_timed_mutex;
+
+    /// Fingerprint of a peer pushed recently,
+    /// i.e. a hash of its id, endpoint and table generation.
+    using recent_peer = std::atomic< std::uint64_t >;
+
+    ///
+    enum { RECENT_PEERS_COUNT = 1024 };
+
+    ///
+    using recent_peers = std::array< recent_peer, RECENT_PEERS_COUNT >;
+
+private:
+    /**
+     *
+     */
+    std::uint64_t
+    get_fingerprint
+        ( id const& peer_id
+        , peer_type const& peer )
+        const
+    {
+        std::uint64_t hash = generation_.load( std::memory_order_acquire );
+        for ( std::size_t i = 0; i != id::WORDS_COUNT; ++ i )
+            hash = ( hash ^ peer_id.get_word( i ) ) * 0x9E3779B97F4A7C15ULL;
+
+        hash = ( hash ^ hash_value( peer ) ) * 0x9E3779B97F4A7C15ULL;
+
+        // Spread the high bits of the products to the low ones.
+        return hash ^ ( hash >> 32 );
+    }
+
+    /**
+     *
+     */
+    recent_peer &
+    get_recent_peer
+        ( std::uint64_t f )
+    { return recent_peers_[ f % RECENT_PEERS_COUNT ]; }
+
+    /**
+     *  @note The mutex must be locked exclusively.
+     */
+    void
+    save_recent_peer
+        ( id const& peer_id
+        , peer_type const& peer )
+    {
+        auto const f = get_fingerprint( peer_id, peer );
+        get_recent_peer( f ).store( f, std::memory_order_release );
+    }
+
+    /**
+     *  @brief Make the recent peers fingerprints outdated.
+     *  @note The mutex must be locked exclusively.
+     */
+    void
+    invalidate_recent_peers
+        ( void )
+    { generation_.fetch_add( 1, std::memory_order_release ); }
+
+private:
+    ///
+    mutable mutex mutex_;
+    ///
+    table_type table_;
+    /// Changed each time a peer may have been evicted or flagged.
+    std::atomic< std::uint64_t > generation_;
+    /// Lookups run concurrently with the mutex holder.
+    recent_peers recent_peers_;
+};
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
+
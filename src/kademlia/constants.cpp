@@ -32,8 +32,15 @@ std::size_t const ROUTING_TABLE_BUCKET_SIZE{ 20 };
 std::size_t const CONCURRENT_FIND_PEER_REQUESTS_COUNT{ 3 };
 std::size_t const REDUNDANT_SAVE_COUNT{ 3 };
 
+std::size_t const SUBMISSIONS_BATCH_SIZE{ 64 };
+
+std::size_t const VALUE_STORE_BYTES_BUDGET{ 64 * 1024 * 1024 };
+std::chrono::seconds const VALUE_TTL{ std::chrono::hours{ 24 } };
+
 std::chrono::milliseconds const INITIAL_CONTACT_RECEIVE_TIMEOUT{ 1000 };
 std::chrono::milliseconds const PEER_LOOKUP_TIMEOUT{ 200 };
+std::chrono::milliseconds const MIN_PEER_LOOKUP_TIMEOUT{ 20 };
+std::chrono::milliseconds const MAX_PEER_LOOKUP_TIMEOUT{ 2000 };
 
 } // namespace detail
 } // namespace kademlia
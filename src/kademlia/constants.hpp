@@ -42,10 +42,23 @@ extern std::size_t const CONCURRENT_FIND_PEER_REQUESTS_COUNT;
 // c
 extern std::size_t const REDUNDANT_SAVE_COUNT;
 
+// Saves and loads submitted by the application executed
+// before the engine handles received messages again.
+extern std::size_t const SUBMISSIONS_BATCH_SIZE;
+
+// Bytes of the values stored on behalf of the network,
+// least recently used values are evicted beyond.
+extern std::size_t const VALUE_STORE_BYTES_BUDGET;
+// Stored values expire this long after their last save.
+extern std::chrono::seconds const VALUE_TTL;
+
 //
 extern std::chrono::milliseconds const INITIAL_CONTACT_RECEIVE_TIMEOUT;
-//
+// Used until a peer responded once.
 extern std::chrono::milliseconds const PEER_LOOKUP_TIMEOUT;
+// Bounds of the timeouts computed from peers round trip times.
+extern std::chrono::milliseconds const MIN_PEER_LOOKUP_TIMEOUT;
+extern std::chrono::milliseconds const MAX_PEER_LOOKUP_TIMEOUT;
 
 } // namespace detail
 } // namespace kademlia
@@ -0,0 +1,222 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KADEMLIA_DATAGRAM_BATCH_HPP
+#define KADEMLIA_DATAGRAM_BATCH_HPP
+
+#ifdef _MSC_VER
+#   pragma once
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+
+#include <boost/version.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include <kademlia/detail/cxx11_macros.hpp>
+
+#if defined( __linux__ ) && BOOST_VERSION >= 106600
+#   include <cerrno>
+#   include <sys/socket.h>
+#   include <sys/uio.h>
+#   define KADEMLIA_HAS_DATAGRAM_BATCH
+#endif
+
+namespace kademlia {
+namespace detail {
+
+/**
+ *  @brief Move several datagrams per system call.
+ *
+ *  Only native UDP sockets on Linux (recvmmsg/sendmmsg)
+ *  support it, others handle a datagram at a time.
+ */
+template< typename UnderlyingSocketType >
+struct datagram_batch
+{
+    ///
+    static CXX11_CONSTEXPR bool SUPPORTED = false;
+
+    /// Datagrams moved at once.
+    static CXX11_CONSTEXPR std::size_t MAX_SIZE = 1;
+};
+
+template< typename UnderlyingSocketType >
+CXX11_CONSTEXPR bool datagram_batch< UnderlyingSocketType >::SUPPORTED;
+
+template< typename UnderlyingSocketType >
+CXX11_CONSTEXPR std::size_t datagram_batch< UnderlyingSocketType >::MAX_SIZE;
+
+#ifdef KADEMLIA_HAS_DATAGRAM_BATCH
+
+/**
+ *
+ */
+template<>
+struct datagram_batch< boost::asio::ip::udp::socket >
+{
+    ///
+    static CXX11_CONSTEXPR bool SUPPORTED = true;
+
+    /// Datagrams moved by a single system call.
+    static CXX11_CONSTEXPR std::size_t MAX_SIZE = 16;
+
+    ///
+    using socket_type = boost::asio::ip::udp::socket;
+
+    ///
+    using endpoint_type = socket_type::endpoint_type;
+
+    /**
+     *  @brief Receive pending datagrams without blocking.
+     *  @param buffers count contiguous buffers of buffer_size bytes.
+     *  @param sizes Set to the size of each datagram received,
+     *         0 if it didn't fit its buffer and has been truncated.
+     *  @return The count of datagrams received, 0 on failure
+     *          or if there is nothing to read.
+     */
+    static std::size_t
+    receive
+        ( socket_type & socket
+        , std::uint8_t * buffers
+        , std::size_t buffer_size
+        , endpoint_type * senders
+        , std::size_t * sizes
+        , std::size_t count
+        , std::error_code & failure )
+    {
+        ::mmsghdr headers[ MAX_SIZE ];
+        ::iovec vectors[ MAX_SIZE ];
+        count = std::min( count, MAX_SIZE );
+
+        for ( std::size_t i = 0; i != count; ++ i )
+        {
+            vectors[ i ].iov_base = buffers + i * buffer_size;
+            vectors[ i ].iov_len = buffer_size;
+
+            auto & h = headers[ i ].msg_hdr;
+            h = ::msghdr{};
+            h.msg_name = senders[ i ].data();
+            h.msg_namelen = senders[ i ].capacity();
+            h.msg_iov = &vectors[ i ];
+            h.msg_iovlen = 1;
+        }
+
+        auto const result = ::recvmmsg( socket.native_handle()
+                                      , headers, unsigned( count )
+                                      , MSG_DONTWAIT, nullptr );
+        if ( result < 0 )
+        {
+            failure = get_failure();
+            return 0;
+        }
+
+        for ( int i = 0; i != result; ++ i )
+        {
+            auto const& h = headers[ i ].msg_hdr;
+            senders[ i ].resize( h.msg_namelen );
+            sizes[ i ] = ( h.msg_flags & MSG_TRUNC ) ? 0 : headers[ i ].msg_len;
+        }
+
+        return std::size_t( result );
+    }
+
+    /**
+     *  @brief Send datagrams without blocking.
+     *  @details A datagram is made of its message
+     *           followed by its payload, if any.
+     *  @return The count of datagrams sent. When a datagram
+     *          can't be sent, the previous ones are reported
+     *          and failure is set on the next call.
+     */
+    template< typename Message >
+    static std::size_t
+    send
+        ( socket_type & socket
+        , Message const* messages
+        , std::size_t count
+        , std::error_code & failure )
+    {
+        ::mmsghdr headers[ MAX_SIZE ];
+        ::iovec vectors[ MAX_SIZE ][ 2 ];
+        count = std::min( count, MAX_SIZE );
+
+        for ( std::size_t i = 0; i != count; ++ i )
+        {
+            auto const& m = messages[ i ];
+            vectors[ i ][ 0 ].iov_base = const_cast< std::uint8_t * >( m.data() );
+            vectors[ i ][ 0 ].iov_len = m.size();
+
+            auto const& payload = m.payload();
+            if ( payload )
+            {
+                vectors[ i ][ 1 ].iov_base = const_cast< std::uint8_t * >( payload.data_ );
+                vectors[ i ][ 1 ].iov_len = payload.size_;
+            }
+
+            auto & h = headers[ i ].msg_hdr;
+            h = ::msghdr{};
+            h.msg_name = const_cast< ::sockaddr * >( m.destination().data() );
+            h.msg_namelen = m.destination().size();
+            h.msg_iov = vectors[ i ];
+            h.msg_iovlen = payload ? 2 : 1;
+        }
+
+        auto const result = ::sendmmsg( socket.native_handle()
+                                      , headers, unsigned( count )
+                                      , MSG_DONTWAIT );
+        if ( result < 0 )
+        {
+            failure = get_failure();
+            return 0;
+        }
+
+        return std::size_t( result );
+    }
+
+private:
+    ///
+    static std::error_code
+    get_failure
+        ( void )
+    {
+        // Nothing to read or no room left to write.
+        if ( errno == EAGAIN || errno == EWOULDBLOCK )
+            return std::make_error_code( std::errc::operation_would_block );
+
+        return std::error_code{ errno, std::generic_category() };
+    }
+};
+
+#endif
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
+
@@ -31,6 +31,7 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <stdexcept>
 #include <queue>
 #include <chrono>
@@ -40,8 +41,10 @@
 #include <type_traits>
 #include <functional>
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/strand.hpp>
 
 #include <kademlia/endpoint.hpp>
+#include <kademlia/session_base.hpp>
 #include "kademlia/error_impl.hpp"
 
 #include "kademlia/log.hpp"
@@ -50,21 +53,27 @@
 #include "kademlia/response_router.hpp"
 #include "kademlia/network.hpp"
 #include "kademlia/message.hpp"
-#include "kademlia/routing_table.hpp"
+#include "kademlia/concurrent_routing_table.hpp"
 #include "kademlia/value_store.hpp"
+#include "kademlia/persistent_value_store.hpp"
 #include "kademlia/find_value_task.hpp"
 #include "kademlia/store_value_task.hpp"
 #include "kademlia/discover_neighbors_task.hpp"
 #include "kademlia/notify_peer_task.hpp"
+#include "kademlia/submission_queue.hpp"
 #include "kademlia/tracker.hpp"
 
 namespace kademlia {
 namespace detail {
 
 /**
- *
+ *  @details Several threads may run the io_service. Requests
+ *           received from peers are answered by the thread which
+ *           received them, while the state of the pending requests
+ *           (tracker, tasks, timeouts) is only touched from a strand.
+ *           Timeouts and round trip times are measured with ClockType.
  */
-template< typename UnderlyingSocketType >
+template< typename UnderlyingSocketType, typename ClockType = clock >
 class engine final
 {
 public:
@@ -78,12 +87,79 @@ public:
     using endpoint_type = ip_endpoint;
 
     ///
-    using routing_table_type = routing_table< endpoint_type >;
+    using routing_table_type = concurrent_routing_table< endpoint_type >;
 
     ///
-    using value_store_type = value_store< id, data_type >;
+    using value_store_type = concurrent_value_store< id, data_type >;
+
+    /// State shared by the engines of a sharded session.
+    struct shared_state final
+    {
+        /**
+         *  @param storage_directory If not empty, values are
+         *         stored in the persistent_value_store of this
+         *         directory instead of value_store_.
+         *  @throw std::system_error if the directory can't be
+         *         used or the platform has no persistent_value_store.
+         */
+        explicit
+        shared_state
+            ( id const& my_id
+            , std::string const& storage_directory = std::string{} )
+                : my_id_( my_id )
+                , routing_table_( my_id )
+                , value_store_()
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+                , persistent_value_store_()
+#endif
+                , engines_()
+        {
+            if ( storage_directory.empty() )
+                return;
+
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+            persistent_value_store_.reset( new persistent_value_store{ storage_directory } );
+#else
+            throw std::system_error{ make_error_code( std::errc::operation_not_supported ) };
+#endif
+        }
+
+        ///
+        id const my_id_;
+        ///
+        routing_table_type routing_table_;
+        ///
+        value_store_type value_store_;
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+        /// Null unless a storage directory is used.
+        std::unique_ptr< persistent_value_store > persistent_value_store_;
+#endif
+        /// Indexed by shard, filled as engines are constructed.
+        std::vector< engine * > engines_;
+    };
+
+    ///
+    using shared_state_pointer = std::shared_ptr< shared_state >;
 
 public:
+    /**
+     *  @param new_id The engine id, a random one is drawn if null.
+     *  @param storage_directory If not empty, the values stored in this
+     *         directory by a previous engine are indexed and served.
+     */
+    static shared_state_pointer
+    create_shared_state
+        ( id const& new_id = id{}
+        , std::string const& storage_directory = std::string{} )
+    {
+        if ( new_id != id{} )
+            return std::make_shared< shared_state >( new_id, storage_directory );
+
+        random_engine_type random_engine{ std::random_device{}() };
+        return std::make_shared< shared_state >( id{ random_engine }
+                                               , storage_directory );
+    }
+
     /**
      *
      */
@@ -92,11 +168,37 @@ public:
         , endpoint const& ipv4
         , endpoint const& ipv6
         , id const& new_id = id{} )
-            : random_engine_( std::random_device{}() )
-            , my_id_( new_id == id{} ? id{ random_engine_ } : new_id )
+            : engine( io_service, ipv4, ipv6
+                    , create_shared_state( new_id ), 1 )
+    { }
+
+    /**
+     *  @brief Construct one of the shards_count engines sharing state.
+     *  @details The engines share their routing table and values,
+     *           each one owns a socket per address family bound
+     *           to the same port. As the system balances received
+     *           datagrams among these sockets, a response can be
+     *           received by another engine than the requester,
+     *           it is then posted to the requester.
+     *  @note Engines must be constructed from a single thread,
+     *        the shard index is the construction order.
+     */
+    engine
+        ( boost::asio::io_service & io_service
+        , endpoint const& ipv4
+        , endpoint const& ipv6
+        , shared_state_pointer const& state
+        , std::size_t shards_count )
+            : io_service_( io_service )
+            , strand_( io_service )
+            , random_engine_( std::random_device{}() )
+            , shared_state_( state )
+            , my_id_( state->my_id_ )
             , network_( io_service
-                      , message_socket_type::ipv4( io_service, ipv4 )
-                      , message_socket_type::ipv6( io_service, ipv6 )
+                      , message_socket_type::ipv4( io_service, ipv4
+                                                 , shards_count > 1 )
+                      , message_socket_type::ipv6( io_service, ipv6
+                                                 , shards_count > 1 )
                       , std::bind( &engine::handle_new_message
                                  , this
                                  , std::placeholders::_1
@@ -105,12 +207,23 @@ public:
             , tracker_( io_service
                       , my_id_
                       , network_
-                      , random_engine_ )
-            , routing_table_( my_id_ )
-            , value_store_()
-            , is_connected_()
+                      , random_engine_
+                      , state->engines_.size()
+                      , shards_count
+                      , &strand_ )
+            , routing_table_( state->routing_table_ )
+            , value_store_( state->value_store_ )
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+            , persistent_value_store_( state->persistent_value_store_.get() )
+#endif
+            , shard_index_( state->engines_.size() )
+            , is_connected_( false )
+            , is_latency_aware_( false )
             , pending_tasks_()
+            , submissions_()
     {
+        shared_state_->engines_.push_back( this );
+
         kademlia::detail::enable_log_for("engine");
         LOG_DEBUG(engine, this) << "peerless engine created." << std::endl;
     }
@@ -148,7 +261,107 @@ public:
         = delete;
 
     /**
-     *
+     *  @brief Ask a peer which peers are close to our id.
+     */
+    void
+    discover_neighbors
+        ( endpoint const& initial_peer )
+    {
+        // Initial peer should know our neighbors, hence ask
+        // him which peers are close to our own id.
+        auto endoints_to_query = network_.resolve_endpoint( initial_peer );
+
+        auto on_discovery = [ this ]
+            ( std::error_code const& failure )
+        {
+            if ( failure )
+                throw std::system_error{ failure };
+
+            notify_neighbors();
+        };
+
+        start_discover_neighbors_task( my_id_, tracker_, routing_table_
+                                     , std::move( endoints_to_query )
+                                     , on_discovery );
+    }
+
+    /**
+     *  @brief Handle a response received by another
+     *         engine of a sharded session.
+     *  @note Thread safe, the response is handled
+     *        by the strand of this engine.
+     */
+    void
+    post_response
+        ( ip_endpoint const& sender
+        , header const& h
+        , buffer message )
+    {
+        auto handle_response = [ this, sender, h, message ] ( void )
+        {
+            tracker_.handle_new_response( sender, h
+                                        , message.begin(), message.end() );
+            on_message_handled();
+        };
+
+        strand_.post( std::move( handle_response ) );
+    }
+
+    /**
+     *  @brief Notify the engine another engine of
+     *         a sharded session has been contacted.
+     *  @note Thread safe.
+     */
+    void
+    post_connection
+        ( void )
+    {
+        auto handle_connection = [ this ] ( void )
+        { on_connection(); };
+
+        strand_.post( handle_connection );
+    }
+
+    /**
+     *  @brief Count the values stored on behalf of the network.
+     *  @note Thread safe.
+     */
+    session_base::storage_statistics
+    get_storage_statistics
+        ( void )
+        const
+    {
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+        if ( persistent_value_store_ )
+            return persistent_value_store_->get_statistics();
+#endif
+
+        return value_store_.get_statistics();
+    }
+
+    /**
+     *  @brief Distribution of the timeouts of the
+     *         requests sent by this engine.
+     *  @note Thread safe.
+     */
+    session_base::timeout_statistics
+    get_timeout_statistics
+        ( void )
+        const
+    { return tracker_.get_timeout_statistics().get_statistics(); }
+
+    /**
+     *  @brief Prefer low latency peers among nearly
+     *         as close candidates of the next lookups.
+     *  @note Thread safe.
+     */
+    void
+    set_latency_aware_peer_selection
+        ( bool enabled )
+    { is_latency_aware_ = enabled; }
+
+    /**
+     *  @note Thread safe, the value is saved from the strand.
      */
     template< typename HandlerType >
     void
@@ -156,6 +369,82 @@ public:
         ( key_type const& key
         , data_type const& data
         , HandlerType && handler )
+    {
+        auto t = [ this, key, data, handler ] ( void ) mutable
+        { save( key, data, std::move( handler ) ); };
+
+        submit( std::move( t ) );
+    }
+
+    /**
+     *  @note Thread safe, the value is loaded from the strand.
+     */
+    template< typename HandlerType >
+    void
+    async_load
+        ( key_type const& key
+        , HandlerType && handler )
+    {
+        auto t = [ this, key, handler ] ( void ) mutable
+        { load( key, std::move( handler ) ); };
+
+        submit( std::move( t ) );
+    }
+
+private:
+    ///
+    using pending_task_type = std::function< void ( void ) >;
+
+    ///
+    using message_socket_type = message_socket< UnderlyingSocketType >;
+
+    ///
+    using network_type = network< message_socket_type >;
+
+    ///
+    using random_engine_type = std::default_random_engine;
+
+    ///
+    using tracker_type = tracker< random_engine_type, network_type, ClockType >;
+
+private:
+    /**
+     *  @brief Queue a task executed from the strand.
+     *  @details Tasks submitted meanwhile are executed
+     *           by the same handler.
+     */
+    void
+    submit
+        ( pending_task_type task )
+    {
+        if ( submissions_.push( std::move( task ) ) )
+            strand_.post( std::bind( &engine::execute_submissions, this ) );
+    }
+
+    /**
+     *
+     */
+    void
+    execute_submissions
+        ( void )
+    {
+        auto execute = [] ( pending_task_type & task )
+        { task(); };
+
+        // Leave room for the received messages.
+        if ( ! submissions_.drain( execute, SUBMISSIONS_BATCH_SIZE ) )
+            strand_.post( std::bind( &engine::execute_submissions, this ) );
+    }
+
+    /**
+     *
+     */
+    template< typename HandlerType >
+    void
+    save
+        ( key_type const& key
+        , data_type const& data
+        , HandlerType && handler )
     {
         // If the routing table is empty, save the
         // current request for processing when
@@ -166,7 +455,7 @@ public:
                     << to_string( key ) << "'." << std::endl;
 
             auto t = [ this, key, data, handler ] ( void ) mutable
-            { async_save( key, data, std::move( handler ) ); };
+            { save( key, data, std::move( handler ) ); };
 
             pending_tasks_.push( std::move( t ) );
         }
@@ -179,7 +468,8 @@ public:
                                   , data
                                   , tracker_
                                   , routing_table_
-                                  , std::forward< HandlerType >( handler ) );
+                                  , std::forward< HandlerType >( handler )
+                                  , is_latency_aware_ );
         }
     }
 
@@ -188,7 +478,7 @@ public:
      */
     template< typename HandlerType >
     void
-    async_load
+    load
         ( key_type const& key
         , HandlerType && handler )
     {
@@ -201,7 +491,7 @@ public:
                     << to_string( key ) << "'." << std::endl;
 
             auto t = [ this, key, handler ] ( void ) mutable
-            { async_load( key, std::move( handler ) ); };
+            { load( key, std::move( handler ) ); };
 
             pending_tasks_.push( std::move( t ) );
         }
@@ -213,27 +503,11 @@ public:
             start_find_value_task< data_type >( id( key )
                                               , tracker_
                                               , routing_table_
-                                              , std::forward< HandlerType >( handler ) );
+                                              , std::forward< HandlerType >( handler )
+                                              , is_latency_aware_ );
         }
     }
 
-private:
-    ///
-    using pending_task_type = std::function< void ( void ) >;
-
-    ///
-    using message_socket_type = message_socket< UnderlyingSocketType >;
-
-    ///
-    using network_type = network< message_socket_type >;
-
-    ///
-    using random_engine_type = std::default_random_engine;
-
-    ///
-    using tracker_type = tracker< random_engine_type, network_type >;
-
-private:
     /**
      *
      */
@@ -259,11 +533,37 @@ private:
                 handle_find_value_request( sender, h, i, e );
                 break;
             default:
-                tracker_.handle_new_response( sender, h, i, e );
+                handle_response( sender, h, i, e );
                 break;
         }
     }
 
+    /**
+     *
+     */
+    void
+    handle_response
+        ( ip_endpoint const& sender
+        , header const& h
+        , buffer::const_iterator i
+        , buffer::const_iterator e )
+    {
+        auto const shard_index = tracker_.get_shard_of( h );
+        if ( shard_index != shard_index_ )
+            return shared_state_->engines_[ shard_index ]->post_response( sender, h
+                                                                        , buffer( i, e ) );
+
+        // The message is copied as the reception buffer
+        // is reused once this handler returns.
+        auto handle_response = [ this, sender, h, message = buffer( i, e ) ] ( void )
+        {
+            tracker_.handle_new_response( sender, h
+                                        , message.begin(), message.end() );
+        };
+
+        strand_.dispatch( std::move( handle_response ) );
+    }
+
     /**
      *
      */
@@ -292,7 +592,9 @@ private:
         LOG_DEBUG( engine, this ) << "handling store request."
                 << std::endl;
 
-        store_value_request_body request;
+        // Values are stored as the body of their find value
+        // response, hence sent back without being serialized.
+        serialized_store_value_request_body request;
         if ( auto failure = deserialize( i, e, request ) )
         {
             LOG_DEBUG( engine, this )
@@ -302,8 +604,25 @@ private:
             return;
         }
 
-        value_store_[ request.data_key_hash_ ]
-                = std::move( request.data_value_ );
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+        if ( persistent_value_store_ )
+        {
+            try
+            {
+                persistent_value_store_->assign( request.data_key_hash_
+                                               , request.serialized_response_ );
+            }
+            catch ( std::system_error const& failure )
+            {
+                LOG_DEBUG( engine, this ) << "failed to store value ("
+                        << failure.what() << ")." << std::endl;
+            }
+            return;
+        }
+#endif
+
+        value_store_.assign( request.data_key_hash_
+                           , std::move( request.serialized_response_ ) );
     }
 
     /**
@@ -346,14 +665,13 @@ private:
     {
         // Find X closest peers and save
         // their location into the response..
-        find_peer_response_body response;
+        auto const& closest_peers = routing_table_.closest( peer_to_find_id
+                                                          , ROUTING_TABLE_BUCKET_SIZE );
 
-        auto remaining_peer = ROUTING_TABLE_BUCKET_SIZE;
-        for ( auto i = routing_table_.find( peer_to_find_id )
-                 , e = routing_table_.end()
-            ; i != e && remaining_peer > 0
-            ; ++i, -- remaining_peer )
-            response.peers_.push_back( { i->first, i->second } );
+        find_peer_response_body response;
+        response.peers_.reserve( closest_peers.size() );
+        for ( auto const& p : closest_peers )
+            response.peers_.push_back( { p.first, p.second } );
 
         // Now send the response.
         tracker_.send_response( random_token, response, sender );
@@ -382,43 +700,23 @@ private:
             return;
         }
 
-        auto found = value_store_.find( request.value_to_find_ );
-        if ( found == value_store_.end() )
+        // The stored bytes are sent without copy.
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+        auto const body = persistent_value_store_
+                ? persistent_value_store_->find_shared( request.value_to_find_ )
+                : value_store_.find_shared( request.value_to_find_ );
+#else
+        auto const body = value_store_.find_shared( request.value_to_find_ );
+#endif
+        if ( ! body )
             send_find_peer_response( sender
                                    , h.random_token_
                                    , request.value_to_find_ );
         else
-        {
-            find_value_response_body const response{ found->second };
-            tracker_.send_response( h.random_token_
-                                  , response
-                                  , sender );
-        }
-    }
-
-    /**
-     *
-     */
-    void
-    discover_neighbors
-        ( endpoint const& initial_peer )
-    {
-        // Initial peer should know our neighbors, hence ask
-        // him which peers are close to our own id.
-        auto endoints_to_query = network_.resolve_endpoint( initial_peer );
-
-        auto on_discovery = [ this ]
-            ( std::error_code const& failure )
-        {
-            if ( failure )
-                throw std::system_error{ failure };
-
-            notify_neighbors();
-        };
-
-        start_discover_neighbors_task( my_id_, tracker_, routing_table_
-                                     , std::move( endoints_to_query )
-                                     , on_discovery );
+            tracker_.send_serialized_response( h.random_token_
+                                             , header::FIND_VALUE_RESPONSE
+                                             , body
+                                             , sender );
     }
 
     /**
@@ -428,12 +726,14 @@ private:
     get_closest_neighbor_id
         ( void )
     {
-        // Find our closest neighbor.
-        auto closest_neighbor = routing_table_.find( my_id_ );
-        if ( closest_neighbor->first == my_id_ )
+        // Find our closest neighbor, we may know ourself.
+        auto const& neighbors = routing_table_.closest( my_id_, 2 );
+        auto closest_neighbor = neighbors.begin();
+        if ( closest_neighbor != neighbors.end()
+           && closest_neighbor->first == my_id_ )
             ++ closest_neighbor;
 
-        assert( closest_neighbor != routing_table_.end()
+        assert( closest_neighbor != neighbors.end()
               && "at least one peer is known" );
 
         return closest_neighbor->first;
@@ -447,11 +747,11 @@ private:
         ( void )
     {
         auto closest_neighbor_id = get_closest_neighbor_id();
-        auto i = id::BIT_SIZE - 1;
 
-        // Skip empty buckets.
-        while ( i && closest_neighbor_id[ i ] == my_id_[ i ] )
-            -- i;
+        // Skip empty buckets, i.e. start from the
+        // bucket of our closest neighbor.
+        auto i = std::min( common_prefix_length( closest_neighbor_id, my_id_ )
+                         , id::BIT_SIZE - 1 );
 
         // Send refresh from closest neighbor bucket to farest bucket.
         auto refresh_id = my_id_;
@@ -490,13 +790,44 @@ private:
 
         process_new_message( sender, h, i, e );
 
+        on_message_handled();
+    }
+
+    /**
+     *
+     */
+    void
+    on_message_handled
+        ( void )
+    {
         // A message has been received, hence the connection
         // is up. Check if it was down before.
-        if ( ! is_connected_ )
-        {
-            is_connected_ = true;
-            execute_pending_tasks();
-        }
+        if ( is_connected_ )
+            return;
+
+        auto handle_connection = [ this ] ( void )
+        { on_connection(); };
+
+        strand_.dispatch( handle_connection );
+    }
+
+    /**
+     *  @note Called from the strand.
+     */
+    void
+    on_connection
+        ( void )
+    {
+        if ( is_connected_ )
+            return;
+
+        is_connected_ = true;
+        execute_pending_tasks();
+
+        // The routing table is shared, hence so is the connection.
+        for ( auto e : shared_state_->engines_ )
+            if ( e != this )
+                e->post_connection();
     }
 
     /**
@@ -519,22 +850,38 @@ private:
     }
 
 private:
+    ///
+    boost::asio::io_service & io_service_;
+    /// Serializes the handlers touching the pending requests.
+    boost::asio::io_service::strand strand_;
     ///
     random_engine_type random_engine_;
     ///
+    shared_state_pointer shared_state_;
+    ///
     id my_id_;
     ///
     network_type network_;
     ///
     tracker_type tracker_;
     ///
-    routing_table_type routing_table_;
+    routing_table_type & routing_table_;
+    ///
+    value_store_type & value_store_;
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+    /// Null unless the shared state has one.
+    persistent_value_store * persistent_value_store_;
+#endif
     ///
-    value_store_type value_store_;
+    std::size_t shard_index_;
+    /// Read by the threads receiving messages.
+    std::atomic< bool > is_connected_;
     ///
-    bool is_connected_;
+    std::atomic< bool > is_latency_aware_;
     ///
     std::queue< pending_task_type > pending_tasks_;
+    /// Saves and loads submitted from any thread.
+    submission_queue< pending_task_type > submissions_;
 };
 
 } // namespace detail
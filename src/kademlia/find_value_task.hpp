@@ -31,6 +31,7 @@
 #endif
 
 #include <system_error>
+#include <chrono>
 #include <memory>
 #include <type_traits>
 
@@ -82,7 +83,10 @@ namespace detail {
  *  }
  *  @enddot
  */
-template< typename LoadHandlerType, typename TrackerType, typename DataType >
+template< typename LoadHandlerType
+        , typename TrackerType
+        , typename DataType
+        , typename RoutingTableType >
 class find_value_task final
     : public lookup_task
 {
@@ -93,26 +97,34 @@ public:
     ///
     using tracker_type = TrackerType;
 
+    ///
+    using clock = typename tracker_type::clock_type;
+
     ///
     using data_type = DataType;
 
+    ///
+    using routing_table_type = RoutingTableType;
+
 public:
     /**
-     *
+     *  @param is_latency_aware If true, low latency peers are
+     *         preferred among nearly as close candidates.
      */
-    template< typename RoutingTableType >
     static void
     start
         ( detail::id const & key
         , tracker_type & tracker
-        , RoutingTableType & routing_table
-        , load_handler_type handler )
+        , routing_table_type & routing_table
+        , load_handler_type handler
+        , bool is_latency_aware )
     {
         std::shared_ptr< find_value_task > t;
         t.reset( new find_value_task( key
                                     , tracker
                                     , routing_table
-                                    , std::move( handler ) ) );
+                                    , std::move( handler )
+                                    , is_latency_aware ) );
 
         try_candidates( t );
     }
@@ -121,18 +133,20 @@ private:
     /**
      *
      */
-    template< typename RoutingTableType >
     find_value_task
         ( id const & searched_key
         , tracker_type & tracker
-        , RoutingTableType & routing_table
-        , load_handler_type load_handler )
+        , routing_table_type & routing_table
+        , load_handler_type load_handler
+        , bool is_latency_aware )
             : lookup_task( searched_key
-                         , routing_table.find( searched_key )
-                         , routing_table.end() )
+                         , routing_table.closest( searched_key
+                                                , ROUTING_TABLE_BUCKET_SIZE ) )
             , tracker_( tracker )
+            , routing_table_( routing_table )
             , load_handler_( std::move( load_handler ) )
             , is_finished_()
+            , is_latency_aware_( is_latency_aware )
     {
         LOG_DEBUG( find_value_task, this )
                 << "create find value task for '"
@@ -180,8 +194,10 @@ private:
         ( std::shared_ptr< find_value_task > task
         , std::size_t concurrent_requests_count = CONCURRENT_FIND_PEER_REQUESTS_COUNT )
     {
-        auto const closest_candidates = task->select_new_closest_candidates
-                ( concurrent_requests_count );
+        auto const closest_candidates = task->is_latency_aware_
+                ? task->select_new_closest_candidates( concurrent_requests_count
+                                                     , task->routing_table_ )
+                : task->select_new_closest_candidates( concurrent_requests_count );
 
         find_value_request_body const request{ task->get_key() };
         for ( auto const& c : closest_candidates )
@@ -204,13 +220,18 @@ private:
                 << "' value request to '"
                 << current_candidate << "'." << std::endl;
 
+        auto const sent_at = clock::now();
+
         // On message received, process it.
-        auto on_message_received = [ task, current_candidate ]
+        auto on_message_received = [ task, current_candidate, sent_at ]
             ( ip_endpoint const& s
             , header const& h
             , buffer::const_iterator i
             , buffer::const_iterator e )
         {
+            task->routing_table_.record_round_trip_time( current_candidate.id_
+                    , clock::now() - sent_at );
+
             if ( task->is_caller_notified() )
                 return;
 
@@ -225,14 +246,14 @@ private:
             if ( task->is_caller_notified() )
                 return;
 
-            // XXX: Current current_candidate must be flagged as stale.
             task->flag_candidate_as_invalid( current_candidate.id_ );
+            task->routing_table_.flag_peer_as_unresponsive( current_candidate.id_ );
             try_candidates( task );
         };
 
         task->tracker_.send_request( request
                                    , current_candidate.endpoint_
-                                   , PEER_LOOKUP_TIMEOUT
+                                   , task->routing_table_.get_request_timeout( current_candidate.id_ )
                                    , on_message_received
                                    , on_error );
     }
@@ -326,13 +347,18 @@ private:
     ///
     tracker_type & tracker_;
     ///
+    routing_table_type & routing_table_;
+    ///
     load_handler_type load_handler_;
     ///
     bool is_finished_;
+    ///
+    bool is_latency_aware_;
 };
 
 /**
- *
+ *  @param is_latency_aware If true, low latency peers are
+ *         preferred among nearly as close candidates.
  */
 template< typename DataType
         , typename TrackerType
@@ -343,13 +369,18 @@ start_find_value_task
     ( id const& key
     , TrackerType & tracker
     , RoutingTableType & routing_table
-    , HandlerType && handler )
+    , HandlerType && handler
+    , bool is_latency_aware = false )
 {
     using handler_type = typename std::decay< HandlerType >::type;
-    using task = find_value_task< handler_type, TrackerType, DataType >;
+    using task = find_value_task< handler_type
+                                , TrackerType
+                                , DataType
+                                , RoutingTableType >;
 
     task::start( key, tracker, routing_table
-               , std::forward< HandlerType >( handler ) );
+               , std::forward< HandlerType >( handler )
+               , is_latency_aware );
 }
 
 } // namespace detail
@@ -65,5 +65,11 @@ first_session::abort
         ( void )
 { impl_->abort(); }
 
+session_base::storage_statistics
+first_session::get_storage_statistics
+        ( void )
+        const
+{ return impl_->getStorageStatistics(); }
+
 } // namespace kademlia
 
@@ -42,6 +42,14 @@
 namespace kademlia {
 namespace detail {
 
+CXX11_CONSTEXPR std::size_t id::BIT_SIZE;
+CXX11_CONSTEXPR std::size_t id::BYTE_PER_BLOCK;
+CXX11_CONSTEXPR std::size_t id::BIT_PER_BLOCK;
+CXX11_CONSTEXPR std::size_t id::BLOCKS_COUNT;
+CXX11_CONSTEXPR std::size_t id::BLOCK_PER_WORD;
+CXX11_CONSTEXPR std::size_t id::BIT_PER_WORD;
+CXX11_CONSTEXPR std::size_t id::WORDS_COUNT;
+
 static CXX11_CONSTEXPR std::size_t HEX_CHAR_PER_BLOCK = id::BYTE_PER_BLOCK * 2;
 
 namespace {
@@ -41,9 +41,62 @@
 
 #include <kademlia/detail/cxx11_macros.hpp>
 
+#include <cstring>
+
+#ifdef _MSC_VER
+#   include <intrin.h>
+#   include <stdlib.h>
+#endif
+
 namespace kademlia {
 namespace detail {
 
+/**
+ *  @brief Count the leading zero bits of a non null word.
+ */
+inline std::size_t
+count_leading_zeros
+    ( std::uint64_t value )
+{
+#if defined( __GNUC__ ) || defined( __clang__ )
+    return __builtin_clzll( value );
+#elif defined( _MSC_VER ) && defined( _M_X64 )
+    unsigned long index;
+    _BitScanReverse64( &index, value );
+    return 63 - index;
+#else
+    std::size_t count = 0;
+    for ( std::uint64_t mask = 1ULL << 63; ! ( value & mask ); mask >>= 1 )
+        ++ count;
+    return count;
+#endif
+}
+
+/**
+ *  @brief Convert a word between host and big endian byte order.
+ */
+inline std::uint64_t
+swap_to_big_endian
+    ( std::uint64_t value )
+{
+#if defined( __GNUC__ ) || defined( __clang__ )
+#   if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64( value );
+#   else
+    return value;
+#   endif
+#elif defined( _MSC_VER )
+    return _byteswap_uint64( value );
+#else
+    std::uint8_t bytes[ sizeof( value ) ];
+    for ( std::size_t i = sizeof( value ); i != 0; -- i, value >>= 8 )
+        bytes[ i - 1 ] = std::uint8_t( value );
+
+    std::memcpy( &value, bytes, sizeof( value ) );
+    return value;
+#endif
+}
+
 ///
 class id final
 {
@@ -69,6 +122,18 @@ public:
     ///
     using value_to_hash_type = std::vector< std::uint8_t >;
 
+    /// Blocks are grouped into words for bulk computations.
+    using word_type = std::uint64_t;
+
+    ///
+    static CXX11_CONSTEXPR std::size_t BLOCK_PER_WORD = sizeof( word_type ) / BYTE_PER_BLOCK;
+
+    ///
+    static CXX11_CONSTEXPR std::size_t BIT_PER_WORD = BLOCK_PER_WORD * BIT_PER_BLOCK;
+
+    ///
+    static CXX11_CONSTEXPR std::size_t WORDS_COUNT = ( BLOCKS_COUNT + BLOCK_PER_WORD - 1 ) / BLOCK_PER_WORD;
+
     /**
      *
      */
@@ -222,7 +287,72 @@ public:
         ( std::size_t index )
     { return reference{ get_block( index ), get_mask( index ) }; }
 
+    /**
+     *  @brief Return a word of the id.
+     *  @param index The index of the word (from 0 to WORDS_COUNT - 1).
+     *  @note Index 0 is the msb word, the last word is
+     *        padded with 0 on its lsb side.
+     */
+    word_type
+    get_word
+        ( std::size_t index )
+        const
+    {
+        auto const first = index * BLOCK_PER_WORD;
+        auto const count = get_word_blocks_count( first );
+
+        word_type value = 0;
+        if ( count == BLOCK_PER_WORD )
+        {
+            std::memcpy( &value, &blocks_[ first ], sizeof( value ) );
+            return swap_to_big_endian( value );
+        }
+
+        for ( std::size_t i = 0; i != count; ++ i )
+            value = value << BIT_PER_BLOCK | blocks_[ first + i ];
+
+        return value << ( BLOCK_PER_WORD - count ) * BIT_PER_BLOCK;
+    }
+
+    /**
+     *  @brief Assign a word of the id.
+     *  @param index The index of the word (from 0 to WORDS_COUNT - 1).
+     *  @param value The new value, padding bits are ignored.
+     */
+    void
+    set_word
+        ( std::size_t index
+        , word_type value )
+    {
+        auto const first = index * BLOCK_PER_WORD;
+        auto const count = get_word_blocks_count( first );
+
+        if ( count == BLOCK_PER_WORD )
+        {
+            value = swap_to_big_endian( value );
+            std::memcpy( &blocks_[ first ], &value, sizeof( value ) );
+            return;
+        }
+
+        for ( std::size_t i = 0; i != count; ++ i )
+        {
+            blocks_[ first + i ] = block_type( value >> ( BIT_PER_WORD - BIT_PER_BLOCK ) );
+            value <<= BIT_PER_BLOCK;
+        }
+    }
+
 private:
+    /**
+     *
+     */
+    static std::size_t
+    get_word_blocks_count
+        ( std::size_t first_block )
+    {
+        auto const remaining = BLOCKS_COUNT - first_block;
+        return remaining < BLOCK_PER_WORD ? remaining : BLOCK_PER_WORD;
+    }
+
     /**
      *
      */
@@ -253,6 +383,45 @@ private:
     blocks_type blocks_;
 };
 
+/**
+ *  @brief Compare two ids as big numbers.
+ *  @return A negative value if a < b, 0 if a == b
+ *          and a positive value otherwise.
+ */
+inline int
+compare
+    ( id const& a
+    , id const& b )
+{
+    for ( std::size_t i = 0; i != id::WORDS_COUNT; ++ i )
+    {
+        auto const word_a = a.get_word( i ), word_b = b.get_word( i );
+        if ( word_a != word_b )
+            return word_a < word_b ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/**
+ *  @brief Count the leading bits shared by two ids.
+ *  @return id::BIT_SIZE if both ids are equal.
+ */
+inline std::size_t
+common_prefix_length
+    ( id const& a
+    , id const& b )
+{
+    for ( std::size_t i = 0; i != id::WORDS_COUNT; ++ i )
+    {
+        auto const difference = a.get_word( i ) ^ b.get_word( i );
+        if ( difference )
+            return i * id::BIT_PER_WORD + count_leading_zeros( difference );
+    }
+
+    return id::BIT_SIZE;
+}
+
 /**
  *
  */
@@ -260,10 +429,7 @@ inline bool
 operator<
     ( id const& a
     , id const& b )
-{
-    return std::lexicographical_compare( a.begin(), a.end()
-                                       , b.begin(), b.end() );
-}
+{ return compare( a, b ) < 0; }
 
 /**
  *
@@ -283,9 +449,27 @@ distance
 {
     id result;
 
-    std::transform( a.begin(), a.end(), b.begin()
-                  , result.begin()
-                  , std::bit_xor< id::block_type >{} );
+    for ( std::size_t i = 0; i != id::WORDS_COUNT; ++ i )
+        result.set_word( i, a.get_word( i ) ^ b.get_word( i ) );
+
+    return result;
+}
+
+/**
+ *  @brief Generate a random id one word at a time.
+ *  @note Cheaper than id( random_engine ) which draws each
+ *        block on its own, hence used for request tokens.
+ */
+template< typename RandomEngineType >
+id
+generate_token
+    ( RandomEngineType & random_engine )
+{
+    std::uniform_int_distribution< id::word_type > distribution;
+
+    id result;
+    for ( std::size_t i = 0; i != id::WORDS_COUNT; ++ i )
+        result.set_word( i, distribution( random_engine ) );
 
     return result;
 }
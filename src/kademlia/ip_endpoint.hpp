@@ -32,6 +32,7 @@
 
 #include <iosfwd>
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <boost/asio/ip/address.hpp>
@@ -84,6 +85,23 @@ operator!=
     , ip_endpoint const& b )
 { return ! ( a == b ); }
 
+/**
+ *
+ */
+inline std::size_t
+hash_value
+    ( ip_endpoint const& e )
+{
+    std::uint64_t hash = e.port_;
+    if ( e.address_.is_v4() )
+        hash ^= std::uint64_t( e.address_.to_v4().to_ulong() ) << 16;
+    else
+        for ( auto const b : e.address_.to_v6().to_bytes() )
+            hash = ( hash * 0x100000001B3ULL ) ^ b;
+
+    return std::size_t( hash );
+}
+
 
 } // namespace detail
 } // namespace kademlia
@@ -25,61 +25,288 @@
 
 #include "kademlia/log.hpp"
 
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
-#include <set>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <kademlia/detail/cxx11_macros.hpp>
+
+#include "kademlia/ring_buffer.hpp"
 
 namespace kademlia {
 namespace detail {
 
+std::atomic< std::uint64_t > enabled_log_modules{ 0 };
+
 namespace {
 
-using enabled_modules_log_type = std::set< std::string >;
+/// Records waiting for the writer, further ones are dropped.
+CXX11_CONSTEXPR std::size_t LOG_BUFFER_CAPACITY = 4096;
+
+/// Bit shared by "*".
+CXX11_CONSTEXPR std::uint64_t ALL_MODULES_MASK = std::uint64_t( 1 ) << 63;
+
+/// Bit shared by modules registered once the others are exhausted.
+CXX11_CONSTEXPR std::uint64_t OVERFLOW_MODULES_MASK = std::uint64_t( 1 ) << 62;
+
+/**
+ *  @brief Drain submitted records to std::cout from its own thread.
+ */
+class log_writer final
+{
+public:
+    /**
+     *
+     */
+    log_writer
+        ( void )
+            : records_( LOG_BUFFER_CAPACITY )
+            , submitted_count_{ 0 }
+            , written_count_{ 0 }
+            , dropped_count_{ 0 }
+            , stopped_{ false }
+            , mutex_()
+            , condition_()
+            , thread_( [ this ] { run(); } )
+    { }
+
+    /**
+     *
+     */
+    ~log_writer
+        ( void )
+    {
+        stopped_.store( true );
+        condition_.notify_one();
+        thread_.join();
+    }
+
+    /**
+     *
+     */
+    void
+    submit
+        ( std::string record )
+    {
+        if ( ! records_.try_push( std::move( record ) ) )
+        {
+            dropped_count_.fetch_add( 1, std::memory_order_relaxed );
+            return;
+        }
+
+        submitted_count_.fetch_add( 1, std::memory_order_release );
+        condition_.notify_one();
+    }
+
+    /**
+     *
+     */
+    void
+    flush
+        ( void )
+    {
+        auto const submitted_count = submitted_count_.load( std::memory_order_acquire );
+
+        condition_.notify_one();
+        while ( written_count_.load( std::memory_order_acquire ) < submitted_count )
+            std::this_thread::yield();
+    }
+
+private:
+    ///
+    void
+    run
+        ( void )
+    {
+        std::string record;
+
+        for ( ;; )
+        {
+            std::uint64_t count = 0;
+            for ( ; records_.try_pop( record ); ++ count )
+            {
+                std::cout << record;
+                if ( record.empty() || record.back() != '\n' )
+                    std::cout << '\n';
+            }
 
-enabled_modules_log_type &
-get_enabled_modules
+            if ( auto const dropped_count = dropped_count_.exchange( 0 ) )
+                std::cout << "[log] " << dropped_count << " records dropped\n";
+
+            if ( count )
+            {
+                std::cout.flush();
+                written_count_.fetch_add( count, std::memory_order_release );
+                continue;
+            }
+
+            if ( stopped_.load() )
+                break;
+
+            // Producers don't take the mutex, hence a notification
+            // can be missed, the timeout bounds the resulting delay.
+            std::unique_lock< std::mutex > lock{ mutex_ };
+            condition_.wait_for( lock, std::chrono::milliseconds{ 10 }
+                               , [ this ] { return has_pending_records() || stopped_.load(); } );
+        }
+    }
+
+    ///
+    bool
+    has_pending_records
+        ( void )
+        const
+    {
+        return written_count_.load( std::memory_order_relaxed )
+                != submitted_count_.load( std::memory_order_relaxed );
+    }
+
+private:
+    ///
+    ring_buffer< std::string > records_;
+    ///
+    std::atomic< std::uint64_t > submitted_count_;
+    ///
+    std::atomic< std::uint64_t > written_count_;
+    ///
+    std::atomic< std::uint64_t > dropped_count_;
+    ///
+    std::atomic< bool > stopped_;
+    ///
+    std::mutex mutex_;
+    ///
+    std::condition_variable condition_;
+    ///
+    std::thread thread_;
+};
+
+log_writer &
+get_log_writer
+    ( void )
+{
+    static log_writer writer_;
+    return writer_;
+}
+
+/// Protect the module names registration.
+struct log_modules
+{
+    ///
+    std::mutex mutex_;
+    ///
+    std::map< std::string, std::uint64_t > masks_;
+};
+
+log_modules &
+get_log_modules
     ( void )
 {
-    static enabled_modules_log_type enabled_modules_;
-    return enabled_modules_;
+    static log_modules modules_;
+    return modules_;
+}
+
+std::uint64_t
+register_log_module
+    ( log_modules & modules
+    , std::string const& module )
+{
+    if ( module == "*" )
+        return ALL_MODULES_MASK;
+
+    auto i = modules.masks_.find( module );
+    if ( i != modules.masks_.end() )
+        return i->second;
+
+    auto const index = modules.masks_.size();
+    auto const mask = index < 62 ? std::uint64_t( 1 ) << index
+                                 : OVERFLOW_MODULES_MASK;
+
+    modules.masks_.emplace( module, mask );
+    return mask;
 }
 
 } // anonymous namespace
 
-std::ostream &
-get_debug_log
-    ( char const * module
+log_record::log_record
+    ( char const * level
+    , char const * module
     , void const * thiz )
+        : stream_()
+        , submitted_( true )
 {
-    return std::cout << "[debug] (" << module << " @ "
-                     << std::hex << ( std::uintptr_t( thiz ) & 0xffffff )
-                     << std::dec << ") ";
+    stream_ << '[' << level << "] (" << module << " @ "
+            << std::hex << ( std::uintptr_t( thiz ) & 0xffffff )
+            << std::dec << ") ";
 }
 
-/**
- *
- */
+log_record::log_record
+    ( log_record && o )
+        : stream_( std::move( o.stream_ ) )
+        , submitted_( o.submitted_ )
+{ o.submitted_ = false; }
+
+log_record::~log_record
+    ( void )
+{
+    if ( submitted_ )
+        get_log_writer().submit( stream_.str() );
+}
+
+log_record
+get_log
+    ( char const * level
+    , char const * module
+    , void const * thiz )
+{ return log_record{ level, module, thiz }; }
+
+log_record
+get_debug_log
+    ( char const * module
+    , void const * thiz )
+{ return get_log( "debug", module, thiz ); }
+
+void
+flush_log
+    ( void )
+{ get_log_writer().flush(); }
+
 void
 enable_log_for
     ( std::string const& module )
-{ get_enabled_modules().insert( module ); }
+{
+    auto & modules = get_log_modules();
+    std::lock_guard< std::mutex > const lock{ modules.mutex_ };
+    enabled_log_modules.fetch_or( register_log_module( modules, module ) );
+}
 
-/**
- *
- */
 void
 disable_log_for
     ( std::string const& module )
-{ get_enabled_modules().erase( module ); }
+{
+    auto & modules = get_log_modules();
+    std::lock_guard< std::mutex > const lock{ modules.mutex_ };
+    enabled_log_modules.fetch_and( ~ register_log_module( modules, module ) );
+}
 
-/**
- *
- */
 bool
 is_log_enabled
     ( std::string const& module )
 {
-    return get_enabled_modules().count( "*" ) > 0
-            || get_enabled_modules().count( module ) > 0;
+    auto & modules = get_log_modules();
+    std::lock_guard< std::mutex > const lock{ modules.mutex_ };
+    return is_log_module_enabled( register_log_module( modules, module ) );
+}
+
+std::uint64_t
+get_log_module_mask
+    ( char const * module )
+{
+    auto & modules = get_log_modules();
+    std::lock_guard< std::mutex > const lock{ modules.mutex_ };
+    return register_log_module( modules, module );
 }
 
 } // namespace detail
@@ -30,23 +30,115 @@
 #   pragma once
 #endif
 
+#include <atomic>
 #include <cstdio>
 #include <cctype>
 #include <cstdint>
+#include <ostream>
 #include <string>
 #include <sstream>
 
+/// Records below KADEMLIA_LOG_LEVEL are removed at compile time.
+#define KADEMLIA_LOG_LEVEL_DEBUG 0
+#define KADEMLIA_LOG_LEVEL_INFO 1
+#define KADEMLIA_LOG_LEVEL_WARNING 2
+#define KADEMLIA_LOG_LEVEL_ERROR 3
+
+#ifndef KADEMLIA_LOG_LEVEL
+#   ifdef KADEMLIA_ENABLE_DEBUG
+#       define KADEMLIA_LOG_LEVEL KADEMLIA_LOG_LEVEL_DEBUG
+#   else
+#       define KADEMLIA_LOG_LEVEL KADEMLIA_LOG_LEVEL_INFO
+#   endif
+#endif
+
 namespace kademlia {
 namespace detail {
 
 /**
+ *  @brief A log line being formatted.
  *
+ *  The line is handed to the background writer
+ *  once the record is destroyed, i.e. at the end
+ *  of the LOG_* statement.
  */
-std::ostream &
+class log_record final
+{
+public:
+    /**
+     *
+     */
+    log_record
+        ( char const * level
+        , char const * module
+        , void const * thiz );
+
+    /**
+     *
+     */
+    log_record
+        ( log_record && o );
+
+    /**
+     *
+     */
+    ~log_record
+        ( void );
+
+    /**
+     *
+     */
+    template< typename Value >
+    log_record &
+    operator<<
+        ( Value const& value )
+    {
+        stream_ << value;
+        return *this;
+    }
+
+    /**
+     *  @brief Support std::endl and friends.
+     */
+    log_record &
+    operator<<
+        ( std::ostream & ( * manipulator )( std::ostream & ) )
+    {
+        manipulator( stream_ );
+        return *this;
+    }
+
+private:
+    ///
+    std::ostringstream stream_;
+    ///
+    bool submitted_;
+};
+
+/**
+ *
+ */
+log_record
+get_log
+    ( char const * level
+    , char const * module
+    , void const * thiz );
+
+/**
+ *
+ */
+log_record
 get_debug_log
     ( char const * module
     , void const * thiz );
 
+/**
+ *  @brief Block until every submitted record has been written.
+ */
+void
+flush_log
+    ( void );
+
 /**
  *
  */
@@ -61,7 +153,6 @@ void
 disable_log_for
     ( std::string const& module );
 
-
 /**
  *
  */
@@ -69,6 +160,29 @@ bool
 is_log_enabled
     ( std::string const& module );
 
+/**
+ *  @brief Return the bit associated with a module,
+ *         registering the module if needed.
+ */
+std::uint64_t
+get_log_module_mask
+    ( char const * module );
+
+/// Bits of the enabled modules, the msb stands for "*".
+extern std::atomic< std::uint64_t > enabled_log_modules;
+
+/**
+ *
+ */
+inline bool
+is_log_module_enabled
+    ( std::uint64_t module_mask )
+{
+    auto const ALL_MODULES_MASK = std::uint64_t( 1 ) << 63;
+    return ( enabled_log_modules.load( std::memory_order_relaxed )
+           & ( module_mask | ALL_MODULES_MASK ) ) != 0;
+}
+
 /**
  *  This macro deserves some explanation.
  *  The goal here is to provide a macro that can be called like:
@@ -76,20 +190,45 @@ is_log_enabled
  *  Depending on 'my_module' string, the code may or may not be executed.
  *  To achieve this, the call to an actual stream is made inside
  *  a for loop whose condition checks if the module associated with
- *  my_module is enabled. Because the call to is_log_enabled()
- *  can be costly, its result is cached in a static variable.
+ *  my_module is enabled. The module name is resolved once into a
+ *  bit cached in a static variable, hence the check is a single
+ *  atomic load and modules can be enabled at any time.
  */
-#define KADEMLIA_ENABLE_DEBUG 1
-#ifdef KADEMLIA_ENABLE_DEBUG
-#   define LOG_DEBUG( module, thiz )                                           \
+#define KADEMLIA_LOG( level, module, thiz )                                    \
     for ( bool used = false; ! used; used = true )                             \
-        for ( static bool enabled = kademlia::detail::is_log_enabled( #module )\
-            ; enabled && ! used; used = true )                                 \
-            kademlia::detail::get_debug_log( #module, thiz )
-#else
-#   define LOG_DEBUG( module, thiz )                                           \
+        for ( static auto const log_module_mask                                \
+                = kademlia::detail::get_log_module_mask( #module )             \
+            ; ! used && kademlia::detail::is_log_module_enabled( log_module_mask ) \
+            ; used = true )                                                    \
+            kademlia::detail::get_log( level, #module, thiz )
+
+/// Type checked yet never executed.
+#define KADEMLIA_NO_LOG( module, thiz )                                        \
     while ( false )                                                            \
-        kademlia::detail::get_debug_log( #module, thiz )
+        kademlia::detail::get_log( "", #module, thiz )
+
+#if KADEMLIA_LOG_LEVEL <= KADEMLIA_LOG_LEVEL_DEBUG
+#   define LOG_DEBUG( module, thiz ) KADEMLIA_LOG( "debug", module, thiz )
+#else
+#   define LOG_DEBUG( module, thiz ) KADEMLIA_NO_LOG( module, thiz )
+#endif
+
+#if KADEMLIA_LOG_LEVEL <= KADEMLIA_LOG_LEVEL_INFO
+#   define LOG_INFO( module, thiz ) KADEMLIA_LOG( "info", module, thiz )
+#else
+#   define LOG_INFO( module, thiz ) KADEMLIA_NO_LOG( module, thiz )
+#endif
+
+#if KADEMLIA_LOG_LEVEL <= KADEMLIA_LOG_LEVEL_WARNING
+#   define LOG_WARNING( module, thiz ) KADEMLIA_LOG( "warning", module, thiz )
+#else
+#   define LOG_WARNING( module, thiz ) KADEMLIA_NO_LOG( module, thiz )
+#endif
+
+#if KADEMLIA_LOG_LEVEL <= KADEMLIA_LOG_LEVEL_ERROR
+#   define LOG_ERROR( module, thiz ) KADEMLIA_LOG( "error", module, thiz )
+#else
+#   define LOG_ERROR( module, thiz ) KADEMLIA_NO_LOG( module, thiz )
 #endif
 
 /**
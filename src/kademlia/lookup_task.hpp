@@ -30,6 +30,7 @@
 #   pragma once
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <map>
 #include <vector>
@@ -65,6 +66,26 @@ public:
     select_new_closest_candidates
         ( std::size_t max_count );
 
+    /**
+     *  @brief Select new candidates, preferring low latency
+     *         peers among nearly as close ones.
+     *  @details Candidates whose distance to the key has the same
+     *           highest bit are considered as close as each other
+     *           (i.e. they would share a k_bucket of the key's routing
+     *           table) and are picked by increasing round trip time,
+     *           in the spirit of proximity neighbor selection.
+     *           Peers without a known round trip time come last.
+     *
+     *  @param round_trip_times Provides a
+     *         get_round_trip_time( id ) method
+     *         returning zero for unknown peers.
+     */
+    template< typename RoundTripTimes >
+    std::vector< peer >
+    select_new_closest_candidates
+        ( std::size_t max_count
+        , RoundTripTimes const& round_trip_times );
+
     /**
      *
      */
@@ -111,6 +132,14 @@ protected:
         ( id const & key
         , Iterator i, Iterator e );
 
+    /**
+     *
+     */
+    template< typename Peers >
+    lookup_task
+        ( id const & key
+        , Peers const& initial_peers );
+
 private:
     ///
     struct candidate final
@@ -169,6 +198,14 @@ lookup_task::lookup_task
         add_candidate( peer{ i->first, i->second } );
 }
 
+template< typename Peers >
+inline
+lookup_task::lookup_task
+    ( id const & key
+    , Peers const& initial_peers )
+        : lookup_task( key, initial_peers.begin(), initial_peers.end() )
+{ }
+
 inline void
 lookup_task::flag_candidate_as_valid
     ( id const& candidate_id )
@@ -216,6 +253,58 @@ lookup_task::select_new_closest_candidates
     return candidates;
 }
 
+template< typename RoundTripTimes >
+inline std::vector< peer >
+lookup_task::select_new_closest_candidates
+    ( std::size_t max_count
+    , RoundTripTimes const& round_trip_times )
+{
+    using round_trip_time = decltype( round_trip_times.get_round_trip_time( key_ ) );
+    using near_candidate = std::pair< round_trip_time, candidate * >;
+
+    auto const get_log_distance = [] ( id const& d )
+    { return common_prefix_length( d, id{} ); };
+
+    std::vector< peer > candidates;
+    std::vector< near_candidate > near_candidates;
+
+    for ( auto i = candidates_.begin(), e = candidates_.end()
+        ; i != e && in_flight_requests_count_ < max_count
+        ; )
+    {
+        // Gather not-contacted candidates as close as the current one.
+        auto const log_distance = get_log_distance( i->first );
+        near_candidates.clear();
+        for ( ; i != e && get_log_distance( i->first ) == log_distance; ++ i )
+        {
+            if ( i->second.state_ != candidate::STATE_UNKNOWN )
+                continue;
+
+            auto t = round_trip_times.get_round_trip_time( i->second.peer_.id_ );
+            if ( t == round_trip_time::zero() )
+                t = round_trip_time::max();
+            near_candidates.emplace_back( t, &i->second );
+        }
+
+        // Candidates are already ordered by distance, keep this
+        // order among peers with the same round trip time.
+        std::stable_sort( near_candidates.begin(), near_candidates.end()
+                        , [] ( near_candidate const& a, near_candidate const& b )
+                          { return a.first < b.first; } );
+
+        for ( auto j = near_candidates.begin(), f = near_candidates.end()
+            ; j != f && in_flight_requests_count_ < max_count
+            ; ++ j )
+        {
+            j->second->state_ = candidate::STATE_CONTACTED;
+            ++ in_flight_requests_count_;
+            candidates.push_back( j->second->peer_ );
+        }
+    }
+
+    return candidates;
+}
+
 inline std::vector< peer >
 lookup_task::select_closest_valid_candidates
     ( std::size_t max_count )
@@ -25,6 +25,8 @@
 
 #include "kademlia/message.hpp"
 
+#include <cassert>
+#include <cstring>
 #include <iostream>
 
 #include "kademlia/error_impl.hpp"
@@ -34,12 +36,20 @@ namespace detail {
 
 namespace {
 
+/**
+ *  @brief Write value in little endian at o and move o past it.
+ */
 template< typename IntegerType >
 inline void
 serialize_integer
     ( IntegerType value
-    , buffer & b )
+    , std::uint8_t *& o )
 {
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // The host order is the wire order.
+    std::memcpy( o, &value, sizeof( value ) );
+    o += sizeof( value );
+#else
     // Cast the integer as unsigned because
     // right shifting signed is UB.
     using unsigned_integer_type
@@ -47,9 +57,10 @@ serialize_integer
 
     for ( auto i = 0u; i < sizeof( value ); ++i )
     {
-        b.push_back( buffer::value_type( value ) );
+        *o++ = buffer::value_type( value );
         static_cast< unsigned_integer_type & >( value ) >>= 8;
     }
+#endif
 }
 
 /**
@@ -73,13 +84,26 @@ deserialize_integer
     return std::error_code{};
 }
 
+/**
+ *
+ */
+inline std::size_t
+get_serialized_size
+    ( std::vector< std::uint8_t > const& data )
+{ return sizeof( std::uint64_t ) + data.size(); }
+
+/**
+ *
+ */
 inline void
 serialize
-    ( std::vector< std::uint8_t > data
-    , buffer & b )
+    ( std::vector< std::uint8_t > const& data
+    , std::uint8_t *& o )
 {
-    serialize_integer( data.size(), b );
-    b.insert( b.end(), data.begin(), data.end() );
+    serialize_integer( std::uint64_t( data.size() ), o );
+    if ( ! data.empty() )
+        std::memcpy( o, data.data(), data.size() );
+    o += data.size();
 }
 
 /**
@@ -109,9 +133,9 @@ deserialize
 inline void
 serialize
     ( id const& i
-    , buffer & b )
+    , std::uint8_t *& o )
 {
-    b.insert( b.end(), i.begin(), i.end() );
+    o = std::copy( i.begin(), i.end(), o );
 }
 
 /**
@@ -160,26 +184,38 @@ enum
     { KADEMLIA_ENDPOINT_SERIALIZATION_IPV4 = 1
     , KADEMLIA_ENDPOINT_SERIALIZATION_IPV6 = 2 };
 
+/**
+ *
+ */
+inline std::size_t
+get_serialized_size
+    ( boost::asio::ip::address const& address )
+{
+    return 1 + ( address.is_v4()
+               ? boost::asio::ip::address_v4::bytes_type{}.size()
+               : boost::asio::ip::address_v6::bytes_type{}.size() );
+}
+
 /**
  *
  */
 inline void
 serialize
     ( boost::asio::ip::address const& address
-    , buffer & b )
+    , std::uint8_t *& o )
 {
     if ( address.is_v4() )
     {
-        b.push_back( KADEMLIA_ENDPOINT_SERIALIZATION_IPV4 );
+        *o++ = KADEMLIA_ENDPOINT_SERIALIZATION_IPV4;
         auto const& a = address.to_v4().to_bytes();
-        b.insert( b.end(), a.begin(), a.end() );
+        o = std::copy( a.begin(), a.end(), o );
     }
     else
     {
         assert( address.is_v6() && "unknown IP version" );
-        b.push_back( KADEMLIA_ENDPOINT_SERIALIZATION_IPV6 );
+        *o++ = KADEMLIA_ENDPOINT_SERIALIZATION_IPV6;
         auto const& a = address.to_v6().to_bytes();
-        b.insert( b.end(), a.begin(), a.end() );
+        o = std::copy( a.begin(), a.end(), o );
     }
 }
 
@@ -243,17 +279,101 @@ deserialize
     return std::error_code{};
 }
 
+/**
+ *
+ */
+inline std::size_t
+get_serialized_size
+    ( peer const& n )
+{
+    return id::BLOCKS_COUNT
+         + sizeof( n.endpoint_.port_ )
+         + get_serialized_size( n.endpoint_.address_ );
+}
+
 /**
  *
  */
 inline void
 serialize
     ( peer const& n
-    , buffer & b )
+    , std::uint8_t *& o )
 {
-    serialize( n.id_, b );
-    serialize_integer( n.endpoint_.port_, b );
-    serialize( n.endpoint_.address_, b );
+    serialize( n.id_, o );
+    serialize_integer( n.endpoint_.port_, o );
+    serialize( n.endpoint_.address_, o );
+}
+
+/**
+ *
+ */
+inline void
+serialize
+    ( header const& h
+    , std::uint8_t *& o )
+{
+    *o++ = h.version_ | h.type_ << 4;
+    serialize( h.source_id_, o );
+    serialize( h.random_token_, o );
+}
+
+/**
+ *
+ */
+inline void
+serialize
+    ( find_peer_request_body const& body
+    , std::uint8_t *& o )
+{
+    serialize( body.peer_to_find_id_, o );
+}
+
+/**
+ *
+ */
+inline void
+serialize
+    ( find_peer_response_body const& body
+    , std::uint8_t *& o )
+{
+    serialize_integer( std::uint64_t( body.peers_.size() ), o );
+
+    for ( auto const & n : body.peers_ )
+        serialize( n, o );
+}
+
+/**
+ *
+ */
+inline void
+serialize
+    ( find_value_request_body const& body
+    , std::uint8_t *& o )
+{
+    serialize( body.value_to_find_, o );
+}
+
+/**
+ *
+ */
+inline void
+serialize
+    ( find_value_response_body const& body
+    , std::uint8_t *& o )
+{
+    serialize( body.data_, o );
+}
+
+/**
+ *
+ */
+inline void
+serialize
+    ( store_value_request_body const& body
+    , std::uint8_t *& o )
+{
+    serialize( body.data_key_hash_, o );
+    serialize( body.data_value_, o );
 }
 
 /**
@@ -276,6 +396,24 @@ deserialize
     return deserialize( i, e, n.endpoint_.address_ );
 }
 
+/**
+ *  @brief Grow b by the serialized size of message
+ *         and serialize message in a single pass.
+ */
+template< typename Message >
+inline void
+serialize_into
+    ( Message const& message
+    , buffer & b )
+{
+    auto const offset = b.size();
+    b.resize( offset + get_serialized_size( message ) );
+
+    auto o = b.data() + offset;
+    serialize( message, o );
+    assert( o == b.data() + b.size() && "size mismatch" );
+}
+
 } // anonymous namespace
 
 std::ostream &
@@ -312,15 +450,16 @@ operator<<
     return out << h.type_;    
 }
 
+std::size_t
+get_serialized_size
+    ( header const& )
+{ return 1 + 2 * id::BLOCKS_COUNT; }
+
 void
 serialize
     ( header const& h
     , buffer & b )
-{
-    b.push_back( h.version_ | h.type_ << 4 );
-    serialize( h.source_id_, b );
-    serialize( h.random_token_, b );
-}
+{ serialize_into( h, b ); }
 
 std::error_code
 deserialize
@@ -339,13 +478,16 @@ deserialize
     return deserialize( i, e, h.random_token_ );
 }
 
+std::size_t
+get_serialized_size
+    ( find_peer_request_body const& )
+{ return id::BLOCKS_COUNT; }
+
 void
 serialize
     ( find_peer_request_body const& body
     , buffer & b )
-{
-    serialize( body.peer_to_find_id_, b );
-}
+{ serialize_into( body, b ); }
 
 std::error_code
 deserialize
@@ -356,16 +498,22 @@ deserialize
     return deserialize( i, e, body.peer_to_find_id_ );
 }
 
+std::size_t
+get_serialized_size
+    ( find_peer_response_body const& body )
+{
+    std::size_t size = sizeof( std::uint64_t );
+    for ( auto const & n : body.peers_ )
+        size += get_serialized_size( n );
+
+    return size;
+}
+
 void
 serialize
     ( find_peer_response_body const& body
     , buffer & b )
-{
-    serialize_integer( body.peers_.size(), b );
-
-    for ( auto const & n : body.peers_ )
-        serialize( n, b );
-}
+{ serialize_into( body, b ); }
 
 std::error_code
 deserialize
@@ -387,13 +535,16 @@ deserialize
     return failure;
 }
 
+std::size_t
+get_serialized_size
+    ( find_value_request_body const& )
+{ return id::BLOCKS_COUNT; }
+
 void
 serialize
     ( find_value_request_body const& body
     , buffer & b )
-{
-    serialize( body.value_to_find_, b );
-}
+{ serialize_into( body, b ); }
 
 std::error_code
 deserialize
@@ -404,13 +555,16 @@ deserialize
     return deserialize( i, e, body.value_to_find_ );
 }
 
+std::size_t
+get_serialized_size
+    ( find_value_response_body const& body )
+{ return get_serialized_size( body.data_ ); }
+
 void
 serialize
     ( find_value_response_body const& body
     , buffer & b )
-{
-    serialize( body.data_, b );
-}
+{ serialize_into( body, b ); }
 
 std::error_code
 deserialize
@@ -421,27 +575,55 @@ deserialize
     return deserialize( i, e, body.data_ );
 }
 
+std::size_t
+get_serialized_size
+    ( store_value_request_body const& body )
+{ return id::BLOCKS_COUNT + get_serialized_size( body.data_value_ ); }
+
 void
 serialize
     ( store_value_request_body const& body
     , buffer & b )
+{ serialize_into( body, b ); }
+
+std::error_code
+deserialize
+    ( buffer::const_iterator & i
+    , buffer::const_iterator e
+    , store_value_request_body & body )
 {
-    serialize( body.data_key_hash_, b );
+    auto failure = deserialize( i, e, body.data_key_hash_ );
+    if ( failure )
+        return failure;
 
-    serialize( body.data_value_, b );
+    return deserialize( i, e, body.data_value_ );
 }
 
 std::error_code
 deserialize
     ( buffer::const_iterator & i
     , buffer::const_iterator e
-    , store_value_request_body & body )
+    , serialized_store_value_request_body & body )
 {
     auto failure = deserialize( i, e, body.data_key_hash_ );
     if ( failure )
         return failure;
 
-    return deserialize( i, e, body.data_value_ );
+    // The value and its size are serialized
+    // as in a find_value_response_body.
+    auto const value = i;
+    std::uint64_t size;
+    failure = deserialize_integer( i, e, size );
+    if ( failure )
+        return failure;
+
+    if ( std::size_t( std::distance( i, e ) ) < size )
+        return make_error_code( CORRUPTED_BODY );
+
+    std::advance( i, size );
+    body.serialized_response_.assign( value, i );
+
+    return std::error_code{};
 }
 
 } // namespace detail
@@ -31,6 +31,7 @@
 #endif
 
 #include <iosfwd>
+#include <cstddef>
 #include <cstdint>
 #include <algorithm>
 #include <system_error>
@@ -105,6 +106,13 @@ operator<<
 template< typename MessageBodyType >
 struct message_traits;
 
+/**
+ *  @return The count of bytes serialize() appends.
+ */
+std::size_t
+get_serialized_size
+    ( header const& h );
+
 /**
  *
  */
@@ -138,6 +146,13 @@ template<>
 struct message_traits< find_peer_request_body >
 { static CXX11_CONSTEXPR header::type TYPE_ID = header::FIND_PEER_REQUEST; };
 
+/**
+ *  @return The count of bytes serialize() appends.
+ */
+std::size_t
+get_serialized_size
+    ( find_peer_request_body const& body );
+
 /**
  *
  */
@@ -172,6 +187,13 @@ template<>
 struct message_traits< find_peer_response_body >
 { static CXX11_CONSTEXPR header::type TYPE_ID = header::FIND_PEER_RESPONSE; };
 
+/**
+ *  @return The count of bytes serialize() appends.
+ */
+std::size_t
+get_serialized_size
+    ( find_peer_response_body const& body );
+
 /**
  *
  */
@@ -205,6 +227,13 @@ template<>
 struct message_traits< find_value_request_body >
 { static CXX11_CONSTEXPR header::type TYPE_ID = header::FIND_VALUE_REQUEST; };
 
+/**
+ *  @return The count of bytes serialize() appends.
+ */
+std::size_t
+get_serialized_size
+    ( find_value_request_body const& body );
+
 /**
  *
  */
@@ -239,6 +268,13 @@ struct message_traits< find_value_response_body >
 { static CXX11_CONSTEXPR header::type TYPE_ID = header::FIND_VALUE_RESPONSE; };
 
 
+/**
+ *  @return The count of bytes serialize() appends.
+ */
+std::size_t
+get_serialized_size
+    ( find_value_response_body const& body );
+
 /**
  *
  */
@@ -275,6 +311,13 @@ struct message_traits< store_value_request_body >
 { static CXX11_CONSTEXPR header::type TYPE_ID = header::STORE_REQUEST; };
 
 
+/**
+ *  @return The count of bytes serialize() appends.
+ */
+std::size_t
+get_serialized_size
+    ( store_value_request_body const& body );
+
 /**
  *
  */
@@ -292,6 +335,28 @@ deserialize
     , buffer::const_iterator e
     , store_value_request_body & body );
 
+/**
+ *  @brief A store_value_request_body whose value is kept in
+ *         the serialized form of a find_value_response_body,
+ *         hence ready to be sent back as is.
+ */
+struct serialized_store_value_request_body final
+{
+    ///
+    id data_key_hash_;
+    ///
+    std::vector< std::uint8_t > serialized_response_;
+};
+
+/**
+ *
+ */
+std::error_code
+deserialize
+    ( buffer::const_iterator & i
+    , buffer::const_iterator e
+    , serialized_store_value_request_body & body );
+
 } // namespace detail
 } // namespace kademlia
 
@@ -50,14 +50,22 @@ message_serializer::serialize
     ( header::type const& type
     , id const& token )
 {
-    auto const header = generate_header( type, token );
-
     buffer b;
-    detail::serialize( header, b );
+    serialize( type, token, b );
 
     return b;
 }
 
+void
+message_serializer::serialize
+    ( header::type const& type
+    , id const& token
+    , buffer & b )
+{
+    auto const header = generate_header( type, token );
+    detail::serialize( header, b );
+}
+
 } // namespace detail
 } // namespace kademlia
 
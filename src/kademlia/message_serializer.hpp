@@ -58,6 +58,16 @@ public:
         ( Message const& message
         , id const& token );
 
+    /**
+     *  @brief Append the serialized message to b.
+     */
+    template< typename Message >
+    void
+    serialize
+        ( Message const& message
+        , id const& token
+        , buffer & b );
+
     /**
      *
      */
@@ -66,6 +76,15 @@ public:
         ( header::type const& type
         , id const& token );
 
+    /**
+     *  @brief Append the serialized header to b.
+     */
+    void
+    serialize
+        ( header::type const& type
+        , id const& token
+        , buffer & b );
+
 private:
     /**
      *
@@ -85,15 +104,30 @@ buffer
 message_serializer::serialize
     ( Message const& message
     , id const& token )
+{
+    buffer b;
+    serialize( message, token, b );
+
+    return b;
+}
+
+template< typename Message >
+void
+message_serializer::serialize
+    ( Message const& message
+    , id const& token
+    , buffer & b )
 {
     auto const type = message_traits< Message >::TYPE_ID;
     auto const header = generate_header( type, token );
 
-    buffer b;
+    // Grow b once for both.
+    b.reserve( b.size()
+             + get_serialized_size( header )
+             + get_serialized_size( message ) );
+
     detail::serialize( header, b );
     detail::serialize( message, b );
-
-    return b;
 }
 
 } // namespace detail
@@ -32,7 +32,14 @@
 
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <type_traits>
 #include <boost/asio/io_service.hpp>
+#include <boost/asio/socket_base.hpp>
 #include <boost/asio/ip/v6_only.hpp>
 #include <boost/asio/buffer.hpp>
 
@@ -40,8 +47,10 @@
 #include <kademlia/detail/cxx11_macros.hpp>
 
 #include "kademlia/buffer.hpp"
+#include "kademlia/buffer_pool.hpp"
 #include "kademlia/ip_endpoint.hpp"
 #include "kademlia/boost_to_std_error.hpp"
+#include "kademlia/datagram_batch.hpp"
 
 namespace kademlia {
 namespace detail {
@@ -62,6 +71,20 @@ public:
     ///
     using resolved_endpoints = std::vector< endpoint_type >;
 
+    /// A datagram of a received batch.
+    struct received_message
+    {
+        ///
+        endpoint_type sender_;
+        ///
+        buffer::const_iterator begin_;
+        ///
+        buffer::const_iterator end_;
+    };
+
+    ///
+    using received_messages = std::vector< received_message >;
+
 public:
     /**
      *
@@ -73,22 +96,28 @@ public:
         , EndpointType const& e );
 
     /**
-     *
+     *  @param shared_port If set, other sockets may bind the same
+     *         port and the system balances datagrams among them
+     *         (SO_REUSEPORT).
      */
     template< typename EndpointType >
     static message_socket
     ipv4
         ( boost::asio::io_service & io_service
-        , EndpointType const& e );
+        , EndpointType const& e
+        , bool shared_port = false );
 
     /**
-     *
+     *  @param shared_port If set, other sockets may bind the same
+     *         port and the system balances datagrams among them
+     *         (SO_REUSEPORT).
      */
     template< typename EndpointType >
     static message_socket
     ipv6
         ( boost::asio::io_service & io_service
-        , EndpointType const& e );
+        , EndpointType const& e
+        , bool shared_port = false );
 
     /**
      *
@@ -125,15 +154,52 @@ public:
         ( ReceiveCallback const& callback );
 
     /**
-     *
+     *  @brief Receive all the datagrams available once
+     *         the socket is readable.
+     *  @note The callback is called with the received messages,
+     *        they are valid until the next reception.
+     */
+    template<typename ReceiveBatchCallback>
+    void
+    async_receive_batch
+        ( ReceiveBatchCallback const& callback );
+
+    /**
+     *  @note When batching is supported, messages sent while
+     *        the socket is waited for are sent together.
      */
     template<typename SendCallback>
     void
     async_send
-        ( buffer const& message
+        ( pooled_buffer message
         , endpoint_type const& to
         , SendCallback const& callback );
 
+    /**
+     *  @brief Send message followed by payload.
+     *  @details When batching is supported, the payload is
+     *           gathered from its owner by the system call,
+     *           otherwise it's appended to message.
+     */
+    template<typename SendCallback>
+    void
+    async_send
+        ( pooled_buffer message
+        , shared_buffer const& payload
+        , endpoint_type const& to
+        , SendCallback const& callback );
+
+    /**
+     *  @note The message is copied, prefer the pooled_buffer overload.
+     */
+    template<typename SendCallback>
+    void
+    async_send
+        ( buffer const& message
+        , endpoint_type const& to
+        , SendCallback const& callback )
+    { async_send( pooled_buffer{ message }, to, callback ); }
+
     /**
      *
      */
@@ -149,13 +215,94 @@ private:
     ///
     using underlying_endpoint_type = typename underlying_socket_type::endpoint_type;
 
+    ///
+    using batch = datagram_batch< underlying_socket_type >;
+
+    ///
+    using batch_supported = std::integral_constant< bool, batch::SUPPORTED >;
+
+    /// A datagram waiting for its batch to be sent.
+    struct pending_message
+    {
+        ///
+        std::uint8_t const*
+        data
+            ( void )
+            const
+        { return message_->data(); }
+
+        ///
+        std::size_t
+        size
+            ( void )
+            const
+        { return message_->size(); }
+
+        /// Sent after the message, if any.
+        shared_buffer const&
+        payload
+            ( void )
+            const
+        { return payload_; }
+
+        ///
+        underlying_endpoint_type const&
+        destination
+            ( void )
+            const
+        { return destination_; }
+
+        ///
+        pooled_buffer message_;
+        ///
+        shared_buffer payload_;
+        ///
+        underlying_endpoint_type destination_;
+        ///
+        std::function< void ( std::error_code const& ) > on_message_sent_;
+    };
+
+    ///
+    using pending_messages = std::vector< pending_message >;
+
+    /// The buffers a batch is received into, one
+    /// INPUT_BUFFER_SIZE slot per datagram.
+    struct batch_reception
+    {
+        ///
+        buffer buffer_;
+        ///
+        std::vector< underlying_endpoint_type > senders_;
+        ///
+        std::vector< std::size_t > sizes_;
+        ///
+        received_messages messages_;
+    };
+
+    ///
+    using batch_reception_pointer = std::shared_ptr< batch_reception >;
+
+    /// State shared by the threads sending and receiving.
+    struct synchronized_state
+    {
+        ///
+        std::mutex mutex_;
+        /// Messages to send once the socket is writable.
+        pending_messages pending_messages_;
+        ///
+        bool is_sending_;
+        /// Buffers of the completed receptions.
+        std::vector< batch_reception_pointer > free_receptions_;
+    };
+
 private:
     /**
      *
      */
     message_socket
         ( boost::asio::io_service & io_service
-        , endpoint_type const& e );
+        , endpoint_type const& e
+        , bool shared_port );
 
     /**
      *
@@ -163,7 +310,85 @@ private:
     static underlying_socket_type
     create_underlying_socket
         ( boost::asio::io_service & io_service
-        , endpoint_type const& e );
+        , endpoint_type const& e
+        , bool shared_port );
+
+    /**
+     *
+     */
+    template<typename ReceiveBatchCallback>
+    void
+    async_receive_batch
+        ( ReceiveBatchCallback const& callback
+        , std::true_type /* batch_supported */ );
+
+    /**
+     *
+     */
+    template<typename ReceiveBatchCallback>
+    void
+    async_receive_batch
+        ( ReceiveBatchCallback const& callback
+        , std::false_type /* batch_supported */ );
+
+    /**
+     *
+     */
+    template<typename SendCallback>
+    void
+    async_send
+        ( pooled_buffer && message
+        , shared_buffer const& payload
+        , endpoint_type const& to
+        , SendCallback const& callback
+        , std::true_type /* batch_supported */ );
+
+    /**
+     *
+     */
+    template<typename SendCallback>
+    void
+    async_send
+        ( pooled_buffer && message
+        , shared_buffer const& payload
+        , endpoint_type const& to
+        , SendCallback const& callback
+        , std::false_type /* batch_supported */ );
+
+    /**
+     *
+     */
+    batch_reception_pointer
+    acquire_batch_reception
+        ( void );
+
+    /**
+     *
+     */
+    void
+    release_batch_reception
+        ( batch_reception_pointer const& reception );
+
+    /**
+     *  @brief Double the slots of a reception, up to batch::MAX_SIZE.
+     */
+    void
+    grow_batch_reception
+        ( batch_reception & reception );
+
+    /**
+     *  @note The state mutex must be locked.
+     */
+    void
+    schedule_pending_messages_sending
+        ( void );
+
+    /**
+     *
+     */
+    void
+    send_pending_messages
+        ( std::error_code const& wait_failure );
 
     /**
      *
@@ -184,6 +409,10 @@ private:
     buffer reception_buffer_;
     ///
     underlying_endpoint_type current_message_sender_;
+    /// Behind a pointer to keep the socket movable.
+    std::unique_ptr< synchronized_state > state_;
+    /// Messages of the batch being sent.
+    pending_messages sending_messages_;
     ///
     underlying_socket_type socket_;
 };
@@ -193,14 +422,15 @@ template< typename EndpointType >
 inline message_socket< UnderlyingSocketType >
 message_socket< UnderlyingSocketType >::ipv4
     ( boost::asio::io_service & io_service
-    , EndpointType const& ipv4_endpoint )
+    , EndpointType const& ipv4_endpoint
+    , bool shared_port )
 {
     auto endpoints = resolve_endpoint( io_service, ipv4_endpoint );
 
     for ( auto const& i : endpoints )
     {
         if ( i.address_.is_v4() )
-            return message_socket{ io_service, i };
+            return message_socket{ io_service, i, shared_port };
     }
 
     throw std::system_error{ make_error_code( INVALID_IPV4_ADDRESS ) };
@@ -211,14 +441,15 @@ template< typename EndpointType >
 inline message_socket< UnderlyingSocketType >
 message_socket< UnderlyingSocketType >::ipv6
     ( boost::asio::io_service & io_service
-    , EndpointType const& ipv6_endpoint )
+    , EndpointType const& ipv6_endpoint
+    , bool shared_port )
 {
     auto endpoints = resolve_endpoint( io_service, ipv6_endpoint );
 
     for ( auto const& i : endpoints )
     {
         if ( i.address_.is_v6() )
-            return message_socket{ io_service, i };
+            return message_socket{ io_service, i, shared_port };
     }
 
     throw std::system_error{ make_error_code( INVALID_IPV6_ADDRESS ) };
@@ -228,10 +459,13 @@ template< typename UnderlyingSocketType >
 inline
 message_socket< UnderlyingSocketType >::message_socket
     ( boost::asio::io_service & io_service
-    , endpoint_type const& e )
+    , endpoint_type const& e
+    , bool shared_port )
     : reception_buffer_( INPUT_BUFFER_SIZE )
     , current_message_sender_()
-    , socket_( create_underlying_socket( io_service, e ) )
+    , state_( new synchronized_state{} )
+    , sending_messages_()
+    , socket_( create_underlying_socket( io_service, e, shared_port ) )
 { }
 
 template< typename UnderlyingSocketType >
@@ -278,30 +512,297 @@ message_socket< UnderlyingSocketType >::async_receive
                               , std::move( on_completion ) );
 }
 
+template< typename UnderlyingSocketType >
+template< typename ReceiveBatchCallback >
+inline void
+message_socket< UnderlyingSocketType >::async_receive_batch
+    ( ReceiveBatchCallback const& callback )
+{ async_receive_batch( callback, batch_supported{} ); }
+
+template< typename UnderlyingSocketType >
+template< typename ReceiveBatchCallback >
+inline void
+message_socket< UnderlyingSocketType >::async_receive_batch
+    ( ReceiveBatchCallback const& callback
+    , std::true_type /* batch_supported */ )
+{
+    auto reception = acquire_batch_reception();
+
+    auto on_readable = [ this, callback, reception ]
+        ( boost::system::error_code const& wait_failure )
+    {
+        auto & messages = reception->messages_;
+        messages.clear();
+
+        auto failure = boost_to_std_error( wait_failure );
+        std::size_t count = 0;
+        if ( ! failure )
+            count = batch::receive( socket_
+                                  , reception->buffer_.data()
+                                  , INPUT_BUFFER_SIZE
+                                  , reception->senders_.data()
+                                  , reception->sizes_.data()
+                                  , reception->senders_.size()
+                                  , failure );
+
+        // Another reader may have drained the socket.
+        if ( failure == std::errc::operation_would_block )
+        {
+            release_batch_reception( reception );
+            return async_receive_batch( callback );
+        }
+
+        for ( std::size_t i = 0; i != count; ++ i )
+        {
+            // Truncated datagrams are dropped.
+            if ( reception->sizes_[ i ] == 0 )
+                continue;
+
+            auto b = reception->buffer_.cbegin();
+            std::advance( b, i * INPUT_BUFFER_SIZE );
+            messages.push_back( received_message
+                    { convert_endpoint( reception->senders_[ i ] )
+                    , b, std::next( b, reception->sizes_[ i ] ) } );
+        }
+
+        callback( failure, messages );
+
+        // More datagrams may be pending.
+        if ( count == reception->senders_.size() )
+            grow_batch_reception( *reception );
+
+        release_batch_reception( reception );
+    };
+
+    socket_.async_wait( underlying_socket_type::wait_read
+                      , std::move( on_readable ) );
+}
+
+template< typename UnderlyingSocketType >
+template< typename ReceiveBatchCallback >
+inline void
+message_socket< UnderlyingSocketType >::async_receive_batch
+    ( ReceiveBatchCallback const& callback
+    , std::false_type /* batch_supported */ )
+{
+    // Fallback to batches of one datagram.
+    auto reception = acquire_batch_reception();
+
+    auto on_message_received = [ this, callback, reception ]
+        ( boost::system::error_code const& failure
+        , std::size_t bytes_received )
+    {
+        auto & messages = reception->messages_;
+        messages.clear();
+        if ( ! failure )
+        {
+            auto const b = reception->buffer_.cbegin();
+            messages.push_back( received_message
+                    { convert_endpoint( reception->senders_.front() )
+                    , b, std::next( b, bytes_received ) } );
+        }
+
+        callback( boost_to_std_error( failure ), messages );
+        release_batch_reception( reception );
+    };
+
+    socket_.async_receive_from( boost::asio::buffer( reception->buffer_ )
+                              , reception->senders_.front()
+                              , std::move( on_message_received ) );
+}
+
+template< typename UnderlyingSocketType >
+inline typename message_socket< UnderlyingSocketType >::batch_reception_pointer
+message_socket< UnderlyingSocketType >::acquire_batch_reception
+    ( void )
+{
+    {
+        std::lock_guard< std::mutex > lock{ state_->mutex_ };
+
+        auto & free_receptions = state_->free_receptions_;
+        if ( ! free_receptions.empty() )
+        {
+            auto reception = std::move( free_receptions.back() );
+            free_receptions.pop_back();
+            return reception;
+        }
+    }
+
+    // A single slot until the socket proves to be busy.
+    auto reception = std::make_shared< batch_reception >();
+    reception->buffer_.resize( INPUT_BUFFER_SIZE );
+    reception->senders_.resize( 1 );
+    reception->sizes_.resize( 1 );
+
+    return reception;
+}
+
+template< typename UnderlyingSocketType >
+inline void
+message_socket< UnderlyingSocketType >::grow_batch_reception
+    ( batch_reception & reception )
+{
+    auto const slots_count = std::min( 2 * reception.senders_.size()
+                                     , batch::MAX_SIZE );
+    if ( slots_count == reception.senders_.size() )
+        return;
+
+    // The previous content is useless, don't copy it.
+    buffer( slots_count * INPUT_BUFFER_SIZE ).swap( reception.buffer_ );
+    reception.senders_.resize( slots_count );
+    reception.sizes_.resize( slots_count );
+}
+
+template< typename UnderlyingSocketType >
+inline void
+message_socket< UnderlyingSocketType >::release_batch_reception
+    ( batch_reception_pointer const& reception )
+{
+    std::lock_guard< std::mutex > lock{ state_->mutex_ };
+    state_->free_receptions_.push_back( reception );
+}
+
+template< typename UnderlyingSocketType >
+template< typename SendCallback >
+inline void
+message_socket< UnderlyingSocketType >::async_send
+    ( pooled_buffer message
+    , endpoint_type const& to
+    , SendCallback const& callback )
+{ async_send( std::move( message ), shared_buffer{}, to, callback ); }
+
 template< typename UnderlyingSocketType >
 template< typename SendCallback >
 inline void
 message_socket< UnderlyingSocketType >::async_send
-    ( buffer const& message
+    ( pooled_buffer message
+    , shared_buffer const& payload
     , endpoint_type const& to
     , SendCallback const& callback )
 {
-    if ( message.size() > INPUT_BUFFER_SIZE )
+    auto const payload_size = payload ? payload.size_ : 0;
+    if ( message->size() + payload_size > INPUT_BUFFER_SIZE )
         callback( make_error_code( std::errc::value_too_large ) );
-    else {
-        // Copy the buffer as it has to live past the end of this call.
-        auto message_copy = std::make_shared< buffer >( message );
-        auto on_completion = [ this, callback, message_copy ]
-            ( boost::system::error_code const& failure
-            , std::size_t /* bytes_sent */ )
-        {
-            callback( boost_to_std_error( failure ) );
-        };
+    else
+        async_send( std::move( message ), payload, to, callback, batch_supported{} );
+}
+
+template< typename UnderlyingSocketType >
+template< typename SendCallback >
+inline void
+message_socket< UnderlyingSocketType >::async_send
+    ( pooled_buffer && message
+    , shared_buffer const& payload
+    , endpoint_type const& to
+    , SendCallback const& callback
+    , std::true_type /* batch_supported */ )
+{
+    std::lock_guard< std::mutex > lock{ state_->mutex_ };
 
-        socket_.async_send_to( boost::asio::buffer( *message_copy )
-                             , convert_endpoint( to )
-                             , std::move( on_completion ) );
+    state_->pending_messages_.push_back( pending_message{ std::move( message )
+                                                        , payload
+                                                        , convert_endpoint( to )
+                                                        , callback } );
+
+    // Messages sent until the socket is reported
+    // writable will be sent along this one.
+    if ( ! state_->is_sending_ )
+        schedule_pending_messages_sending();
+}
+
+template< typename UnderlyingSocketType >
+template< typename SendCallback >
+inline void
+message_socket< UnderlyingSocketType >::async_send
+    ( pooled_buffer && message
+    , shared_buffer const& payload
+    , endpoint_type const& to
+    , SendCallback const& callback
+    , std::false_type /* batch_supported */ )
+{
+    if ( payload )
+        message->insert( message->end(), payload.data_, payload.data_ + payload.size_ );
+
+    auto const data = boost::asio::buffer( *message );
+
+    // The lambda keeps the message alive until it has been sent.
+    auto on_completion = [ callback, message ]
+        ( boost::system::error_code const& failure
+        , std::size_t /* bytes_sent */ )
+    {
+        callback( boost_to_std_error( failure ) );
+    };
+
+    socket_.async_send_to( data
+                         , convert_endpoint( to )
+                         , std::move( on_completion ) );
+}
+
+template< typename UnderlyingSocketType >
+inline void
+message_socket< UnderlyingSocketType >::send_pending_messages
+    ( std::error_code const& wait_failure )
+{
+    // Callbacks may send new messages, they are
+    // queued in pending_messages_ meanwhile.
+    {
+        std::lock_guard< std::mutex > lock{ state_->mutex_ };
+        sending_messages_.swap( state_->pending_messages_ );
     }
+
+    std::size_t first = 0;
+    while ( first != sending_messages_.size() )
+    {
+        auto failure = wait_failure;
+        std::size_t count = 0;
+        if ( ! failure )
+            count = batch::send( socket_
+                               , &sending_messages_[ first ]
+                               , sending_messages_.size() - first
+                               , failure );
+
+        // The socket buffer is full, try again once writable.
+        if ( failure == std::errc::operation_would_block )
+            break;
+
+        for ( auto const end = first + count; first != end; ++ first )
+            sending_messages_[ first ].on_message_sent_( std::error_code{} );
+
+        // The message following the sent ones failed.
+        if ( failure )
+        {
+            sending_messages_[ first ].on_message_sent_( failure );
+            ++ first;
+        }
+    }
+
+    std::lock_guard< std::mutex > lock{ state_->mutex_ };
+
+    // Unsent messages are kept ahead of the new ones.
+    auto & pending_messages = state_->pending_messages_;
+    pending_messages.insert( pending_messages.begin()
+                           , std::make_move_iterator( sending_messages_.begin() + first )
+                           , std::make_move_iterator( sending_messages_.end() ) );
+    sending_messages_.clear();
+
+    state_->is_sending_ = false;
+    if ( ! pending_messages.empty() )
+        schedule_pending_messages_sending();
+}
+
+template< typename UnderlyingSocketType >
+inline void
+message_socket< UnderlyingSocketType >::schedule_pending_messages_sending
+    ( void )
+{
+    state_->is_sending_ = true;
+
+    auto on_writable = [ this ]
+        ( boost::system::error_code const& failure )
+    { send_pending_messages( boost_to_std_error( failure ) ); };
+
+    socket_.async_wait( underlying_socket_type::wait_write
+                      , std::move( on_writable ) );
 }
 
 template< typename UnderlyingSocketType >
@@ -318,7 +819,8 @@ template< typename UnderlyingSocketType >
 inline typename message_socket< UnderlyingSocketType >::underlying_socket_type
 message_socket< UnderlyingSocketType >::create_underlying_socket
     ( boost::asio::io_service & io_service
-    , endpoint_type const& endpoint )
+    , endpoint_type const& endpoint
+    , bool shared_port )
 {
     auto const e = convert_endpoint( endpoint );
 
@@ -327,6 +829,17 @@ message_socket< UnderlyingSocketType >::create_underlying_socket
     if ( e.address().is_v6() )
         new_socket.set_option( boost::asio::ip::v6_only{ true } );
 
+    if ( shared_port )
+    {
+#ifdef SO_REUSEPORT
+        using reuse_port = boost::asio::detail::socket_option::boolean
+                < SOL_SOCKET, SO_REUSEPORT >;
+        new_socket.set_option( reuse_port{ true } );
+#else
+        throw std::system_error{ make_error_code( std::errc::operation_not_supported ) };
+#endif
+    }
+
     new_socket.bind( e );
 
     return new_socket;
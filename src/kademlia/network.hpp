@@ -37,6 +37,7 @@
 #include "kademlia/ip_endpoint.hpp"
 #include "kademlia/message_socket.hpp"
 #include "kademlia/buffer.hpp"
+#include "kademlia/buffer_pool.hpp"
 
 namespace kademlia {
 namespace detail {
@@ -75,6 +76,7 @@ public:
             , socket_ipv4_( std::move( socket_ipv4 ) )
             , socket_ipv6_( std::move( socket_ipv6 ) )
             , on_message_received_( on_message_received )
+            , buffer_pool_()
     {
         start_message_reception();
         LOG_DEBUG( network, this ) << "created at '"
@@ -97,6 +99,15 @@ public:
         ( network const& )
         = delete;
 
+    /**
+     *  @brief Return a buffer to serialize a message into,
+     *         it is recycled once the message has been sent.
+     */
+    pooled_buffer
+    acquire_buffer
+        ( void )
+    { return buffer_pool_.acquire(); }
+
     /**
      *
      */
@@ -108,6 +119,19 @@ public:
         , OnMessageSent const& on_message_sent )
     { get_socket_for( e ).async_send( message, e, on_message_sent ); }
 
+    /**
+     *  @brief Send message followed by payload, which isn't copied
+     *         when the socket gathers the datagrams it sends.
+     */
+    template< typename OnMessageSent >
+    void
+    send
+        ( pooled_buffer message
+        , shared_buffer const& payload
+        , endpoint_type const& e
+        , OnMessageSent const& on_message_sent )
+    { get_socket_for( e ).async_send( std::move( message ), payload, e, on_message_sent ); }
+
     /**
      *
      */
@@ -136,21 +160,24 @@ private:
     schedule_receive_on_socket
         ( message_socket_type & current_subnet )
     {
-        auto on_new_message = [ this, &current_subnet ]
+        auto on_new_messages = [ this, &current_subnet ]
             ( std::error_code const& failure
-            , endpoint_type const& sender
-            , buffer::const_iterator i
-            , buffer::const_iterator e )
+            , typename message_socket_type::received_messages const& messages )
         {
             // Reception failure are fatal.
             if ( failure )
                 throw std::system_error{ failure };
 
-            on_message_received_( sender, i, e );
+            // Rearmed first so that another thread running
+            // the io_service receives the next batch while
+            // this one is handled.
             schedule_receive_on_socket( current_subnet );
+
+            for ( auto const& m : messages )
+                on_message_received_( m.sender_, m.begin_, m.end_ );
         };
 
-        current_subnet.async_receive( on_new_message );
+        current_subnet.async_receive_batch( on_new_messages );
     }
 
     /**
@@ -175,6 +202,8 @@ private:
     message_socket_type socket_ipv6_;
     ///
     on_message_received_type on_message_received_;
+    ///
+    buffer_pool buffer_pool_;
 };
 
 } // namespace detail
@@ -30,6 +30,7 @@
 #   pragma once
 #endif
 
+#include <chrono>
 #include <memory>
 #include <system_error>
 
@@ -42,7 +43,7 @@ namespace kademlia {
 namespace detail {
 
 ///
-template< typename TrackerType >
+template< typename TrackerType, typename RoutingTableType >
 class notify_peer_task final
     : public lookup_task
 {
@@ -50,19 +51,24 @@ public:
     ///
     using tracker_type = TrackerType;
 
+    ///
+    using clock = typename tracker_type::clock_type;
+
     ///
     using endpoint_type = typename tracker_type::endpoint_type;
 
+    ///
+    using routing_table_type = RoutingTableType;
+
 public:
     /**
      *
      */
-    template< typename RoutingTableType >
     static void
     start
         ( detail::id const & key
         , tracker_type & tracker
-        , RoutingTableType & routing_table )
+        , routing_table_type & routing_table )
     {
         std::shared_ptr< notify_peer_task > c;
         c.reset( new notify_peer_task( key, tracker, routing_table ) );
@@ -74,15 +80,15 @@ private:
     /**
      *
      */
-    template< typename RoutingTableType >
     notify_peer_task
         ( detail::id const & key
         , tracker_type & tracker
-        , RoutingTableType & routing_table )
+        , routing_table_type & routing_table )
             : lookup_task( key
-                         , routing_table.find( key )
-                         , routing_table.end() )
+                         , routing_table.closest( key
+                                                , ROUTING_TABLE_BUCKET_SIZE ) )
             , tracker_( tracker )
+            , routing_table_( routing_table )
     {
         LOG_DEBUG( notify_peer_task, this )
                 << "create notify peer task for '"
@@ -122,23 +128,30 @@ private:
                 << "sending find peer to notify to '"
                 << current_peer << "'." << std::endl;
 
-        auto on_message_received = [ task, current_peer ]
+        auto const sent_at = clock::now();
+
+        auto on_message_received = [ task, current_peer, sent_at ]
             ( endpoint_type const& s
             , header const& h
             , buffer::const_iterator i
             , buffer::const_iterator e )
         {
+            task->routing_table_.record_round_trip_time( current_peer.id_
+                    , clock::now() - sent_at );
             task->flag_candidate_as_valid( current_peer.id_ );
             handle_notify_peer_response( s, h, i, e, task );
         };
 
         auto on_error = [ task, current_peer ]
             ( std::error_code const& )
-        { task->flag_candidate_as_invalid( current_peer.id_ ); };
+        {
+            task->flag_candidate_as_invalid( current_peer.id_ );
+            task->routing_table_.flag_peer_as_unresponsive( current_peer.id_ );
+        };
 
         task->tracker_.send_request( request
                                    , current_peer.endpoint_
-                                   , PEER_LOOKUP_TIMEOUT
+                                   , task->routing_table_.get_request_timeout( current_peer.id_ )
                                    , on_message_received
                                    , on_error );
     }
@@ -177,6 +190,8 @@ private:
 private:
     ///
     tracker_type & tracker_;
+    ///
+    routing_table_type & routing_table_;
 };
 
 /**
@@ -189,7 +204,7 @@ start_notify_peer_task
     , TrackerType & tracker
     , RoutingTableType & routing_table )
 {
-    using task = notify_peer_task< TrackerType >;
+    using task = notify_peer_task< TrackerType, RoutingTableType >;
 
     task::start( key, tracker, routing_table );
 }
@@ -0,0 +1,209 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KADEMLIA_PEER_INDEX_HPP
+#define KADEMLIA_PEER_INDEX_HPP
+
+#ifdef _MSC_VER
+#   pragma once
+#endif
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "kademlia/id.hpp"
+
+namespace kademlia {
+namespace detail {
+
+/**
+ *  This class locates the peers of a routing table from their id.
+ *  @note Current implementation is an open addressing hash table
+ *        using linear probing and backward shift deletion,
+ *        hence erased slots don't leave tombstones behind.
+ */
+class peer_index final
+{
+public:
+	/// Where a peer is stored inside the routing table.
+	struct location final
+	{
+		std::uint32_t k_bucket_index_;
+		std::uint32_t position_;
+	};
+
+public:
+	/**
+	 *  Construct an empty index.
+	 */
+	peer_index()
+			: slots_( MIN_CAPACITY ), size_( 0 )
+			, hash_shift_( id::BIT_PER_WORD - MIN_CAPACITY_LOG2 )
+	{ }
+
+	/**
+	 *  Count the number of indexed peers.
+	 *  @note Complexity: O(1).
+	 */
+	std::size_t size() const
+	{ return size_; }
+
+	/**
+	 *  Find the location of a peer.
+	 *  @return The location or nullptr if the peer is unknown.
+	 *  @note Complexity: O(1) on average.
+	 */
+	location * find(id const& peer_id)
+	{
+		for ( auto i = get_home_slot( peer_id ); slots_[ i ].is_used_; i = get_next_slot( i ) )
+			if ( slots_[ i ].id_ == peer_id )
+				return &slots_[ i ].location_;
+
+		return nullptr;
+	}
+
+	location const* find(id const& peer_id) const
+	{ return const_cast< peer_index * >( this )->find( peer_id ); }
+
+	/**
+	 *  Index a peer.
+	 *  @return false if the peer was already indexed.
+	 *  @note Complexity: O(1) amortized.
+	 */
+	bool insert(id const& peer_id, location const& peer_location)
+	{
+		// Keep the load factor under 1/2 so probe sequences stay short.
+		if ( ( size_ + 1 ) * 2 > slots_.size() )
+			grow();
+
+		auto i = get_home_slot( peer_id );
+		for ( ; slots_[ i ].is_used_; i = get_next_slot( i ) )
+			if ( slots_[ i ].id_ == peer_id )
+				return false;
+
+		slots_[ i ] = slot{ peer_id, peer_location, true };
+		++ size_;
+
+		return true;
+	}
+
+	/**
+	 *  Forget a peer.
+	 *  @return false if the peer wasn't indexed.
+	 *  @note Complexity: O(1) on average.
+	 */
+	bool erase(id const& peer_id)
+	{
+		auto i = get_home_slot( peer_id );
+		for ( ; slots_[ i ].is_used_; i = get_next_slot( i ) )
+			if ( slots_[ i ].id_ == peer_id )
+				break;
+
+		if ( ! slots_[ i ].is_used_ )
+			return false;
+
+		// Shift back the following entries of the probe sequence
+		// which can't be reached anymore once slot i is empty.
+		auto const mask = slots_.size() - 1;
+		for ( auto j = get_next_slot( i ); slots_[ j ].is_used_; j = get_next_slot( j ) )
+		{
+			auto const home = get_home_slot( slots_[ j ].id_ );
+			if ( ( ( j - home ) & mask ) >= ( ( j - i ) & mask ) )
+			{
+				slots_[ i ] = slots_[ j ];
+				i = j;
+			}
+		}
+
+		slots_[ i ].is_used_ = false;
+		-- size_;
+
+		return true;
+	}
+
+private:
+	///
+	enum { MIN_CAPACITY_LOG2 = 4, MIN_CAPACITY = 1 << MIN_CAPACITY_LOG2 };
+
+	///
+	struct slot final
+	{
+		id id_;
+		location location_;
+		bool is_used_;
+	};
+
+	///
+	using slots = std::vector< slot >;
+
+private:
+	std::size_t get_home_slot(id const& peer_id) const
+	{
+		id::word_type hash = 0;
+		for ( std::size_t i = 0; i != id::WORDS_COUNT; ++ i )
+			hash ^= peer_id.get_word( i );
+
+		// Fibonacci hashing, the high bits of the product
+		// depend on every bit of the hash.
+		return std::size_t( ( hash * 0x9E3779B97F4A7C15ULL ) >> hash_shift_ );
+	}
+
+	std::size_t get_next_slot(std::size_t i) const
+	{ return ( i + 1 ) & ( slots_.size() - 1 ); }
+
+	void grow()
+	{
+		slots old_slots( slots_.size() * 2 );
+		old_slots.swap( slots_ );
+		-- hash_shift_;
+
+		for ( auto const& s : old_slots )
+		{
+			if ( ! s.is_used_ )
+				continue;
+
+			auto i = get_home_slot( s.id_ );
+			while ( slots_[ i ].is_used_ )
+				i = get_next_slot( i );
+
+			slots_[ i ] = s;
+		}
+	}
+
+private:
+	/// The slot count is always a power of 2.
+	slots slots_;
+	/// Count of used slots.
+	std::size_t size_;
+	/// Keeps the log2(slots_.size()) high bits of the hash.
+	std::size_t hash_shift_;
+};
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
+
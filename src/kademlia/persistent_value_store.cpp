@@ -0,0 +1,682 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "kademlia/persistent_value_store.hpp"
+
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <system_error>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/crc.hpp>
+
+namespace kademlia {
+namespace detail {
+
+namespace {
+
+/// Precedes the key and the value of a record.
+struct record_header final
+{
+    /// Of the record bytes following it.
+    std::uint32_t checksum_;
+    std::uint32_t value_size_;
+    /// In seconds since the epoch.
+    std::int64_t expiration_time_;
+};
+
+static_assert( sizeof( record_header ) == 16, "record_header is packed" );
+
+///
+std::size_t const RECORD_OVERHEAD = sizeof( record_header ) + id::BLOCKS_COUNT;
+
+/// The background thread wakes up this often to drop expired values.
+std::chrono::seconds const COMPACTION_PERIOD{ 60 };
+
+/**
+ *
+ */
+[[noreturn]] void
+throw_system_error
+    ( void )
+{ throw std::system_error{ errno, std::generic_category() }; }
+
+/**
+ *
+ */
+std::uint32_t
+get_checksum
+    ( std::uint8_t const* record
+    , std::size_t record_size )
+{
+    boost::crc_32_type crc;
+    crc.process_bytes( record + sizeof( std::uint32_t )
+                     , record_size - sizeof( std::uint32_t ) );
+    return crc.checksum();
+}
+
+/**
+ *
+ */
+void
+write_all
+    ( int file
+    , std::uint8_t const* data
+    , std::size_t size
+    , std::size_t offset )
+{
+    while ( size )
+    {
+        auto const written = ::pwrite( file, data, size, off_t( offset ) );
+        if ( written < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+            throw_system_error();
+        }
+
+        data += written;
+        size -= std::size_t( written );
+        offset += std::size_t( written );
+    }
+}
+
+/**
+ *  @return true if name is the one of a segment file.
+ */
+bool
+parse_segment_name
+    ( char const* name
+    , std::uint32_t & number )
+{
+    // e.g. 00000042.log
+    if ( std::strlen( name ) != 12 || std::strcmp( name + 8, ".log" ) != 0 )
+        return false;
+
+    number = 0;
+    for ( std::size_t i = 0; i != 8; ++ i )
+    {
+        if ( name[ i ] < '0' || name[ i ] > '9' )
+            return false;
+        number = number * 10 + std::uint32_t( name[ i ] - '0' );
+    }
+
+    return true;
+}
+
+} // anonymous namespace
+
+/**
+ *  A segment file mapped in memory, records
+ *  being appended with pwrite().
+ */
+struct persistent_value_store::segment final
+{
+    /**
+     *
+     */
+    ~segment
+        ( void )
+    {
+        if ( data_ )
+            ::munmap( const_cast< std::uint8_t * >( data_ ), capacity_ );
+        if ( file_ >= 0 )
+            ::close( file_ );
+    }
+
+    /**
+     *
+     */
+    void
+    sync
+        ( void )
+    {
+        if ( ::fdatasync( file_ ) != 0 )
+            throw_system_error();
+    }
+
+    ///
+    segment_number number_;
+    ///
+    std::string path_;
+    ///
+    int file_;
+    ///
+    std::uint8_t const* data_;
+    /// The mapped bytes count, records end before.
+    std::size_t capacity_;
+    /// The bytes count of the records.
+    std::size_t size_;
+    /// The bytes count of the indexed records.
+    std::size_t live_bytes_;
+    /// The latest expiration time of the records.
+    std::int64_t last_expiration_time_;
+};
+
+persistent_value_store::persistent_value_store
+    ( std::string const& directory
+    , std::size_t bytes_budget
+    , std::chrono::seconds ttl
+    , std::size_t segment_size )
+        : directory_( directory )
+        , bytes_budget_( bytes_budget )
+        , ttl_( ttl )
+        , segment_size_( std::min< std::size_t >( segment_size
+                                                , std::numeric_limits< std::uint32_t >::max() ) )
+        , mutex_()
+        , segments_()
+        , index_()
+        , compaction_mutex_()
+        , compaction_requested_()
+        , is_compaction_requested_( false )
+        , is_stop_requested_( false )
+        , values_count_( 0 )
+        , bytes_count_( 0 )
+        , evictions_count_( 0 )
+        , expirations_count_( 0 )
+        , compaction_thread_()
+{
+    open_segments();
+    compaction_thread_ = std::thread{ &persistent_value_store::run_compaction, this };
+}
+
+persistent_value_store::~persistent_value_store
+    ( void )
+{
+    {
+        lock_type lock{ mutex_ };
+        is_stop_requested_ = true;
+    }
+    compaction_requested_.notify_one();
+    compaction_thread_.join();
+
+    try { get_active_segment().sync(); }
+    catch ( std::system_error const& ) { }
+}
+
+bool
+persistent_value_store::assign
+    ( key_type const& key
+    , value_type const& value )
+{
+    auto const bytes_count = get_bytes_count( std::uint32_t( value.size() ) );
+    if ( bytes_count > bytes_budget_
+       || RECORD_OVERHEAD + value.size() > segment_size_ )
+        return false;
+
+    lock_type lock{ mutex_ };
+
+    // Make room for the new value, dropping the oldest segments.
+    for ( ; ; )
+    {
+        auto const previous = index_.find( key );
+        auto const previous_bytes_count = previous == index_.end()
+                ? 0
+                : get_bytes_count( previous->second.value_size_ );
+        if ( bytes_count_ - previous_bytes_count + bytes_count <= bytes_budget_ )
+            break;
+
+        // The active segment is sealed before being dropped.
+        if ( segments_.size() == 1 )
+            create_segment( get_active_segment().number_ + 1 );
+
+        evictions_count_ += drop_segment( segments_.begin() );
+    }
+
+    auto const expiration_time = get_now() + ttl_.count();
+    append( key, value.data(), std::uint32_t( value.size() ), expiration_time );
+
+    return true;
+}
+
+bool
+persistent_value_store::find
+    ( key_type const& key
+    , value_type & value )
+{
+    auto const shared = find_shared( key );
+    if ( ! shared )
+        return false;
+
+    value.assign( shared.data_, shared.data_ + shared.size_ );
+    return true;
+}
+
+shared_buffer
+persistent_value_store::find_shared
+    ( key_type const& key )
+{
+    lock_type lock{ mutex_ };
+
+    auto const found = index_.find( key );
+    if ( found == index_.end() )
+        return shared_buffer{};
+
+    auto const l = found->second;
+    if ( l.expiration_time_ <= get_now() )
+    {
+        unindex_record( key, l );
+        ++ expirations_count_;
+        return shared_buffer{};
+    }
+
+    // The segment stays mapped while the value is referenced.
+    auto const& s = segments_.at( l.segment_ );
+    auto const data = s->data_ + l.offset_ + RECORD_OVERHEAD;
+    return shared_buffer{ std::shared_ptr< void const >{ s, data }
+                        , data
+                        , l.value_size_ };
+}
+
+void
+persistent_value_store::compact
+    ( void )
+{
+    std::lock_guard< std::mutex > compaction{ compaction_mutex_ };
+    while ( compact_once() )
+        continue;
+}
+
+std::size_t
+persistent_value_store::get_segments_count
+    ( void )
+    const
+{
+    lock_type lock{ mutex_ };
+    return segments_.size();
+}
+
+void
+persistent_value_store::open_segments
+    ( void )
+{
+    if ( ::mkdir( directory_.c_str(), 0755 ) != 0 && errno != EEXIST )
+        throw_system_error();
+
+    auto const d = ::opendir( directory_.c_str() );
+    if ( ! d )
+        throw_system_error();
+
+    std::vector< segment_number > numbers;
+    while ( auto const entry = ::readdir( d ) )
+    {
+        segment_number number;
+        if ( parse_segment_name( entry->d_name, number ) )
+            numbers.push_back( number );
+    }
+    ::closedir( d );
+
+    // The latest record of a key wins, hence the oldest segments first.
+    std::sort( numbers.begin(), numbers.end() );
+    auto const now = get_now();
+    for ( auto const number : numbers )
+        recover( create_segment( number ), now );
+
+    if ( segments_.empty() )
+        create_segment( 1 );
+}
+
+void
+persistent_value_store::recover
+    ( segment & s
+    , std::int64_t now )
+{
+    struct stat status;
+    if ( ::fstat( s.file_, &status ) != 0 )
+        throw_system_error();
+
+    auto const file_size = std::size_t( status.st_size );
+
+    std::size_t offset = 0;
+    while ( file_size - offset >= RECORD_OVERHEAD )
+    {
+        auto const record = s.data_ + offset;
+
+        record_header h;
+        std::memcpy( &h, record, sizeof( h ) );
+
+        auto const record_size = RECORD_OVERHEAD + h.value_size_;
+        if ( record_size > file_size - offset
+           || h.checksum_ != get_checksum( record, record_size ) )
+            break;
+
+        key_type key;
+        std::copy_n( record + sizeof( h ), id::BLOCKS_COUNT, key.begin() );
+
+        if ( h.expiration_time_ > now )
+            index_record( key, location{ s.number_
+                                       , std::uint32_t( offset )
+                                       , h.value_size_
+                                       , h.expiration_time_ } );
+        else
+        {
+            // The previous value of the key is replaced.
+            auto const previous = index_.find( key );
+            if ( previous != index_.end() )
+                unindex_record( key, location( previous->second ) );
+        }
+
+        s.last_expiration_time_ = std::max( s.last_expiration_time_
+                                          , h.expiration_time_ );
+        offset += record_size;
+    }
+
+    // Cut the record torn by a crash.
+    s.size_ = offset;
+    if ( offset != file_size && ::ftruncate( s.file_, off_t( offset ) ) != 0 )
+        throw_system_error();
+}
+
+void
+persistent_value_store::append
+    ( key_type const& key
+    , std::uint8_t const* value
+    , std::uint32_t value_size
+    , std::int64_t expiration_time )
+{
+    auto const record_size = RECORD_OVERHEAD + value_size;
+
+    auto * active = &get_active_segment();
+    if ( active->size_ + record_size > segment_size_ && active->size_ != 0 )
+    {
+        active->sync();
+        active = &create_segment( active->number_ + 1 );
+    }
+
+    std::vector< std::uint8_t > record( record_size );
+    record_header h{ 0, value_size, expiration_time };
+    std::memcpy( record.data(), &h, sizeof( h ) );
+    std::copy( key.begin(), key.end(), record.begin() + sizeof( h ) );
+    std::copy_n( value, value_size, record.begin() + RECORD_OVERHEAD );
+
+    h.checksum_ = get_checksum( record.data(), record_size );
+    std::memcpy( record.data(), &h.checksum_, sizeof( h.checksum_ ) );
+
+    write_all( active->file_, record.data(), record_size, active->size_ );
+
+    auto const offset = active->size_;
+    active->size_ += record_size;
+    active->last_expiration_time_ = std::max( active->last_expiration_time_
+                                            , expiration_time );
+
+    index_record( key, location{ active->number_
+                               , std::uint32_t( offset )
+                               , value_size
+                               , expiration_time } );
+}
+
+void
+persistent_value_store::index_record
+    ( key_type const& key
+    , location const& l )
+{
+    auto const inserted = index_.emplace( key, l );
+    if ( ! inserted.second )
+    {
+        auto & previous = inserted.first->second;
+        bytes_count_ -= get_bytes_count( previous.value_size_ );
+
+        auto & s = *segments_.at( previous.segment_ );
+        s.live_bytes_ -= RECORD_OVERHEAD + previous.value_size_;
+
+        // Wake up the compaction once a sealed
+        // segment is mostly made of garbage.
+        if ( &s != &get_active_segment() && s.live_bytes_ * 2 < s.size_ )
+        {
+            is_compaction_requested_ = true;
+            compaction_requested_.notify_one();
+        }
+
+        previous = l;
+    }
+    else
+        ++ values_count_;
+
+    bytes_count_ += get_bytes_count( l.value_size_ );
+    segments_.at( l.segment_ )->live_bytes_ += RECORD_OVERHEAD + l.value_size_;
+}
+
+bool
+persistent_value_store::unindex_record
+    ( key_type const& key
+    , location const& l )
+{
+    auto const found = index_.find( key );
+    if ( found == index_.end()
+       || found->second.segment_ != l.segment_
+       || found->second.offset_ != l.offset_ )
+        return false;
+
+    -- values_count_;
+    bytes_count_ -= get_bytes_count( l.value_size_ );
+    segments_.at( l.segment_ )->live_bytes_ -= RECORD_OVERHEAD + l.value_size_;
+    index_.erase( found );
+
+    return true;
+}
+
+persistent_value_store::segment &
+persistent_value_store::create_segment
+    ( segment_number number )
+{
+    char name[ 16 ];
+    std::snprintf( name, sizeof( name ), "%08u.log", unsigned( number ) );
+
+    std::shared_ptr< segment > s{ new segment{ number
+                                             , directory_ + "/" + name
+                                             , -1, nullptr, 0, 0, 0
+                                             , std::numeric_limits< std::int64_t >::min() } };
+
+    s->file_ = ::open( s->path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+    if ( s->file_ < 0 )
+        throw_system_error();
+
+    struct stat status;
+    if ( ::fstat( s->file_, &status ) != 0 )
+        throw_system_error();
+
+    // The mapping covers the whole segment, records
+    // appended later are read through it.
+    s->capacity_ = std::max( segment_size_, std::size_t( status.st_size ) );
+    auto const data = ::mmap( nullptr, s->capacity_, PROT_READ, MAP_SHARED, s->file_, 0 );
+    if ( data == MAP_FAILED )
+        throw_system_error();
+    s->data_ = static_cast< std::uint8_t const* >( data );
+
+    return *( segments_[ number ] = std::move( s ) );
+}
+
+std::size_t
+persistent_value_store::drop_segment
+    ( segments::iterator s )
+{
+    auto & dropped = *s->second;
+
+    std::size_t count = 0;
+    for ( std::size_t offset = 0; offset != dropped.size_; )
+    {
+        auto const record = dropped.data_ + offset;
+
+        record_header h;
+        std::memcpy( &h, record, sizeof( h ) );
+
+        key_type key;
+        std::copy_n( record + sizeof( h ), id::BLOCKS_COUNT, key.begin() );
+
+        if ( unindex_record( key, location{ dropped.number_
+                                          , std::uint32_t( offset )
+                                          , h.value_size_
+                                          , h.expiration_time_ } ) )
+            ++ count;
+
+        offset += RECORD_OVERHEAD + h.value_size_;
+    }
+
+    ::unlink( dropped.path_.c_str() );
+    segments_.erase( s );
+
+    return count;
+}
+
+void
+persistent_value_store::compact_segment
+    ( segment_number number )
+{
+    // The lock is released between records, hence
+    // assignments and finds aren't delayed for long.
+    for ( std::size_t offset = 0; ; )
+    {
+        lock_type lock{ mutex_ };
+
+        auto const s = segments_.find( number );
+        if ( s == segments_.end() || is_stop_requested_ )
+            return;
+
+        auto & compacted = *s->second;
+        if ( offset == compacted.size_ )
+        {
+            // The copies must reach the disk before their originals are removed.
+            get_active_segment().sync();
+            drop_segment( s );
+            return;
+        }
+
+        auto const record = compacted.data_ + offset;
+
+        record_header h;
+        std::memcpy( &h, record, sizeof( h ) );
+
+        key_type key;
+        std::copy_n( record + sizeof( h ), id::BLOCKS_COUNT, key.begin() );
+
+        location const l{ number
+                        , std::uint32_t( offset )
+                        , h.value_size_
+                        , h.expiration_time_ };
+        offset += RECORD_OVERHEAD + h.value_size_;
+
+        auto const found = index_.find( key );
+        if ( found == index_.end()
+           || found->second.segment_ != l.segment_
+           || found->second.offset_ != l.offset_ )
+            continue;
+
+        if ( l.expiration_time_ <= get_now() )
+        {
+            unindex_record( key, l );
+            ++ expirations_count_;
+        }
+        else
+            append( key, record + RECORD_OVERHEAD, l.value_size_, l.expiration_time_ );
+    }
+}
+
+bool
+persistent_value_store::compact_once
+    ( void )
+{
+    segment_number compacted = 0;
+    {
+        lock_type lock{ mutex_ };
+        if ( is_stop_requested_ )
+            return false;
+
+        auto const now = get_now();
+        auto const active = std::prev( segments_.end() );
+
+        // As the ttl is the same for all values, the
+        // oldest segments are the first to expire.
+        if ( segments_.begin() != active
+           && segments_.begin()->second->last_expiration_time_ <= now )
+        {
+            expirations_count_ += drop_segment( segments_.begin() );
+            return true;
+        }
+
+        // The sealed segment with the most garbage, if above half.
+        std::size_t most_garbage = 0;
+        for ( auto s = segments_.begin(); s != active; ++ s )
+        {
+            auto const garbage = s->second->size_ - s->second->live_bytes_;
+            if ( garbage * 2 > s->second->size_ && garbage > most_garbage )
+            {
+                most_garbage = garbage;
+                compacted = s->first;
+            }
+        }
+
+        if ( ! most_garbage )
+            return false;
+    }
+
+    compact_segment( compacted );
+    return true;
+}
+
+void
+persistent_value_store::run_compaction
+    ( void )
+{
+    for ( ; ; )
+    {
+        {
+            lock_type lock{ mutex_ };
+            compaction_requested_.wait_for( lock, COMPACTION_PERIOD, [ this ] ( void )
+            { return is_stop_requested_ || is_compaction_requested_; } );
+
+            if ( is_stop_requested_ )
+                return;
+
+            is_compaction_requested_ = false;
+        }
+
+        try { compact(); }
+        // The next assignments report the failures.
+        catch ( std::system_error const& ) { }
+    }
+}
+
+std::int64_t
+persistent_value_store::get_now
+    ( void )
+{
+    using namespace std::chrono;
+    return duration_cast< seconds >( system_clock::now().time_since_epoch() ).count();
+}
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
+
@@ -0,0 +1,381 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KADEMLIA_PERSISTENT_VALUE_STORE_HPP
+#define KADEMLIA_PERSISTENT_VALUE_STORE_HPP
+
+#ifdef _MSC_VER
+#   pragma once
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <kademlia/session_base.hpp>
+
+#include "kademlia/buffer.hpp"
+#include "kademlia/constants.hpp"
+#include "kademlia/id.hpp"
+#include "kademlia/value_store.hpp"
+
+// Segments rely on POSIX files, mappings and fdatasync().
+#if defined( __linux__ )
+#   define KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+#endif
+
+namespace kademlia {
+namespace detail {
+
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+
+/**
+ *  @brief Stores values in an append-only log of segment files.
+ *  @details Each assignment appends a checksummed record (header,
+ *           key and value) to the active segment of the directory,
+ *           an in-memory index giving the position of the latest
+ *           record of each key. Segments are mapped in memory and
+ *           values are copied from these mappings.
+ *           Opening a directory rebuilds the index by scanning its
+ *           segments from the oldest, the latest record of a key
+ *           winning. A record that fails its checksum (i.e. one torn
+ *           by a crash) ends its segment, which is truncated there.
+ *           Values expire ttl after their assignment (wall clock
+ *           time, hence across restarts). Once the budget is exceeded,
+ *           the oldest segment is dropped with its values. A background
+ *           thread copies the live records of segments with more than
+ *           half of garbage to the active segment, then removes them,
+ *           and drops segments whose values have all expired.
+ *  @note Records are written without being synced, a process
+ *        crash loses nothing but a system crash may lose the
+ *        latest records (segments are synced when sealed and before
+ *        compacted ones are removed).
+ *        A value larger than a segment or the budget is rejected
+ *        and the previous value of its key is kept.
+ *        Records use the host byte order.
+ *        This class is thread safe.
+ */
+class persistent_value_store final
+{
+public:
+    ///
+    using key_type = id;
+
+    ///
+    using value_type = std::vector< std::uint8_t >;
+
+    ///
+    using statistics = session_base::storage_statistics;
+
+    ///
+    enum : std::size_t { SEGMENT_SIZE = 64 * 1024 * 1024 };
+
+public:
+    /**
+     *  @brief Open the log of directory, creating it if needed.
+     *  @param bytes_budget The bytes count of the values above
+     *         which the oldest segment is dropped.
+     *  @param ttl The duration values are kept after their assignment.
+     *  @param segment_size The size above which the active
+     *         segment is sealed and another one is created.
+     *  @throw std::system_error if the directory can't be used.
+     */
+    explicit
+    persistent_value_store
+        ( std::string const& directory
+        , std::size_t bytes_budget = VALUE_STORE_BYTES_BUDGET
+        , std::chrono::seconds ttl = VALUE_TTL
+        , std::size_t segment_size = SEGMENT_SIZE );
+
+    /**
+     *
+     */
+    ~persistent_value_store
+        ( void );
+
+    /**
+     *
+     */
+    persistent_value_store
+        ( persistent_value_store const& )
+        = delete;
+
+    /**
+     *
+     */
+    persistent_value_store &
+    operator=
+        ( persistent_value_store const& )
+        = delete;
+
+    /**
+     *  @brief Save a value, replacing the previous one.
+     *  @return false if the value exceeds the budget or a segment.
+     *  @throw std::system_error if the record can't be written.
+     */
+    bool
+    assign
+        ( key_type const& key
+        , value_type const& value );
+
+    /**
+     *  @brief Copy the value of a key into value.
+     *  @return false if the key is unknown or expired.
+     */
+    bool
+    find
+        ( key_type const& key
+        , value_type & value );
+
+    /**
+     *  @brief Share the bytes of the value of a key, without copy.
+     *  @return An empty buffer if the key is unknown or expired.
+     *  @note The bytes are kept while the buffer is referenced,
+     *        even if the value is replaced or its segment removed.
+     */
+    shared_buffer
+    find_shared
+        ( key_type const& key );
+
+    /**
+     *  @brief Compact or drop the segments worth it.
+     *  @details This is what the background thread does, this
+     *           call returns once no segment is worth it.
+     */
+    void
+    compact
+        ( void );
+
+    /**
+     *
+     */
+    std::size_t
+    size
+        ( void )
+        const
+    { return values_count_.load( std::memory_order_relaxed ); }
+
+    /**
+     *
+     */
+    std::size_t
+    get_segments_count
+        ( void )
+        const;
+
+    /**
+     *
+     */
+    statistics
+    get_statistics
+        ( void )
+        const
+    {
+        return statistics{ values_count_.load( std::memory_order_relaxed )
+                         , bytes_count_.load( std::memory_order_relaxed )
+                         , evictions_count_.load( std::memory_order_relaxed )
+                         , expirations_count_.load( std::memory_order_relaxed ) };
+    }
+
+private:
+    ///
+    using segment_number = std::uint32_t;
+
+    ///
+    struct segment;
+
+    ///
+    /// Shared with the buffers of their values.
+    using segments = std::map< segment_number, std::shared_ptr< segment > >;
+
+    /// Where the latest record of a key is.
+    struct location final
+    {
+        segment_number segment_;
+        std::uint32_t offset_;
+        std::uint32_t value_size_;
+        std::int64_t expiration_time_;
+    };
+
+    ///
+    using index = std::unordered_map
+            < key_type
+            , location
+            , value_store_key_hasher< key_type > >;
+
+    ///
+    using lock_type = std::unique_lock< std::mutex >;
+
+private:
+    /**
+     *
+     */
+    void
+    open_segments
+        ( void );
+
+    /**
+     *  @brief Index the valid records of s, truncating its torn tail.
+     */
+    void
+    recover
+        ( segment & s
+        , std::int64_t now );
+
+    /**
+     *  @brief Append a record to the active segment and index it.
+     */
+    void
+    append
+        ( key_type const& key
+        , std::uint8_t const* value
+        , std::uint32_t value_size
+        , std::int64_t expiration_time );
+
+    /**
+     *
+     */
+    void
+    index_record
+        ( key_type const& key
+        , location const& l );
+
+    /**
+     *  @brief Remove the index entry of key, if at l.
+     */
+    bool
+    unindex_record
+        ( key_type const& key
+        , location const& l );
+
+    /**
+     *
+     */
+    segment &
+    create_segment
+        ( segment_number number );
+
+    /**
+     *  @brief Remove s and the index entries of its records.
+     *  @return The count of these entries.
+     */
+    std::size_t
+    drop_segment
+        ( segments::iterator s );
+
+    /**
+     *  @brief Move the live records of s to the active segment.
+     */
+    void
+    compact_segment
+        ( segment_number number );
+
+    /**
+     *  @return true if a segment has been compacted or dropped.
+     */
+    bool
+    compact_once
+        ( void );
+
+    /**
+     *
+     */
+    void
+    run_compaction
+        ( void );
+
+    /**
+     *
+     */
+    segment &
+    get_active_segment
+        ( void )
+    { return *segments_.rbegin()->second; }
+
+    /**
+     *
+     */
+    static std::size_t
+    get_bytes_count
+        ( std::uint32_t value_size )
+    { return sizeof( key_type ) + value_size; }
+
+    /**
+     *
+     */
+    static std::int64_t
+    get_now
+        ( void );
+
+private:
+    ///
+    std::string const directory_;
+    ///
+    std::size_t const bytes_budget_;
+    ///
+    std::chrono::seconds const ttl_;
+    ///
+    std::size_t const segment_size_;
+    /// Protects segments_ and index_.
+    mutable std::mutex mutex_;
+    /// Oldest first, the last one is active.
+    segments segments_;
+    ///
+    index index_;
+    /// Serializes the compactions.
+    std::mutex compaction_mutex_;
+    ///
+    std::condition_variable compaction_requested_;
+    /// Set once a sealed segment is mostly made of garbage.
+    bool is_compaction_requested_;
+    ///
+    bool is_stop_requested_;
+    ///
+    std::atomic< std::size_t > values_count_;
+    ///
+    std::atomic< std::size_t > bytes_count_;
+    ///
+    std::atomic< std::size_t > evictions_count_;
+    ///
+    std::atomic< std::size_t > expirations_count_;
+    ///
+    std::thread compaction_thread_;
+};
+
+#endif
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
+
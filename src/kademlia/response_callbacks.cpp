@@ -26,30 +26,49 @@
 #include "kademlia/response_callbacks.hpp"
 
 #include <cassert>
-#include <iostream>
 
 #include "kademlia/error_impl.hpp"
 
 namespace kademlia {
 namespace detail {
 
-void
-response_callbacks::push_callback
-    ( id const& message_id
-    , callback const& on_message_received )
+CXX11_CONSTEXPR std::size_t response_callbacks::MAX_CALLBACK_SIZE;
+CXX11_CONSTEXPR std::size_t response_callbacks::INITIAL_CAPACITY;
+
+namespace {
+
+/// Sentinel returned when a token isn't registered.
+CXX11_CONSTEXPR std::size_t NOT_FOUND = std::size_t( -1 );
+
+} // anonymous namespace
+
+response_callbacks::response_callbacks
+    ( void )
+        : slots_( INITIAL_CAPACITY )
+        , callbacks_( INITIAL_CAPACITY )
+        , size_()
+{ }
+
+response_callbacks::~response_callbacks
+    ( void )
 {
-    auto i = callbacks_.emplace( message_id, on_message_received );
-	std::cout << "push_callback: message_id=[" << message_id << ']' << std::endl;
-    (void)i;
-    assert( i.second && "an id can't be registered twice" );
+    for ( std::size_t i = 0; i != slots_.size(); ++ i )
+        if ( slots_[ i ].operations_ )
+            slots_[ i ].operations_->destroy_( callbacks_[ i ] );
 }
 
 bool
 response_callbacks::remove_callback
     ( id const& message_id )
 {
-	std::cout << "remove_callback: message_id=[" << message_id << ']' << std::endl;
-	return callbacks_.erase( message_id ) > 0;
+    auto const index = find_slot( message_id );
+    if ( index == NOT_FOUND )
+        return false;
+
+    slots_[ index ].operations_->destroy_( callbacks_[ index ] );
+    erase_slot( index );
+
+    return true;
 }
 
 std::error_code
@@ -59,21 +78,154 @@ response_callbacks::dispatch_response
     , buffer::const_iterator i
     , buffer::const_iterator e )
 {
-	std::cout << "looking for:" << h.random_token_ << std::endl;
-    auto callback = callbacks_.find( h.random_token_ );
-    if ( callback == callbacks_.end() )
+    auto const index = find_slot( h.random_token_ );
+    if ( index == NOT_FOUND )
+        return make_error_code( UNASSOCIATED_MESSAGE_ID );
+
+    // Destroys the callback, even if it throws.
+    struct dispatched_callback final
     {
-    	std::cout << "UNASSOCIATED_MESSAGE_ID:" << h.random_token_ << std::endl;
-		return make_error_code(UNASSOCIATED_MESSAGE_ID);
-	}
-
-	std::cout << "calling:" << h.random_token_ << std::endl;
-    callback->second( sender, h, i, e );
-    callbacks_.erase( callback );
-	std::cout << "erased:" << h.random_token_ << std::endl;
+        ~dispatched_callback
+            ( void )
+        { operations_->destroy_( callback_ ); }
+
+        operations const* operations_;
+        storage callback_;
+    };
+
+    // The callback is moved out of the table first
+    // as it may register new callbacks, hence
+    // reorganize the table.
+    dispatched_callback dispatched{ slots_[ index ].operations_, {} };
+    dispatched.operations_->move_( callbacks_[ index ], dispatched.callback_ );
+    erase_slot( index );
+
+    dispatched.operations_->invoke_( dispatched.callback_, sender, h, i, e );
+
     return std::error_code{};
 }
 
+std::size_t
+response_callbacks::get_home_index
+    ( id const& message_id )
+    const
+{
+    // Tokens are random, yet fold every word so that
+    // tokens differing only in their last bits spread too.
+    id::word_type hash = 0;
+    for ( std::size_t i = 0; i != id::WORDS_COUNT; ++ i )
+        hash ^= message_id.get_word( i );
+
+    // Fibonacci hashing, slots count is a power of 2.
+    hash *= 0x9E3779B97F4A7C15ULL;
+    return std::size_t( hash >> 32 ) & ( slots_.size() - 1 );
+}
+
+std::size_t
+response_callbacks::find_slot
+    ( id const& message_id )
+    const
+{
+    auto const mask = slots_.size() - 1;
+
+    for ( auto i = get_home_index( message_id ); ; i = ( i + 1 ) & mask )
+    {
+        auto const& s = slots_[ i ];
+        if ( ! s.operations_ )
+            return NOT_FOUND;
+
+        if ( s.message_id_ == message_id )
+            return i;
+    }
+}
+
+std::size_t
+response_callbacks::reserve_slot
+    ( id const& message_id )
+{
+    assert( find_slot( message_id ) == NOT_FOUND
+          && "an id can't be registered twice" );
+
+    // Keep the load factor below 1/2 so that probe
+    // sequences stay short.
+    if ( ( size_ + 1 ) * 2 > slots_.size() )
+        grow();
+
+    auto const mask = slots_.size() - 1;
+
+    auto i = get_home_index( message_id );
+    while ( slots_[ i ].operations_ )
+        i = ( i + 1 ) & mask;
+
+    slots_[ i ].message_id_ = message_id;
+    ++ size_;
+
+    return i;
+}
+
+void
+response_callbacks::erase_slot
+    ( std::size_t index )
+{
+    auto const mask = slots_.size() - 1;
+
+    // Shift back the following entries of the probe
+    // sequence so that no tombstone is needed.
+    for ( auto next = ( index + 1 ) & mask
+        ; slots_[ next ].operations_
+        ; next = ( next + 1 ) & mask )
+    {
+        auto const home = get_home_index( slots_[ next ].message_id_ );
+
+        // Entries already between their home slot
+        // and the hole stay in place.
+        if ( ( ( next - home ) & mask ) < ( ( next - index ) & mask ) )
+            continue;
+
+        move_slot( slots_, callbacks_, next, index );
+        index = next;
+    }
+
+    slots_[ index ].operations_ = nullptr;
+    -- size_;
+}
+
+void
+response_callbacks::move_slot
+    ( slots & from_slots
+    , callbacks & from_callbacks
+    , std::size_t from
+    , std::size_t to )
+{
+    auto const ops = from_slots[ from ].operations_;
+    slots_[ to ] = from_slots[ from ];
+    ops->move_( from_callbacks[ from ], callbacks_[ to ] );
+}
+
+void
+response_callbacks::grow
+    ( void )
+{
+    slots old_slots( slots_.size() * 2 );
+    callbacks old_callbacks( slots_.size() * 2 );
+    old_slots.swap( slots_ );
+    old_callbacks.swap( callbacks_ );
+
+    auto const mask = slots_.size() - 1;
+
+    for ( std::size_t from = 0; from != old_slots.size(); ++ from )
+    {
+        if ( ! old_slots[ from ].operations_ )
+            continue;
+
+        auto to = get_home_index( old_slots[ from ].message_id_ );
+        while ( slots_[ to ].operations_ )
+            to = ( to + 1 ) & mask;
+
+        move_slot( old_slots, old_callbacks, from, to );
+    }
+}
+
 } // namespace detail
 } // namespace kademlia
 
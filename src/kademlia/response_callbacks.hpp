@@ -30,8 +30,12 @@
 #   pragma once
 #endif
 
-#include <map>
-#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "kademlia/id.hpp"
 #include "kademlia/ip_endpoint.hpp"
@@ -40,28 +44,73 @@
 namespace kademlia {
 namespace detail {
 
-///
+/**
+ *  @brief Associate in-flight request tokens with their response callback.
+ *
+ *  Tokens are probed in a flat open addressing table (linear
+ *  probing, backward shift deletion) while callbacks live inline
+ *  in a parallel array, hence registering, dispatching and removing
+ *  a callback never allocate once the table has grown to the number
+ *  of outstanding requests.
+ */
 class response_callbacks final
 {
 public:
     ///
     using endpoint_type = ip_endpoint;
 
-    ///
-    using callback = std::function< void
-            ( endpoint_type const& sender
-            , header const& h
-            , buffer::const_iterator i
-            , buffer::const_iterator e ) >;
+    /// Largest callback that can be stored in the table.
+    static CXX11_CONSTEXPR std::size_t MAX_CALLBACK_SIZE = 128;
+
+    /// Slots preallocated by a new table.
+    static CXX11_CONSTEXPR std::size_t INITIAL_CAPACITY = 64;
 
 public:
     /**
      *
      */
+    response_callbacks
+        ( void );
+
+    /**
+     *
+     */
+    response_callbacks
+        ( response_callbacks const& )
+        = delete;
+
+    /**
+     *
+     */
+    response_callbacks &
+    operator=
+        ( response_callbacks const& )
+        = delete;
+
+    /**
+     *
+     */
+    ~response_callbacks
+        ( void );
+
+    /**
+     *
+     */
+    template< typename Callback >
     void
     push_callback
         ( id const& message_id
-        , callback const& on_message_received );
+        , Callback const& on_message_received )
+    {
+        static_assert( sizeof( Callback ) <= MAX_CALLBACK_SIZE
+                     , "callback doesn't fit in a slot" );
+        static_assert( alignof( Callback ) <= alignof( storage )
+                     , "callback alignment isn't supported" );
+
+        auto const index = reserve_slot( message_id );
+        new ( &callbacks_[ index ] ) Callback( on_message_received );
+        slots_[ index ].operations_ = &callback_operations< Callback >::instance;
+    }
 
     /**
      *
@@ -80,15 +129,137 @@ public:
         , buffer::const_iterator i
         , buffer::const_iterator e );
 
+    /**
+     *  @brief Return the count of registered callbacks.
+     */
+    std::size_t
+    size
+        ( void )
+        const
+    { return size_; }
+
+private:
+    ///
+    using storage = std::aligned_storage< MAX_CALLBACK_SIZE >::type;
+
+    /// Type erased operations of a stored callback.
+    struct operations
+    {
+        ///
+        void ( * invoke_ )
+                ( storage & callback
+                , endpoint_type const& sender
+                , header const& h
+                , buffer::const_iterator i
+                , buffer::const_iterator e );
+        ///
+        void ( * move_ )
+                ( storage & from
+                , storage & to );
+        ///
+        void ( * destroy_ )
+                ( storage & callback );
+    };
+
+    ///
+    template< typename Callback >
+    struct callback_operations
+    {
+        static Callback &
+        get
+            ( storage & callback )
+        { return *reinterpret_cast< Callback * >( &callback ); }
+
+        static void
+        invoke
+            ( storage & callback
+            , endpoint_type const& sender
+            , header const& h
+            , buffer::const_iterator i
+            , buffer::const_iterator e )
+        { get( callback )( sender, h, i, e ); }
+
+        static void
+        move
+            ( storage & from
+            , storage & to )
+        {
+            new ( &to ) Callback( std::move( get( from ) ) );
+            destroy( from );
+        }
+
+        static void
+        destroy
+            ( storage & callback )
+        { get( callback ).~Callback(); }
+
+        static CXX11_CONSTEXPR operations instance{ &invoke, &move, &destroy };
+    };
+
+    /// An unused slot has no operations.
+    struct slot
+    {
+        ///
+        id message_id_;
+        ///
+        operations const* operations_;
+    };
+
+    ///
+    using slots = std::vector< slot >;
+
+    ///
+    using callbacks = std::vector< storage >;
+
 private:
     ///
-    using callbacks = std::map< id, callback >;
+    std::size_t
+    get_home_index
+        ( id const& message_id )
+        const;
+
+    ///
+    std::size_t
+    find_slot
+        ( id const& message_id )
+        const;
+
+    ///
+    std::size_t
+    reserve_slot
+        ( id const& message_id );
+
+    ///
+    void
+    move_slot
+        ( slots & from_slots
+        , callbacks & from_callbacks
+        , std::size_t from
+        , std::size_t to );
+
+    ///
+    void
+    erase_slot
+        ( std::size_t index );
+
+    ///
+    void
+    grow
+        ( void );
 
 private:
+    ///
+    slots slots_;
     ///
     callbacks callbacks_;
+    ///
+    std::size_t size_;
 };
 
+template< typename Callback >
+CXX11_CONSTEXPR response_callbacks::operations
+response_callbacks::callback_operations< Callback >::instance;
+
 } // namespace detail
 } // namespace kademlia
 
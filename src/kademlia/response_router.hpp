@@ -31,7 +31,6 @@
 #include "kademlia/response_callbacks.hpp"
 #include "kademlia/timer.hpp"
 #include "kademlia/log.hpp"
-#include <iostream>
 
 #ifdef _MSC_VER
 #   pragma once
@@ -43,36 +42,42 @@ namespace detail {
 /**
  *
  */
-class response_router final
+template< typename ClockType >
+class basic_response_router final
 {
 public:
     ///
     using endpoint_type = ip_endpoint;
 
+    ///
+    using timer_type = basic_timer< ClockType >;
+
 public:
     /**
-     *
+     *  @param strand When not null, timeouts are reported
+     *         through this strand.
      */
     explicit
-    response_router
-        ( boost::asio::io_service & io_service )
+    basic_response_router
+        ( boost::asio::io_service & io_service
+        , boost::asio::io_service::strand * strand = nullptr )
             : response_callbacks_()
-            , timer_( io_service )
+            , timer_( io_service, strand )
     { }
 
     /**
      *
      */
-    response_router
-        ( response_router const& )
+    basic_response_router
+        ( basic_response_router const& )
         = delete;
 
     /**
      *
      */
-    response_router &
+    basic_response_router &
     operator=
-        ( response_router const& )
+        ( basic_response_router const& )
         = delete;
 
     /**
@@ -96,13 +101,13 @@ public:
     }
 
     /**
-     *
+     *  @return The handle of the callback timeout.
      */
     template< typename OnResponseReceived, typename OnError >
-    void
+    typename timer_type::handle
     register_temporary_callback
         ( id const& response_id
-        , timer::duration const& callback_ttl
+        , typename timer_type::duration const& callback_ttl
         , OnResponseReceived const& on_response_received
         , OnError const& on_error )
     {
@@ -112,27 +117,58 @@ public:
             // If a callback has been removed, that means
             // the message has never been received
             // hence report the timeout to the client.
-            std::cout << "UNregister_temporary_callback[response_id]=" << response_id << std::endl;
+            LOG_DEBUG( response_router, this ) << "response '" << response_id
+                    << "' timed out." << std::endl;
             if ( response_callbacks_.remove_callback( response_id ) )
                 on_error( make_error_code( std::errc::timed_out ) );
         };
 
+        auto const timeout = timer_.expires_from_now( callback_ttl, on_timeout );
+
+        // The timeout is useless once the response has been received.
+        auto on_response = [ this, timeout, on_response_received ]
+            ( endpoint_type const& sender
+            , header const& h
+            , buffer::const_iterator i
+            , buffer::const_iterator e )
+        {
+            timer_.cancel( timeout );
+            on_response_received( sender, h, i, e );
+        };
+
         // Associate the response id with the
         // on_response_received callback.
-        std::cout << "register_temporary_callback[response_id]=" << response_id << std::endl;
-        response_callbacks_.push_callback( response_id
-                                         , on_response_received );
+        LOG_DEBUG( response_router, this ) << "waiting for response '"
+                << response_id << "'." << std::endl;
+        response_callbacks_.push_callback( response_id, on_response );
+
+        return timeout;
+    }
 
-        timer_.expires_from_now( callback_ttl, on_timeout );
+    /**
+     *  @brief Forget a callback whose request couldn't be sent.
+     *  @return false if its response or its timeout
+     *          has already been handled.
+     */
+    bool
+    unregister_temporary_callback
+        ( id const& response_id
+        , typename timer_type::handle const& timeout )
+    {
+        timer_.cancel( timeout );
+        return response_callbacks_.remove_callback( response_id );
     }
 
 private:
     ///
     response_callbacks response_callbacks_;
     ///
-    timer timer_;
+    timer_type timer_;
 };
 
+///
+using response_router = basic_response_router< clock >;
+
 } // namespace detail
 } // namespace kademlia
 
@@ -0,0 +1,196 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KADEMLIA_RING_BUFFER_HPP
+#define KADEMLIA_RING_BUFFER_HPP
+
+#ifdef _MSC_VER
+#   pragma once
+#endif
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace kademlia {
+namespace detail {
+
+/**
+ *  @brief Bounded lock-free queue usable by several
+ *         producer and consumer threads.
+ *
+ *  Each cell carries a sequence number telling whether it is
+ *  ready to be written or read at a given position, hence a
+ *  push or a pop only contends on a single atomic index
+ *  (Vyukov's bounded queue). Full and empty states are
+ *  reported rather than waited for.
+ */
+template< typename ValueType >
+class ring_buffer final
+{
+public:
+    ///
+    using value_type = ValueType;
+
+public:
+    /**
+     *  @param capacity The count of cells, must be a power of 2.
+     */
+    explicit
+    ring_buffer
+        ( std::size_t capacity )
+            : cells_( new cell[ capacity ] )
+            , mask_( capacity - 1 )
+            , push_position_{ 0 }
+            , pop_position_{ 0 }
+    {
+        assert( capacity >= 2 && ( capacity & mask_ ) == 0
+              && "capacity must be a power of 2" );
+
+        for ( std::size_t i = 0; i != capacity; ++ i )
+            cells_[ i ].sequence_.store( i, std::memory_order_relaxed );
+    }
+
+    /**
+     *
+     */
+    ring_buffer
+        ( ring_buffer const& )
+        = delete;
+
+    /**
+     *
+     */
+    ring_buffer &
+    operator=
+        ( ring_buffer const& )
+        = delete;
+
+    /**
+     *  @return false if the buffer is full.
+     */
+    template< typename Value >
+    bool
+    try_push
+        ( Value && value )
+    {
+        auto position = push_position_.load( std::memory_order_relaxed );
+
+        for ( ;; )
+        {
+            auto & c = cells_[ position & mask_ ];
+            auto const sequence = c.sequence_.load( std::memory_order_acquire );
+            auto const difference = std::ptrdiff_t( sequence - position );
+
+            if ( difference == 0 )
+            {
+                // The cell is free at this position, claim it.
+                if ( push_position_.compare_exchange_weak( position, position + 1
+                                                         , std::memory_order_relaxed ) )
+                {
+                    c.value_ = std::forward< Value >( value );
+                    c.sequence_.store( position + 1, std::memory_order_release );
+                    return true;
+                }
+            }
+            else if ( difference < 0 )
+                // The cell still holds a value from the previous lap.
+                return false;
+            else
+                position = push_position_.load( std::memory_order_relaxed );
+        }
+    }
+
+    /**
+     *  @return false if the buffer is empty.
+     */
+    bool
+    try_pop
+        ( value_type & value )
+    {
+        auto position = pop_position_.load( std::memory_order_relaxed );
+
+        for ( ;; )
+        {
+            auto & c = cells_[ position & mask_ ];
+            auto const sequence = c.sequence_.load( std::memory_order_acquire );
+            auto const difference = std::ptrdiff_t( sequence - ( position + 1 ) );
+
+            if ( difference == 0 )
+            {
+                if ( pop_position_.compare_exchange_weak( position, position + 1
+                                                        , std::memory_order_relaxed ) )
+                {
+                    value = std::move( c.value_ );
+                    // Make the cell available for the next lap.
+                    c.sequence_.store( position + mask_ + 1
+                                     , std::memory_order_release );
+                    return true;
+                }
+            }
+            else if ( difference < 0 )
+                return false;
+            else
+                position = pop_position_.load( std::memory_order_relaxed );
+        }
+    }
+
+    /**
+     *
+     */
+    std::size_t
+    capacity
+        ( void )
+        const
+    { return mask_ + 1; }
+
+private:
+    ///
+    struct cell
+    {
+        ///
+        std::atomic< std::size_t > sequence_;
+        ///
+        value_type value_;
+    };
+
+private:
+    ///
+    std::unique_ptr< cell[] > cells_;
+    ///
+    std::size_t const mask_;
+    /// Producers and consumers indices live on distinct cache lines.
+    alignas( 64 ) std::atomic< std::size_t > push_position_;
+    ///
+    alignas( 64 ) std::atomic< std::size_t > pop_position_;
+};
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
+
@@ -31,33 +31,50 @@
 #endif
 
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
-#include <list>
+#include <limits>
 #include <utility>
 #include <vector>
 #include <iterator>
 
 #include <kademlia/detail/cxx11_macros.hpp>
+#include "kademlia/constants.hpp"
 #include "kademlia/id.hpp"
 #include "kademlia/log.hpp"
+#include "kademlia/peer_index.hpp"
 
 namespace kademlia {
 namespace detail {
 
 /**
  *  This class keeps track of peers and find the known peer closed to an id.
- *  @note Current implementation use a discret symbol approach.
+ *  @note Current implementation is a binary trie whose leaves are the
+ *        k_buckets. A full k_bucket is split when it covers our own id
+ *        or, to handle unbalanced trees, when the new peer is among the
+ *        k peers closest to our own id (see sections 2.4 and 4.2 of the
+ *        Kademlia paper).
+ *  @note Peers which stop responding are replaced by the most recently
+ *        seen peers of their k_bucket replacement cache, as described
+ *        by the Kademlia paper.
  */
 template<typename PeerType>
 class routing_table final
 {
 public:
-	enum { DEFAULT_K_BUCKET_SIZE = 20 };
+	enum { DEFAULT_K_BUCKET_SIZE = 20
+		 /// A peer is evicted after this count of failures in a row
+		 /// even if there is no replacement available.
+		 , MAX_PEER_FAILURES_COUNT = 5 };
 
 	using peer_type = PeerType;
 	using value_type = std::pair< id, peer_type >;
+	/// Peers ordered from the closest to the farthest.
+	using closest_peers_type = std::vector< value_type >;
+	using duration = std::chrono::steady_clock::duration;
 
 	class iterator;
 
@@ -66,12 +83,18 @@ public:
 	 *  Construct the routing_table implementation.
 	 */
 	routing_table(const id& my_id, std::size_t k_bucket_size = DEFAULT_K_BUCKET_SIZE )
-			: k_buckets_( id::BIT_SIZE ), my_id_( my_id )
+			: nodes_{ trie_node{ { 0, 0 }, 0, 0, 0 } }
+			, k_buckets_( 1 ), replacement_caches_( 1 )
+			, my_id_( my_id )
 			, peer_count_( 0 ), k_bucket_size_( k_bucket_size )
-			, largest_k_bucket_index_( 0 )
+			, seen_count_( 0 )
 	{
 		assert( k_bucket_size_ > 0 && "k_bucket size must be > 0" );
 
+		k_buckets_.front().reserve( k_bucket_size_ );
+		closest_candidates_.reserve( k_bucket_size_ );
+		closest_peers_.reserve( k_bucket_size_ );
+
 		LOG_DEBUG( routing_table, this ) << "created with id '"
 				<< my_id_ << "'." << std::endl;
 	}
@@ -93,12 +116,23 @@ public:
 	std::size_t peer_count() const
 	{ return peer_count_; }
 
+	/**
+	 *  Count the number of k_bucket in the routing table.
+	 *  @note Complexity: O(1).
+	 */
+	std::size_t k_bucket_count() const
+	{ return k_buckets_.size(); }
+
 	/**
 	 *  Register a peer into the routing table.
 	 *  @return true if the peer has been inserted.
 	 *  @note This method takes ownership of the peer.
-	 *  @note The peer may not be pushed if the target bucket is full.
-	 *  @note Complexity: O(log n)
+	 *  @note If the target bucket is full and can't be split, the peer
+	 *        replaces a stale peer or is saved into the bucket
+	 *        replacement cache.
+	 *  @note A known peer is not inserted again but its endpoint is updated
+	 *        and it is flagged as recently seen.
+	 *  @note Complexity: O(1) if the peer is known, O(log n) otherwise.
 	 */
 	bool push(const id& peer_id, const peer_type& new_peer )
 	{
@@ -106,97 +140,258 @@ public:
 				<< new_peer << "' as '"
 				<< peer_id << "'." << std::endl;
 
-		auto k_bucket_index = find_k_bucket_index( peer_id );
-		auto & bucket = k_buckets_[ k_bucket_index ];
-
-		// If there is room in the bucket.
-		if ( bucket.size() == k_bucket_size_ )
+		// Most pushes come from known peers sending messages.
+		if ( auto const known_peer = peers_index_.find( peer_id ) )
 		{
-			update_largest_k_bucket_index( k_bucket_index );
-
-			if ( k_bucket_index != largest_k_bucket_index_ )
-				return false;
+			auto & entry = get_entry( *known_peer );
+			entry.peer_.second = new_peer;
+			entry.last_seen_ = ++ seen_count_;
+			entry.failures_count_ = 0;
+			return false;
 		}
 
-		auto const end = bucket.end();
+		auto leaf = find_leaf( peer_id );
 
-		// Check if the peer is not already known.
-		auto is_peer_known = [ &peer_id ] ( value_type const& entry )
-		{ return entry.first == peer_id; };
+		// Split the k_bucket until there is room for the new peer.
+		while ( k_buckets_[ nodes_[ leaf ].k_bucket_index_ ].size() == k_bucket_size_ )
+		{
+			if ( ! is_splittable( nodes_[ leaf ], peer_id ) )
+				return replace_stale_entry( nodes_[ leaf ].k_bucket_index_
+										  , value_type{ peer_id, new_peer } );
 
-		if ( std::find_if( bucket.begin(), end, is_peer_known ) != end )
-			return false;
+			split( leaf );
+			leaf = get_child( nodes_[ leaf ], peer_id );
+		}
 
-		bucket.insert( end, value_type{ peer_id, new_peer } );
+		auto const k_bucket_index = nodes_[ leaf ].k_bucket_index_;
+		auto & bucket = k_buckets_[ k_bucket_index ];
+
+		peers_index_.insert( peer_id
+						   , peer_index::location{ k_bucket_index
+												 , std::uint32_t( bucket.size() ) } );
+		bucket.push_back( k_bucket_entry{ value_type{ peer_id, new_peer }
+										, ++ seen_count_, 0
+										, duration::zero(), duration::zero() } );
 		++ peer_count_;
 
+		update_peer_counts( peer_id, +1 );
+
 		return true;
 	}
 
 	/**
 	 *  Remove a peer from the routing table.
 	 *  @return true if the peer has been removed.
-	 *  @note Complexity: O(log n)
+	 *  @note Complexity: O(k)
 	 */
 	bool remove(const id& peer_id)
 	{
 		LOG_DEBUG( routing_table, this ) << "removing peer '"
 				<< peer_id << "'." << std::endl;
 
-		// Find the closer bucket.
-		auto & bucket = k_buckets_[ find_k_bucket_index( peer_id ) ];
+		auto const known_peer = peers_index_.find( peer_id );
 
-		// Check if the peer is inside.
-		auto is_peer_known = [&peer_id] ( value_type const& entry )
-		{ return entry.first == peer_id; };
+		// If the peer wasn't inside.
+		if ( ! known_peer )
+			return false;
 
-		auto i = std::find_if( bucket.begin(), bucket.end(), is_peer_known );
+		erase_entry( *known_peer );
 
-		// If the peer wasn't inside.
-		if ( i == bucket.end() )
+		return true;
+	}
+
+	/**
+	 *  Report a peer which failed to respond to a request.
+	 *  @return true if the peer has been evicted.
+	 *  @note A failing peer is replaced as soon as its k_bucket replacement
+	 *        cache is not empty, otherwise it is evicted once it failed
+	 *        MAX_PEER_FAILURES_COUNT times in a row.
+	 *  @note Complexity: O(k)
+	 */
+	bool flag_peer_as_unresponsive(const id& peer_id)
+	{
+		auto const known_peer = peers_index_.find( peer_id );
+		if ( ! known_peer )
 			return false;
 
-		// Remove it.
-		bucket.erase( i );
-		--peer_count_;
+		auto const l = *known_peer;
+		auto & entry = get_entry( l );
+		++ entry.failures_count_;
+
+		LOG_DEBUG( routing_table, this ) << "peer '" << peer_id
+				<< "' failed " << entry.failures_count_ << " time(s)." << std::endl;
+
+		// Replacements may have been pushed since a room was freed.
+		auto & replacements = replacement_caches_[ l.k_bucket_index_ ];
+		while ( ! replacements.empty() && peers_index_.find( replacements.back().first ) )
+			replacements.pop_back();
+
+		if ( ! replacements.empty() )
+		{
+			replace_entry( l, replacements.back() );
+			replacements.pop_back();
+			return true;
+		}
+
+		if ( entry.failures_count_ < MAX_PEER_FAILURES_COUNT )
+			return false;
+
+		erase_entry( l );
 
 		return true;
 	}
 
 	/**
-	 *  Find closest peers to an id.
-	 *  @return An iterator to the closest peer from the id to the far.
-	 *  @note Complexity: O(log n)
+	 *  Report the round trip time of a request a peer responded to.
+	 *  @return false if the peer is unknown.
+	 *  @note As TCP does (RFC 6298), each new sample weights
+	 *        1/8 of the smoothed round trip time and 1/4
+	 *        of its variation.
+	 *  @note Complexity: O(1)
 	 */
-	iterator find(const id& id_to_find )
+	bool record_round_trip_time(const id& peer_id, duration const& round_trip_time)
 	{
-		LOG_DEBUG( routing_table, this ) << "finding peer near '"
-				<< id_to_find << "'." << std::endl;
+		auto const known_peer = peers_index_.find( peer_id );
+		if ( ! known_peer )
+			return false;
 
-		auto index = std::max( get_lowest_k_bucket_index()
-							 , find_k_bucket_index( id_to_find ) );
+		// Zero is reserved to peers which never responded.
+		auto const sample = std::max( round_trip_time, duration{ 1 } );
 
-		auto i = std::next( k_buckets_.begin(), index );
+		auto & entry = get_entry( *known_peer );
+		if ( entry.round_trip_time_ == duration::zero() )
+		{
+			entry.round_trip_time_ = sample;
+			entry.round_trip_time_variation_ = sample / 2;
+		}
+		else
+		{
+			auto const error = sample - entry.round_trip_time_;
+			entry.round_trip_time_variation_
+					+= ( ( error < duration::zero() ? -error : error )
+					   - entry.round_trip_time_variation_ ) / 4;
+			entry.round_trip_time_ += error / 8;
+		}
 
-		// Find the first non empty k_bucket.
-		while ( i->empty() && i != k_buckets_.begin() )
-			-- i;
+		entry.last_seen_ = ++ seen_count_;
+		entry.failures_count_ = 0;
 
-		return iterator( &k_buckets_, i, i->begin() );
+		return true;
 	}
 
 	/**
-	 *  @return An iterator to the end of the routing table.
+	 *  @return The smoothed round trip time of a peer,
+	 *          zero if the peer is unknown or never responded.
+	 *  @note Complexity: O(1)
 	 */
-	iterator end()
+	duration get_round_trip_time(const id& peer_id) const
+	{
+		auto const known_peer = peers_index_.find( peer_id );
+		return known_peer ? get_entry( *known_peer ).round_trip_time_ : duration::zero();
+	}
+
+	/**
+	 *  @return How long to wait for a response of a peer.
+	 *  @note The timeout is computed from the smoothed round trip
+	 *        time and its variation (Jacobson/Karels), falls back to
+	 *        PEER_LOOKUP_TIMEOUT for peers which never responded and
+	 *        doubles on each failure in a row. It is bounded by
+	 *        MIN_PEER_LOOKUP_TIMEOUT and MAX_PEER_LOOKUP_TIMEOUT.
+	 *  @note Complexity: O(1)
+	 */
+	duration get_request_timeout(const id& peer_id) const
 	{
-		assert( k_buckets_.size() > 0
-			  && "routing_table must always contains k_buckets" );
-		auto const first_k_bucket = k_buckets_.begin();
+		auto const known_peer = peers_index_.find( peer_id );
+		if ( ! known_peer )
+			return PEER_LOOKUP_TIMEOUT;
 
-		return iterator( &k_buckets_, first_k_bucket, first_k_bucket->end() );
+		auto const& entry = get_entry( *known_peer );
+		duration timeout = PEER_LOOKUP_TIMEOUT;
+		if ( entry.round_trip_time_ != duration::zero() )
+			timeout = std::max( duration{ MIN_PEER_LOOKUP_TIMEOUT }
+							  , entry.round_trip_time_
+								+ 4 * entry.round_trip_time_variation_ );
+
+		for ( auto i = entry.failures_count_; i != 0 && timeout < MAX_PEER_LOOKUP_TIMEOUT; -- i )
+			timeout *= 2;
+
+		return std::min( timeout, duration{ MAX_PEER_LOOKUP_TIMEOUT } );
+	}
+
+	/**
+	 *  @return The count of requests a peer failed
+	 *          to respond to since its last response.
+	 *  @note Complexity: O(1)
+	 */
+	std::size_t get_failures_count(const id& peer_id) const
+	{
+		auto const known_peer = peers_index_.find( peer_id );
+		return known_peer ? get_entry( *known_peer ).failures_count_ : 0;
+	}
+
+	/**
+	 *  @return true if the peer is in a k_bucket,
+	 *          i.e. not only in a replacement cache.
+	 *  @note Complexity: O(1)
+	 */
+	bool contains(const id& peer_id) const
+	{ return peers_index_.find( peer_id ) != nullptr; }
+
+	/**
+	 *  Find the peers closest to an id.
+	 *  @param id_to_find The searched id.
+	 *  @param max_count The maximum count of peers to return.
+	 *  @return Up to max_count peers, ordered from the closest
+	 *          to the farthest from id_to_find.
+	 *  @note The returned peers are stored inside the routing table,
+	 *        they remain valid until the next call to closest(),
+	 *        find() or push().
+	 *  @note Complexity: O(k log k), empty subtrees are skipped.
+	 */
+	closest_peers_type const& closest(const id& id_to_find
+									 , std::size_t max_count = DEFAULT_K_BUCKET_SIZE )
+	{
+		find_closest( id_to_find, max_count, closest_candidates_, closest_peers_ );
+		return closest_peers_;
+	}
+
+	/**
+	 *  Find the peers closest to an id, as closest() does,
+	 *  without using the table scratch storage.
+	 *  @param peers Receives up to max_count peers, ordered
+	 *         from the closest to the farthest from id_to_find.
+	 *  @note Unlike closest(), it can be called concurrently.
+	 *  @note Complexity: O(k log k), empty subtrees are skipped.
+	 */
+	void copy_closest(const id& id_to_find
+					 , std::size_t max_count
+					 , closest_peers_type & peers ) const
+	{
+		std::vector< closest_candidate > candidates;
+		candidates.reserve( k_bucket_size_ );
+		find_closest( id_to_find, max_count, candidates, peers );
 	}
 
+	/**
+	 *  Find closest peers to an id.
+	 *  @return An iterator to the closest peer from the id to the far.
+	 *  @note The iterator remains valid until the next call to
+	 *        closest(), find() or push().
+	 *  @note Complexity: O(n log n), prefer closest() which bounds its output.
+	 */
+	iterator find(const id& id_to_find )
+	{
+		closest( id_to_find, peer_count_ );
+
+		return iterator( &closest_peers_, 0 );
+	}
+
+	/**
+	 *  @return An iterator to the end of the routing table.
+	 */
+	iterator end()
+	{ return iterator( &closest_peers_, std::numeric_limits< std::size_t >::max() ); }
+
 	/**
 	 *  Print the routing table content.
 	 *  @param out The output stream.
@@ -211,12 +406,15 @@ public:
 			<< "\t\"k_bucket_size\": " << table.k_bucket_size_<< ',' << std::endl
 			<< "\t\"k_buckets\": " << std::endl;
 
-		for ( std::size_t i = 0, e = table.k_buckets_.size(); i != e; ++i )
+		for ( auto const& node : table.nodes_ )
 		{
+			if ( ! node.is_leaf() )
+				continue;
+
 			out << "\t{" << std::endl
-				<< "\t\t\"index\": " << i << "," << std::endl
-				<< "\t\t\"bit_value\": " << bool(table.my_id_[i]) << "," << std::endl
-				<< "\t\t\"peer_count\": " << table.k_buckets_[i].size() << std::endl
+				<< "\t\t\"index\": " << node.k_bucket_index_ << "," << std::endl
+				<< "\t\t\"depth\": " << node.depth_ << "," << std::endl
+				<< "\t\t\"peer_count\": " << node.peer_count_ << std::endl
 				<< "\t}" << std::endl;
 		}
 
@@ -224,62 +422,394 @@ public:
 	}
 
 private:
+	/// A peer and its liveness.
+	struct k_bucket_entry final
+	{
+		value_type peer_;
+		/// Value of seen_count_ when the peer was last seen.
+		std::uint64_t last_seen_;
+		/// Count of requests the peer failed to respond to in a row.
+		std::uint32_t failures_count_;
+		/// Smoothed round trip time, zero until the first response.
+		duration round_trip_time_;
+		/// Smoothed mean deviation of the round trip time.
+		duration round_trip_time_variation_;
+	};
+
 	/// Contains peer with a common base id.
-	using k_bucket = std::list< value_type >;
-	/// Contains all the k_bucket.
-	/// @note Algorithms expect a vector here, do not change this.
+	/// @note Peers are stored contiguously to keep
+	/// the bucket scan cache friendly.
+	using k_bucket = std::vector< k_bucket_entry >;
+	/// Contains all the k_bucket, in creation order.
 	using k_buckets = std::vector< k_bucket >;
+	/// Peers waiting for a room in a full k_bucket,
+	/// from the least to the most recently seen.
+	using replacement_cache = std::vector< value_type >;
+	/// Contains the replacement_cache of each k_bucket.
+	using replacement_caches = std::vector< replacement_cache >;
+
+	/// A node of the binary trie.
+	struct trie_node final
+	{
+		bool is_leaf() const
+		{ return children_[ 0 ] == 0; }
+
+		/// Indexes of the children in nodes_, selected by the
+		/// bit at depth_ of an id. Leaves have none and as the
+		/// root can't be a child, 0 means none.
+		std::uint32_t children_[ 2 ];
+		/// The k_bucket of a leaf.
+		std::uint32_t k_bucket_index_;
+		/// Count of leading bits shared by all the ids below this node.
+		std::uint32_t depth_;
+		/// Count of peers below this node.
+		std::uint32_t peer_count_;
+	};
+
+	/// The root is the first node.
+	using trie_nodes = std::vector< trie_node >;
+
+	/// A peer candidate and the most significant word
+	/// of its distance to the searched id.
+	using closest_candidate = std::pair< id::word_type, value_type const* >;
 
 private:
-	std::size_t find_k_bucket_index(const id& id_to_find) const
+	std::uint32_t get_child(trie_node const& node, const id& id_to_find) const
+	{ return node.children_[ bool( id_to_find[ node.depth_ ] ) ]; }
+
+	std::uint32_t find_leaf(const id& id_to_find) const
+	{
+		std::uint32_t i = 0;
+		while ( ! nodes_[ i ].is_leaf() )
+			i = get_child( nodes_[ i ], id_to_find );
+
+		LOG_DEBUG( routing_table, this ) << "found bucket at depth '"
+				<< nodes_[ i ].depth_ << "'." << std::endl;
+
+		return i;
+	}
+
+	/**
+	 *  Update the peer count of the nodes on the path of an id.
+	 */
+	void update_peer_counts(const id& peer_id, std::int32_t delta)
 	{
-		// Find closest bucket from the peer id.
-		// i.e. the index of the first different bit
-		// in the id of the new peer vs our id is equal to the
-		// index of the closest bucket in the buckets container.
-		std::size_t bit_index = 0;
-		while ( bit_index < id::BIT_SIZE - 1
-			  && id_to_find[ bit_index ] == my_id_[ bit_index ] )
-			++ bit_index;
+		std::uint32_t i = 0;
+		for ( ; ! nodes_[ i ].is_leaf(); i = get_child( nodes_[ i ], peer_id ) )
+			nodes_[ i ].peer_count_ += delta;
 
-		LOG_DEBUG( routing_table, this ) << "found bucket at index '"
-				<< bit_index << "'." << std::endl;
+		nodes_[ i ].peer_count_ += delta;
+	}
+
+	/**
+	 *  @return The depth of the smallest subtree around
+	 *          our own id which holds at least k peers.
+	 */
+	std::size_t get_closest_subtree_depth() const
+	{
+		std::uint32_t i = 0;
+		while ( ! nodes_[ i ].is_leaf() )
+		{
+			auto const closer_child = get_child( nodes_[ i ], my_id_ );
+			if ( nodes_[ closer_child ].peer_count_ < k_bucket_size_ )
+				break;
 
-		return bit_index;
+			i = closer_child;
+		}
+
+		return nodes_[ i ].depth_;
 	}
 
-	std::size_t get_lowest_k_bucket_index() const
+	/**
+	 *  @return true if a full leaf can be split to store the new peer.
+	 */
+	bool is_splittable(trie_node const& leaf, const id& new_peer_id)
 	{
-		std::size_t i = 0ULL, e = k_buckets_.size() - 1;
+		if ( leaf.depth_ == id::BIT_SIZE )
+			return false;
 
-		for ( std::size_t peer_count = 0ULL
-			; i != e && peer_count <= k_bucket_size_
-			; ++ i )
-			peer_count += k_buckets_[ i ].size();
+		auto const shared_bits_count = common_prefix_length( new_peer_id, my_id_ );
 
-		LOG_DEBUG( routing_table, this ) << "bottom bucket is at index '"
-				<< i << "'." << std::endl;
+		// The k_bucket covers our own id.
+		if ( shared_bits_count >= leaf.depth_ )
+			return true;
 
-		return i;
+		// Peers outside this subtree can't be among the k closest.
+		if ( shared_bits_count < get_closest_subtree_depth() )
+			return false;
+
+		auto const& closest_peers = closest( my_id_, k_bucket_size_ );
+		return closest_peers.size() < k_bucket_size_
+			|| distance( new_peer_id, my_id_ )
+					< distance( closest_peers.back().first, my_id_ );
+	}
+
+	/**
+	 *  Turn a leaf into an internal node with two leaves.
+	 *  @note The peers with a 0 at depth keep the k_bucket of the leaf.
+	 */
+	void split(std::uint32_t leaf)
+	{
+		auto const depth = nodes_[ leaf ].depth_;
+		auto const k_bucket_index = nodes_[ leaf ].k_bucket_index_;
+		auto const new_k_bucket_index = std::uint32_t( k_buckets_.size() );
+		auto const first_child = std::uint32_t( nodes_.size() );
+
+		LOG_DEBUG( routing_table, this ) << "splitting bucket at depth '"
+				<< depth << "'." << std::endl;
+
+		k_buckets_.emplace_back();
+		replacement_caches_.emplace_back();
+
+		auto & bucket = k_buckets_[ k_bucket_index ];
+		auto & new_bucket = k_buckets_[ new_k_bucket_index ];
+		new_bucket.reserve( k_bucket_size_ );
+
+		auto get_entry_id = [] ( k_bucket_entry const& entry ) -> id const&
+		{ return entry.peer_.first; };
+		move_upper_half( bucket, new_bucket, depth, get_entry_id );
+
+		update_locations( k_bucket_index );
+		update_locations( new_k_bucket_index );
+
+		auto get_replacement_id = [] ( value_type const& replacement ) -> id const&
+		{ return replacement.first; };
+		move_upper_half( replacement_caches_[ k_bucket_index ]
+					   , replacement_caches_[ new_k_bucket_index ]
+					   , depth, get_replacement_id );
+
+		nodes_.push_back( trie_node{ { 0, 0 }, k_bucket_index, depth + 1
+								   , std::uint32_t( bucket.size() ) } );
+		nodes_.push_back( trie_node{ { 0, 0 }, new_k_bucket_index, depth + 1
+								   , std::uint32_t( new_bucket.size() ) } );
+		nodes_[ leaf ].children_[ 0 ] = first_child;
+		nodes_[ leaf ].children_[ 1 ] = first_child + 1;
+	}
+
+	/**
+	 *  Move the elements whose id has a 1 at depth
+	 *  from source to destination, preserving their order.
+	 */
+	template< typename Container, typename GetId >
+	static void move_upper_half(Container & source, Container & destination
+							   , std::uint32_t depth, GetId get_id)
+	{
+		auto kept = source.begin();
+		for ( auto i = source.begin(), e = source.end(); i != e; ++ i )
+		{
+			if ( get_id( *i )[ depth ] )
+				destination.push_back( std::move( *i ) );
+			else
+			{
+				if ( kept != i )
+					*kept = std::move( *i );
+				++ kept;
+			}
+		}
+
+		source.erase( kept, source.end() );
+	}
+
+	/**
+	 *  Refresh the index of the peers of a k_bucket after they moved.
+	 */
+	void update_locations(std::uint32_t k_bucket_index)
+	{
+		auto const& bucket = k_buckets_[ k_bucket_index ];
+
+		for ( std::uint32_t i = 0, e = std::uint32_t( bucket.size() ); i != e; ++ i )
+			*peers_index_.find( bucket[ i ].peer_.first )
+					= peer_index::location{ k_bucket_index, i };
 	}
 
-	void update_largest_k_bucket_index(std::size_t index)
+	k_bucket_entry & get_entry(peer_index::location const& l)
+	{ return k_buckets_[ l.k_bucket_index_ ][ l.position_ ]; }
+
+	k_bucket_entry const& get_entry(peer_index::location const& l) const
+	{ return k_buckets_[ l.k_bucket_index_ ][ l.position_ ]; }
+
+	void replace_entry(peer_index::location const& l, value_type const& new_peer)
 	{
-		if ( k_buckets_[ largest_k_bucket_index_ ].size() <= k_bucket_size_ )
-			largest_k_bucket_index_ = index;
+		auto & entry = get_entry( l );
+
+		LOG_DEBUG( routing_table, this ) << "replacing peer '"
+				<< entry.peer_.first << "' by '"
+				<< new_peer.first << "'." << std::endl;
+
+		peers_index_.erase( entry.peer_.first );
+		peers_index_.insert( new_peer.first, l );
+		entry = k_bucket_entry{ new_peer, ++ seen_count_, 0
+							  , duration::zero(), duration::zero() };
+	}
+
+	/**
+	 *  Replace the least recently seen peer of a full k_bucket
+	 *  which failed to respond, or cache the new peer for later.
+	 *  @return true if the new peer has been inserted.
+	 */
+	bool replace_stale_entry(std::size_t k_bucket_index, value_type const& new_peer)
+	{
+		auto const& bucket = k_buckets_[ k_bucket_index ];
+
+		auto is_less_recently_seen = [] ( k_bucket_entry const& a
+										, k_bucket_entry const& b )
+		{
+			// Stale peers come first.
+			if ( ( a.failures_count_ == 0 ) != ( b.failures_count_ == 0 ) )
+				return a.failures_count_ != 0;
+
+			return a.last_seen_ < b.last_seen_;
+		};
+
+		auto const lrs = std::min_element( bucket.begin(), bucket.end()
+										 , is_less_recently_seen );
+
+		if ( lrs != bucket.end() && lrs->failures_count_ != 0 )
+		{
+			auto const position = std::uint32_t( std::distance( bucket.begin(), lrs ) );
+			replace_entry( peer_index::location{ std::uint32_t( k_bucket_index ), position }
+						 , new_peer );
+			return true;
+		}
+
+		cache_replacement( replacement_caches_[ k_bucket_index ], new_peer );
+
+		return false;
+	}
+
+	void cache_replacement(replacement_cache & replacements, value_type const& new_peer)
+	{
+		auto is_same_peer = [ &new_peer ] ( value_type const& entry )
+		{ return entry.first == new_peer.first; };
+
+		auto const known = std::find_if( replacements.begin(), replacements.end()
+									   , is_same_peer );
+
+		// The new peer becomes the most recently seen.
+		if ( known != replacements.end() )
+			replacements.erase( known );
+		else if ( replacements.size() == k_bucket_size_ )
+			replacements.erase( replacements.begin() );
+		else if ( replacements.capacity() == 0 )
+			replacements.reserve( k_bucket_size_ );
+
+		replacements.push_back( new_peer );
+	}
+
+	void erase_entry(peer_index::location const l)
+	{
+		auto & bucket = k_buckets_[ l.k_bucket_index_ ];
+		auto const peer_id = bucket[ l.position_ ].peer_.first;
+
+		peers_index_.erase( peer_id );
+		bucket.erase( std::next( bucket.begin(), l.position_ ) );
+		-- peer_count_;
+
+		update_peer_counts( peer_id, -1 );
+
+		// Following peers moved back by one position.
+		for ( auto i = l.position_, e = std::uint32_t( bucket.size() ); i != e; ++ i )
+			peers_index_.find( bucket[ i ].peer_.first )->position_ = i;
+	}
+
+	void find_closest(const id& id_to_find
+					 , std::size_t max_count
+					 , std::vector< closest_candidate > & candidates
+					 , closest_peers_type & peers ) const
+	{
+		LOG_DEBUG( routing_table, this ) << "finding " << max_count
+				<< " peers closest to '" << id_to_find << "'." << std::endl;
+
+		peers.clear();
+
+		// Ids below a trie node share its prefix, hence the child
+		// sharing the next bit of id_to_find holds peers closer than
+		// any peer of its sibling. Walking the trie depth first,
+		// closer child first, yields k_buckets by increasing distance.
+		// A pending far child is stacked at most once per depth.
+		std::array< std::uint32_t, id::BIT_SIZE + 1 > pending_nodes;
+		std::size_t pending_nodes_count = 0;
+		pending_nodes[ pending_nodes_count ++ ] = 0;
+
+		while ( pending_nodes_count != 0 && peers.size() < max_count )
+		{
+			auto const& node = nodes_[ pending_nodes[ -- pending_nodes_count ] ];
+
+			if ( node.peer_count_ == 0 )
+				continue;
+
+			if ( node.is_leaf() )
+			{
+				add_closest_candidates( k_buckets_[ node.k_bucket_index_ ], id_to_find, candidates );
+				select_closest_candidates( id_to_find, max_count, candidates, peers );
+				continue;
+			}
+
+			auto const bit = bool( id_to_find[ node.depth_ ] );
+			pending_nodes[ pending_nodes_count ++ ] = node.children_[ ! bit ];
+			pending_nodes[ pending_nodes_count ++ ] = node.children_[ bit ];
+		}
+	}
+
+	void add_closest_candidates(k_bucket const& bucket, id const& id_to_find
+							   , std::vector< closest_candidate > & candidates ) const
+	{
+		auto const target_word = id_to_find.get_word( 0 );
+
+		for ( auto const& entry : bucket )
+			candidates.emplace_back( entry.peer_.first.get_word( 0 ) ^ target_word
+								   , &entry.peer_ );
+	}
+
+	void select_closest_candidates(id const& id_to_find, std::size_t max_count
+								  , std::vector< closest_candidate > & candidates
+								  , closest_peers_type & peers ) const
+	{
+		auto const count = std::min( max_count - peers.size()
+								   , candidates.size() );
+		auto const selected_end = std::next( candidates.begin(), count );
+
+		// The full distance is only required to break the ties.
+		auto is_closer = [ &id_to_find ] ( closest_candidate const& a
+										 , closest_candidate const& b )
+		{
+			if ( a.first != b.first )
+				return a.first < b.first;
+
+			return distance( a.second->first, id_to_find )
+					< distance( b.second->first, id_to_find );
+		};
+
+		std::partial_sort( candidates.begin(), selected_end
+						 , candidates.end(), is_closer );
+
+		for ( auto i = candidates.begin(); i != selected_end; ++ i )
+			peers.push_back( *i->second );
+
+		candidates.clear();
 	}
 
 private:
-	/// This contains buckets up to id bit count.
+	/// The binary trie whose leaves are k_buckets.
+	trie_nodes nodes_;
+	/// The k_buckets of the trie leaves.
 	k_buckets k_buckets_;
+	/// The replacement cache of each bucket.
+	replacement_caches replacement_caches_;
 	/// Own id.
 	id const my_id_;
 	/// Keep a track of peer count to make size() complexity O(1).
 	std::size_t peer_count_;
+	/// Locates each peer of k_buckets_ from its id.
+	peer_index peers_index_;
 	/// This is max number of peers stored per k_bucket.
 	std::size_t k_bucket_size_;
-	/// This keeps the index of the largest subtree.
-	std::size_t largest_k_bucket_index_;
+	/// Scratch storage used by closest().
+	std::vector< closest_candidate > closest_candidates_;
+	/// Result of the last closest() call.
+	closest_peers_type closest_peers_;
+	/// Incremented each time a peer is seen.
+	std::uint64_t seen_count_;
 };
 
 
@@ -294,24 +824,20 @@ public:
 	using reference = PeerType&;
 
 	iterator
-		( k_buckets * buckets
-		, typename k_buckets::iterator current_bucket
-		, typename k_bucket::iterator current_peer )
-		: k_buckets_( buckets )
-		, current_k_bucket_( current_bucket )
-		, current_entry_( current_peer )
+		( closest_peers_type const* peers
+		, std::size_t position )
+		: peers_( peers )
+		, position_( position )
 	{ }
 
-	iterator(const iterator& other): k_buckets_(other.k_buckets_),
-		current_k_bucket_(other.current_k_bucket_),
-		current_entry_(other.current_entry_)
+	iterator(const iterator& other): peers_(other.peers_),
+		position_(other.position_)
 	{ }
 
 	iterator& operator = (const iterator& o)
 	{
-		k_buckets_ = o.k_buckets_;
-		current_k_bucket_ = o.current_k_bucket_;
-		current_entry_ = o.current_entry_;
+		peers_ = o.peers_;
+		position_ = o.position_;
 
 		return *this;
 	}
@@ -326,12 +852,12 @@ public:
 		return !equal(other);
 	}
 
-	typename routing_table::value_type& operator * () const
+	typename routing_table::value_type const& operator * () const
 	{
 		return dereference();
 	}
 
-	typename routing_table::value_type* operator -> () const
+	typename routing_table::value_type const* operator -> () const
 	{
 		return &dereference();
 	}
@@ -353,41 +879,28 @@ public:
 private:
 	void increment()
 	{
-		++ current_entry_;
-
-		// If the current entry is not at the end of the bucket
-		// then there is nothing more to do.
-		if ( current_entry_ != current_k_bucket_->end() )
-			return;
-
-		// If the current bucket is already the first (far)
-		// then there is nothing more to do, we reach the end of the routing table.
-		if ( current_k_bucket_ == k_buckets_->begin() )
-			return;
+		++ position_;
+	}
 
-		// Go to the next non-empty bucket and start from its first entry.
-		do
-			-- current_k_bucket_;
-		while ( current_k_bucket_->empty() && current_k_bucket_ != k_buckets_->begin() );
-		current_entry_ = current_k_bucket_->begin();
+	bool is_end() const
+	{
+		return position_ >= peers_->size();
 	}
 
 	bool equal(iterator const& o) const
 	{
-		return k_buckets_ == o.k_buckets_
-				&& current_k_bucket_ == o.current_k_bucket_
-				&& current_entry_ == o.current_entry_;
+		return peers_ == o.peers_
+				&& ( position_ == o.position_ || ( is_end() && o.is_end() ) );
 	}
 
-	typename routing_table::value_type& dereference() const
+	typename routing_table::value_type const& dereference() const
 	{
-		return *current_entry_;
+		return ( *peers_ )[ position_ ];
 	}
 
 private:
-	k_buckets * k_buckets_;
-	typename k_buckets::iterator current_k_bucket_;
-	typename k_bucket::iterator current_entry_;
+	closest_peers_type const* peers_;
+	std::size_t position_;
 
 };
 
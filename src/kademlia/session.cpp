@@ -82,5 +82,22 @@ session::abort
         ( void )
 { impl_->abort(); }
 
+void
+session::set_latency_aware_peer_selection
+        ( bool enabled )
+{ impl_->setLatencyAwarePeerSelection( enabled ); }
+
+session_base::storage_statistics
+session::get_storage_statistics
+        ( void )
+        const
+{ return impl_->getStorageStatistics(); }
+
+session_base::timeout_statistics
+session::get_timeout_statistics
+        ( void )
+        const
+{ return impl_->getTimeoutStatistics(); }
+
 } // namespace kademlia
 
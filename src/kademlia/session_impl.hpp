@@ -31,10 +31,20 @@
 #endif
 
 
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/udp.hpp>
 
+#include <kademlia/session_base.hpp>
+
 #include "kademlia/message_socket.hpp"
 #include "kademlia/engine.hpp"
 #include "kademlia/concurrent_guard.hpp"
@@ -43,7 +53,13 @@ namespace kademlia {
 namespace detail {
 
 /**
- *
+ *  @details With several shards, each shard owns an engine, a
+ *           socket per address family bound to the listening port
+ *           (SO_REUSEPORT) and threads running its io_service.
+ *           Engines share the routing table and the values, save
+ *           and load requests are executed by the first shard.
+ *           Threads of a shard answer requests in parallel while
+ *           responses are handled by the strand of the engine.
  */
 class session_impl
 {
@@ -56,37 +72,60 @@ public:
     using socket_type = boost::asio::ip::udp::socket;
     ///
     using engine_type = detail::engine< socket_type >;
+    ///
+    using storage_statistics = session_base::storage_statistics;
+    ///
+    using timeout_statistics = session_base::timeout_statistics;
 
 public:
     /**
-     *
+     *  @param shards_count The count of engines serving the
+     *         listening endpoints, they must use a fixed port
+     *         when greater than 1.
+     *  @param threads_count The count of threads running
+     *         the io_service of each shard.
+     *  @param storage_directory If not empty, stored values
+     *         are kept in this directory across restarts.
      */
     session_impl
         ( endpoint const& listen_on_ipv4
-        , endpoint const& listen_on_ipv6 )
-            : io_service_{}
-            , engine_{ io_service_
-                     , listen_on_ipv4
-                     , listen_on_ipv6 }
+        , endpoint const& listen_on_ipv6
+        , std::size_t shards_count = 1
+        , std::size_t threads_count = 1
+        , std::string const& storage_directory = std::string{} )
+            : shards_{}
+            , threads_count_{ threads_count }
             , is_abort_requested_{}
+            , failure_mutex_{}
             , concurrent_guard_{}
-    { }
+    {
+        assert( threads_count_ > 0 && "at least one thread per shard" );
+        create_shards( listen_on_ipv4, listen_on_ipv6
+                     , shards_count, storage_directory );
+    }
 
     /**
-     *
+     *  @param shards_count The count of engines serving the
+     *         listening endpoints, they must use a fixed port
+     *         when greater than 1.
+     *  @param threads_count The count of threads running
+     *         the io_service of each shard.
+     *  @param storage_directory If not empty, stored values
+     *         are kept in this directory across restarts.
      */
     session_impl
         ( endpoint const& initial_peer
         , endpoint const& listen_on_ipv4
-        , endpoint const& listen_on_ipv6 )
-            : io_service_{}
-            , engine_{ io_service_
-                     , initial_peer
-                     , listen_on_ipv4
-                     , listen_on_ipv6 }
-            , is_abort_requested_{}
-            , concurrent_guard_{}
-    { }
+        , endpoint const& listen_on_ipv6
+        , std::size_t shards_count = 1
+        , std::size_t threads_count = 1
+        , std::string const& storage_directory = std::string{} )
+            : session_impl{ listen_on_ipv4
+                          , listen_on_ipv6
+                          , shards_count
+                          , threads_count
+                          , storage_directory }
+    { shards_.front()->engine_->discover_neighbors( initial_peer ); }
 
     /**
      *
@@ -98,9 +137,9 @@ public:
         , data_type const& data
         , HandlerType && handler )
     {
-        engine_.async_save( key
-                          , data
-                          , std::forward< HandlerType >( handler ) );
+        shards_.front()->engine_->async_save( key
+                                            , data
+                                            , std::forward< HandlerType >( handler ) );
     }
 
     /**
@@ -112,8 +151,45 @@ public:
         ( key_type const& key
         , HandlerType && handler )
     {
-        engine_.async_load( key
-                          , std::forward< HandlerType >( handler ) );
+        shards_.front()->engine_->async_load( key
+                                            , std::forward< HandlerType >( handler ) );
+    }
+
+    /**
+     *  @note Thread safe, shards share their values.
+     */
+    storage_statistics
+    get_storage_statistics
+        ( void )
+        const
+    { return shards_.front()->engine_->get_storage_statistics(); }
+
+    /**
+     *  @note Thread safe, the distributions
+     *        of the shards are gathered.
+     */
+    timeout_statistics
+    get_timeout_statistics
+        ( void )
+        const
+    {
+        timeout_statistics total{};
+        for ( auto & s : shards_ )
+            detail::timeout_statistics::merge( total
+                                             , s->engine_->get_timeout_statistics() );
+
+        return total;
+    }
+
+    /**
+     *  @note Thread safe.
+     */
+    void
+    set_latency_aware_peer_selection
+        ( bool enabled )
+    {
+        for ( auto & s : shards_ )
+            s->engine_->set_latency_aware_peer_selection( enabled );
     }
 
     /**
@@ -128,13 +204,27 @@ public:
         if ( ! s )
             return make_error_code( ALREADY_RUNNING );
 
+        // The calling thread is one of the first shard threads.
+        std::exception_ptr failure;
+        std::vector< std::thread > threads;
+        for ( std::size_t i = 0; i != shards_.size(); ++ i )
+            for ( std::size_t j = i == 0 ? 1 : 0; j != threads_count_; ++ j )
+                threads.emplace_back( [ this, i, &failure ] ( void )
+                { run_shard( *shards_[ i ], failure ); } );
+
+        run_shard( *shards_.front(), failure );
+
+        for ( auto & t : threads )
+            t.join();
+
+        // Reset on exit, hence an abort requested before
+        // the call is honored.
         is_abort_requested_ = false;
+        for ( std::size_t i = 0; i != shards_.size(); ++ i )
+            shards_[ i ]->io_service_.reset();
 
-        while ( ! is_abort_requested_ )
-        {
-            io_service_.run_one();
-            io_service_.poll();
-        }
+        if ( failure )
+            std::rethrow_exception( failure );
 
         return make_error_code( RUN_ABORTED );
     }
@@ -146,19 +236,85 @@ public:
     abort
         ( void )
     {
-        auto service_stopper = [ this ] ( void )
-        { is_abort_requested_ = true; };
+        is_abort_requested_ = true;
+
+        // Wake up each thread so it notices the request. Posted
+        // wake ups could all be consumed by one thread's poll().
+        for ( auto & s : shards_ )
+            s->io_service_.stop();
+    }
+
+private:
+    ///
+    struct shard
+    {
+        ///
+        boost::asio::io_service io_service_;
+        ///
+        std::unique_ptr< engine_type > engine_;
+    };
+
+private:
+    /**
+     *
+     */
+    void
+    create_shards
+        ( endpoint const& listen_on_ipv4
+        , endpoint const& listen_on_ipv6
+        , std::size_t shards_count
+        , std::string const& storage_directory )
+    {
+        auto const state = engine_type::create_shared_state( detail::id{}
+                                                           , storage_directory );
 
-        io_service_.post( service_stopper );
+        for ( std::size_t i = 0; i != shards_count; ++ i )
+        {
+            shards_.emplace_back( new shard );
+            auto & s = *shards_.back();
+            s.engine_.reset( new engine_type{ s.io_service_
+                                            , listen_on_ipv4
+                                            , listen_on_ipv6
+                                            , state, shards_count } );
+        }
+    }
+
+    /**
+     *
+     */
+    void
+    run_shard
+        ( shard & s
+        , std::exception_ptr & failure )
+    {
+        try
+        {
+            while ( ! is_abort_requested_ )
+            {
+                s.io_service_.run_one();
+                s.io_service_.poll();
+            }
+        }
+        catch ( ... )
+        {
+            // Keep the first failure and stop the other shards.
+            std::lock_guard< std::mutex > lock{ failure_mutex_ };
+            if ( ! failure )
+                failure = std::current_exception();
+
+            abort();
+        }
     }
 
 private:
     ///
-    boost::asio::io_service io_service_;
+    std::vector< std::unique_ptr< shard > > shards_;
+    ///
+    std::size_t threads_count_;
     ///
-    engine_type engine_;
+    std::atomic< bool > is_abort_requested_;
     ///
-    bool is_abort_requested_;
+    std::mutex failure_mutex_;
     ///
     detail::concurrent_guard concurrent_guard_;
 };
@@ -0,0 +1,391 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#ifndef KADEMLIA_SLAB_ALLOCATOR_HPP
+#define KADEMLIA_SLAB_ALLOCATOR_HPP
+
+#ifdef _MSC_VER
+#   pragma once
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "kademlia/id.hpp"
+
+namespace kademlia {
+namespace detail {
+
+/**
+ *  @brief Allocates blobs from size classed slabs.
+ *  @details Blob sizes are rounded up to a size class (16 bytes steps
+ *           up to 256 bytes, then 4 classes per doubling up to
+ *           MAX_SLOT_SIZE), each class carving its slots from slabs
+ *           which double in size from about 1 KiB up to SLAB_SIZE.
+ *           Released slots are reused by the next blobs of the same
+ *           class, hence storing a small blob costs neither a heap
+ *           allocation nor its header, and doesn't fragment the heap.
+ *           Larger blobs get their own allocation.
+ *           Blobs are identified by a 32 bits handle.
+ *  @note Slabs are kept once allocated, their memory is only
+ *        reused by blobs of the same class.
+ *        This class is not thread safe.
+ */
+class slab_allocator final
+{
+public:
+    ///
+    using handle = std::uint32_t;
+
+    ///
+    enum : std::size_t { SLAB_SIZE = 64 * 1024
+                       , MAX_SLOT_SIZE = 64 * 1024
+                       /// The size of the first slab of each class.
+                       , FIRST_SLAB_SIZE = 1024 };
+
+public:
+    /**
+     *
+     */
+    slab_allocator
+        ( void )
+            : classes_()
+            , large_blobs_()
+            , free_large_blobs_()
+            , reserved_bytes_count_( 0 )
+    {
+        for ( auto const size : get_slot_sizes() )
+            classes_.emplace_back( size );
+    }
+
+    /**
+     *
+     */
+    slab_allocator
+        ( slab_allocator const& )
+        = delete;
+
+    /**
+     *
+     */
+    slab_allocator &
+    operator=
+        ( slab_allocator const& )
+        = delete;
+
+    /**
+     *  @return The handle of a blob able to store size bytes.
+     */
+    handle
+    allocate
+        ( std::size_t size )
+    {
+        if ( size > MAX_SLOT_SIZE )
+            return allocate_large_blob( size );
+
+        auto const class_index = get_class_index( size );
+        auto & c = classes_[ class_index ];
+
+        std::uint32_t slot;
+        if ( ! c.free_slots_.empty() )
+        {
+            slot = c.free_slots_.back();
+            c.free_slots_.pop_back();
+        }
+        else
+        {
+            if ( c.slots_count_ > SLOT_MASK )
+                throw std::bad_alloc{};
+
+            if ( c.slots_count_ == c.get_capacity() )
+                reserved_bytes_count_ += c.add_slab();
+
+            slot = c.slots_count_ ++;
+        }
+
+        return handle( class_index << SLOT_BITS | slot );
+    }
+
+    /**
+     *  @brief Make the blob of h available to the next allocations.
+     */
+    void
+    release
+        ( handle h )
+    {
+        auto const class_index = h >> SLOT_BITS;
+        auto const slot = h & SLOT_MASK;
+
+        if ( class_index == LARGE_CLASS )
+        {
+            reserved_bytes_count_ -= large_blobs_[ slot ].size();
+            large_blobs_[ slot ] = std::vector< std::uint8_t >{};
+            free_large_blobs_.push_back( slot );
+        }
+        else
+            classes_[ class_index ].free_slots_.push_back( slot );
+    }
+
+    /**
+     *
+     */
+    std::uint8_t *
+    get
+        ( handle h )
+    {
+        auto const class_index = h >> SLOT_BITS;
+        auto const slot = h & SLOT_MASK;
+
+        if ( class_index == LARGE_CLASS )
+            return large_blobs_[ slot ].data();
+
+        return classes_[ class_index ].get_slot( slot );
+    }
+
+    /**
+     *  @return The bytes count of the slabs and large blobs.
+     */
+    std::size_t
+    get_reserved_bytes_count
+        ( void )
+        const
+    { return reserved_bytes_count_; }
+
+private:
+    ///
+    enum : std::uint32_t { SLOT_BITS = 26
+                         , SLOT_MASK = ( 1U << SLOT_BITS ) - 1
+                         , LARGE_CLASS = ( 1U << ( 32 - SLOT_BITS ) ) - 1 };
+
+    /**
+     *  Slabs of a class double from first_slab_slots_
+     *  up to last_slab_slots_ slots (both powers of 2).
+     */
+    struct size_class final
+    {
+        /**
+         *
+         */
+        explicit
+        size_class
+            ( std::size_t slot_size )
+                : slot_size_( slot_size )
+                , first_slab_slots_( get_slots_count( FIRST_SLAB_SIZE, slot_size ) )
+                , last_slab_slots_( first_slab_slots_ )
+                , growing_slabs_count_( 0 )
+                , slots_count_( 0 )
+                , slabs_()
+                , free_slots_()
+        {
+            auto const max_slots = std::max< std::size_t >( 1, SLAB_SIZE / slot_size );
+            while ( last_slab_slots_ * 2 <= max_slots )
+            {
+                last_slab_slots_ *= 2;
+                ++ growing_slabs_count_;
+            }
+        }
+
+        /**
+         *
+         */
+        static std::size_t
+        get_slots_count
+            ( std::size_t bytes_count
+            , std::size_t slot_size )
+        {
+            // The largest power of 2 fitting in bytes_count.
+            std::size_t slots = 1;
+            while ( slots * 2 * slot_size <= bytes_count )
+                slots *= 2;
+
+            return slots;
+        }
+
+        /**
+         *  @return The slots count of the allocated slabs.
+         */
+        std::size_t
+        get_capacity
+            ( void )
+            const
+        { return get_slab_first_slot( slabs_.size() ); }
+
+        /**
+         *
+         */
+        std::size_t
+        get_slab_first_slot
+            ( std::size_t slab )
+            const
+        {
+            if ( slab <= growing_slabs_count_ )
+                return first_slab_slots_ * ( ( std::size_t{ 1 } << slab ) - 1 );
+
+            return first_slab_slots_ * ( ( std::size_t{ 1 } << growing_slabs_count_ ) - 1 )
+                    + ( slab - growing_slabs_count_ ) * last_slab_slots_;
+        }
+
+        /**
+         *  @return The bytes count of the new slab.
+         */
+        std::size_t
+        add_slab
+            ( void )
+        {
+            auto const slab = slabs_.size();
+            auto const bytes_count = ( get_slab_first_slot( slab + 1 )
+                                     - get_slab_first_slot( slab ) ) * slot_size_;
+            slabs_.emplace_back( new std::uint8_t[ bytes_count ] );
+
+            return bytes_count;
+        }
+
+        /**
+         *
+         */
+        std::uint8_t *
+        get_slot
+            ( std::size_t slot )
+        {
+            std::size_t slab;
+
+            // Slabs double while growing: slab k starts at
+            // first_slab_slots_ * ( 2^k - 1 ).
+            auto const growing_slots = get_slab_first_slot( growing_slabs_count_ );
+            if ( slot < growing_slots )
+                slab = 63 - count_leading_zeros( slot / first_slab_slots_ + 1 );
+            else
+                slab = growing_slabs_count_
+                     + ( slot - growing_slots ) / last_slab_slots_;
+
+            auto const offset = slot - get_slab_first_slot( slab );
+            return slabs_[ slab ].get() + offset * slot_size_;
+        }
+
+        ///
+        std::size_t slot_size_;
+        ///
+        std::size_t first_slab_slots_;
+        ///
+        std::size_t last_slab_slots_;
+        /// Slabs before the first of last_slab_slots_ slots.
+        std::size_t growing_slabs_count_;
+        /// Slots carved so far.
+        std::uint32_t slots_count_;
+        ///
+        std::vector< std::unique_ptr< std::uint8_t[] > > slabs_;
+        ///
+        std::vector< std::uint32_t > free_slots_;
+    };
+
+private:
+    /**
+     *
+     */
+    static std::vector< std::size_t > const&
+    get_slot_sizes
+        ( void )
+    {
+        static auto const slot_sizes = []( void )
+        {
+            std::vector< std::size_t > sizes;
+            for ( std::size_t size = 16; size <= 256; size += 16 )
+                sizes.push_back( size );
+
+            for ( std::size_t power = 256; power < MAX_SLOT_SIZE; power *= 2 )
+                for ( std::size_t i = 1; i <= 4; ++ i )
+                    sizes.push_back( power + i * power / 4 );
+
+            assert( sizes.back() == MAX_SLOT_SIZE );
+            assert( sizes.size() < LARGE_CLASS );
+            return sizes;
+        }();
+
+        return slot_sizes;
+    }
+
+    /**
+     *
+     */
+    static std::size_t
+    get_class_index
+        ( std::size_t size )
+    {
+        if ( size <= 256 )
+            return size == 0 ? 0 : ( size - 1 ) / 16;
+
+        auto const& sizes = get_slot_sizes();
+        return std::size_t( std::lower_bound( sizes.begin(), sizes.end(), size )
+                          - sizes.begin() );
+    }
+
+    /**
+     *
+     */
+    handle
+    allocate_large_blob
+        ( std::size_t size )
+    {
+        std::uint32_t slot;
+        if ( ! free_large_blobs_.empty() )
+        {
+            slot = free_large_blobs_.back();
+            free_large_blobs_.pop_back();
+        }
+        else
+        {
+            slot = std::uint32_t( large_blobs_.size() );
+            if ( slot > SLOT_MASK )
+                throw std::bad_alloc{};
+
+            large_blobs_.emplace_back();
+        }
+
+        large_blobs_[ slot ].resize( size );
+        reserved_bytes_count_ += size;
+
+        return handle( LARGE_CLASS << SLOT_BITS | slot );
+    }
+
+private:
+    ///
+    std::vector< size_class > classes_;
+    ///
+    std::vector< std::vector< std::uint8_t > > large_blobs_;
+    ///
+    std::vector< std::uint32_t > free_large_blobs_;
+    ///
+    std::size_t reserved_bytes_count_;
+};
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
+
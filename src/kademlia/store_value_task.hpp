@@ -30,6 +30,7 @@
 #   pragma once
 #endif
 
+#include <chrono>
 #include <memory>
 #include <type_traits>
 #include <system_error>
@@ -43,7 +44,10 @@ namespace kademlia {
 namespace detail {
 
 ///
-template< typename SaveHandlerType, typename TrackerType, typename DataType >
+template< typename SaveHandlerType
+        , typename TrackerType
+        , typename DataType
+        , typename RoutingTableType >
 class store_value_task final
     : public lookup_task
 {
@@ -54,28 +58,36 @@ public:
     ///
     using tracker_type = TrackerType;
 
+    ///
+    using clock = typename tracker_type::clock_type;
+
     ///
     using data_type = DataType;
 
+    ///
+    using routing_table_type = RoutingTableType;
+
 public:
     /**
-     *
+     *  @param is_latency_aware If true, low latency peers are
+     *         preferred among nearly as close candidates.
      */
-    template< typename RoutingTableType >
     static void
     start
         ( detail::id const & key
         , data_type const& data
         , tracker_type & tracker
-        , RoutingTableType & routing_table
-        , save_handler_type handler )
+        , routing_table_type & routing_table
+        , save_handler_type handler
+        , bool is_latency_aware )
     {
         std::shared_ptr< store_value_task > c;
         c.reset( new store_value_task( key
                                      , data
                                      , tracker
                                      , routing_table
-                                     , std::move( handler ) ) );
+                                     , std::move( handler )
+                                     , is_latency_aware ) );
 
         try_to_store_value( c );
     }
@@ -84,19 +96,22 @@ private:
     /**
      *
      */
-    template< typename RoutingTableType, typename HandlerType >
+    template< typename HandlerType >
     store_value_task
         ( detail::id const & key
         , data_type const& data
         , tracker_type & tracker
-        , RoutingTableType & routing_table
-        , HandlerType && save_handler )
+        , routing_table_type & routing_table
+        , HandlerType && save_handler
+        , bool is_latency_aware )
             : lookup_task( key
-                         , routing_table.find( key )
-                         , routing_table.end() )
+                         , routing_table.closest( key
+                                                , ROUTING_TABLE_BUCKET_SIZE ) )
             , tracker_( tracker )
+            , routing_table_( routing_table )
             , data_( data )
             , save_handler_( std::forward< HandlerType >( save_handler ) )
+            , is_latency_aware_( is_latency_aware )
     {
         LOG_DEBUG( store_value_task, this )
                 << "create store value task for '"
@@ -135,8 +150,10 @@ private:
 
         find_peer_request_body const request{ task->get_key() };
 
-        auto const closest_candidates = task->select_new_closest_candidates
-                ( concurrent_requests_count );
+        auto const closest_candidates = task->is_latency_aware_
+                ? task->select_new_closest_candidates( concurrent_requests_count
+                                                     , task->routing_table_ )
+                : task->select_new_closest_candidates( concurrent_requests_count );
 
         for ( auto const& c : closest_candidates )
             send_find_peer_to_store_request( request, c, task );
@@ -162,13 +179,17 @@ private:
                 << task->get_key() << "' to '"
                 << current_candidate << "'." << std::endl;
 
+        auto const sent_at = clock::now();
+
         // On message received, process it.
-        auto on_message_received = [ task ]
+        auto on_message_received = [ task, current_candidate, sent_at ]
             ( ip_endpoint const& s
             , header const& h
             , buffer::const_iterator i
             , buffer::const_iterator e )
         {
+            task->routing_table_.record_round_trip_time( current_candidate.id_
+                    , clock::now() - sent_at );
             handle_find_peer_to_store_response( s, h, i, e, task );
         };
 
@@ -176,16 +197,15 @@ private:
         auto on_error = [ task, current_candidate ]
             ( std::error_code const& )
         {
-            // XXX: Can also flag candidate as invalid is
-            // present in routing table.
             task->flag_candidate_as_invalid( current_candidate.id_ );
+            task->routing_table_.flag_peer_as_unresponsive( current_candidate.id_ );
 
             try_to_store_value( task );
         };
 
         task->tracker_.send_request( request
                                    , current_candidate.endpoint_
-                                   , PEER_LOOKUP_TIMEOUT
+                                   , task->routing_table_.get_request_timeout( current_candidate.id_ )
                                    , on_message_received
                                    , on_error );
     }
@@ -275,13 +295,18 @@ private:
     ///
     tracker_type & tracker_;
     ///
+    routing_table_type & routing_table_;
+    ///
     data_type data_;
     ///
     save_handler_type save_handler_;
+    ///
+    bool is_latency_aware_;
 };
 
 /**
- *
+ *  @param is_latency_aware If true, low latency peers are
+ *         preferred among nearly as close candidates.
  */
 template< typename DataType
         , typename TrackerType
@@ -293,13 +318,18 @@ start_store_value_task
     , DataType const& data
     , TrackerType & tracker
     , RoutingTableType & routing_table
-    , HandlerType && save_handler )
+    , HandlerType && save_handler
+    , bool is_latency_aware = false )
 {
     using handler_type = typename std::decay< HandlerType >::type;
-    using task = store_value_task< handler_type, TrackerType, DataType >;
+    using task = store_value_task< handler_type
+                                 , TrackerType
+                                 , DataType
+                                 , RoutingTableType >;
 
     task::start( key, data, tracker, routing_table
-               , std::forward< HandlerType >( save_handler ) );
+               , std::forward< HandlerType >( save_handler )
+               , is_latency_aware );
 }
 
 } // namespace detail
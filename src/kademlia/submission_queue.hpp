@@ -0,0 +1,215 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KADEMLIA_SUBMISSION_QUEUE_HPP
+#define KADEMLIA_SUBMISSION_QUEUE_HPP
+
+#ifdef _MSC_VER
+#   pragma once
+#endif
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace kademlia {
+namespace detail {
+
+/**
+ *  @brief Unbounded lock-free queue filled by several
+ *         producer threads and drained by a single consumer.
+ *
+ *  A push exchanges the head of an intrusive list then links
+ *  the previous head to the new node, hence it never waits on
+ *  another producer (Vyukov's MPSC queue). A value pushed while
+ *  its predecessor is not linked yet is only seen by the next
+ *  drain, which its producer requests.
+ *
+ *  The consumer is woken up once per batch: a push only asks
+ *  for a wake up if none is pending since the last drain().
+ */
+template< typename ValueType >
+class submission_queue final
+{
+public:
+    ///
+    using value_type = ValueType;
+
+public:
+    /**
+     *
+     */
+    submission_queue
+        ( void )
+            : stub_()
+            , head_{ &stub_ }
+            , tail_( &stub_ )
+            , is_wake_up_pending_{ false }
+    { }
+
+    /**
+     *
+     */
+    submission_queue
+        ( submission_queue const& )
+        = delete;
+
+    /**
+     *
+     */
+    submission_queue &
+    operator=
+        ( submission_queue const& )
+        = delete;
+
+    /**
+     *
+     */
+    ~submission_queue
+        ( void )
+    {
+        while ( auto n = tail_->next_.load( std::memory_order_acquire ) )
+        {
+            if ( tail_ != &stub_ )
+                delete tail_;
+            tail_ = n;
+        }
+
+        if ( tail_ != &stub_ )
+            delete tail_;
+    }
+
+    /**
+     *  @brief Queue a value, from any thread.
+     *  @return true if the consumer must be woken up.
+     */
+    template< typename Value >
+    bool
+    push
+        ( Value && value )
+    {
+        auto n = new node{ std::forward< Value >( value ) };
+
+        auto previous = head_.exchange( n, std::memory_order_acq_rel );
+        previous->next_.store( n, std::memory_order_release );
+
+        // Checked once linked, hence a drain clearing
+        // the flag before this point sees the value.
+        return ! is_wake_up_pending_.exchange( true, std::memory_order_acq_rel );
+    }
+
+    /**
+     *  @brief Pop at most max_count values in submission order.
+     *  @return false if values remain, the consumer must then
+     *          drain again as producers don't wake it up.
+     *  @note Must only be called by the consumer thread.
+     */
+    template< typename Consumer >
+    bool
+    drain
+        ( Consumer && consume
+        , std::size_t max_count )
+    {
+        is_wake_up_pending_.exchange( false, std::memory_order_acq_rel );
+
+        for ( std::size_t i = 0; i != max_count; ++ i )
+        {
+            auto next = tail_->next_.load( std::memory_order_acquire );
+            if ( ! next )
+                return true;
+
+            if ( tail_ != &stub_ )
+                delete tail_;
+
+            // The popped node becomes the new stub, its
+            // value is moved out not to outlive the call.
+            tail_ = next;
+            auto value = std::move( tail_->value_ );
+            consume( value );
+        }
+
+        if ( ! tail_->next_.load( std::memory_order_acquire ) )
+            return true;
+
+        is_wake_up_pending_.store( true, std::memory_order_release );
+        return false;
+    }
+
+private:
+    ///
+    struct node
+    {
+        /**
+         *
+         */
+        node
+            ( void )
+                : value_()
+                , next_{ nullptr }
+        { }
+
+        /**
+         *
+         */
+        template< typename Value >
+        explicit
+        node
+            ( Value && value )
+                : value_( std::forward< Value >( value ) )
+                , next_{ nullptr }
+        { }
+
+        ///
+        value_type value_;
+        ///
+        std::atomic< node * > next_;
+    };
+
+    ///
+    enum { CACHE_LINE_SIZE = 64 };
+
+private:
+    ///
+    node stub_;
+    /// Producers and the consumer live on distinct cache lines.
+    /// Padded rather than aligned, so that the owners of a queue
+    /// aren't over-aligned, which operator new doesn't support
+    /// before C++17.
+    char stub_padding_[ CACHE_LINE_SIZE ];
+    ///
+    std::atomic< node * > head_;
+    ///
+    char head_padding_[ CACHE_LINE_SIZE - sizeof( std::atomic< node * > ) ];
+    ///
+    node * tail_;
+    ///
+    std::atomic< bool > is_wake_up_pending_;
+};
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
+
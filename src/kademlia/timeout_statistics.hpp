@@ -0,0 +1,254 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KADEMLIA_TIMEOUT_STATISTICS_HPP
+#define KADEMLIA_TIMEOUT_STATISTICS_HPP
+
+#ifdef _MSC_VER
+#   pragma once
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+#include <kademlia/session_base.hpp>
+
+namespace kademlia {
+namespace detail {
+
+/**
+ *  @brief Distribution of the timeouts of sent requests.
+ *  @details Timeouts are counted into buckets whose
+ *           bounds are powers of 2 milliseconds.
+ *  @note Timeouts are recorded by a single thread
+ *        while they can be read from any thread.
+ */
+class timeout_statistics final
+{
+public:
+    ///
+    using duration = std::chrono::steady_clock::duration;
+
+    ///
+    using statistics = session_base::timeout_statistics;
+
+    /// Bucket 0 counts timeouts under 1 ms, bucket i those in
+    /// [2^(i-1), 2^i) ms and the last one all timeouts above.
+    enum { BUCKETS_COUNT = statistics::BUCKETS_COUNT };
+
+public:
+    /**
+     *
+     */
+    timeout_statistics
+        ( void )
+            : buckets_()
+            , count_()
+            , sum_()
+            , min_( duration::max().count() )
+            , max_()
+    { }
+
+    /**
+     *
+     */
+    timeout_statistics
+        ( timeout_statistics const& )
+        = delete;
+
+    /**
+     *
+     */
+    timeout_statistics &
+    operator=
+        ( timeout_statistics const& )
+        = delete;
+
+    /**
+     *
+     */
+    void
+    record
+        ( duration const& timeout )
+    {
+        auto const t = timeout.count();
+        buckets_[ get_bucket_index( timeout ) ].fetch_add( 1, std::memory_order_relaxed );
+        sum_.fetch_add( t, std::memory_order_relaxed );
+        if ( t < min_.load( std::memory_order_relaxed ) )
+            min_.store( t, std::memory_order_relaxed );
+        if ( t > max_.load( std::memory_order_relaxed ) )
+            max_.store( t, std::memory_order_relaxed );
+        count_.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    /**
+     *
+     */
+    std::uint64_t
+    get_count
+        ( void )
+        const
+    { return count_.load( std::memory_order_relaxed ); }
+
+    /**
+     *  @return The count of timeouts from get_bucket_lower_bound( i )
+     *          to get_bucket_lower_bound( i + 1 ).
+     */
+    std::uint64_t
+    get_bucket_count
+        ( std::size_t i )
+        const
+    { return buckets_[ i ].load( std::memory_order_relaxed ); }
+
+    /**
+     *
+     */
+    static duration
+    get_bucket_lower_bound
+        ( std::size_t i )
+    {
+        return i == 0
+                ? duration::zero()
+                : duration{ std::chrono::milliseconds{ 1 << ( i - 1 ) } };
+    }
+
+    /**
+     *  @return Zero until a timeout has been recorded.
+     */
+    duration
+    get_min
+        ( void )
+        const
+    {
+        return get_count()
+                ? duration{ min_.load( std::memory_order_relaxed ) }
+                : duration::zero();
+    }
+
+    /**
+     *
+     */
+    duration
+    get_max
+        ( void )
+        const
+    { return duration{ max_.load( std::memory_order_relaxed ) }; }
+
+    /**
+     *  @return Zero until a timeout has been recorded.
+     */
+    duration
+    get_mean
+        ( void )
+        const
+    {
+        auto const count = get_count();
+        return count
+                ? duration{ sum_.load( std::memory_order_relaxed ) } / duration::rep( count )
+                : duration::zero();
+    }
+
+    /**
+     *  @brief Copy the distribution into the type returned by sessions.
+     */
+    statistics
+    get_statistics
+        ( void )
+        const
+    {
+        using std::chrono::duration_cast;
+        using std::chrono::milliseconds;
+
+        statistics s{};
+        s.requests_count_ = get_count();
+        s.min_timeout_ = duration_cast< milliseconds >( get_min() );
+        s.max_timeout_ = duration_cast< milliseconds >( get_max() );
+        s.mean_timeout_ = duration_cast< milliseconds >( get_mean() );
+        for ( std::size_t i = 0; i != BUCKETS_COUNT; ++ i )
+            s.timeouts_counts_[ i ] = get_bucket_count( i );
+
+        return s;
+    }
+
+    /**
+     *  @brief Add the distribution s to total, e.g. to
+     *         gather the distributions of several trackers.
+     */
+    static void
+    merge
+        ( statistics & total
+        , statistics const& s )
+    {
+        if ( ! s.requests_count_ )
+            return;
+
+        auto const count = total.requests_count_ + s.requests_count_;
+        total.mean_timeout_ = ( total.mean_timeout_ * total.requests_count_
+                              + s.mean_timeout_ * s.requests_count_ ) / count;
+        total.min_timeout_ = total.requests_count_
+                ? std::min( total.min_timeout_, s.min_timeout_ )
+                : s.min_timeout_;
+        total.max_timeout_ = std::max( total.max_timeout_, s.max_timeout_ );
+        total.requests_count_ = count;
+
+        for ( std::size_t i = 0; i != BUCKETS_COUNT; ++ i )
+            total.timeouts_counts_[ i ] += s.timeouts_counts_[ i ];
+    }
+
+private:
+    /**
+     *
+     */
+    static std::size_t
+    get_bucket_index
+        ( duration const& timeout )
+    {
+        std::size_t i = 0;
+        while ( i + 1 != BUCKETS_COUNT && timeout >= get_bucket_lower_bound( i + 1 ) )
+            ++ i;
+
+        return i;
+    }
+
+private:
+    ///
+    std::array< std::atomic< std::uint64_t >, BUCKETS_COUNT > buckets_;
+    ///
+    std::atomic< std::uint64_t > count_;
+    ///
+    std::atomic< duration::rep > sum_;
+    ///
+    std::atomic< duration::rep > min_;
+    ///
+    std::atomic< duration::rep > max_;
+};
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
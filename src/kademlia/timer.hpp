@@ -30,54 +30,100 @@
 #   pragma once
 #endif
 
-#include <map>
 #include <chrono>
-#include <functional>
+#include <system_error>
+#include <type_traits>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/basic_waitable_timer.hpp>
+#include <boost/asio/strand.hpp>
+
+#include "kademlia/clock.hpp"
+#include "kademlia/error_impl.hpp"
+#include "kademlia/log.hpp"
+#include "kademlia/timing_wheel.hpp"
 
 namespace kademlia {
 namespace detail {
 
+/**
+ *  @brief Tells how a basic_timer waits with ClockType.
+ *  @details A clock which doesn't follow the real time
+ *           specializes it with its own deadline timer.
+ */
+template< typename ClockType >
+struct timer_traits
+{
+    ///
+    using deadline_timer = boost::asio::basic_waitable_timer< ClockType >;
+};
+
 ///
-class timer final
+template< typename ClockType >
+class basic_timer final
 {
 public:
     ///
-    using clock = std::chrono::steady_clock;
+    using clock = ClockType;
 
     ///
-    using duration = clock::duration;
+    using duration = typename clock::duration;
+
+    ///
+    using handle = timing_wheel::handle;
 
 public:
     /**
-     *
+     *  @param strand When not null, expired timeouts
+     *         are called through this strand.
      */
     explicit
-    timer
-        ( boost::asio::io_service & io_service );
+    basic_timer
+        ( boost::asio::io_service & io_service
+        , boost::asio::io_service::strand * strand = nullptr )
+            : timer_{ io_service }
+            , strand_{ strand }
+            , timeouts_{ clock::now() }
+            , next_tick_{ time_point::max() }
+    { }
 
     /**
-     *
+     *  @return The handle to cancel the timeout.
      */
     template< typename Callback >
-    void
+    handle
     expires_from_now
         ( duration const& timeout
-        , Callback const& on_timer_expired );
+        , Callback const& on_timer_expired )
+    {
+        auto const h = timeouts_.schedule( clock::now() + timeout, on_timer_expired );
 
-private:
-    ///
-    using time_point = clock::time_point;
+        // If the new timeout will be the sooner to expire
+        // then cancel any pending wait and schedule this one instead.
+        auto const expiration_time = timeouts_.get_next_expiration_time();
+        if ( expiration_time < next_tick_ )
+            schedule_next_tick( expiration_time );
 
-    ///
-    using callback = std::function< void ( void ) >;
+        return h;
+    }
 
+    /**
+     *  @brief Remove a timeout without calling its callback.
+     *  @return false if the timeout already expired or was cancelled.
+     */
+    bool
+    cancel
+        ( handle const& h )
+    { return timeouts_.cancel( h ); }
+
+private:
     ///
-    using timeouts = std::multimap< time_point, callback >;
+    using time_point = typename clock::time_point;
 
     ///
-    using deadline_timer = boost::asio::basic_waitable_timer< clock >;
+    using deadline_timer = typename timer_traits< clock >::deadline_timer;
+
+    static_assert( std::is_same< time_point, timing_wheel::time_point >::value
+                 , "the clock time points must be the timing_wheel ones" );
 
 private:
     /**
@@ -85,30 +131,93 @@ private:
      */
     void
     schedule_next_tick
-        ( time_point const& expiration_time );
+        ( time_point const& expiration_time )
+    {
+        LOG_DEBUG( timer, this ) << "schedule callback at "
+                << expiration_time.time_since_epoch().count()
+                << "." << std::endl;
+
+        // This will cancel any pending task.
+        timer_.expires_at( expiration_time );
+        next_tick_ = expiration_time;
+
+        auto on_fire = [ this ]( boost::system::error_code const& failure )
+        {
+            // The current timeout has been canceled
+            // hence stop right there.
+            if ( failure == boost::asio::error::operation_aborted )
+                return;
+
+            if ( failure )
+                throw std::system_error{ make_error_code( TIMER_MALFUNCTION ) };
+
+            expire_timeouts();
+        };
+
+        if ( strand_ )
+            timer_.async_wait( strand_->wrap( on_fire ) );
+        else
+            timer_.async_wait( on_fire );
+    }
+
+    /**
+     *
+     */
+    void
+    expire_timeouts
+        ( void )
+    {
+        next_tick_ = time_point::max();
+
+        // Call the user callbacks of the expired timeouts,
+        // they may schedule new timeouts.
+        auto const count = timeouts_.size();
+        try
+        {
+            timeouts_.expire( clock::now() );
+        }
+        catch ( ... )
+        {
+            // Don't let the other timeouts wait for a new one.
+            schedule_remaining_timeouts();
+            throw;
+        }
+
+        LOG_DEBUG( timer, this )
+                << "remaining " << timeouts_.size() << " callback(s) out of "
+                << count << "." << std::endl;
+
+        schedule_remaining_timeouts();
+    }
+
+    /**
+     *
+     */
+    void
+    schedule_remaining_timeouts
+        ( void )
+    {
+        if ( ! timeouts_.empty() && next_tick_ == time_point::max() )
+        {
+            LOG_DEBUG( timer, this )
+                    << "schedule remaining timers" << std::endl;
+            schedule_next_tick( timeouts_.get_next_expiration_time() );
+        }
+    }
 
 private:
     ///
     deadline_timer timer_;
     ///
-    timeouts timeouts_;
+    boost::asio::io_service::strand * strand_;
+    ///
+    timing_wheel timeouts_;
+    /// time_point::max() when no tick is scheduled.
+    time_point next_tick_;
 };
 
-template< typename Callback >
-void
-timer::expires_from_now
-    ( duration const& timeout
-    , Callback const& on_timer_expired )
-{
-    auto expiration_time = clock::now() + timeout;
-
-    // If the current expiration time will be the sooner to expires
-    // then cancel any pending wait and schedule this one instead.
-    if ( timeouts_.empty() || expiration_time < timeouts_.begin()->first )
-        schedule_next_tick( expiration_time );
-
-    timeouts_.emplace( expiration_time, on_timer_expired );
-}
+///
+using timer = basic_timer< clock >;
 
 } // namespace detail
 } // namespace kademlia
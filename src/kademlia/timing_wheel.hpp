@@ -0,0 +1,715 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KADEMLIA_TIMING_WHEEL_HPP
+#define KADEMLIA_TIMING_WHEEL_HPP
+
+#ifdef _MSC_VER
+#   pragma once
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "kademlia/clock.hpp"
+#include "kademlia/id.hpp"
+
+namespace kademlia {
+namespace detail {
+
+/**
+ *  @brief Hierarchical timing wheel storing the timeouts of timer and Timer.
+ *  @details Expiration times are rounded up to the millisecond (tick)
+ *           while expire() truncates its time, hence timeouts expire up
+ *           to one tick late but never early. They are stored in one of
+ *           the LEVELS_COUNT wheels of SLOTS_COUNT slots, according to
+ *           the highest 8 bits digit which differs between their tick
+ *           and the current one.
+ *           When the current tick reaches a slot of an upper wheel, its
+ *           timeouts are cascaded into the lower wheels, as described by
+ *           Varghese & Lauck "Hashed and Hierarchical Timing Wheels".
+ *           Timeouts already expired when scheduled are kept apart
+ *           and expire on the next call to expire().
+ *           Timeouts are pooled in a vector and doubly linked by index,
+ *           hence they can be cancelled in constant time. Their
+ *           callbacks are stored inline in a parallel array, hence
+ *           once the pool has grown, scheduling doesn't allocate.
+ *  @note Complexity: O(1) to schedule, cancel and expire a timeout.
+ */
+class timing_wheel final
+{
+public:
+    ///
+    using clock = detail::clock;
+
+    ///
+    using duration = clock::duration;
+
+    ///
+    using time_point = clock::time_point;
+
+    ///
+    using tick = std::chrono::milliseconds;
+
+    /// Identifies a scheduled timeout.
+    struct handle final
+    {
+        std::uint32_t index_;
+        /// Entries are reused, this tells
+        /// apart the timeouts they stored.
+        std::uint32_t generation_;
+    };
+
+    ///
+    enum { SLOT_BITS = 8
+         , SLOTS_COUNT = 1 << SLOT_BITS
+         /// Enough levels to cover 64 bits ticks.
+         , LEVELS_COUNT = 64 / SLOT_BITS
+         /// Largest callback that can be stored in an entry.
+         , MAX_CALLBACK_SIZE = 128 };
+
+public:
+    /**
+     *  @param origin The time of the tick 0.
+     */
+    explicit
+    timing_wheel
+        ( time_point const& origin = clock::now() )
+            : origin_( origin )
+            , current_tick_( 0 )
+            , entries_()
+            , callbacks_()
+            , callbacks_capacity_()
+            , free_entries_( NONE )
+            , timeouts_count_( 0 )
+            , is_expiring_()
+    {
+        slots_.fill( NONE );
+        slots_occupancy_.fill( 0 );
+    }
+
+    /**
+     *
+     */
+    timing_wheel
+        ( timing_wheel const& )
+        = delete;
+
+    /**
+     *
+     */
+    timing_wheel &
+    operator=
+        ( timing_wheel const& )
+        = delete;
+
+    /**
+     *
+     */
+    ~timing_wheel
+        ( void )
+    {
+        for ( std::uint32_t i = 0; i != entries_.size(); ++ i )
+            destroy_callback( i );
+    }
+
+    /**
+     *  @brief Schedule a callback.
+     *  @return The handle to cancel the timeout.
+     *  @note Timeouts already expired scheduled from
+     *        an expiring callback are delayed to the next tick.
+     */
+    template< typename Callback >
+    handle
+    schedule
+        ( time_point const& expiration_time
+        , Callback && on_expiration )
+    {
+        using callback_type = typename std::decay< Callback >::type;
+        static_assert( sizeof( callback_type ) <= MAX_CALLBACK_SIZE
+                     , "callback doesn't fit in an entry" );
+        static_assert( alignof( callback_type ) <= alignof( storage )
+                     , "callback alignment isn't supported" );
+
+        auto const i = allocate_entry();
+        auto & e = entries_[ i ];
+        new ( &callbacks_[ i ] ) callback_type( std::forward< Callback >( on_expiration ) );
+        e.operations_ = &callback_operations< callback_type >::instance;
+        e.expiration_tick_ = to_expiration_tick( expiration_time );
+
+        if ( e.expiration_tick_ > current_tick_ )
+            link_entry( i, current_tick_ );
+        else if ( is_expiring_ )
+        {
+            e.expiration_tick_ = current_tick_ + 1;
+            link_entry( i, current_tick_ );
+        }
+        else
+            link_entry_to_slot( i, EXPIRED_SLOT );
+
+        ++ timeouts_count_;
+
+        return handle{ i, e.generation_ };
+    }
+
+    /**
+     *  @brief Remove a timeout without calling its callback.
+     *  @return false if the timeout already expired or was cancelled.
+     */
+    bool
+    cancel
+        ( handle const& h )
+    {
+        if ( h.index_ >= entries_.size()
+           || entries_[ h.index_ ].generation_ != h.generation_
+           || entries_[ h.index_ ].slot_ == NONE )
+            return false;
+
+        unlink_entry( h.index_ );
+        destroy_callback( h.index_ );
+        release_entry( h.index_ );
+        -- timeouts_count_;
+
+        return true;
+    }
+
+    /**
+     *  @brief Call the callbacks of the timeouts expired at now.
+     *  @note Callbacks are allowed to schedule new timeouts.
+     *        If a callback throws, the exception is propagated
+     *        and the remaining timeouts expire on the next call.
+     */
+    void
+    expire
+        ( time_point const& now )
+    {
+        auto const target_tick = to_tick( now );
+
+        is_expiring_ = true;
+        expiration_guard guard{ *this, EXPIRED_SLOT };
+
+        fire_slot( EXPIRED_SLOT );
+
+        while ( current_tick_ < target_tick && timeouts_count_ != 0 )
+        {
+            // Jump over the ticks without timeout.
+            auto const next_tick = std::min( target_tick, get_next_tick() );
+            cascade( next_tick );
+            current_tick_ = next_tick;
+            guard.slot_ = get_slot_index( 0, next_tick );
+            fire_slot( guard.slot_ );
+        }
+
+        if ( current_tick_ < target_tick )
+            current_tick_ = target_tick;
+    }
+
+    /**
+     *
+     */
+    bool
+    empty
+        ( void )
+        const
+    { return timeouts_count_ == 0; }
+
+    /**
+     *
+     */
+    std::size_t
+    size
+        ( void )
+        const
+    { return timeouts_count_; }
+
+    /**
+     *  @return A time when expire() should be called,
+     *          i.e. no timeout expires before it.
+     *  @note The wheel must not be empty.
+     */
+    time_point
+    get_next_expiration_time
+        ( void )
+        const
+    {
+        assert( ! empty() );
+        if ( slots_[ EXPIRED_SLOT ] != NONE )
+            return origin_ + tick( current_tick_ );
+
+        return origin_ + tick( get_next_tick() );
+    }
+
+private:
+    /// Index of no entry.
+    enum : std::uint32_t { NONE = std::numeric_limits< std::uint32_t >::max() };
+
+    ///
+    using storage = std::aligned_storage< MAX_CALLBACK_SIZE >::type;
+
+    /// Type erased operations of a stored callback.
+    struct operations
+    {
+        ///
+        void ( * invoke_ )
+                ( storage & callback );
+        ///
+        void ( * move_ )
+                ( storage & from
+                , storage & to );
+        ///
+        void ( * destroy_ )
+                ( storage & callback );
+    };
+
+    ///
+    template< typename Callback >
+    struct callback_operations
+    {
+        static Callback &
+        get
+            ( storage & callback )
+        { return *reinterpret_cast< Callback * >( &callback ); }
+
+        static void
+        invoke
+            ( storage & callback )
+        { get( callback )(); }
+
+        static void
+        move
+            ( storage & from
+            , storage & to )
+        {
+            new ( &to ) Callback( std::move( get( from ) ) );
+            destroy( from );
+        }
+
+        static void
+        destroy
+            ( storage & callback )
+        { get( callback ).~Callback(); }
+
+        static CXX11_CONSTEXPR operations instance{ &invoke, &move, &destroy };
+    };
+
+    ///
+    struct entry final
+    {
+        /// Null while no callback is stored.
+        operations const* operations_;
+        std::uint64_t expiration_tick_;
+        std::uint32_t previous_;
+        std::uint32_t next_;
+        /// NONE while the entry is free.
+        std::uint32_t slot_;
+        std::uint32_t generation_;
+    };
+
+    /// Holds the callback of an expired timeout while it's called.
+    struct expired_callback final
+    {
+        expired_callback
+            ( operations const* o
+            , storage & callback )
+                : operations_( o )
+        { operations_->move_( callback, callback_ ); }
+
+        ~expired_callback
+            ( void )
+        { operations_->destroy_( callback_ ); }
+
+        void
+        operator()
+            ( void )
+        { operations_->invoke_( callback_ ); }
+
+        operations const* operations_;
+        storage callback_;
+    };
+
+    /// Ends an expiration, even if a callback throws.
+    struct expiration_guard final
+    {
+        ~expiration_guard
+            ( void )
+        {
+            // The timeouts of the slot left by a throwing
+            // callback would otherwise wait for the wheel
+            // to turn, they expire on the next call instead.
+            if ( slot_ != EXPIRED_SLOT )
+                while ( wheel_.slots_[ slot_ ] != NONE )
+                {
+                    auto const i = wheel_.slots_[ slot_ ];
+                    wheel_.unlink_entry( i );
+                    wheel_.link_entry_to_slot( i, EXPIRED_SLOT );
+                }
+
+            wheel_.is_expiring_ = false;
+        }
+
+        timing_wheel & wheel_;
+        /// Slot whose timeouts are being fired.
+        std::size_t slot_;
+    };
+
+    ///
+    using entries = std::vector< entry >;
+
+    /// Kept apart from the entries, which are walked
+    /// more often than their callbacks are called.
+    using callbacks = std::unique_ptr< storage[] >;
+
+    ///
+    enum { INITIAL_CAPACITY = 64
+         , OCCUPANCY_WORDS_COUNT = SLOTS_COUNT / 64
+         /// Slot of the timeouts already expired when scheduled.
+         , EXPIRED_SLOT = LEVELS_COUNT * SLOTS_COUNT };
+
+    /// Wheels slots followed by EXPIRED_SLOT.
+    using slots = std::array< std::uint32_t, LEVELS_COUNT * SLOTS_COUNT + 1 >;
+
+    /// The last word only tracks EXPIRED_SLOT.
+    using slots_occupancy = std::array< std::uint64_t
+                                      , LEVELS_COUNT * OCCUPANCY_WORDS_COUNT + 1 >;
+
+private:
+    /**
+     *  @return The last tick started at t.
+     */
+    std::uint64_t
+    to_tick
+        ( time_point const& t )
+        const
+    {
+        if ( t <= origin_ )
+            return 0;
+
+        return std::uint64_t( std::chrono::duration_cast< tick >( t - origin_ ).count() );
+    }
+
+    /**
+     *  @return The first tick started at or after t.
+     */
+    std::uint64_t
+    to_expiration_tick
+        ( time_point const& t )
+        const
+    {
+        auto const ticks = to_tick( t );
+        return origin_ + tick( ticks ) < t ? ticks + 1 : ticks;
+    }
+
+    /**
+     *
+     */
+    static std::size_t
+    get_slot_index
+        ( std::size_t level
+        , std::uint64_t t )
+    {
+        return level * SLOTS_COUNT
+             + ( ( t >> ( level * SLOT_BITS ) ) & ( SLOTS_COUNT - 1 ) );
+    }
+
+    /**
+     *  @return The level of the highest digit differing
+     *          between t and reference, 0 if equal.
+     */
+    static std::size_t
+    get_level
+        ( std::uint64_t t
+        , std::uint64_t reference )
+    {
+        auto const difference = t ^ reference;
+        if ( difference == 0 )
+            return 0;
+
+        return ( 63 - count_leading_zeros( difference ) ) / SLOT_BITS;
+    }
+
+    /**
+     *
+     */
+    std::uint32_t
+    allocate_entry
+        ( void )
+    {
+        if ( free_entries_ == NONE )
+        {
+            if ( entries_.size() == callbacks_capacity_ )
+                grow_callbacks();
+
+            entries_.push_back( entry{ nullptr, 0, NONE, NONE, NONE, 0 } );
+            return std::uint32_t( entries_.size() - 1 );
+        }
+
+        auto const i = free_entries_;
+        free_entries_ = entries_[ i ].next_;
+        return i;
+    }
+
+    /**
+     *  @brief Double the callbacks capacity, moving the stored ones.
+     */
+    void
+    grow_callbacks
+        ( void )
+    {
+        auto const capacity = std::max< std::size_t >( INITIAL_CAPACITY
+                                                     , 2 * callbacks_capacity_ );
+        // Left uninitialized as only the stored callbacks are constructed.
+        callbacks grown{ new storage[ capacity ] };
+        for ( std::size_t i = 0; i != entries_.size(); ++ i )
+            if ( entries_[ i ].operations_ )
+                entries_[ i ].operations_->move_( callbacks_[ i ], grown[ i ] );
+
+        callbacks_.swap( grown );
+        callbacks_capacity_ = capacity;
+    }
+
+    /**
+     *
+     */
+    void
+    destroy_callback
+        ( std::uint32_t i )
+    {
+        auto & e = entries_[ i ];
+        if ( e.operations_ )
+            e.operations_->destroy_( callbacks_[ i ] );
+        e.operations_ = nullptr;
+    }
+
+    /**
+     *
+     */
+    void
+    release_entry
+        ( std::uint32_t i )
+    {
+        // Invalidate the handles of the timeout.
+        ++ entries_[ i ].generation_;
+        entries_[ i ].slot_ = NONE;
+        entries_[ i ].next_ = free_entries_;
+        free_entries_ = i;
+    }
+
+    /**
+     *  @brief Insert an entry in the slot of its
+     *         expiration tick relative to reference.
+     */
+    void
+    link_entry
+        ( std::uint32_t i
+        , std::uint64_t reference )
+    {
+        auto const t = entries_[ i ].expiration_tick_;
+        link_entry_to_slot( i, get_slot_index( get_level( t, reference ), t ) );
+    }
+
+    /**
+     *
+     */
+    void
+    link_entry_to_slot
+        ( std::uint32_t i
+        , std::size_t s )
+    {
+        auto & e = entries_[ i ];
+        e.slot_ = std::uint32_t( s );
+        e.previous_ = NONE;
+        e.next_ = slots_[ s ];
+        if ( e.next_ != NONE )
+            entries_[ e.next_ ].previous_ = i;
+        slots_[ s ] = i;
+
+        slots_occupancy_[ s / 64 ] |= std::uint64_t( 1 ) << ( s % 64 );
+    }
+
+    /**
+     *
+     */
+    void
+    unlink_entry
+        ( std::uint32_t i )
+    {
+        auto const& e = entries_[ i ];
+        auto const s = e.slot_;
+
+        if ( e.previous_ != NONE )
+            entries_[ e.previous_ ].next_ = e.next_;
+        else
+            slots_[ s ] = e.next_;
+
+        if ( e.next_ != NONE )
+            entries_[ e.next_ ].previous_ = e.previous_;
+
+        if ( slots_[ s ] == NONE )
+            slots_occupancy_[ s / 64 ] &= ~ ( std::uint64_t( 1 ) << ( s % 64 ) );
+    }
+
+    /**
+     *  @return The first occupied slot of level in [first, SLOTS_COUNT)
+     *          or SLOTS_COUNT.
+     */
+    std::size_t
+    find_occupied_slot
+        ( std::size_t level
+        , std::size_t first )
+        const
+    {
+        auto const words = &slots_occupancy_[ level * OCCUPANCY_WORDS_COUNT ];
+        for ( auto w = first / 64; w < OCCUPANCY_WORDS_COUNT; ++ w )
+        {
+            auto word = words[ w ];
+            // Ignore the slots before first in its word.
+            if ( w == first / 64 )
+                word &= ~ std::uint64_t( 0 ) << ( first % 64 );
+
+            if ( word )
+                return w * 64 + 63 - count_leading_zeros( word & ( ~ word + 1 ) );
+        }
+
+        return SLOTS_COUNT;
+    }
+
+    /**
+     *  @return The next tick with a timeout to fire or to cascade.
+     */
+    std::uint64_t
+    get_next_tick
+        ( void )
+        const
+    {
+        // Slots of a level hold ticks sharing the upper digits
+        // of current_tick_ and a greater digit at that level.
+        for ( std::size_t level = 0; level != LEVELS_COUNT; ++ level )
+        {
+            auto const shift = level * SLOT_BITS;
+            auto const digit = ( current_tick_ >> shift ) & ( SLOTS_COUNT - 1 );
+            auto const slot = find_occupied_slot( level, digit + 1 );
+            if ( slot == SLOTS_COUNT )
+                continue;
+
+            auto const upper_shift = shift + SLOT_BITS;
+            auto const upper = upper_shift < 64
+                    ? ( current_tick_ >> upper_shift ) << upper_shift
+                    : 0;
+            return upper | ( std::uint64_t( slot ) << shift );
+        }
+
+        return std::numeric_limits< std::uint64_t >::max();
+    }
+
+    /**
+     *  @brief Move down the timeouts of the upper
+     *         levels slots reached at t.
+     */
+    void
+    cascade
+        ( std::uint64_t t )
+    {
+        for ( std::size_t level = LEVELS_COUNT - 1; level != 0; -- level )
+        {
+            // The slot is reached when all the lower digits are 0.
+            auto const lower_mask = ( std::uint64_t( 1 ) << ( level * SLOT_BITS ) ) - 1;
+            if ( t & lower_mask )
+                continue;
+
+            auto const s = get_slot_index( level, t );
+            while ( slots_[ s ] != NONE )
+            {
+                auto const i = slots_[ s ];
+                unlink_entry( i );
+                link_entry( i, t );
+            }
+        }
+    }
+
+    /**
+     *
+     */
+    void
+    fire_slot
+        ( std::size_t s )
+    {
+        // Callbacks may schedule new timeouts, but
+        // as these expire later, they land elsewhere.
+        while ( slots_[ s ] != NONE )
+        {
+            auto const i = slots_[ s ];
+            unlink_entry( i );
+
+            // The entry may be reused by the callback.
+            expired_callback on_expiration{ entries_[ i ].operations_
+                                          , callbacks_[ i ] };
+            entries_[ i ].operations_ = nullptr;
+            release_entry( i );
+            -- timeouts_count_;
+
+            on_expiration();
+        }
+    }
+
+private:
+    ///
+    time_point origin_;
+    ///
+    std::uint64_t current_tick_;
+    ///
+    entries entries_;
+    ///
+    callbacks callbacks_;
+    ///
+    std::size_t callbacks_capacity_;
+    ///
+    std::uint32_t free_entries_;
+    ///
+    std::size_t timeouts_count_;
+    ///
+    bool is_expiring_;
+    /// Head entry of each slot.
+    slots slots_;
+    /// Bit s is set when slot s is not empty.
+    slots_occupancy slots_occupancy_;
+};
+
+template< typename Callback >
+CXX11_CONSTEXPR timing_wheel::operations
+timing_wheel::callback_operations< Callback >::instance;
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
@@ -30,12 +30,15 @@
 #   pragma once
 #endif
 
+#include <cassert>
+
 #include "kademlia/log.hpp"
 #include "kademlia/message_serializer.hpp"
 #include "kademlia/response_router.hpp"
 #include "kademlia/network.hpp"
 #include "kademlia/message.hpp"
 #include "kademlia/routing_table.hpp"
+#include "kademlia/timeout_statistics.hpp"
 #include "kademlia/value_store.hpp"
 #include "kademlia/constants.hpp"
 
@@ -45,33 +48,56 @@ namespace detail {
 /**
  *
  */
-template< typename RandomEngineType, typename NetworkType >
+template< typename RandomEngineType
+        , typename NetworkType
+        , typename ClockType = clock >
 class tracker final
 {
 public:
     ///
     using network_type = NetworkType;
 
+    ///
+    using clock_type = ClockType;
+
     ///
     using endpoint_type = typename network_type::endpoint_type;
 
     ///
     using random_engine_type = RandomEngineType;
 
+public:
+    /// The shard index is stored in the last block of the tokens.
+    static CXX11_CONSTEXPR std::size_t MAX_SHARDS_COUNT = 256;
+
 public:
     /**
-     *
+     *  @param shard_index When several trackers share a port, the
+     *         index of this one, responses to its requests are
+     *         recognized with get_shard_of().
+     *  @param strand When not null, the completions touching the
+     *         pending requests are called through this strand.
      */
     tracker
         ( boost::asio::io_service & io_service
         , id const& my_id
         , network_type & network
-        , random_engine_type & random_engine )
-            : response_router_( io_service )
+        , random_engine_type & random_engine
+        , std::size_t shard_index = 0
+        , std::size_t shards_count = 1
+        , boost::asio::io_service::strand * strand = nullptr )
+            : response_router_( io_service, strand )
             , message_serializer_( my_id )
             , network_( network )
             , random_engine_( random_engine )
-    { }
+            , timeout_statistics_()
+            , shard_index_( shard_index )
+            , shards_count_( shards_count )
+            , strand_( strand )
+    {
+        assert( shards_count_ > 0 && shards_count_ <= MAX_SHARDS_COUNT
+              && shard_index_ < shards_count_ && "invalid shard" );
+    }
 
     /**
      *
@@ -89,37 +115,57 @@ public:
         = delete;
 
     /**
-     *
+     *  @note Called from the strand, if any.
      */
     template< typename Request, typename OnResponseReceived, typename OnError >
     void
     send_request
         ( Request const& request
         , endpoint_type const& e
-        , timer::duration const& timeout
+        , typename clock_type::duration const& timeout
         , OnResponseReceived const& on_response_received
         , OnError const& on_error )
     {
-        id const response_id( random_engine_ );
-        // Generate the request buffer.
-        auto message = message_serializer_.serialize( request, response_id );
-
-        // This lamba will keep the request message alive.
-        auto on_request_sent = [ this, response_id
-                               , on_response_received, on_error
-                               , timeout ]
+        auto const response_id = generate_response_id();
+        // Generate the request straight into a recycled buffer.
+        auto message = network_.acquire_buffer();
+        message_serializer_.serialize( request, response_id, *message );
+
+        timeout_statistics_.record( timeout );
+
+        // Registered before sending as another thread
+        // may receive the response before the send completes.
+        auto const timeout_handle
+                = response_router_.register_temporary_callback( response_id, timeout
+                                                              , on_response_received
+                                                              , on_error );
+
+        auto on_request_sent = [ this, response_id, timeout_handle, on_error ]
             ( std::error_code const& failure )
         {
-            if ( failure )
+            if ( failure
+               && response_router_.unregister_temporary_callback( response_id
+                                                                , timeout_handle ) )
                 on_error( failure );
-            else
-                response_router_.register_temporary_callback( response_id, timeout
-                                                            , on_response_received
-                                                            , on_error );
         };
 
-        // Serialize the request and send it.
-        network_.send( message, e, on_request_sent );
+        if ( ! strand_ )
+            return network_.send( message, e, on_request_sent );
+
+        // The sending thread may not be the one owning the requests.
+        auto on_request_sent_in_strand = [ this, on_request_sent ]
+            ( std::error_code const& failure )
+        {
+            if ( ! failure )
+                return;
+
+            auto handle_sending = [ on_request_sent, failure ] ( void )
+            { on_request_sent( failure ); };
+
+            strand_->dispatch( std::move( handle_sending ) );
+        };
+
+        network_.send( message, e, on_request_sent_in_strand );
     }
 
     /**
@@ -131,7 +177,7 @@ public:
         ( Request const& request
         , endpoint_type const& e )
     {
-        id const response_id( random_engine_ );
+        auto const response_id = generate_token( random_engine_ );
         send_response( response_id, request, e );
     }
 
@@ -145,7 +191,8 @@ public:
         , Response const& response
         , endpoint_type const& e )
     {
-        auto message = message_serializer_.serialize( response, response_id );
+        auto message = network_.acquire_buffer();
+        message_serializer_.serialize( response, response_id, *message );
 
         auto on_response_sent = []
             ( std::error_code const& /* failure */ )
@@ -154,6 +201,27 @@ public:
         network_.send( message, e, on_response_sent );
     }
 
+    /**
+     *  @brief Send a response whose body is already serialized,
+     *         only its header is serialized.
+     */
+    void
+    send_serialized_response
+        ( id const& response_id
+        , header::type type
+        , shared_buffer const& body
+        , endpoint_type const& e )
+    {
+        auto message = network_.acquire_buffer();
+        message_serializer_.serialize( type, response_id, *message );
+
+        auto on_response_sent = []
+            ( std::error_code const& /* failure */ )
+        { };
+
+        network_.send( std::move( message ), body, e, on_response_sent );
+    }
+
     /**
      *
      */
@@ -165,15 +233,62 @@ public:
         , buffer::const_iterator e )
     { response_router_.handle_new_response( s, h, i, e ); }
 
+    /**
+     *  @brief Return the index of the tracker
+     *         which sent the request of a response.
+     */
+    std::size_t
+    get_shard_of
+        ( header const& h )
+        const
+    {
+        if ( shards_count_ == 1 )
+            return 0;
+
+        return *( h.random_token_.end() - 1 ) % shards_count_;
+    }
+
+    /**
+     *  @brief Distribution of the timeouts of sent requests.
+     */
+    timeout_statistics const&
+    get_timeout_statistics
+        ( void )
+        const
+    { return timeout_statistics_; }
+
+private:
+    /**
+     *
+     */
+    id
+    generate_response_id
+        ( void )
+    {
+        auto response_id = generate_token( random_engine_ );
+        if ( shards_count_ != 1 )
+            *( response_id.end() - 1 ) = id::block_type( shard_index_ );
+
+        return response_id;
+    }
+
 private:
     ///
-    response_router response_router_;
+    basic_response_router< clock_type > response_router_;
     ///
     message_serializer message_serializer_;
     ///
     network_type & network_;
     ///
     random_engine_type & random_engine_;
+    ///
+    timeout_statistics timeout_statistics_;
+    ///
+    std::size_t shard_index_;
+    ///
+    std::size_t shards_count_;
+    ///
+    boost::asio::io_service::strand * strand_;
 };
 
 } // namespace detail
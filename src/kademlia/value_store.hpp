@@ -30,12 +30,24 @@
 #   pragma once
 #endif
 
+#include <atomic>
 #include <cstdint>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include "Poco/Hash.h"
 
+#include <kademlia/session_base.hpp>
+
+#include "kademlia/buffer.hpp"
+#include "kademlia/clock.hpp"
+#include "kademlia/constants.hpp"
+#include "kademlia/slab_allocator.hpp"
+
 
 namespace kademlia {
 namespace detail {
@@ -52,12 +64,590 @@ struct value_store_key_hasher
     }
 };
 
-///
+/**
+ *  @brief Stores values within a bytes budget, for a limited time.
+ *  @details Values are copied into a slab_allocator, each entry only
+ *           holding a handle and a size (Value is any contiguous
+ *           container of bytes, such as std::vector or std::string).
+ *           A value expires ttl after its last assignment and, once
+ *           the budget is exceeded, the least recently used values are
+ *           evicted. Entries are linked in two lists, by use and by
+ *           expiration time (as the ttl is the same for all values, the
+ *           latest assigned expires last), hence assign(), find() and the
+ *           counters are O(1), expired values being removed from the
+ *           front of the expiration list on assignment, the time being
+ *           read from ClockType.
+ *           Storing a value costs a single map node and a slab slot.
+ *  @note The bytes of a value are its size plus its key size, the
+ *        containers overhead and the slots rounding aren't accounted.
+ *        Counters can be read from any thread.
+ */
+template< typename Key, typename Value, typename ClockType = clock >
+class bounded_value_store final
+{
+public:
+    ///
+    using duration = typename ClockType::duration;
+
+    ///
+    using statistics = session_base::storage_statistics;
+
+    /// The bytes of a value, see pin().
+    struct pinned_value final
+    {
+        slab_allocator::handle blob_;
+        std::uint8_t const* data_;
+        std::size_t size_;
+    };
+
+public:
+    /**
+     *  @param bytes_budget The bytes count of the values above
+     *         which the least recently used ones are evicted.
+     *  @param ttl The duration values are kept after their assignment.
+     */
+    explicit
+    bounded_value_store
+        ( std::size_t bytes_budget = VALUE_STORE_BYTES_BUDGET
+        , duration ttl = VALUE_TTL )
+            : bytes_budget_( bytes_budget )
+            , ttl_( ttl )
+            , blobs_()
+            , entries_()
+            , uses_{ nullptr, nullptr }
+            , expirations_{ nullptr, nullptr }
+            , pins_()
+            , values_count_( 0 )
+            , bytes_count_( 0 )
+            , evictions_count_( 0 )
+            , expirations_count_( 0 )
+    { }
+
+    /**
+     *
+     */
+    bounded_value_store
+        ( bounded_value_store const& )
+        = delete;
+
+    /**
+     *
+     */
+    bounded_value_store &
+    operator=
+        ( bounded_value_store const& )
+        = delete;
+
+    /**
+     *  @brief Save a value, replacing the previous one.
+     *  @return false if the value alone exceeds the
+     *          budget, the key then has no value.
+     */
+    bool
+    assign
+        ( Key const& key
+        , Value value )
+    {
+        auto const now = ClockType::now();
+        remove_expired_values( now );
+
+        // The entry of a known key is reused.
+        auto i = entries_.find( key );
+        if ( i != entries_.end() )
+            detach( &*i );
+
+        auto const size = value.size();
+        auto const bytes_count = get_bytes_count( size );
+        if ( bytes_count > bytes_budget_ )
+        {
+            if ( i != entries_.end() )
+                entries_.erase( i );
+            return false;
+        }
+
+        // Make room for the new value.
+        while ( bytes_count_ + bytes_count > bytes_budget_ )
+        {
+            remove( uses_.front_ );
+            ++ evictions_count_;
+        }
+
+        if ( i == entries_.end() )
+            i = entries_.emplace( key, entry() ).first;
+
+        auto & e = i->second;
+        e.blob_ = blobs_.allocate( size );
+        if ( size )
+            std::memcpy( blobs_.get( e.blob_ ), value.data(), size );
+        e.size_ = std::uint32_t( size );
+        e.expiration_time_ = now + ttl_;
+        push_back( uses_, &entry::use_, &*i );
+        push_back( expirations_, &entry::expiration_, &*i );
+
+        ++ values_count_;
+        bytes_count_ += bytes_count;
+
+        return true;
+    }
+
+    /**
+     *  @brief Copy the value of a key into value.
+     *  @return false if the key is unknown or expired.
+     */
+    bool
+    find
+        ( Key const& key
+        , Value & value )
+    {
+        auto const n = use( key );
+        if ( ! n )
+            return false;
+
+        auto const data = blobs_.get( n->second.blob_ );
+        value.assign( data, data + n->second.size_ );
+        return true;
+    }
+
+    /**
+     *  @brief Pin the bytes of the value of a key.
+     *  @return false if the key is unknown or expired, otherwise
+     *          the bytes are kept until unpin(), even if the
+     *          value is replaced or evicted meanwhile.
+     */
+    bool
+    pin
+        ( Key const& key
+        , pinned_value & value )
+    {
+        auto const n = use( key );
+        if ( ! n )
+            return false;
+
+        value = pinned_value{ n->second.blob_
+                            , blobs_.get( n->second.blob_ )
+                            , n->second.size_ };
+        ++ pins_[ value.blob_ ].count_;
+        return true;
+    }
+
+    /**
+     *  @brief Release a pin of blob, its bytes being
+     *         reused once unpinned if its value is gone.
+     */
+    void
+    unpin
+        ( slab_allocator::handle blob )
+    {
+        auto const p = pins_.find( blob );
+        if ( -- p->second.count_ != 0 )
+            return;
+
+        if ( p->second.is_released_ )
+            blobs_.release( blob );
+        pins_.erase( p );
+    }
+
+    /**
+     *
+     */
+    std::size_t
+    size
+        ( void )
+        const
+    { return values_count_.load( std::memory_order_relaxed ); }
+
+    /**
+     *
+     */
+    statistics
+    get_statistics
+        ( void )
+        const
+    {
+        return statistics{ values_count_.load( std::memory_order_relaxed )
+                         , bytes_count_.load( std::memory_order_relaxed )
+                         , evictions_count_.load( std::memory_order_relaxed )
+                         , expirations_count_.load( std::memory_order_relaxed ) };
+    }
+
+private:
+    ///
+    struct entry;
+
+    ///
+    using node = std::pair< Key const, entry >;
+
+    /// The neighbours of a node within a list.
+    struct link final
+    {
+        node * previous_;
+        node * next_;
+    };
+
+    ///
+    struct node_list final
+    {
+        node * front_;
+        node * back_;
+    };
+
+    ///
+    struct entry final
+    {
+        slab_allocator::handle blob_;
+        std::uint32_t size_;
+        typename ClockType::time_point expiration_time_;
+        /// Position of the node in uses_.
+        link use_;
+        /// Position of the node in expirations_.
+        link expiration_;
+    };
+
+    ///
+    using entries = std::unordered_map
+            < Key
+            , entry
+            , value_store_key_hasher< Key > >;
+
+    ///
+    struct blob_pins final
+    {
+        std::size_t count_;
+        /// The blob is released once unpinned.
+        bool is_released_;
+    };
+
+private:
+    /**
+     *
+     */
+    static void
+    push_back
+        ( node_list & list
+        , link entry::* position
+        , node * n )
+    {
+        n->second.*position = link{ list.back_, nullptr };
+        if ( list.back_ )
+            ( list.back_->second.*position ).next_ = n;
+        else
+            list.front_ = n;
+        list.back_ = n;
+    }
+
+    /**
+     *
+     */
+    static void
+    erase
+        ( node_list & list
+        , link entry::* position
+        , node * n )
+    {
+        auto const& l = n->second.*position;
+        if ( l.previous_ )
+            ( l.previous_->second.*position ).next_ = l.next_;
+        else
+            list.front_ = l.next_;
+
+        if ( l.next_ )
+            ( l.next_->second.*position ).previous_ = l.previous_;
+        else
+            list.back_ = l.previous_;
+    }
+
+    /**
+     *
+     */
+    static std::size_t
+    get_bytes_count
+        ( std::size_t size )
+    { return sizeof( Key ) + size; }
+
+    /**
+     *
+     */
+    void
+    remove_expired_values
+        ( typename ClockType::time_point const& now )
+    {
+        while ( expirations_.front_ )
+        {
+            auto const oldest = expirations_.front_;
+            if ( oldest->second.expiration_time_ > now )
+                break;
+
+            remove( oldest );
+            ++ expirations_count_;
+        }
+    }
+
+    /**
+     *  @return The node of key, moved to the most recently
+     *          used, or null if the key is unknown or expired.
+     */
+    node *
+    use
+        ( Key const& key )
+    {
+        auto const found = entries_.find( key );
+        if ( found == entries_.end() )
+            return nullptr;
+
+        if ( found->second.expiration_time_ <= ClockType::now() )
+        {
+            remove( &*found );
+            ++ expirations_count_;
+            return nullptr;
+        }
+
+        erase( uses_, &entry::use_, &*found );
+        push_back( uses_, &entry::use_, &*found );
+
+        return &*found;
+    }
+
+    /**
+     *  @brief Release the value of n and unlink it, n is kept.
+     */
+    void
+    detach
+        ( node * n )
+    {
+        -- values_count_;
+        bytes_count_ -= get_bytes_count( n->second.size_ );
+
+        // A pinned blob is released by its last unpin().
+        auto const p = pins_.find( n->second.blob_ );
+        if ( p == pins_.end() )
+            blobs_.release( n->second.blob_ );
+        else
+            p->second.is_released_ = true;
+
+        erase( uses_, &entry::use_, n );
+        erase( expirations_, &entry::expiration_, n );
+    }
+
+    /**
+     *
+     */
+    void
+    remove
+        ( node * n )
+    {
+        detach( n );
+        entries_.erase( entries_.find( n->first ) );
+    }
+
+private:
+    ///
+    std::size_t const bytes_budget_;
+    ///
+    duration const ttl_;
+    ///
+    slab_allocator blobs_;
+    ///
+    entries entries_;
+    /// Least recently used first.
+    node_list uses_;
+    /// Soonest to expire first.
+    node_list expirations_;
+    /// The blobs pinned at least once.
+    std::unordered_map< slab_allocator::handle, blob_pins > pins_;
+    ///
+    std::atomic< std::size_t > values_count_;
+    ///
+    std::atomic< std::size_t > bytes_count_;
+    ///
+    std::atomic< std::size_t > evictions_count_;
+    ///
+    std::atomic< std::size_t > expirations_count_;
+};
+
+/**
+ *  @brief A bounded_value_store shared by the engines of a sharded session.
+ *  @note Keys are spread among STRIPES_COUNT stores, each
+ *        with its own mutex and an even share of the budget,
+ *        to limit contention.
+ */
 template< typename Key, typename Value >
-using value_store = std::unordered_map
-        < Key
-        , Value
-        , value_store_key_hasher< Key > >;
+class concurrent_value_store final
+{
+public:
+    ///
+    enum { STRIPES_COUNT = 16 };
+
+    ///
+    using duration = typename bounded_value_store< Key, Value >::duration;
+
+    ///
+    using statistics = typename bounded_value_store< Key, Value >::statistics;
+
+public:
+    /**
+     *  @see bounded_value_store
+     */
+    explicit
+    concurrent_value_store
+        ( std::size_t bytes_budget = VALUE_STORE_BYTES_BUDGET
+        , duration ttl = VALUE_TTL )
+            : stripes_()
+    {
+        for ( std::size_t i = 0; i != STRIPES_COUNT; ++ i )
+            stripes_.push_back( std::make_shared< stripe >( bytes_budget / STRIPES_COUNT
+                                                          , ttl ) );
+    }
+
+    /**
+     *
+     */
+    concurrent_value_store
+        ( concurrent_value_store const& )
+        = delete;
+
+    /**
+     *
+     */
+    concurrent_value_store &
+    operator=
+        ( concurrent_value_store const& )
+        = delete;
+
+    /**
+     *  @brief Save a value, replacing the previous one.
+     *  @return false if the value exceeds the budget of its stripe.
+     */
+    bool
+    assign
+        ( Key const& key
+        , Value value )
+    {
+        auto & s = *get_stripe( key );
+        std::lock_guard< std::mutex > lock{ s.mutex_ };
+        return s.values_.assign( key, std::move( value ) );
+    }
+
+    /**
+     *  @brief Copy the value of a key into value.
+     *  @return false if the key is unknown or expired.
+     */
+    bool
+    find
+        ( Key const& key
+        , Value & value )
+        const
+    {
+        auto & s = *get_stripe( key );
+        std::lock_guard< std::mutex > lock{ s.mutex_ };
+        return s.values_.find( key, value );
+    }
+
+    /**
+     *  @brief Share the bytes of the value of a key, without copy.
+     *  @return An empty buffer if the key is unknown or expired.
+     *  @note The bytes are kept while the buffer is referenced,
+     *        even if the value is replaced or the store destroyed.
+     */
+    shared_buffer
+    find_shared
+        ( Key const& key )
+        const
+    {
+        auto const& s = get_stripe( key );
+
+        typename bounded_value_store< Key, Value >::pinned_value value;
+        {
+            std::lock_guard< std::mutex > lock{ s->mutex_ };
+            if ( ! s->values_.pin( key, value ) )
+                return shared_buffer{};
+        }
+
+        // The stripe is kept alive until unpinned.
+        auto const blob = value.blob_;
+        auto unpin = [ s, blob ] ( void const* )
+        {
+            std::lock_guard< std::mutex > lock{ s->mutex_ };
+            s->values_.unpin( blob );
+        };
+
+        return shared_buffer{ std::shared_ptr< void const >{ value.data_, unpin }
+                            , value.data_
+                            , value.size_ };
+    }
+
+    /**
+     *
+     */
+    std::size_t
+    size
+        ( void )
+        const
+    {
+        std::size_t count = 0;
+        for ( auto & s : stripes_ )
+            count += s->values_.size();
+
+        return count;
+    }
+
+    /**
+     *
+     */
+    statistics
+    get_statistics
+        ( void )
+        const
+    {
+        statistics total{};
+        for ( auto & s : stripes_ )
+        {
+            auto const c = s->values_.get_statistics();
+            total.values_count_ += c.values_count_;
+            total.bytes_count_ += c.bytes_count_;
+            total.evictions_count_ += c.evictions_count_;
+            total.expirations_count_ += c.expirations_count_;
+        }
+
+        return total;
+    }
+
+private:
+    ///
+    struct stripe
+    {
+        /**
+         *
+         */
+        stripe
+            ( std::size_t bytes_budget
+            , duration ttl )
+                : mutex_()
+                , values_( bytes_budget, ttl )
+        { }
+
+        ///
+        std::mutex mutex_;
+        ///
+        bounded_value_store< Key, Value > values_;
+    };
+
+private:
+    /**
+     *
+     */
+    std::shared_ptr< stripe > const&
+    get_stripe
+        ( Key const& key )
+        const
+    {
+        auto const h = value_store_key_hasher< Key >{}( key );
+        return stripes_[ h % STRIPES_COUNT ];
+    }
+
+private:
+    /// Shared with the buffers of their pinned values.
+    std::vector< std::shared_ptr< stripe > > stripes_;
+};
 
 } // namespace detail
 } // namespace kademlia
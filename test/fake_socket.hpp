@@ -37,6 +37,7 @@
 #include <vector>
 #include <cstdint>
 #include <iostream>
+#include <memory>
 
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/ip/udp.hpp>
@@ -45,6 +46,8 @@
 #include "kademlia/error_impl.hpp"
 #include "kademlia/message.hpp"
 
+#include "simulator/virtual_clock.hpp"
+
 namespace kademlia {
 namespace test {
 
@@ -74,6 +77,14 @@ public:
     ///
     using packets = std::queue< packet >;
 
+    /**
+     *  Decides the fate of each sent packet: it is delivered
+     *  after the returned latency, or lost if it's negative.
+     */
+    using link_model = std::function
+            < virtual_clock::duration ( endpoint_type const& from
+                                      , endpoint_type const& to ) >;
+
 public:
     /**
      *
@@ -229,6 +240,20 @@ public:
         , endpoint_type const& to
         , Callback && callback )
     {
+        if ( get_link_model() )
+        {
+            send_through_link( buffer, to );
+
+            // As with UDP, the send completes
+            // whether the packet arrives or not.
+            auto const size = boost::asio::buffer_size( buffer );
+            io_service_.post( [ callback, size ]( void )
+            { callback( boost::system::error_code(), size ); } );
+
+            log_packet( buffer, to );
+            return;
+        }
+
         // Ensure the destination socket is listening.
         auto target = get_socket( to );
         if ( ! target )
@@ -267,6 +292,59 @@ public:
         return logged_packets_;
     }
 
+    /**
+     *  @brief Send the packets through m instead of
+     *         delivering them immediately, or restore
+     *         the immediate delivery if m is empty.
+     *  @details Packets in flight are delivered by
+     *           deliver_packets() once the virtual_clock
+     *           reached their delivery time.
+     */
+    static void
+    set_link_model
+        ( link_model m )
+    { get_link_model() = std::move( m ); }
+
+    /**
+     *  @return The delivery time of the next packet in flight,
+     *          virtual_clock::time_point::max() if there is none.
+     */
+    static virtual_clock::time_point
+    get_next_delivery_time
+        ( void )
+    {
+        auto const& in_flight = get_in_flight_datagrams();
+        return in_flight.empty()
+                ? virtual_clock::time_point::max()
+                : in_flight.top().delivery_time_;
+    }
+
+    /**
+     *  @brief Deliver the packets in flight whose
+     *         delivery time has been reached.
+     *  @details Packets from or to a closed socket are lost.
+     *  @note Readers are called from this function, hence
+     *        it must not be called concurrently with the
+     *        io_service handlers.
+     */
+    static void
+    deliver_packets
+        ( void )
+    {
+        auto & in_flight = get_in_flight_datagrams();
+        auto const now = virtual_clock::now();
+
+        while ( ! in_flight.empty() && in_flight.top().delivery_time_ <= now )
+        {
+            auto const d = in_flight.top().datagram_;
+            in_flight.pop();
+
+            auto target = get_socket( d->to_ );
+            if ( target && get_socket( d->from_ ) )
+                target->receive_datagram( d );
+        }
+    }
+
     /**
      *
      */
@@ -335,6 +413,43 @@ private:
         callback_type callback_;
     };
 
+    ///
+    struct datagram final
+    {
+        endpoint_type from_;
+        endpoint_type to_;
+        detail::buffer data_;
+    };
+
+    ///
+    using datagram_pointer = std::shared_ptr< datagram >;
+
+    ///
+    struct in_flight_datagram final
+    {
+        virtual_clock::time_point delivery_time_;
+        /// Tells apart datagrams delivered at the same
+        /// time, hence they're delivered in sending order.
+        std::uint64_t sequence_;
+        datagram_pointer datagram_;
+
+        bool
+        operator>
+            ( in_flight_datagram const& o )
+            const
+        {
+            return delivery_time_ != o.delivery_time_
+                    ? delivery_time_ > o.delivery_time_
+                    : sequence_ > o.sequence_;
+        }
+    };
+
+    ///
+    using in_flight_datagrams = std::priority_queue
+            < in_flight_datagram
+            , std::vector< in_flight_datagram >
+            , std::greater< in_flight_datagram > >;
+
     ///
     class router
     {
@@ -427,6 +542,79 @@ private:
         get_logged_packets().push( std::move( p ) );
     }
 
+    /**
+     *
+     */
+    void
+    send_through_link
+        ( boost::asio::const_buffer const& buffer
+        , endpoint_type const& to )
+    {
+        auto const latency = get_link_model()( local_endpoint_, to );
+        if ( latency < virtual_clock::duration::zero() )
+            return;
+
+        auto i = boost::asio::buffer_cast< uint8_t const * >( buffer );
+        auto e = i + boost::asio::buffer_size( buffer );
+
+        static std::uint64_t sequence_ = 0;
+        get_in_flight_datagrams().push
+                ( { virtual_clock::now() + latency, sequence_ ++
+                  , std::make_shared< datagram >( datagram{ local_endpoint_, to, { i, e } } ) } );
+    }
+
+    /**
+     *
+     */
+    void
+    receive_datagram
+        ( datagram_pointer const& d )
+    {
+        auto const buffer = boost::asio::buffer( d->data_ );
+
+        // Keep the datagram until a read consumes it.
+        if ( pending_reads_.empty() )
+        {
+            pending_writes_.push_back( { buffer, d->from_
+                                       , [ d ]( boost::system::error_code const&
+                                              , std::size_t )
+                                         { } } );
+            return;
+        }
+
+        // The reader may read again from its callback.
+        pending_read p = std::move( pending_reads_.front() );
+        pending_reads_.pop_front();
+
+        auto const copied_bytes_count = copy_buffer( buffer, p.buffer_ );
+        p.source_ = d->from_;
+
+        p.callback_( boost::system::error_code()
+                   , copied_bytes_count );
+    }
+
+    /**
+     *
+     */
+    static link_model &
+    get_link_model
+        ( void )
+    {
+        static link_model link_model_;
+        return link_model_;
+    }
+
+    /**
+     *
+     */
+    static in_flight_datagrams &
+    get_in_flight_datagrams
+        ( void )
+    {
+        static in_flight_datagrams in_flight_datagrams_;
+        return in_flight_datagrams_;
+    }
+
     /**
      *
      */
@@ -453,8 +641,7 @@ private:
         assert( i != e /* all ip address have been allocated */ );
 
         address = IpAddress{ bytes };
-		std::cout << address.to_string() << std::endl;
-		return address;
+        return address;
     }
 
     /**
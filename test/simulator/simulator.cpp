@@ -0,0 +1,640 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+/**
+ *  Deterministic discrete-event simulation of a kademlia network.
+ *
+ *  Engines are connected through test::fake_socket, whose link model
+ *  applies latency and loss to each packet, while the engines run with
+ *  test::virtual_clock: once no handler is ready, the time jumps to the next
+ *  packet delivery or timer tick. Hence thousands of engines run in one
+ *  process, faster than real time and reproducibly for a given seed.
+ *
+ *  The simulation alternates saves and loads of a value from random
+ *  engines, optionally replacing engines to simulate churn (the network
+ *  is formed without loss, later joins may fail), and reports
+ *  for each operation kind its latency percentiles, its hops (the depth
+ *  of the farthest peer queried by the lookup, peers known beforehand
+ *  being at depth 1) and the messages sent per operation.
+ *
+ *  Usage: simulator [--clients-count=50] [--messages-count=10000]
+ *                   [--latency-ms=20] [--jitter-ms=10] [--loss=0]
+ *                   [--churn=0] [--seed=0]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+
+#include <kademlia/endpoint.hpp>
+#include <kademlia/session_base.hpp>
+
+#include "kademlia/id.hpp"
+#include "kademlia/message.hpp"
+
+#include "fake_socket.hpp"
+#include "test_engine.hpp"
+#include "simulator/virtual_clock.hpp"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+namespace t = k::test;
+
+using clock = t::virtual_clock;
+
+using engine_type = t::basic_test_engine< clock >;
+
+/// Engines get this virtual time to join the network.
+auto const JOIN_DURATION = std::chrono::seconds( 2 );
+
+/// Operations not completed by then are failed.
+auto const OPERATION_TIMEOUT = std::chrono::seconds( 60 );
+
+///
+auto const VALUE_SIZE = 32;
+
+///
+struct options final
+{
+    std::size_t clients_count_ = 50;
+    std::size_t messages_count_ = 10000;
+    double latency_ms_ = 20.;
+    double jitter_ms_ = 10.;
+    /// Probability to lose a packet.
+    double loss_ = 0.;
+    /// Probability to replace an engine before an operation.
+    double churn_ = 0.;
+    std::uint32_t seed_ = 0;
+};
+
+/**
+ *
+ */
+options
+parse_options
+    ( int argc
+    , char ** argv )
+{
+    options o;
+
+    for ( int i = 1; i != argc; ++ i )
+    {
+        std::string const argument{ argv[ i ] };
+        auto const separator = argument.find( '=' );
+        if ( argument.compare( 0, 2, "--" ) != 0 || separator == std::string::npos )
+            throw std::invalid_argument{ "unexpected argument '" + argument + "'" };
+
+        auto const name = argument.substr( 2, separator - 2 );
+        auto const value = argument.substr( separator + 1 );
+
+        if ( name == "clients-count" )
+            o.clients_count_ = std::stoul( value );
+        else if ( name == "messages-count" )
+            o.messages_count_ = std::stoul( value );
+        else if ( name == "latency-ms" )
+            o.latency_ms_ = std::stod( value );
+        else if ( name == "jitter-ms" )
+            o.jitter_ms_ = std::stod( value );
+        else if ( name == "loss" )
+            o.loss_ = std::stod( value );
+        else if ( name == "churn" )
+            o.churn_ = std::stod( value );
+        else if ( name == "seed" )
+            o.seed_ = std::stoul( value );
+        else
+            throw std::invalid_argument{ "unknown option '" + name + "'" };
+    }
+
+    if ( o.clients_count_ < 2 )
+        throw std::invalid_argument{ "at least 2 clients are required" };
+
+    return o;
+}
+
+/// Measures of one kind of operation.
+struct statistics final
+{
+    std::size_t count_ = 0;
+    std::size_t failures_count_ = 0;
+    std::size_t messages_count_ = 0;
+    std::vector< double > latencies_ms_;
+    std::vector< std::size_t > hops_;
+};
+
+///
+class simulation final
+{
+public:
+    ///
+    using endpoint_type = t::fake_socket::endpoint_type;
+
+    ///
+    using engine_pointer = std::unique_ptr< engine_type >;
+
+public:
+    /**
+     *
+     */
+    explicit
+    simulation
+        ( options const& o )
+            : options_( o )
+            , random_engine_( o.seed_ )
+            , io_service_()
+            , engines_()
+    {
+        start_ = clock::now();
+
+        t::fake_socket::set_link_model( [ this ]( endpoint_type const&
+                                                , endpoint_type const& )
+        { return get_link_latency(); } );
+
+        // The network is formed without loss.
+        is_lossy_ = false;
+        for ( std::size_t i = 0; i != options_.clients_count_; ++ i )
+        {
+            add_engine();
+            run_for( JOIN_DURATION );
+        }
+        is_lossy_ = true;
+    }
+
+    /**
+     *
+     */
+    ~simulation
+        ( void )
+    {
+        drain();
+        engines_.clear();
+        t::fake_socket::set_link_model( t::fake_socket::link_model{} );
+    }
+
+    /**
+     *
+     */
+    void
+    run
+        ( void )
+    {
+        std::bernoulli_distribution is_churning{ options_.churn_ };
+
+        for ( std::size_t i = 0; i != options_.messages_count_; ++ i )
+        {
+            if ( is_churning( random_engine_ ) )
+                replace_engine();
+
+            auto const key = "key_" + std::to_string( i / 2 );
+            auto & origin = get_random_engine();
+
+            if ( i % 2 == 0 )
+            {
+                auto const value = generate_value();
+                run_operation( saves_, origin, [ & ]( std::function< void ( std::error_code const& ) > const& on_done )
+                {
+                    auto on_save = [ on_done ]( std::error_code const& failure )
+                    { on_done( failure ); };
+                    origin.async_save( key, value, on_save );
+                } );
+            }
+            else
+                run_operation( loads_, origin, [ & ]( std::function< void ( std::error_code const& ) > const& on_done )
+                {
+                    auto on_load = [ on_done ]( std::error_code const& failure
+                                              , std::string const& )
+                    { on_done( failure ); };
+                    origin.async_load( key, on_load );
+                } );
+        }
+    }
+
+    /**
+     *
+     */
+    void
+    report
+        ( std::ostream & out
+        , double wall_seconds )
+    {
+        auto const virtual_seconds = std::chrono::duration< double >
+                ( clock::now() - start_ ).count();
+
+        out << "engines: " << options_.clients_count_
+            << ", replaced: " << replaced_engines_count_
+            << ", failed joins: " << failed_joins_count_
+            << ", operations: " << options_.messages_count_ << "\n"
+            << std::fixed << std::setprecision( 2 )
+            << "virtual time: " << virtual_seconds << " s"
+            << ", wall time: " << wall_seconds << " s"
+            << " (x" << virtual_seconds / wall_seconds << ")\n";
+
+        report( out, "save", saves_ );
+        report( out, "load", loads_ );
+    }
+
+private:
+    /**
+     *
+     */
+    clock::duration
+    get_link_latency
+        ( void )
+    {
+        std::bernoulli_distribution is_lost{ options_.loss_ };
+        if ( is_lossy_ && is_lost( random_engine_ ) )
+            return clock::duration{ -1 };
+
+        std::uniform_real_distribution< double > jitter{ 0., options_.jitter_ms_ };
+        std::chrono::duration< double, std::milli > const latency
+                { options_.latency_ms_ + jitter( random_engine_ ) };
+
+        return std::chrono::duration_cast< clock::duration >( latency );
+    }
+
+    /**
+     *
+     */
+    void
+    add_engine
+        ( void )
+    {
+        k::endpoint const ipv4{ "127.0.0.1", k::session_base::DEFAULT_PORT };
+        k::endpoint const ipv6{ "::1", k::session_base::DEFAULT_PORT };
+        kd::id const new_id{ random_engine_ };
+
+        if ( engines_.empty() )
+            engines_.emplace_back( new engine_type{ io_service_
+                                                  , ipv4, ipv6, new_id } );
+        else
+            engines_.emplace_back( new engine_type{ io_service_
+                                                  , get_random_engine().ipv4()
+                                                  , ipv4, ipv6, new_id } );
+    }
+
+    /**
+     *  @brief Replace a random engine by a new
+     *         one bootstrapping from another engine.
+     */
+    void
+    replace_engine
+        ( void )
+    {
+        // Engines handlers can't outlive them.
+        drain();
+
+        std::uniform_int_distribution< std::size_t > index{ 0, engines_.size() - 1 };
+        auto const i = index( random_engine_ );
+        std::swap( engines_[ i ], engines_.back() );
+        engines_.pop_back();
+
+        add_engine();
+        ++ replaced_engines_count_;
+    }
+
+    /**
+     *
+     */
+    engine_type &
+    get_random_engine
+        ( void )
+    {
+        std::uniform_int_distribution< std::size_t > index{ 0, engines_.size() - 1 };
+        return *engines_[ index( random_engine_ ) ];
+    }
+
+    /**
+     *
+     */
+    std::string
+    generate_value
+        ( void )
+    {
+        std::uniform_int_distribution< int > letter{ 'a', 'z' };
+
+        std::string value( VALUE_SIZE, ' ' );
+        for ( auto & c : value )
+            c = char( letter( random_engine_ ) );
+
+        return value;
+    }
+
+    /**
+     *  @brief Run the ready handlers.
+     */
+    void
+    drain
+        ( void )
+    {
+        while ( poll() )
+            continue;
+    }
+
+    /**
+     *  @brief Run the ready handlers.
+     */
+    std::size_t
+    poll
+        ( void )
+    { return guard( [ this ]( void ) { return io_service_.poll(); } ); }
+
+    /**
+     *  @brief Call step, an engine failing to join is only counted.
+     *  @return The step result, 1 if it failed.
+     */
+    template< typename Step >
+    std::size_t
+    guard
+        ( Step const& step )
+    {
+        try
+        {
+            return step();
+        }
+        catch ( std::system_error const& )
+        {
+            ++ failed_joins_count_;
+            return 1;
+        }
+    }
+
+    /**
+     *  @brief Run the simulation until predicate holds,
+     *         deadline is reached or nothing remains to do.
+     *  @return true if predicate holds.
+     */
+    template< typename Predicate >
+    bool
+    run_until
+        ( Predicate predicate
+        , clock::time_point const& deadline )
+    {
+        while ( ! predicate() )
+        {
+            if ( poll() )
+                continue;
+
+            // Jump to the next event.
+            auto const next_event = std::min( t::fake_socket::get_next_delivery_time()
+                                            , t::virtual_timer::get_next_expiration_time() );
+            if ( next_event > deadline )
+            {
+                if ( deadline != clock::time_point::max() )
+                    clock::advance_to( deadline );
+                return false;
+            }
+
+            clock::advance_to( next_event );
+            guard( []( void )
+            {
+                t::fake_socket::deliver_packets();
+                t::virtual_timer::expire_timers();
+                return 0;
+            } );
+        }
+
+        return true;
+    }
+
+    /**
+     *
+     */
+    void
+    run_for
+        ( clock::duration const& duration )
+    { run_until( []( void ) { return false; }, clock::now() + duration ); }
+
+    /**
+     *
+     */
+    template< typename Operation >
+    void
+    run_operation
+        ( statistics & s
+        , engine_type & origin
+        , Operation const& start_operation )
+    {
+        // Ignore the packets of the previous operations.
+        t::clear_packets();
+
+        // The callback may be called after the timeout.
+        struct state { bool is_done_ = false; std::error_code failure_; };
+        auto const result = std::make_shared< state >();
+
+        auto const start = clock::now();
+        start_operation( [ result ]( std::error_code const& failure )
+        {
+            result->is_done_ = true;
+            result->failure_ = failure;
+        } );
+
+        auto const is_done = run_until( [ result ]( void ) { return result->is_done_; }
+                                      , start + OPERATION_TIMEOUT );
+
+        ++ s.count_;
+        if ( ! is_done || result->failure_ )
+            ++ s.failures_count_;
+        else
+            s.latencies_ms_.push_back( std::chrono::duration< double, std::milli >
+                    ( clock::now() - start ).count() );
+
+        analyze_packets( s, origin );
+    }
+
+    /**
+     *  @brief Count the packets sent during an operation
+     *         and the hops of its lookup.
+     *  @details Peers known by the origin are at depth 1, the
+     *           peers returned by a peer at depth d are at d + 1.
+     */
+    void
+    analyze_packets
+        ( statistics & s
+        , engine_type & origin )
+    {
+        auto const origin_ipv4 = to_endpoint_type( origin.ipv4() );
+        auto const origin_ipv6 = to_endpoint_type( origin.ipv6() );
+        auto is_origin = [ & ]( endpoint_type const& e )
+        { return e == origin_ipv4 || e == origin_ipv6; };
+
+        std::map< endpoint_type, std::size_t > depths;
+        std::size_t hops = 0;
+
+        auto & packets = t::fake_socket::get_logged_packets();
+        for ( ; ! packets.empty(); packets.pop() )
+        {
+            auto const& p = packets.front();
+            ++ s.messages_count_;
+
+            kd::header h;
+            auto i = p.data_.begin(), e = p.data_.end();
+            if ( kd::deserialize( i, e, h ) )
+                continue;
+
+            if ( is_origin( p.from_ )
+               && ( h.type_ == kd::header::FIND_PEER_REQUEST
+                  || h.type_ == kd::header::FIND_VALUE_REQUEST ) )
+                hops = std::max( hops, depths.emplace( p.to_, 1 ).first->second );
+            else if ( is_origin( p.to_ )
+                    && h.type_ == kd::header::FIND_PEER_RESPONSE )
+            {
+                kd::find_peer_response_body body;
+                if ( kd::deserialize( i, e, body ) )
+                    continue;
+
+                auto const depth = depths.emplace( p.from_, 1 ).first->second;
+                for ( auto const& peer : body.peers_ )
+                    depths.emplace( endpoint_type{ peer.endpoint_.address_
+                                                 , peer.endpoint_.port_ }
+                                  , depth + 1 );
+            }
+        }
+
+        s.hops_.push_back( hops );
+    }
+
+    /**
+     *
+     */
+    static endpoint_type
+    to_endpoint_type
+        ( k::endpoint const& e )
+    {
+        return endpoint_type{ boost::asio::ip::address::from_string( e.address() )
+                            , std::uint16_t( std::stoul( e.service() ) ) };
+    }
+
+    /**
+     *
+     */
+    template< typename Value >
+    static Value
+    get_percentile
+        ( std::vector< Value > const& sorted_values
+        , double percentile )
+    {
+        if ( sorted_values.empty() )
+            return Value{};
+
+        auto const index = std::size_t( percentile / 100. * ( sorted_values.size() - 1 ) + .5 );
+        return sorted_values[ index ];
+    }
+
+    /**
+     *
+     */
+    static void
+    report
+        ( std::ostream & out
+        , char const* name
+        , statistics & s )
+    {
+        std::sort( s.latencies_ms_.begin(), s.latencies_ms_.end() );
+        std::sort( s.hops_.begin(), s.hops_.end() );
+
+        double hops_sum = 0.;
+        for ( auto h : s.hops_ )
+            hops_sum += h;
+
+        auto const count = std::max< std::size_t >( s.count_, 1 );
+
+        out << name << ": " << s.count_ - s.failures_count_ << "/" << s.count_ << " succeeded\n"
+            << "  latency ms: p50 " << get_percentile( s.latencies_ms_, 50. )
+            << ", p90 " << get_percentile( s.latencies_ms_, 90. )
+            << ", p99 " << get_percentile( s.latencies_ms_, 99. )
+            << ", max " << get_percentile( s.latencies_ms_, 100. ) << "\n"
+            << "  hops: mean " << hops_sum / count
+            << ", p50 " << get_percentile( s.hops_, 50. )
+            << ", p99 " << get_percentile( s.hops_, 99. )
+            << ", max " << get_percentile( s.hops_, 100. ) << "\n"
+            << "  messages per operation: "
+            << double( s.messages_count_ ) / count << "\n";
+    }
+
+private:
+    ///
+    options const options_;
+    ///
+    std::default_random_engine random_engine_;
+    ///
+    boost::asio::io_service io_service_;
+    ///
+    std::vector< engine_pointer > engines_;
+    ///
+    clock::time_point start_;
+    ///
+    std::size_t replaced_engines_count_ = 0;
+    ///
+    std::size_t failed_joins_count_ = 0;
+    ///
+    bool is_lossy_ = true;
+    ///
+    statistics saves_;
+    ///
+    statistics loads_;
+};
+
+} // anonymous namespace
+
+int
+main
+    ( int argc
+    , char ** argv )
+{
+    try
+    {
+        auto const o = parse_options( argc, argv );
+
+        auto const wall_start = std::chrono::steady_clock::now();
+
+        simulation s{ o };
+        s.run();
+
+        std::chrono::duration< double > const wall_duration
+                = std::chrono::steady_clock::now() - wall_start;
+        s.report( std::cout, wall_duration.count() );
+    }
+    catch ( std::exception const& e )
+    {
+        std::cerr << argv[ 0 ] << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,287 @@
+// Copyright (c) 2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KADEMLIA_VIRTUAL_CLOCK_HPP
+#define KADEMLIA_VIRTUAL_CLOCK_HPP
+
+#ifdef _MSC_VER
+#   pragma once
+#endif
+
+#include <chrono>
+#include <functional>
+#include <set>
+#include <utility>
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <kademlia/detail/cxx11_macros.hpp>
+
+#include "kademlia/timer.hpp"
+
+namespace kademlia {
+namespace test {
+
+/**
+ *  @brief Clock of the simulated engines, it only moves when
+ *         advanced, hence a simulation runs deterministically
+ *         and faster than real time.
+ *  @note Meant for single threaded simulations.
+ */
+class virtual_clock final
+{
+public:
+    ///
+    using duration = std::chrono::steady_clock::duration;
+
+    ///
+    using rep = duration::rep;
+
+    ///
+    using period = duration::period;
+
+    /// Shares the epoch of the timing_wheel time points.
+    using time_point = std::chrono::steady_clock::time_point;
+
+    ///
+    static CXX11_CONSTEXPR bool is_steady = true;
+
+public:
+    /**
+     *
+     */
+    static time_point
+    now
+        ( void )
+    { return get_now(); }
+
+    /**
+     *  @brief Move the time forward, up to t.
+     *  @note The time never goes backward.
+     */
+    static void
+    advance_to
+        ( time_point const& t )
+    {
+        auto & now = get_now();
+        if ( t > now )
+            now = t;
+    }
+
+private:
+    /**
+     *
+     */
+    static time_point &
+    get_now
+        ( void )
+    {
+        static time_point now_{};
+        return now_;
+    }
+};
+
+/**
+ *  @brief Deadline timer of the engines running with virtual_clock.
+ *  @details It doesn't wait on the io_service but registers its tick,
+ *           the simulation advances the virtual_clock to the earliest
+ *           tick then calls expire_timers().
+ */
+class virtual_timer final
+{
+public:
+    ///
+    using clock_type = virtual_clock;
+
+    ///
+    using time_point = clock_type::time_point;
+
+public:
+    /**
+     *
+     */
+    explicit
+    virtual_timer
+        ( boost::asio::io_service & io_service )
+            : io_service_( io_service )
+            , expiration_time_( time_point::max() )
+            , on_fire_()
+    { }
+
+    /**
+     *
+     */
+    virtual_timer
+        ( virtual_timer const& )
+        = delete;
+
+    /**
+     *
+     */
+    virtual_timer &
+    operator=
+        ( virtual_timer const& )
+        = delete;
+
+    /**
+     *
+     */
+    ~virtual_timer
+        ( void )
+    { get_ticks().erase( { expiration_time_, this } ); }
+
+    /**
+     *  @brief Cancel the pending wait, if any,
+     *         and set the next expiration time.
+     */
+    void
+    expires_at
+        ( time_point const& expiration_time )
+    {
+        cancel_wait();
+        expiration_time_ = expiration_time;
+    }
+
+    /**
+     *
+     */
+    template< typename Handler >
+    void
+    async_wait
+        ( Handler handler )
+    {
+        cancel_wait();
+        on_fire_ = std::move( handler );
+        get_ticks().emplace( expiration_time_, this );
+    }
+
+    /**
+     *  @return The earliest tick of all the timers,
+     *          time_point::max() if there is none.
+     */
+    static time_point
+    get_next_expiration_time
+        ( void )
+    {
+        auto const& ticks = get_ticks();
+        return ticks.empty() ? time_point::max() : ticks.begin()->first;
+    }
+
+    /**
+     *  @brief Complete the waits of all the timers
+     *         reached by the virtual_clock.
+     *  @details As with asio, completion handlers are
+     *           posted to the io_service of their timer.
+     */
+    static void
+    expire_timers
+        ( void )
+    {
+        auto & ticks = get_ticks();
+        auto const now = clock_type::now();
+
+        while ( ! ticks.empty() && ticks.begin()->first <= now )
+        {
+            auto t = ticks.begin()->second;
+            ticks.erase( ticks.begin() );
+            t->complete( boost::system::error_code{} );
+        }
+    }
+
+private:
+    /// Sorted by expiration time.
+    using ticks = std::set< std::pair< time_point, virtual_timer * > >;
+
+    ///
+    using handler = std::function< void ( boost::system::error_code const& ) >;
+
+private:
+    /**
+     *
+     */
+    void
+    cancel_wait
+        ( void )
+    {
+        if ( ! on_fire_ )
+            return;
+
+        get_ticks().erase( { expiration_time_, this } );
+        complete( boost::asio::error::operation_aborted );
+    }
+
+    /**
+     *
+     */
+    void
+    complete
+        ( boost::system::error_code const& failure )
+    {
+        handler on_fire;
+        std::swap( on_fire, on_fire_ );
+
+        io_service_.post( [ on_fire, failure ]( void )
+        { on_fire( failure ); } );
+    }
+
+    /**
+     *
+     */
+    static ticks &
+    get_ticks
+        ( void )
+    {
+        static ticks ticks_;
+        return ticks_;
+    }
+
+private:
+    ///
+    boost::asio::io_service & io_service_;
+    ///
+    time_point expiration_time_;
+    /// Empty when no wait is pending.
+    handler on_fire_;
+};
+
+} // namespace test
+
+namespace detail {
+
+///
+template<>
+struct timer_traits< test::virtual_clock >
+{
+    ///
+    using deadline_timer = test::virtual_timer;
+};
+
+} // namespace detail
+} // namespace kademlia
+
+#endif
+
@@ -32,6 +32,7 @@
 
 #include "kademlia/log.hpp"
 #include "kademlia/buffer.hpp"
+#include "kademlia/clock.hpp"
 #include "kademlia/engine.hpp"
 
 #include "fake_socket.hpp"
@@ -39,10 +40,11 @@
 namespace kademlia {
 namespace test {
 
-class test_engine final
+template< typename ClockType >
+class basic_test_engine final
 {
 public:
-    test_engine
+    basic_test_engine
         ( boost::asio::io_service & service
         , endpoint const & ipv4
         , endpoint const & ipv6
@@ -56,7 +58,7 @@ public:
                           , session_base::DEFAULT_PORT )
     { }
 
-    test_engine
+    basic_test_engine
         ( boost::asio::io_service & service
         , endpoint const & initial_peer
         , endpoint const & ipv4
@@ -80,8 +82,8 @@ public:
         , std::string const& data
         , Callable & callable )
     {
-        impl::key_type const k{ key.begin(), key.end() };
-        impl::data_type const d{ data.begin(), data.end() };
+        typename impl::key_type const k{ key.begin(), key.end() };
+        typename impl::data_type const d{ data.begin(), data.end() };
         engine_.async_save( k, d, callable );
     }
 
@@ -91,9 +93,9 @@ public:
         ( std::string const& key
         , Callable & callable )
     {
-        impl::key_type const k{ key.begin(), key.end() };
+        typename impl::key_type const k{ key.begin(), key.end() };
         auto c = [ callable ]( std::error_code const& failure
-                             , impl::data_type const& data )
+                             , typename impl::data_type const& data )
         {
             callable( failure, std::string{ data.begin(), data.end() } );
         };
@@ -101,6 +103,17 @@ public:
         engine_.async_load( k, c );
     }
 
+    void
+    set_latency_aware_peer_selection
+        ( bool enabled )
+    { engine_.set_latency_aware_peer_selection( enabled ); }
+
+    session_base::timeout_statistics
+    get_timeout_statistics
+        ( void )
+        const
+    { return engine_.get_timeout_statistics(); }
+
     endpoint
     ipv4
         ( void )
@@ -120,7 +133,7 @@ public:
     }
 
 private:
-    using impl = detail::engine< fake_socket >;
+    using impl = detail::engine< fake_socket, ClockType >;
 
 private:
     boost::asio::io_service::work work_;
@@ -129,6 +142,8 @@ private:
     fake_socket::endpoint_type listen_ipv6_;
 };
 
+using test_engine = basic_test_engine< detail::clock >;
+
 class packet final
 {
 public:
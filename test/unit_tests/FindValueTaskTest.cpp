@@ -97,6 +97,10 @@ TEST_F(FindValueTaskTest, can_notify_error_when_unique_peer_fails_to_respond)
     // Task didn't send any more message.
     EXPECT_TRUE(! tracker_.has_sent_message());
 
+    // Task reported p1 as unresponsive.
+    ASSERT_EQ(1, routing_table_.unresponsive_ids_.size());
+    EXPECT_EQ(p1.id_, routing_table_.unresponsive_ids_.front());
+
     // Task notified the error.
     EXPECT_EQ(1, callback_call_count_);
     EXPECT_TRUE(failure_ == k::VALUE_NOT_FOUND);
@@ -127,6 +131,9 @@ TEST_F(FindValueTaskTest, can_notify_error_when_all_peers_fail_to_respond)
     // Task didn't send any more message.
     EXPECT_TRUE(! tracker_.has_sent_message());
 
+    // Task reported p1 & p2 as unresponsive.
+    EXPECT_EQ(2, routing_table_.unresponsive_ids_.size());
+
     // Task notified the error.
     EXPECT_EQ(1, callback_call_count_);
     EXPECT_TRUE(failure_ == k::VALUE_NOT_FOUND);
@@ -236,6 +243,10 @@ TEST_F(FindValueTaskTest, can_return_value_when_already_known_peer_has_the_value
     EXPECT_TRUE(tracker_.has_sent_message(p1.endpoint_, fv));
     EXPECT_TRUE(! tracker_.has_sent_message());
 
+    // Task reported p1 response.
+    ASSERT_EQ(1, routing_table_.responsive_ids_.size());
+    EXPECT_EQ(p1.id_, routing_table_.responsive_ids_.front());
+
     // Task notified the success.
     EXPECT_EQ(1, callback_call_count_);
     EXPECT_TRUE(! failure_);
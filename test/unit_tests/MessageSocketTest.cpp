@@ -23,6 +23,8 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <vector>
+#include "Poco/Net/DatagramSocket.h"
 #include "Poco/Net/SocketReactor.h"
 #include "kademlia/endpoint.hpp"
 #include "kademlia/MessageSocket.h"
@@ -100,4 +102,68 @@ TEST(MessageSocketTest, ipv6_socket_can_be_created)
 	EXPECT_NO_THROW(MessageSocket_type::ipv6(io_service, endpoint););
 }
 
+TEST(MessageSocketTest, bursts_of_sends_are_queued)
+{
+	Poco::Net::SocketReactor io_service;
+
+	Poco::Net::SocketAddress const receiverAddress("127.0.0.1", k::test::getTemporaryListeningPort());
+	Poco::Net::DatagramSocket receiver(receiverAddress);
+	kd::SocketAdapter<Poco::Net::DatagramSocket> sender(&io_service,
+		Poco::Net::SocketAddress("127.0.0.1", k::test::getTemporaryListeningPort(1235)), true, false);
+
+	std::vector<kd::buffer> messages;
+	for (std::size_t i = 0; i != 20; ++i)
+		messages.emplace_back(i + 1, std::uint8_t(i));
+
+	// Sends issued before the previous ones completed must not be lost.
+	std::size_t sentCount = 0;
+	for (auto const& m : messages)
+		sender.asyncSendTo(boost::asio::buffer(m), receiverAddress,
+			[&] (boost::system::error_code const& failure, std::size_t bytesSent)
+			{
+				EXPECT_FALSE(failure);
+				if (++sentCount == messages.size())
+					io_service.stop();
+			});
+
+	if (sentCount != messages.size())
+		io_service.run();
+
+	EXPECT_EQ(messages.size(), sentCount);
+	for (auto const& m : messages)
+	{
+		kd::buffer received(m.size() + 1);
+		int n = receiver.receiveBytes(received.data(), int(received.size()));
+		received.resize(n);
+		EXPECT_EQ(m, received);
+	}
+}
+
+TEST(MessageSocketTest, queued_sends_are_aborted_when_overwritten)
+{
+	Poco::Net::SocketReactor io_service;
+
+	Poco::Net::SocketAddress const receiverAddress("127.0.0.1", k::test::getTemporaryListeningPort());
+	Poco::Net::DatagramSocket receiver(receiverAddress);
+	kd::SocketAdapter<Poco::Net::DatagramSocket> sender(&io_service,
+		Poco::Net::SocketAddress("127.0.0.1", k::test::getTemporaryListeningPort(1235)), true, false);
+
+	std::vector<kd::buffer> messages(200, kd::buffer(8192));
+
+	// Each datagram is either sent inline or queued.
+	std::size_t completedCount = 0;
+	for (auto const& m : messages)
+		sender.asyncSendTo(boost::asio::buffer(m), receiverAddress,
+			[&] (boost::system::error_code const& failure, std::size_t bytesSent)
+			{
+				EXPECT_TRUE(!failure || failure == boost::asio::error::operation_aborted);
+				++completedCount;
+			});
+
+	// Queued datagrams are completed rather than dropped.
+	sender = kd::SocketAdapter<Poco::Net::DatagramSocket>(&io_service,
+		Poco::Net::SocketAddress("127.0.0.1", k::test::getTemporaryListeningPort(1236)), true, false);
+	EXPECT_EQ(messages.size(), completedCount);
+}
+
 }
@@ -146,4 +146,111 @@ TEST_F(ResponseCallbacksTest, multiple_callbacks_can_be_added)
     EXPECT_EQ(h2.random_token_, messages_received_.back());
 }
 
+TEST_F(ResponseCallbacksTest, table_grows_beyond_its_initial_capacity)
+{
+    std::default_random_engine random_engine;
+    std::vector< kd::id > ids;
+
+    auto on_message_received = [ this ]
+            (kd::ResponseCallbacks::endpoint_type const& s
+            , kd::Header const& h
+            , kd::buffer::const_iterator
+            , kd::buffer::const_iterator)
+    { messages_received_.push_back(h.random_token_); };
+
+    auto const count = 4 * kd::ResponseCallbacks::INITIAL_CAPACITY;
+    for (std::size_t i = 0; i != count; ++ i)
+    {
+        ids.push_back(kd::generate_token(random_engine));
+        callbacks_.push_callback(ids.back(), on_message_received);
+    }
+    EXPECT_EQ(count, callbacks_.size());
+
+    // Remove every other callback then dispatch the remaining ones.
+    for (std::size_t i = 0; i < count; i += 2)
+        EXPECT_TRUE(callbacks_.remove_callback(ids[i]));
+    EXPECT_EQ(count / 2, callbacks_.size());
+
+    kd::ResponseCallbacks::endpoint_type const s{};
+    kd::buffer const b;
+    for (std::size_t i = 0; i != count; ++ i)
+    {
+        kd::Header const h{ kd::Header::V1, kd::Header::PING_RESPONSE
+                          , kd::id{}, ids[i] };
+        auto result = callbacks_.dispatch_response(s, h, b.begin(), b.end());
+        EXPECT_EQ(i % 2 == 0, k::UNASSOCIATED_MESSAGE_ID == result);
+    }
+
+    EXPECT_EQ(0, callbacks_.size());
+    EXPECT_EQ(count / 2, messages_received_.size());
+}
+
+TEST_F(ResponseCallbacksTest, colliding_ids_can_be_removed)
+{
+    // Ids differing only by their last bits share
+    // their home slot once folded.
+    kd::id const id1{ "1" }, id2{ "10000000000000001" }, id3{ "3" };
+
+    auto on_message_received = [ this ]
+            (kd::ResponseCallbacks::endpoint_type const& s
+            , kd::Header const& h
+            , kd::buffer::const_iterator
+            , kd::buffer::const_iterator)
+    { messages_received_.push_back(h.random_token_); };
+
+    callbacks_.push_callback(id1, on_message_received);
+    callbacks_.push_callback(id2, on_message_received);
+    callbacks_.push_callback(id3, on_message_received);
+
+    EXPECT_TRUE(callbacks_.remove_callback(id1));
+    EXPECT_FALSE(callbacks_.remove_callback(id1));
+
+    kd::ResponseCallbacks::endpoint_type const s{};
+    kd::buffer const b;
+    kd::Header const h2{ kd::Header::V1, kd::Header::PING_RESPONSE
+                       , kd::id{}, id2 };
+    EXPECT_TRUE(! callbacks_.dispatch_response(s, h2, b.begin(), b.end()));
+    kd::Header const h3{ kd::Header::V1, kd::Header::PING_RESPONSE
+                       , kd::id{}, id3 };
+    EXPECT_TRUE(! callbacks_.dispatch_response(s, h3, b.begin(), b.end()));
+
+    EXPECT_EQ(2, messages_received_.size());
+}
+
+TEST_F(ResponseCallbacksTest, callbacks_can_register_callbacks)
+{
+    std::default_random_engine random_engine;
+    kd::id const first_id = kd::generate_token(random_engine);
+
+    auto on_message_received = [ this ]
+            (kd::ResponseCallbacks::endpoint_type const& s
+            , kd::Header const& h
+            , kd::buffer::const_iterator
+            , kd::buffer::const_iterator)
+    { messages_received_.push_back(h.random_token_); };
+
+    // This callback forces the table to grow
+    // while it is being called.
+    auto on_first_message_received = [ & ]
+            (kd::ResponseCallbacks::endpoint_type const& s
+            , kd::Header const& h
+            , kd::buffer::const_iterator
+            , kd::buffer::const_iterator)
+    {
+        messages_received_.push_back(h.random_token_);
+        for (std::size_t i = 0; i != kd::ResponseCallbacks::INITIAL_CAPACITY; ++ i)
+            callbacks_.push_callback(kd::generate_token(random_engine)
+                                    , on_message_received);
+    };
+    callbacks_.push_callback(first_id, on_first_message_received);
+
+    kd::ResponseCallbacks::endpoint_type const s{};
+    kd::buffer const b;
+    kd::Header const h{ kd::Header::V1, kd::Header::PING_RESPONSE
+                      , kd::id{}, first_id };
+    EXPECT_TRUE(! callbacks_.dispatch_response(s, h, b.begin(), b.end()));
+    EXPECT_EQ(1, messages_received_.size());
+    EXPECT_EQ(kd::ResponseCallbacks::INITIAL_CAPACITY, callbacks_.size());
+}
+
 }
@@ -26,11 +26,13 @@
 #ifndef KADEMLIA_TEST_HELPERS_ROUTING_TABLE_MOCK_H
 #define KADEMLIA_TEST_HELPERS_ROUTING_TABLE_MOCK_H
 
+#include <chrono>
 #include <vector>
 #include <deque>
 #include <utility>
 #include <stdexcept>
 
+#include "kademlia/constants.hpp"
 #include "kademlia/Message.h"
 #include "kademlia/IPEndpoint.h"
 #include "kademlia/Peer.h"
@@ -43,22 +45,25 @@ struct RoutingTableMock
 	using peer_type = std::pair< detail::id, detail::IPEndpoint >;
 	using peers_type = std::vector< peer_type >;
 	using expected_ids_type = std::deque< detail::id >;
-
-	using iterator_type = peers_type::iterator;
+	using unresponsive_ids_type = std::vector< detail::id >;
+	using responsive_ids_type = std::vector< detail::id >;
+	using duration = std::chrono::steady_clock::duration;
 
 	RoutingTableMock(): expected_ids_(),
 		peers_(),
-		find_call_count_()
+		find_call_count_(),
+		unresponsive_ids_(),
+		responsive_ids_()
 	{ }
 
-	iterator_type find(detail::id const& id)
+	peers_type const& closest(detail::id const& id, std::size_t)
 	{
 		if (expected_ids_.empty() || id != expected_ids_.front())
 			throw std::runtime_error("Unexpected searched id.");
 
 		expected_ids_.pop_front();
 		++ find_call_count_;
-		return peers_.begin();
+		return peers_;
 	}
 
 	void push(detail::id const& id, detail::IPEndpoint const& endpoint)
@@ -66,14 +71,33 @@ struct RoutingTableMock
 		peers_.emplace_back(id, endpoint);
 	}
 
-	iterator_type end()
+	bool flag_peer_as_unresponsive(detail::id const& id)
+	{
+		unresponsive_ids_.push_back(id);
+		return false;
+	}
+
+	bool record_round_trip_time(detail::id const& id, duration const&)
+	{
+		responsive_ids_.push_back(id);
+		return false;
+	}
+
+	duration get_round_trip_time(detail::id const&) const
+	{
+		return duration::zero();
+	}
+
+	duration get_request_timeout(detail::id const&) const
 	{
-		return peers_.end();
+		return detail::PEER_LOOKUP_TIMEOUT;
 	}
 
 	expected_ids_type expected_ids_;
 	peers_type peers_;
 	uint64_t find_call_count_;
+	unresponsive_ids_type unresponsive_ids_;
+	responsive_ids_type responsive_ids_;
 };
 
 } // namespace test
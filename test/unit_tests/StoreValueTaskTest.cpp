@@ -95,6 +95,10 @@ TEST_F(StoreValueTaskTest, CanNotifyErrorWhenUniquePeerFailsToRespond)
     // Task didn't send any more message.
     EXPECT_TRUE(! tracker_.has_sent_message());
 
+    // Task reported p1 as unresponsive.
+    ASSERT_EQ(1, routing_table_.unresponsive_ids_.size());
+    EXPECT_EQ(p1.id_, routing_table_.unresponsive_ids_.front());
+
     // Task notified the error.
     EXPECT_EQ(1, callback_call_count_);
     EXPECT_TRUE(failure_ == k::INITIAL_PEER_FAILED_TO_RESPOND);
@@ -127,6 +131,9 @@ TEST_F(StoreValueTaskTest, CanNotifyErrorWhenAllPeersFailToRespond)
     // Task didn't send any more message.
     EXPECT_TRUE(! tracker_.has_sent_message());
 
+    // Task reported p1 & p2 as unresponsive.
+    EXPECT_EQ(2, routing_table_.unresponsive_ids_.size());
+
     // Task notified the error.
     EXPECT_EQ(1, callback_call_count_);
     EXPECT_TRUE(failure_ == k::INITIAL_PEER_FAILED_TO_RESPOND);
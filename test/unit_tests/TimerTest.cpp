@@ -110,5 +110,20 @@ TEST_F(TimerTest, multiple_associations_can_be_added)
     // A timeout (infinite) is still in flight atm.
 }
 
+TEST_F(TimerTest, cancelled_associations_are_not_called)
+{
+    auto on_expiration = [ this ] (void)
+    { ++ timeouts_received_; };
+
+    auto const immediate = kd::Timer::duration::zero();
+    auto const h = manager_.expires_from_now(immediate, on_expiration);
+    EXPECT_TRUE(manager_.cancel(h));
+    EXPECT_FALSE(manager_.cancel(h));
+
+    // The task is still executed but doesn't call the callback.
+    EXPECT_EQ(1, io_service_.runOne());
+    EXPECT_EQ(0, timeouts_received_);
+}
+
 
 }
@@ -26,11 +26,14 @@
 #ifndef KADEMLIA_TEST_HELPERS_ROUTING_TABLE_MOCK_HPP
 #define KADEMLIA_TEST_HELPERS_ROUTING_TABLE_MOCK_HPP
 
+#include <chrono>
+#include <map>
 #include <vector>
 #include <deque>
 #include <utility>
 #include <stdexcept>
 
+#include "kademlia/constants.hpp"
 #include "kademlia/message.hpp"
 #include "kademlia/ip_endpoint.hpp"
 #include "kademlia/peer.hpp"
@@ -43,19 +46,25 @@ struct routing_table_mock
     using peer_type = std::pair< detail::id, detail::ip_endpoint >;
     using peers_type = std::vector< peer_type >;
     using expected_ids_type = std::deque< detail::id >;
-
-    using iterator_type = peers_type::iterator;
+    using unresponsive_ids_type = std::vector< detail::id >;
+    using responsive_ids_type = std::vector< detail::id >;
+    using duration = std::chrono::steady_clock::duration;
+    using round_trip_times_type = std::map< detail::id, duration >;
 
     routing_table_mock
         ( void )
         : expected_ids_()
         , peers_()
         , find_call_count_()
+        , unresponsive_ids_()
+        , responsive_ids_()
+        , round_trip_times_()
     { }
 
-    iterator_type
-    find
-        ( detail::id const& id )
+    peers_type const&
+    closest
+        ( detail::id const& id
+        , std::size_t )
     {
         if ( expected_ids_.empty() || id != expected_ids_.front() )
             throw std::runtime_error( "Unexpected searched id." );
@@ -64,7 +73,7 @@ struct routing_table_mock
 
         ++ find_call_count_;
 
-        return peers_.begin();
+        return peers_;
     }
 
     void
@@ -73,14 +82,44 @@ struct routing_table_mock
         , detail::ip_endpoint const& endpoint )
     { peers_.emplace_back( id, endpoint ); }
 
-    iterator_type
-    end
-        ( void )
-    { return peers_.end(); }
+    bool
+    flag_peer_as_unresponsive
+        ( detail::id const& id )
+    {
+        unresponsive_ids_.push_back( id );
+        return false;
+    }
+
+    bool
+    record_round_trip_time
+        ( detail::id const& id
+        , duration const& )
+    {
+        responsive_ids_.push_back( id );
+        return false;
+    }
+
+    duration
+    get_round_trip_time
+        ( detail::id const& id )
+        const
+    {
+        auto const i = round_trip_times_.find( id );
+        return i == round_trip_times_.end() ? duration::zero() : i->second;
+    }
+
+    duration
+    get_request_timeout
+        ( detail::id const& )
+        const
+    { return detail::PEER_LOOKUP_TIMEOUT; }
 
     expected_ids_type expected_ids_;
     peers_type peers_;
     uint64_t find_call_count_;
+    unresponsive_ids_type unresponsive_ids_;
+    responsive_ids_type responsive_ids_;
+    round_trip_times_type round_trip_times_;
 };
 
 } // namespace test
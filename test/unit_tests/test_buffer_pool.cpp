@@ -0,0 +1,130 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "kademlia/buffer_pool.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+
+TEST(buffer_pool_test, released_buffers_are_recycled)
+{
+    kd::buffer_pool pool;
+    EXPECT_EQ(0, pool.free_count());
+
+    std::uint8_t const * data;
+    {
+        auto b = pool.acquire();
+        b->assign(32, 0xff);
+        data = b->data();
+    }
+    EXPECT_EQ(1, pool.free_count());
+
+    // The recycled buffer is empty but keeps its storage.
+    auto b = pool.acquire();
+    EXPECT_EQ(0, pool.free_count());
+    EXPECT_TRUE(b->empty());
+    EXPECT_LE(32, b->capacity());
+    b->resize(32);
+    EXPECT_EQ(data, b->data());
+}
+
+TEST(buffer_pool_test, buffers_are_released_by_their_last_owner)
+{
+    kd::buffer_pool pool;
+
+    auto b1 = pool.acquire();
+    b1->push_back(1);
+    {
+        auto b2 = b1;
+        EXPECT_EQ(&*b1, &*b2);
+
+        b1 = kd::pooled_buffer{};
+        EXPECT_EQ(0, pool.free_count());
+        EXPECT_EQ(1, b2->size());
+    }
+    EXPECT_EQ(1, pool.free_count());
+}
+
+TEST(buffer_pool_test, buffers_can_outlive_their_pool)
+{
+    kd::pooled_buffer b;
+    {
+        kd::buffer_pool pool;
+        b = pool.acquire();
+        b->push_back(1);
+        pool.acquire();
+    }
+
+    EXPECT_EQ(1, b->size());
+}
+
+TEST(buffer_pool_test, buffers_can_be_shared_among_threads)
+{
+    kd::buffer_pool pool;
+
+    auto const THREADS_COUNT = 4;
+    auto const BUFFERS_PER_THREAD = 64;
+
+    std::vector< std::vector< kd::pooled_buffer > > buffers(THREADS_COUNT);
+    for (auto & thread_buffers : buffers)
+        for (auto i = 0; i != BUFFERS_PER_THREAD; ++ i)
+            thread_buffers.push_back(pool.acquire());
+
+    // Each thread releases its buffers while the
+    // main thread releases the other owners.
+    auto copies = buffers;
+    std::vector< std::thread > threads;
+    for (auto & thread_buffers : buffers)
+        threads.emplace_back([ &pool, &thread_buffers ]
+        {
+            for (auto i = 0; i != BUFFERS_PER_THREAD; ++ i)
+                pool.acquire()->push_back(1);
+            thread_buffers.clear();
+        });
+    copies.clear();
+
+    for (auto & t : threads)
+        t.join();
+
+    EXPECT_EQ(THREADS_COUNT * BUFFERS_PER_THREAD, pool.free_count());
+}
+
+TEST(buffer_pool_test, unpooled_buffers_own_their_content)
+{
+    kd::buffer const content{ 1, 2, 3 };
+    kd::pooled_buffer b{ content };
+
+    EXPECT_EQ(content, *b);
+}
+
+}
+
@@ -0,0 +1,148 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "peer_factory.hpp"
+#include "kademlia/concurrent_routing_table.hpp"
+#include "kademlia/ip_endpoint.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+
+using test_routing_table = kd::concurrent_routing_table< kd::ip_endpoint >;
+
+TEST(concurrent_routing_table_test, closest_returns_a_copy)
+{
+    test_routing_table rt{ kd::id{} };
+    EXPECT_TRUE(rt.push(kd::id{ "1" }, create_endpoint()));
+    EXPECT_TRUE(rt.push(kd::id{ "2" }, create_endpoint()));
+
+    auto const closest = rt.closest(kd::id{ "2" }, 1);
+    EXPECT_TRUE(rt.remove(kd::id{ "2" }));
+
+    ASSERT_EQ(1, closest.size());
+    EXPECT_EQ(kd::id{ "2" }, closest[0].first);
+    EXPECT_EQ(kd::id{ "1" }, rt.closest(kd::id{ "2" }, 1)[0].first);
+}
+
+TEST(concurrent_routing_table_test, recently_pushed_peers_are_refreshed_once_flagged)
+{
+    test_routing_table rt{ kd::id{} };
+    EXPECT_TRUE(rt.push(kd::id{ "1" }, create_endpoint()));
+    EXPECT_FALSE(rt.push(kd::id{ "1" }, create_endpoint()));
+
+    EXPECT_FALSE(rt.flag_peer_as_unresponsive(kd::id{ "1" }));
+    EXPECT_EQ(1, rt.get_failures_count(kd::id{ "1" }));
+
+    EXPECT_FALSE(rt.push(kd::id{ "1" }, create_endpoint()));
+    EXPECT_EQ(0, rt.get_failures_count(kd::id{ "1" }));
+}
+
+TEST(concurrent_routing_table_test, recently_pushed_peers_can_be_pushed_again_once_removed)
+{
+    test_routing_table rt{ kd::id{} };
+    EXPECT_TRUE(rt.push(kd::id{ "1" }, create_endpoint()));
+    EXPECT_FALSE(rt.push(kd::id{ "1" }, create_endpoint()));
+
+    EXPECT_TRUE(rt.remove(kd::id{ "1" }));
+    EXPECT_EQ(0, rt.peer_count());
+
+    EXPECT_TRUE(rt.push(kd::id{ "1" }, create_endpoint()));
+    EXPECT_EQ(1, rt.peer_count());
+}
+
+TEST(concurrent_routing_table_test, recently_pushed_peers_endpoint_can_be_updated)
+{
+    test_routing_table rt{ kd::id{} };
+    EXPECT_TRUE(rt.push(kd::id{ "1" }, create_endpoint("127.0.0.1", 1)));
+    EXPECT_FALSE(rt.push(kd::id{ "1" }, create_endpoint("127.0.0.1", 1)));
+    EXPECT_FALSE(rt.push(kd::id{ "1" }, create_endpoint("::1", 1)));
+
+    auto const closest = rt.closest(kd::id{ "1" }, 1);
+    ASSERT_EQ(1, closest.size());
+    EXPECT_EQ(create_endpoint("::1", 1), closest[0].second);
+}
+
+TEST(concurrent_routing_table_test, peers_can_be_pushed_by_several_threads)
+{
+    test_routing_table rt{ kd::id{} };
+    auto const THREADS_COUNT = 4, PEERS_COUNT = 500;
+
+    std::vector< std::thread > threads;
+    for (auto t = 0; t != THREADS_COUNT; ++ t)
+        threads.emplace_back([ &rt, t, PEERS_COUNT ]
+        {
+            std::default_random_engine random_engine{ std::uint32_t(t) };
+            for (auto i = 0; i != PEERS_COUNT; ++ i)
+            {
+                kd::id const new_id(random_engine);
+                rt.push(new_id, create_endpoint());
+                rt.record_round_trip_time(new_id, std::chrono::milliseconds(10));
+                rt.closest(new_id);
+            }
+        });
+
+    for (auto & t : threads)
+        t.join();
+
+    EXPECT_LT(0, rt.peer_count());
+    EXPECT_GE(THREADS_COUNT * PEERS_COUNT, rt.peer_count());
+}
+
+TEST(concurrent_routing_table_test, closest_peers_can_be_found_by_several_threads)
+{
+    test_routing_table rt{ kd::id{} };
+    std::default_random_engine random_engine;
+    for (auto i = 0; i != 200; ++ i)
+        rt.push(kd::id(random_engine), create_endpoint());
+    auto const target = kd::id(random_engine);
+    auto const expected = rt.closest(target);
+
+    auto const THREADS_COUNT = 4, LOOKUPS_COUNT = 500;
+    std::vector< std::thread > threads;
+    std::vector< std::size_t > mismatches(THREADS_COUNT);
+    for (auto t = 0; t != THREADS_COUNT; ++ t)
+        threads.emplace_back([ &, t ]
+        {
+            for (auto i = 0; i != LOOKUPS_COUNT; ++ i)
+                if (rt.closest(target) != expected)
+                    ++ mismatches[t];
+        });
+
+    for (auto & t : threads)
+        t.join();
+
+    EXPECT_EQ(std::vector< std::size_t >(THREADS_COUNT), mismatches);
+}
+
+}
+
@@ -25,6 +25,7 @@
 
 #include <memory>
 #include <boost/asio/io_service.hpp>
+#include <boost/filesystem.hpp>
 #include "test_engine.hpp"
 #include "gtest/gtest.h"
 
@@ -71,7 +72,8 @@ TEST(engine_test, isolated_bootstrap_engine_cannot_save )
     };
     e1->async_save( "key", "data", on_save );
 
-    EXPECT_EQ( 0, io_service.poll() );
+    // Only the save dispatched to the strand is executed.
+    EXPECT_EQ( 1, io_service.poll() );
 
     EXPECT_TRUE( ! save_executed );
 std::cout << "===============================" << std::endl;
@@ -97,7 +99,8 @@ TEST(engine_test, isolated_bootstrap_engine_cannot_load )
     { load_executed = true; };
     e1->async_load( "key", on_load );
 
-    EXPECT_EQ( 0, io_service.poll() );
+    // Only the load dispatched to the strand is executed.
+    EXPECT_EQ( 1, io_service.poll() );
 
     EXPECT_TRUE( ! load_executed );
 
@@ -115,10 +118,11 @@ TEST(engine_test, isolated_engine_cannot_be_constructed )
 
     k::endpoint initial_peer{ "172.18.1.2", k::session_base::DEFAULT_PORT };
 
-    EXPECT_THROW( create_test_engine( io_service
-                                           , d::id{}
-                                           , initial_peer )
-                       , std::exception );
+    // The failure is reported from the strand.
+    auto e = create_test_engine( io_service
+                               , d::id{}
+                               , initial_peer );
+    EXPECT_THROW( io_service.poll(), std::exception );
 }
 
 TEST(engine_test, two_engines_can_find_themselves )
@@ -134,6 +138,11 @@ TEST(engine_test, two_engines_can_find_themselves )
     auto e2 = create_test_engine( io_service, id2, e1->ipv4() );
 
     EXPECT_GT( io_service.poll(), 0 );
+
+    // e2 discovered its neighbors through e1.
+    auto const timeouts = e2->get_timeout_statistics();
+    EXPECT_GT( timeouts.requests_count_, 0 );
+    EXPECT_GT( timeouts.max_timeout_.count(), 0 );
 }
 
 TEST(engine_test, two_engines_can_save_and_load )
@@ -168,5 +177,130 @@ TEST(engine_test, two_engines_can_save_and_load )
     EXPECT_GT( io_service.poll(), 0 );
 }
 
+TEST(engine_test, latency_aware_engines_can_save_and_load )
+{
+    boost::asio::io_service io_service;
+
+    d::id const id1{ "8000000000000000000000000000000000000000" };
+    auto e1 = create_test_engine( io_service, id1 );
+    e1->set_latency_aware_peer_selection( true );
+
+    d::id const id2{ "4000000000000000000000000000000000000000" };
+    auto e2 = create_test_engine( io_service, id2, e1->ipv4() );
+    e2->set_latency_aware_peer_selection( true );
+
+    EXPECT_GT( io_service.poll(), 0 );
+
+    std::string const expected_data{ "data" };
+
+    bool save_executed = false;
+    auto on_save = [ &save_executed ]( std::error_code const& failure )
+    {
+        if ( failure ) throw std::system_error{ failure };
+        save_executed = true;
+    };
+    e1->async_save( "key", expected_data, on_save );
+
+    EXPECT_GT( io_service.poll(), 0 );
+    EXPECT_TRUE( save_executed );
+
+    bool load_executed = false;
+    auto on_load = [ &expected_data, &load_executed ]( std::error_code const& failure
+                                                     , std::string const& actual_data )
+    {
+        if ( failure ) throw std::system_error{ failure };
+        if ( expected_data != actual_data )
+            throw std::runtime_error{ "Unexpected data" };
+        load_executed = true;
+    };
+    e2->async_load( "key", on_load );
+
+    EXPECT_GT( io_service.poll(), 0 );
+    EXPECT_TRUE( load_executed );
+}
+
+TEST(engine_test, sharded_engines_share_their_connection )
+{
+    boost::asio::io_service io_service;
+    boost::asio::io_service::work work{ io_service };
+
+    k::endpoint ipv4_endpoint{ "127.0.0.1", k::session_base::DEFAULT_PORT };
+    k::endpoint ipv6_endpoint{ "::1", k::session_base::DEFAULT_PORT };
+
+    using engine_type = d::engine< t::fake_socket >;
+    auto const state = engine_type::create_shared_state( d::id{ "1" } );
+    engine_type shard1{ io_service, ipv4_endpoint, ipv6_endpoint, state, 2 };
+    engine_type shard2{ io_service, ipv4_endpoint, ipv6_endpoint, state, 2 };
+    k::endpoint const shard2_ipv4{ t::fake_socket::get_last_allocated_ipv4().to_string()
+                                 , k::session_base::DEFAULT_PORT };
+
+    bool save_executed = false;
+    auto on_save = [ &save_executed ]( std::error_code const& failure )
+    { save_executed = true; };
+    shard1.async_save( { 'k' }, { 'd' }, on_save );
+
+    // The save is delayed until connected.
+    EXPECT_EQ( 1, io_service.poll() );
+    EXPECT_TRUE( ! save_executed );
+
+    // Only the second shard is contacted.
+    auto e = create_test_engine( io_service, d::id{ "2" }, shard2_ipv4 );
+
+    EXPECT_GT( io_service.poll(), 0 );
+    EXPECT_TRUE( save_executed );
+}
+
+
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+
+TEST(engine_test, stored_values_survive_a_restart_with_a_storage_directory )
+{
+    boost::asio::io_service io_service;
+
+    auto const directory = boost::filesystem::temp_directory_path()
+            / boost::filesystem::unique_path( "kademlia-%%%%-%%%%-%%%%" );
+
+    k::endpoint ipv4_endpoint{ "127.0.0.1", k::session_base::DEFAULT_PORT };
+    k::endpoint ipv6_endpoint{ "::1", k::session_base::DEFAULT_PORT };
+
+    using engine_type = d::engine< t::fake_socket >;
+    {
+        auto const state = engine_type::create_shared_state( d::id{ "1" }
+                                                           , directory.string() );
+        engine_type e1{ io_service, ipv4_endpoint, ipv6_endpoint, state, 1 };
+        k::endpoint const e1_ipv4{ t::fake_socket::get_last_allocated_ipv4().to_string()
+                                 , k::session_base::DEFAULT_PORT };
+
+        auto e2 = create_test_engine( io_service, d::id{ "2" }, e1_ipv4 );
+        EXPECT_GT( io_service.poll(), 0 );
+
+        auto on_save = []( std::error_code const& failure )
+        { if ( failure ) throw std::system_error{ failure }; };
+        e2->async_save( "key", "data", on_save );
+        EXPECT_GT( io_service.poll(), 0 );
+
+        EXPECT_EQ( 1, e1.get_storage_statistics().values_count_ );
+    }
+
+    // The values of the directory are indexed on creation.
+    auto const state = engine_type::create_shared_state( d::id{ "1" }
+                                                       , directory.string() );
+    engine_type e1{ io_service, ipv4_endpoint, ipv6_endpoint, state, 1 };
+    EXPECT_EQ( 1, e1.get_storage_statistics().values_count_ );
+
+    boost::filesystem::remove_all( directory );
+}
+
+#else
+
+TEST(engine_test, storage_directory_requires_a_persistent_value_store )
+{
+    using engine_type = d::engine< t::fake_socket >;
+    EXPECT_THROW( engine_type::create_shared_state( d::id{ "1" }, "directory" )
+                , std::system_error );
+}
+
+#endif
+
 }
 
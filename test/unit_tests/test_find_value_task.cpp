@@ -28,6 +28,7 @@
 #include "kademlia/ip_endpoint.hpp"
 #include "kademlia/find_value_task.hpp"
 #include "gtest/gtest.h"
+#include <chrono>
 #include <vector>
 
 namespace {
@@ -97,6 +98,10 @@ TEST_F(find_value_task_test, can_notify_error_when_unique_peer_fails_to_respond)
     // Task didn't send any more message.
     EXPECT_TRUE(! tracker_.has_sent_message());
 
+    // Task reported p1 as unresponsive.
+    ASSERT_EQ(1, routing_table_.unresponsive_ids_.size());
+    EXPECT_EQ(p1.id_, routing_table_.unresponsive_ids_.front());
+
     // Task notified the error.
     EXPECT_EQ(1, callback_call_count_);
     EXPECT_TRUE(failure_ == k::VALUE_NOT_FOUND);
@@ -127,6 +132,9 @@ TEST_F(find_value_task_test, can_notify_error_when_all_peers_fail_to_respond)
     // Task didn't send any more message.
     EXPECT_TRUE(! tracker_.has_sent_message());
 
+    // Task reported p1 & p2 as unresponsive.
+    EXPECT_EQ(2, routing_table_.unresponsive_ids_.size());
+
     // Task notified the error.
     EXPECT_EQ(1, callback_call_count_);
     EXPECT_TRUE(failure_ == k::VALUE_NOT_FOUND);
@@ -236,6 +244,10 @@ TEST_F(find_value_task_test, can_return_value_when_already_known_peer_has_the_va
     EXPECT_TRUE(tracker_.has_sent_message(p1.endpoint_, fv));
     EXPECT_TRUE(! tracker_.has_sent_message());
 
+    // Task reported p1 response.
+    ASSERT_EQ(1, routing_table_.responsive_ids_.size());
+    EXPECT_EQ(p1.id_, routing_table_.responsive_ids_.front());
+
     // Task notified the success.
     EXPECT_EQ(1, callback_call_count_);
     EXPECT_TRUE(! failure_);
@@ -283,4 +295,41 @@ TEST_F(find_value_task_test, can_return_value_when_discovered_peer_has_the_value
     EXPECT_EQ(fv2.data_, data_);
 }
 
+TEST_F(find_value_task_test, can_query_low_latency_peers_first)
+{
+    kd::id const searched_key{};
+    routing_table_.expected_ids_.emplace_back(searched_key);
+
+    // All peers are as close to the key.
+    auto p1 = create_and_add_peer("192.168.1.1", kd::id{ "4" });
+    auto p2 = create_and_add_peer("192.168.1.2", kd::id{ "5" });
+    auto p3 = create_and_add_peer("192.168.1.3", kd::id{ "6" });
+    auto p4 = create_and_add_peer("192.168.1.4", kd::id{ "7" });
+    routing_table_.round_trip_times_[ p2.id_ ] = std::chrono::milliseconds{ 30 };
+    routing_table_.round_trip_times_[ p3.id_ ] = std::chrono::milliseconds{ 20 };
+    routing_table_.round_trip_times_[ p4.id_ ] = std::chrono::milliseconds{ 10 };
+
+    kd::start_find_value_task< data_type >(searched_key
+            , tracker_
+            , routing_table_
+            , std::ref(*this)
+            , true);
+    io_service_.poll();
+
+    // Task asked the fastest peers first and p1,
+    // whose latency is unknown, once p4 failed.
+    kd::find_value_request_body const fv{ searched_key };
+    EXPECT_TRUE(tracker_.has_sent_message(p4.endpoint_, fv));
+    EXPECT_TRUE(tracker_.has_sent_message(p3.endpoint_, fv));
+    EXPECT_TRUE(tracker_.has_sent_message(p2.endpoint_, fv));
+    EXPECT_TRUE(tracker_.has_sent_message(p1.endpoint_, fv));
+
+    // Task didn't send any more message.
+    EXPECT_TRUE(! tracker_.has_sent_message());
+
+    // Task notified the error.
+    EXPECT_EQ(1, callback_call_count_);
+    EXPECT_TRUE(failure_ == k::VALUE_NOT_FOUND);
+}
+
 }
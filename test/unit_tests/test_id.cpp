@@ -229,8 +229,68 @@ TEST(IDTest, id_distance_can_be_evaluated)
         EXPECT_LT(kd::distance(id1, id2)
                         , kd::distance(id1, id3));
     }
+    {
+        kd::id const id1{ "0123456789abcdeffedcba9876543210aabbccdd" };
+        kd::id const id2{ "ffffffffffffffff00000000000000000000ffff" };
+
+        EXPECT_EQ(kd::id{ "fedcba9876543210fedcba9876543210aabb3322" }
+                 , kd::distance(id1, id2));
+    }
+}
+
+
+TEST(IDTest, id_can_be_compared)
+{
+    EXPECT_EQ(0, kd::compare(kd::id{ "1" }, kd::id{ "1" }));
+    EXPECT_GT(0, kd::compare(kd::id{ "1" }, kd::id{ "2" }));
+    EXPECT_LT(0, kd::compare(kd::id{ "2" }, kd::id{ "1" }));
+    // Across words boundaries.
+    EXPECT_LT(0, kd::compare(kd::id{ "100000000" }, kd::id{ "ffffffff" }));
+    EXPECT_LT(0, kd::compare(kd::id{ "8000000000000000000000000000000000000000" }
+                            , kd::id{ "7fffffffffffffffffffffffffffffffffffffff" }));
+}
+
+TEST(IDTest, id_common_prefix_length_can_be_evaluated)
+{
+    kd::id const zero{};
+
+    EXPECT_EQ(kd::id::BIT_SIZE, kd::common_prefix_length(zero, zero));
+    EXPECT_EQ(0, kd::common_prefix_length(zero
+            , kd::id{ "8000000000000000000000000000000000000000" }));
+    EXPECT_EQ(63, kd::common_prefix_length(zero
+            , kd::id{ "0000000000000001000000000000000000000000" }));
+    EXPECT_EQ(64, kd::common_prefix_length(zero
+            , kd::id{ "0000000000000000800000000000000000000000" }));
+    EXPECT_EQ(128, kd::common_prefix_length(zero
+            , kd::id{ "0000000000000000000000000000000080000000" }));
+    EXPECT_EQ(kd::id::BIT_SIZE - 1, kd::common_prefix_length(zero
+            , kd::id{ "1" }));
+
+    // Same as a bit per bit comparison.
+    std::default_random_engine random_engine;
+    for (int round = 0; round != 64; ++ round)
+    {
+        kd::id const a{ random_engine };
+        kd::id b{ a };
+        std::size_t const expected = round * 2 % kd::id::BIT_SIZE;
+        b[expected] = ! b[expected];
+
+        EXPECT_EQ(expected, kd::common_prefix_length(a, b));
+    }
 }
 
+TEST(IDTest, id_words_can_be_updated)
+{
+    kd::id i{ "0123456789abcdeffedcba9876543210aabbccdd" };
+
+    EXPECT_EQ(0x0123456789abcdefULL, i.get_word(0));
+    EXPECT_EQ(0xfedcba9876543210ULL, i.get_word(1));
+    // Last word is padded.
+    EXPECT_EQ(0xaabbccdd00000000ULL, i.get_word(2));
+
+    i.set_word(2, 0x11223344ffffffffULL);
+    EXPECT_EQ(kd::id{ "0123456789abcdeffedcba987654321011223344" }, i);
+}
 
 TEST(IDTest, id_is_printable)
 {
@@ -26,7 +26,10 @@
 #include "common.hpp"
 #include "kademlia/log.hpp"
 #include "gtest/gtest.h"
+#include <algorithm>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 namespace {
 
@@ -78,6 +81,7 @@ TEST_F(LogTest, can_write_to_debug_log)
         rdbuf_saver const s{ std::cout, out.rdbuf() };
         auto const ptr = reinterpret_cast< void *>(0x12345678);
         kd::get_debug_log("test", ptr)<< "message" << std::endl;
+        kd::flush_log();
     }
 
     EXPECT_EQ(out.str(), "[debug] (test @ 345678) message\n");
@@ -90,9 +94,10 @@ TEST_F(LogTest, can_write_to_debug_log_using_macro)
         rdbuf_saver const s{ std::cout, out.rdbuf() };
         auto const ptr = reinterpret_cast< void *>(0x12345678);
         LOG_DEBUG(test, ptr)<< "message" << std::endl;
+        kd::flush_log();
     }
 
-#ifdef KADEMLIA_ENABLE_DEBUG
+#if KADEMLIA_LOG_LEVEL <= KADEMLIA_LOG_LEVEL_DEBUG
     EXPECT_TRUE(out.str() == ("[debug] (test @ 345678) message\n"));
 #else
     EXPECT_TRUE(out.str().empty());
@@ -117,6 +122,52 @@ TEST_F(LogTest, can_enable_log_module)
 
 }
 
+TEST_F(LogTest, can_enable_log_module_after_its_first_use)
+{
+    std::ostringstream out;
+    {
+        rdbuf_saver const s{ std::cout, out.rdbuf() };
+        auto const ptr = reinterpret_cast< void *>(0x12345678);
+        for (auto i = 0; i != 2; ++ i)
+        {
+            LOG_INFO(late_test, ptr) << "message " << i << std::endl;
+            kd::enable_log_for("late_test");
+        }
+        kd::disable_log_for("late_test");
+        kd::flush_log();
+    }
+
+#if KADEMLIA_LOG_LEVEL <= KADEMLIA_LOG_LEVEL_INFO
+    EXPECT_EQ(out.str(), "[info] (late_test @ 345678) message 1\n");
+#else
+    EXPECT_TRUE(out.str().empty());
+#endif
+}
+
+TEST_F(LogTest, can_write_to_debug_log_from_several_threads)
+{
+    std::ostringstream out;
+    {
+        rdbuf_saver const s{ std::cout, out.rdbuf() };
+
+        std::vector< std::thread > threads;
+        for (auto i = 0; i != 4; ++ i)
+            threads.emplace_back([]
+            {
+                for (auto j = 0; j != 100; ++ j)
+                    kd::get_debug_log("test", nullptr) << "message" << std::endl;
+            });
+
+        for (auto & t : threads)
+            t.join();
+        kd::flush_log();
+    }
+
+    auto const content = out.str();
+    auto const lines = std::count(content.begin(), content.end(), '\n');
+    EXPECT_EQ(400, lines);
+}
+
 TEST_F(LogTest, can_convert_container_to_string)
 {
     {
@@ -28,6 +28,8 @@
 #include "kademlia/id.hpp"
 #include "kademlia/lookup_task.hpp"
 #include "gtest/gtest.h"
+#include <chrono>
+#include <map>
 #include <vector>
 #include <utility>
 
@@ -48,6 +50,21 @@ struct test_task : kd::lookup_task {
 using routing_table_peer = std::pair< kd::id
                                     , kd::ip_endpoint >;
 
+struct round_trip_times {
+    using duration = std::chrono::steady_clock::duration;
+
+    duration
+    get_round_trip_time
+        (kd::id const& id)
+        const
+    {
+        auto const i = values_.find(id);
+        return i == values_.end() ? duration::zero() : i->second;
+    }
+
+    std::map< kd::id, duration > values_;
+};
+
 TEST(lookup_task_test, can_be_constructed_without_candidates)
 {
     std::vector< routing_table_peer > candidates;
@@ -137,4 +154,40 @@ TEST(lookup_task_test, can_add_candidates)
     EXPECT_EQ(1, c.select_new_closest_candidates(20).size());
 }
 
+TEST(lookup_task_test, can_select_low_latency_candidates)
+{
+    std::vector< routing_table_peer > candidates;
+    kd::ip_endpoint const default_address{};
+    candidates.emplace_back(kd::id{ "1" }, default_address);
+    candidates.emplace_back(kd::id{ "2" }, default_address);
+    candidates.emplace_back(kd::id{ "3" }, default_address);
+    candidates.emplace_back(kd::id{ "6" }, default_address);
+    candidates.emplace_back(kd::id{ "7" }, default_address);
+    kd::id const key{};
+    test_task c{ key, candidates.begin(), candidates.end() };
+
+    round_trip_times rtts;
+    rtts.values_[ kd::id{ "1" } ] = std::chrono::milliseconds{ 300 };
+    rtts.values_[ kd::id{ "2" } ] = std::chrono::milliseconds{ 50 };
+    rtts.values_[ kd::id{ "3" } ] = std::chrono::milliseconds{ 10 };
+    rtts.values_[ kd::id{ "7" } ] = std::chrono::milliseconds{ 100 };
+
+    // "1" is alone at its distance, hence selected
+    // first while "3" is as close as "2" but faster.
+    auto closest_candidates = c.select_new_closest_candidates(2, rtts);
+    EXPECT_EQ(2, closest_candidates.size());
+    EXPECT_EQ(kd::id{ "1" }, closest_candidates[ 0 ].id_);
+    EXPECT_EQ(kd::id{ "3" }, closest_candidates[ 1 ].id_);
+
+    c.flag_candidate_as_valid(kd::id{ "1" });
+    c.flag_candidate_as_valid(kd::id{ "3" });
+
+    // Peers with an unknown latency come last.
+    closest_candidates = c.select_new_closest_candidates(3, rtts);
+    EXPECT_EQ(3, closest_candidates.size());
+    EXPECT_EQ(kd::id{ "2" }, closest_candidates[ 0 ].id_);
+    EXPECT_EQ(kd::id{ "7" }, closest_candidates[ 1 ].id_);
+    EXPECT_EQ(kd::id{ "6" }, closest_candidates[ 2 ].id_);
+}
+
 }
@@ -329,6 +329,41 @@ TEST(message_test, can_detect_corrupted_store_value_request_body)
     }
 }
 
+TEST(message_test, store_value_request_value_can_be_kept_serialized)
+{
+    std::default_random_engine random_engine;
+
+    kd::store_value_request_body body_out
+            { kd::id{ random_engine }
+            , std::vector< std::uint8_t >(4096) };
+
+    std::generate(body_out.data_value_.begin()
+                 , body_out.data_value_.end()
+                 , std::rand);
+
+    kd::buffer buffer;
+    kd::serialize(body_out, buffer);
+
+    kd::serialized_store_value_request_body body_in;
+    auto i = buffer.cbegin(), e = buffer.cend();
+    EXPECT_TRUE(! kd::deserialize(i, e, body_in));
+    EXPECT_TRUE(i == e);
+
+    EXPECT_EQ(body_out.data_key_hash_, body_in.data_key_hash_);
+
+    // The value is ready to be sent in a find value response.
+    kd::buffer response;
+    kd::serialize(kd::find_value_response_body{ body_out.data_value_ }, response);
+    EXPECT_EQ(response, body_in.serialized_response_);
+
+    auto b = buffer.cbegin();
+    while (b != e)
+    {
+        auto j = b;
+        EXPECT_TRUE(kd::deserialize(j, --e, body_in));
+    }
+}
+
 kd::header
 generate_incorrect_header(void)
 {
@@ -336,6 +371,37 @@ generate_incorrect_header(void)
                      , static_cast< kd::header::type >(-1) };
 }
 
+TEST(message_test, serialized_size_is_known_up_front)
+{
+    std::default_random_engine random_engine;
+
+    kd::find_peer_response_body body_out;
+    body_out.peers_.push_back({ kd::id{ random_engine }
+                              , { boost::asio::ip::address::from_string("::1")
+                                , 1024 } });
+    body_out.peers_.push_back({ kd::id{ random_engine }
+                              , { boost::asio::ip::address::from_string("127.0.0.1")
+                                , 1025 } });
+
+    // The body is appended after the bytes already there.
+    kd::buffer buffer{ 1, 2, 3 };
+    kd::serialize(body_out, buffer);
+    EXPECT_EQ(3 + kd::get_serialized_size(body_out), buffer.size());
+    EXPECT_EQ(1, buffer[ 0 ]);
+
+    kd::find_peer_response_body body_in;
+    auto i = buffer.cbegin() + 3, e = buffer.cend();
+    EXPECT_TRUE(! kd::deserialize(i, e, body_in));
+    EXPECT_TRUE(i == e);
+    EXPECT_EQ(body_out.peers_, body_in.peers_);
+
+    kd::store_value_request_body const store_out
+            { kd::id{ random_engine }, std::vector< std::uint8_t >(100) };
+    buffer.clear();
+    kd::serialize(store_out, buffer);
+    EXPECT_EQ(kd::get_serialized_size(store_out), buffer.size());
+}
+
 TEST(message_test, header_is_printable)
 {
     std::string pattern(k::test::readFile(k::test::get_capture_path("pattern_header.out"), "\n"));
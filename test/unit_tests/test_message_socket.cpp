@@ -23,6 +23,10 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include <boost/asio/ip/udp.hpp>
 #include "kademlia/endpoint.hpp"
 #include "kademlia/message_socket.hpp"
@@ -107,4 +111,208 @@ TEST(message_socket_test, ipv6_socket_can_be_created)
     EXPECT_NO_THROW(message_socket_type::ipv6(io_service, endpoint););
 }
 
+TEST(message_socket_test, sockets_can_share_a_port)
+{
+    boost::asio::io_service io_service;
+
+    k::endpoint const endpoint("127.0.0.1"
+                              , k::test::get_temporary_listening_port());
+
+    auto const s1 = message_socket_type::ipv4(io_service, endpoint, true);
+    EXPECT_NO_THROW(message_socket_type::ipv4(io_service, endpoint, true););
+    EXPECT_THROW(message_socket_type::ipv4(io_service, endpoint);,
+                 std::exception);
+}
+
+TEST(message_socket_test, messages_can_be_sent_and_received_in_batch)
+{
+    boost::asio::io_service io_service;
+
+    auto sender = message_socket_type::ipv4(io_service
+            , k::endpoint{ "127.0.0.1", k::test::get_temporary_listening_port() });
+    auto receiver = message_socket_type::ipv4(io_service
+            , k::endpoint{ "127.0.0.1", k::test::get_temporary_listening_port(1235) });
+
+    auto const MESSAGES_COUNT = 20;
+    std::size_t sent_count = 0;
+    for (auto i = 0; i != MESSAGES_COUNT; ++ i)
+    {
+        kd::buffer const message(std::size_t(i + 1), std::uint8_t(i));
+        sender.async_send(message, receiver.local_endpoint()
+                         , [ &sent_count ](std::error_code const& failure)
+                         { EXPECT_TRUE(! failure); ++ sent_count; });
+    }
+
+    std::vector< kd::buffer > received;
+    std::function< void (std::error_code const&
+                        , message_socket_type::received_messages const&) > on_receive;
+    on_receive = [ & ](std::error_code const& failure
+                      , message_socket_type::received_messages const& messages)
+    {
+        EXPECT_TRUE(! failure);
+        for (auto const& m : messages)
+        {
+            EXPECT_EQ(sender.local_endpoint(), m.sender_);
+            received.emplace_back(m.begin_, m.end_);
+        }
+
+        if (received.size() < MESSAGES_COUNT)
+            receiver.async_receive_batch(on_receive);
+    };
+    receiver.async_receive_batch(on_receive);
+
+    io_service.run();
+
+    EXPECT_EQ(MESSAGES_COUNT, sent_count);
+    ASSERT_EQ(MESSAGES_COUNT, received.size());
+    for (auto i = 0; i != MESSAGES_COUNT; ++ i)
+        EXPECT_EQ(kd::buffer(std::size_t(i + 1), std::uint8_t(i)), received[i]);
+}
+
+TEST(message_socket_test, large_messages_can_be_received_in_batch)
+{
+    boost::asio::io_service io_service;
+
+    auto sender = message_socket_type::ipv4(io_service
+            , k::endpoint{ "127.0.0.1", k::test::get_temporary_listening_port() });
+    auto receiver = message_socket_type::ipv4(io_service
+            , k::endpoint{ "127.0.0.1", k::test::get_temporary_listening_port(1235) });
+
+    // Interleave a few datagrams close to the IPv4 limit with small
+    // ones, without overflowing the receiver socket buffer.
+    auto const MESSAGES_COUNT = 20;
+    auto const get_message = [](int i)
+    { return kd::buffer(i % 8 ? std::size_t(i + 1) : 65000, std::uint8_t(i)); };
+
+    std::size_t sent_count = 0;
+    for (auto i = 0; i != MESSAGES_COUNT; ++ i)
+        sender.async_send(get_message(i), receiver.local_endpoint()
+                         , [ &sent_count ](std::error_code const& failure)
+                         { EXPECT_TRUE(! failure); ++ sent_count; });
+
+    std::vector< kd::buffer > received;
+    std::function< void (std::error_code const&
+                        , message_socket_type::received_messages const&) > on_receive;
+    on_receive = [ & ](std::error_code const& failure
+                      , message_socket_type::received_messages const& messages)
+    {
+        EXPECT_TRUE(! failure);
+        for (auto const& m : messages)
+            received.emplace_back(m.begin_, m.end_);
+
+        if (received.size() < MESSAGES_COUNT)
+            receiver.async_receive_batch(on_receive);
+    };
+    receiver.async_receive_batch(on_receive);
+
+    io_service.run();
+
+    EXPECT_EQ(MESSAGES_COUNT, sent_count);
+    ASSERT_EQ(MESSAGES_COUNT, received.size());
+    for (auto i = 0; i != MESSAGES_COUNT; ++ i)
+        EXPECT_EQ(get_message(i), received[i]);
+}
+
+#ifdef KADEMLIA_HAS_DATAGRAM_BATCH
+
+TEST(message_socket_test, truncated_datagrams_are_reported)
+{
+    using socket_type = boost::asio::ip::udp::socket;
+    using batch = kd::datagram_batch< socket_type >;
+
+    boost::asio::io_service io_service;
+    socket_type sender{ io_service, { boost::asio::ip::address_v4::loopback(), 0 } };
+    socket_type receiver{ io_service, { boost::asio::ip::address_v4::loopback(), 0 } };
+
+    kd::buffer const large(16, 1), small(4, 2);
+    sender.send_to(boost::asio::buffer(large), receiver.local_endpoint());
+    sender.send_to(boost::asio::buffer(small), receiver.local_endpoint());
+
+    std::uint8_t buffers[ 2 * 8 ];
+    socket_type::endpoint_type senders[ 2 ];
+    std::size_t sizes[ 2 ];
+    std::error_code failure;
+    EXPECT_EQ(2, batch::receive(receiver, buffers, 8, senders, sizes, 2, failure));
+    EXPECT_TRUE(! failure);
+    EXPECT_EQ(0, sizes[ 0 ]);
+    EXPECT_EQ(small.size(), sizes[ 1 ]);
+    EXPECT_EQ(small, kd::buffer(buffers + 8, buffers + 8 + sizes[ 1 ]));
+}
+
+#endif
+
+TEST(message_socket_test, messages_can_be_sent_and_received_by_several_threads)
+{
+    boost::asio::io_service io_service;
+
+    auto sender = message_socket_type::ipv4(io_service
+            , k::endpoint{ "127.0.0.1", k::test::get_temporary_listening_port() });
+    auto receiver = message_socket_type::ipv4(io_service
+            , k::endpoint{ "127.0.0.1", k::test::get_temporary_listening_port(1235) });
+
+    auto const THREADS_COUNT = 4;
+    auto const MESSAGES_PER_THREAD = 16;
+    auto const MESSAGES_COUNT = THREADS_COUNT * MESSAGES_PER_THREAD;
+
+    std::mutex mutex;
+    std::vector< kd::buffer > received;
+    std::function< void (std::error_code const&
+                        , message_socket_type::received_messages const&) > on_receive;
+    on_receive = [ & ](std::error_code const& failure
+                      , message_socket_type::received_messages const& messages)
+    {
+        EXPECT_TRUE(! failure);
+        std::lock_guard< std::mutex > lock{ mutex };
+        for (auto const& m : messages)
+            received.emplace_back(m.begin_, m.end_);
+
+        if (received.size() < MESSAGES_COUNT)
+            receiver.async_receive_batch(on_receive);
+        else
+            io_service.stop();
+    };
+    receiver.async_receive_batch(on_receive);
+
+    std::atomic< std::size_t > sent_count{ 0 };
+    std::vector< std::thread > threads;
+    for (auto i = 0; i != THREADS_COUNT; ++ i)
+    {
+        threads.emplace_back([ & ] { io_service.run(); });
+        threads.emplace_back([ &, i ]
+        {
+            for (auto j = 0; j != MESSAGES_PER_THREAD; ++ j)
+                sender.async_send(kd::buffer{ std::uint8_t(i), std::uint8_t(j) }
+                                 , receiver.local_endpoint()
+                                 , [ &sent_count ](std::error_code const& failure)
+                                 { EXPECT_TRUE(! failure); ++ sent_count; });
+        });
+    }
+
+    for (auto & t : threads)
+        t.join();
+
+    EXPECT_EQ(MESSAGES_COUNT, sent_count);
+    ASSERT_EQ(MESSAGES_COUNT, received.size());
+    std::sort(received.begin(), received.end());
+    for (auto i = 0; i != MESSAGES_COUNT; ++ i)
+        EXPECT_EQ((kd::buffer{ std::uint8_t(i / MESSAGES_PER_THREAD)
+                             , std::uint8_t(i % MESSAGES_PER_THREAD) }), received[i]);
+}
+
+TEST(message_socket_test, too_large_messages_are_rejected)
+{
+    boost::asio::io_service io_service;
+
+    auto sender = message_socket_type::ipv4(io_service
+            , k::endpoint{ "127.0.0.1", k::test::get_temporary_listening_port() });
+
+    kd::buffer const message(message_socket_type::INPUT_BUFFER_SIZE + 1);
+    std::error_code result;
+    sender.async_send(message, sender.local_endpoint()
+                     , [ &result ](std::error_code const& failure)
+                     { result = failure; });
+
+    EXPECT_TRUE(std::errc::value_too_large == result);
+}
+
 }
@@ -0,0 +1,111 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <random>
+#include <vector>
+
+#include "common.hpp"
+#include "kademlia/peer_index.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+
+using location = kd::peer_index::location;
+
+TEST(peer_index_test, is_empty_on_construction)
+{
+    kd::peer_index index;
+    EXPECT_EQ(0, index.size());
+    EXPECT_EQ(nullptr, index.find(kd::id{}));
+}
+
+TEST(peer_index_test, can_find_an_inserted_peer)
+{
+    kd::peer_index index;
+    EXPECT_TRUE(index.insert(kd::id{ "1" }, location{ 2, 3 }));
+    EXPECT_EQ(1, index.size());
+
+    auto const found = index.find(kd::id{ "1" });
+    ASSERT_NE(nullptr, found);
+    EXPECT_EQ(2, found->k_bucket_index_);
+    EXPECT_EQ(3, found->position_);
+
+    EXPECT_EQ(nullptr, index.find(kd::id{ "2" }));
+}
+
+TEST(peer_index_test, discards_already_inserted_peers)
+{
+    kd::peer_index index;
+    EXPECT_TRUE(index.insert(kd::id{ "1" }, location{ 2, 3 }));
+    EXPECT_FALSE(index.insert(kd::id{ "1" }, location{ 4, 5 }));
+    EXPECT_EQ(1, index.size());
+    EXPECT_EQ(2, index.find(kd::id{ "1" })->k_bucket_index_);
+}
+
+TEST(peer_index_test, can_erase_a_peer)
+{
+    kd::peer_index index;
+    EXPECT_TRUE(index.insert(kd::id{ "1" }, location{ 2, 3 }));
+    EXPECT_TRUE(index.erase(kd::id{ "1" }));
+    EXPECT_FALSE(index.erase(kd::id{ "1" }));
+    EXPECT_EQ(0, index.size());
+    EXPECT_EQ(nullptr, index.find(kd::id{ "1" }));
+}
+
+TEST(peer_index_test, keeps_peers_reachable_across_growth_and_erasure)
+{
+    std::default_random_engine random_engine;
+
+    std::vector< kd::id > ids;
+    kd::peer_index index;
+    for (std::uint32_t i = 0; i != 1000; ++ i)
+    {
+        ids.emplace_back(random_engine);
+        EXPECT_TRUE(index.insert(ids.back(), location{ i, i }));
+    }
+
+    // Erase one peer out of two.
+    for (std::size_t i = 0; i < ids.size(); i += 2)
+        EXPECT_TRUE(index.erase(ids[i]));
+    EXPECT_EQ(ids.size() / 2, index.size());
+
+    for (std::uint32_t i = 0; i != ids.size(); ++ i)
+    {
+        auto const found = index.find(ids[i]);
+        if (i % 2 == 0)
+            EXPECT_EQ(nullptr, found);
+        else
+        {
+            ASSERT_NE(nullptr, found);
+            EXPECT_EQ(i, found->position_);
+        }
+    }
+}
+
+}
+
@@ -0,0 +1,269 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "common.hpp"
+#include "kademlia/id.hpp"
+#include "kademlia/persistent_value_store.hpp"
+#include "gtest/gtest.h"
+
+#ifdef KADEMLIA_HAS_PERSISTENT_VALUE_STORE
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+namespace filesystem = boost::filesystem;
+
+using value_type = kd::persistent_value_store::value_type;
+
+/// A directory removed on destruction.
+struct temporary_directory final
+{
+    temporary_directory()
+        : path_{ filesystem::temp_directory_path()
+                 / filesystem::unique_path( "kademlia-%%%%-%%%%-%%%%" ) }
+    { }
+
+    ~temporary_directory()
+    { filesystem::remove_all(path_); }
+
+    std::string
+    operator/(std::string const& name) const
+    { return (path_ / name).string(); }
+
+    filesystem::path path_;
+};
+
+/// The first segment of a store.
+std::string const FIRST_SEGMENT = "00000001.log";
+
+value_type
+make_value(std::size_t i)
+{ return value_type(i + 1, std::uint8_t(i)); }
+
+kd::id
+make_key(std::size_t i)
+{ return kd::id{ std::to_string(i + 1) }; }
+
+/**
+ *  Crash injection: the store of directory is reopened
+ *  after each fault applied to a copy of its first segment.
+ */
+struct crash_harness final
+{
+    /// Saves values_count values, recording the segment size after each.
+    explicit
+    crash_harness(std::size_t values_count)
+        : directory_{}
+        , records_ends_{}
+    {
+        kd::persistent_value_store store{ directory_.path_.string() };
+        for (std::size_t i = 0; i != values_count; ++i)
+        {
+            store.assign(make_key(i), make_value(i));
+            records_ends_.push_back(filesystem::file_size(directory_ / FIRST_SEGMENT));
+        }
+    }
+
+    /// The count of values whose record ends before offset.
+    std::size_t
+    get_complete_records_count(std::size_t offset) const
+    {
+        std::size_t count = 0;
+        while (count != records_ends_.size() && records_ends_[count] <= offset)
+            ++count;
+        return count;
+    }
+
+    /// Copy the store, apply fault to the copy of its segment and reopen it.
+    template<typename Fault>
+    void
+    check_recovery(Fault fault, std::size_t expected_values_count) const
+    {
+        temporary_directory crashed;
+        filesystem::create_directory(crashed.path_);
+        filesystem::copy_file(directory_ / FIRST_SEGMENT, crashed / FIRST_SEGMENT);
+        fault(crashed / FIRST_SEGMENT);
+
+        {
+            kd::persistent_value_store store{ crashed.path_.string() };
+            ASSERT_EQ(expected_values_count, store.size());
+
+            value_type value;
+            for (std::size_t i = 0; i != records_ends_.size(); ++i)
+            {
+                ASSERT_EQ(i < expected_values_count, store.find(make_key(i), value));
+                if (i < expected_values_count)
+                {
+                    ASSERT_EQ(make_value(i), value);
+                }
+            }
+
+            // The torn tail is overwritten by the next records.
+            store.assign(make_key(records_ends_.size()), make_value(0));
+        }
+
+        kd::persistent_value_store store{ crashed.path_.string() };
+        EXPECT_EQ(expected_values_count + 1, store.size());
+    }
+
+    temporary_directory directory_;
+    std::vector<std::size_t> records_ends_;
+};
+
+TEST(persistent_value_store_test, values_survive_a_restart)
+{
+    temporary_directory directory;
+    {
+        kd::persistent_value_store store{ directory.path_.string() };
+        EXPECT_TRUE(store.assign(make_key(0), make_value(0)));
+        EXPECT_TRUE(store.assign(make_key(1), make_value(1)));
+        EXPECT_TRUE(store.assign(make_key(0), make_value(2)));
+        EXPECT_EQ(2, store.size());
+    }
+
+    kd::persistent_value_store store{ directory.path_.string() };
+    auto const s = store.get_statistics();
+    EXPECT_EQ(2, s.values_count_);
+    EXPECT_EQ(sizeof(kd::id) * 2 + make_value(2).size() + make_value(1).size()
+             , s.bytes_count_);
+
+    value_type value;
+    EXPECT_TRUE(store.find(make_key(0), value));
+    EXPECT_EQ(make_value(2), value);
+    EXPECT_TRUE(store.find(make_key(1), value));
+    EXPECT_EQ(make_value(1), value);
+    EXPECT_FALSE(store.find(make_key(2), value));
+}
+
+TEST(persistent_value_store_test, expired_values_are_not_restored)
+{
+    temporary_directory directory;
+    {
+        kd::persistent_value_store store{ directory.path_.string()
+                                        , 1024, std::chrono::seconds(0) };
+        EXPECT_TRUE(store.assign(make_key(0), make_value(0)));
+
+        value_type value;
+        EXPECT_FALSE(store.find(make_key(0), value));
+        EXPECT_EQ(1, store.get_statistics().expirations_count_);
+    }
+
+    kd::persistent_value_store store{ directory.path_.string() };
+    EXPECT_EQ(0, store.size());
+}
+
+TEST(persistent_value_store_test, the_oldest_segment_is_dropped_beyond_the_budget)
+{
+    temporary_directory directory;
+    auto const bytes_count = sizeof(kd::id) + make_value(9).size();
+
+    // 4 records per segment, the budget fits 6 values.
+    kd::persistent_value_store store{ directory.path_.string()
+                                    , 6 * bytes_count
+                                    , std::chrono::hours(1)
+                                    , 4 * (16 + bytes_count) };
+    for (std::size_t i = 0; i != 7; ++i)
+        EXPECT_TRUE(store.assign(make_key(i), value_type(10, 0)));
+
+    auto const s = store.get_statistics();
+    EXPECT_EQ(3, s.values_count_);
+    EXPECT_EQ(4, s.evictions_count_);
+    EXPECT_EQ(1, store.get_segments_count());
+
+    value_type value;
+    EXPECT_FALSE(store.find(make_key(3), value));
+    EXPECT_TRUE(store.find(make_key(4), value));
+
+    // A value larger than the budget is rejected.
+    EXPECT_FALSE(store.assign(make_key(4), value_type(6 * bytes_count)));
+    EXPECT_TRUE(store.find(make_key(4), value));
+}
+
+TEST(persistent_value_store_test, compaction_removes_overwritten_records)
+{
+    temporary_directory directory;
+    {
+        kd::persistent_value_store store{ directory.path_.string()
+                                        , 1024 * 1024
+                                        , std::chrono::hours(1)
+                                        , 1024 };
+        for (std::size_t round = 0; round != 10; ++round)
+            for (std::size_t i = 0; i != 10; ++i)
+                store.assign(make_key(i), make_value(i + round));
+
+        store.compact();
+        // The live records fit in 2 segments.
+        EXPECT_GE(3, store.get_segments_count());
+        EXPECT_EQ(10, store.size());
+    }
+
+    kd::persistent_value_store store{ directory.path_.string() };
+    EXPECT_EQ(10, store.size());
+
+    value_type value;
+    for (std::size_t i = 0; i != 10; ++i)
+    {
+        EXPECT_TRUE(store.find(make_key(i), value));
+        EXPECT_EQ(make_value(i + 9), value);
+    }
+}
+
+TEST(persistent_value_store_test, recovers_from_a_crash_at_any_offset)
+{
+    crash_harness const harness{ 8 };
+
+    for (std::size_t offset = 0; offset <= harness.records_ends_.back(); ++offset)
+        harness.check_recovery([ offset ](std::string const& segment)
+                               { filesystem::resize_file(segment, offset); }
+                              , harness.get_complete_records_count(offset));
+}
+
+TEST(persistent_value_store_test, a_corrupted_record_ends_its_segment)
+{
+    crash_harness const harness{ 8 };
+
+    for (std::size_t offset = 0; offset != harness.records_ends_.back(); ++offset)
+        harness.check_recovery([ offset ](std::string const& segment)
+                               {
+                                   std::fstream file{ segment, std::ios::in | std::ios::out | std::ios::binary };
+                                   file.seekg(offset);
+                                   auto const c = char(file.get() ^ 0x40);
+                                   file.seekp(offset);
+                                   file.put(c);
+                               }
+                              , harness.get_complete_records_count(offset));
+}
+
+} // anonymous namespace
+
+#endif
+
@@ -28,6 +28,8 @@
 #include "kademlia/error_impl.hpp"
 #include "kademlia/response_callbacks.hpp"
 #include "gtest/gtest.h"
+#include <memory>
+#include <stdexcept>
 #include <vector>
 
 
@@ -146,4 +148,135 @@ TEST_F(response_callbacks_test, multiple_callbacks_can_be_added)
     EXPECT_EQ(h2.random_token_, messages_received_.back());
 }
 
+TEST_F(response_callbacks_test, table_grows_beyond_its_initial_capacity)
+{
+    std::default_random_engine random_engine;
+    std::vector< kd::id > ids;
+
+    auto on_message_received = [ this ]
+            (kd::response_callbacks::endpoint_type const& s
+            , kd::header const& h
+            , kd::buffer::const_iterator
+            , kd::buffer::const_iterator)
+    { messages_received_.push_back(h.random_token_); };
+
+    auto const count = 4 * kd::response_callbacks::INITIAL_CAPACITY;
+    for (std::size_t i = 0; i != count; ++ i)
+    {
+        ids.push_back(kd::generate_token(random_engine));
+        callbacks_.push_callback(ids.back(), on_message_received);
+    }
+    EXPECT_EQ(count, callbacks_.size());
+
+    // Remove every other callback then dispatch the remaining ones.
+    for (std::size_t i = 0; i < count; i += 2)
+        EXPECT_TRUE(callbacks_.remove_callback(ids[i]));
+    EXPECT_EQ(count / 2, callbacks_.size());
+
+    kd::response_callbacks::endpoint_type const s{};
+    kd::buffer const b;
+    for (std::size_t i = 0; i != count; ++ i)
+    {
+        kd::header const h{ kd::header::V1, kd::header::PING_RESPONSE
+                          , kd::id{}, ids[i] };
+        auto result = callbacks_.dispatch_response(s, h, b.begin(), b.end());
+        EXPECT_EQ(i % 2 == 0, k::UNASSOCIATED_MESSAGE_ID == result);
+    }
+
+    EXPECT_EQ(0, callbacks_.size());
+    EXPECT_EQ(count / 2, messages_received_.size());
+}
+
+TEST_F(response_callbacks_test, colliding_ids_can_be_removed)
+{
+    // Ids differing only by their last bits share
+    // their home slot once folded.
+    kd::id const id1{ "1" }, id2{ "10000000000000001" }, id3{ "3" };
+
+    auto on_message_received = [ this ]
+            (kd::response_callbacks::endpoint_type const& s
+            , kd::header const& h
+            , kd::buffer::const_iterator
+            , kd::buffer::const_iterator)
+    { messages_received_.push_back(h.random_token_); };
+
+    callbacks_.push_callback(id1, on_message_received);
+    callbacks_.push_callback(id2, on_message_received);
+    callbacks_.push_callback(id3, on_message_received);
+
+    EXPECT_TRUE(callbacks_.remove_callback(id1));
+    EXPECT_FALSE(callbacks_.remove_callback(id1));
+
+    kd::response_callbacks::endpoint_type const s{};
+    kd::buffer const b;
+    kd::header const h2{ kd::header::V1, kd::header::PING_RESPONSE
+                       , kd::id{}, id2 };
+    EXPECT_TRUE(! callbacks_.dispatch_response(s, h2, b.begin(), b.end()));
+    kd::header const h3{ kd::header::V1, kd::header::PING_RESPONSE
+                       , kd::id{}, id3 };
+    EXPECT_TRUE(! callbacks_.dispatch_response(s, h3, b.begin(), b.end()));
+
+    EXPECT_EQ(2, messages_received_.size());
+}
+
+TEST_F(response_callbacks_test, callbacks_can_register_callbacks)
+{
+    std::default_random_engine random_engine;
+    kd::id const first_id = kd::generate_token(random_engine);
+
+    auto on_message_received = [ this ]
+            (kd::response_callbacks::endpoint_type const& s
+            , kd::header const& h
+            , kd::buffer::const_iterator
+            , kd::buffer::const_iterator)
+    { messages_received_.push_back(h.random_token_); };
+
+    // This callback forces the table to grow
+    // while it is being called.
+    auto on_first_message_received = [ & ]
+            (kd::response_callbacks::endpoint_type const& s
+            , kd::header const& h
+            , kd::buffer::const_iterator
+            , kd::buffer::const_iterator)
+    {
+        messages_received_.push_back(h.random_token_);
+        for (std::size_t i = 0; i != kd::response_callbacks::INITIAL_CAPACITY; ++ i)
+            callbacks_.push_callback(kd::generate_token(random_engine)
+                                    , on_message_received);
+    };
+    callbacks_.push_callback(first_id, on_first_message_received);
+
+    kd::response_callbacks::endpoint_type const s{};
+    kd::buffer const b;
+    kd::header const h{ kd::header::V1, kd::header::PING_RESPONSE
+                      , kd::id{}, first_id };
+    EXPECT_TRUE(! callbacks_.dispatch_response(s, h, b.begin(), b.end()));
+    EXPECT_EQ(1, messages_received_.size());
+    EXPECT_EQ(kd::response_callbacks::INITIAL_CAPACITY, callbacks_.size());
+}
+
+TEST_F(response_callbacks_test, throwing_callbacks_are_destroyed)
+{
+    std::default_random_engine random_engine;
+    kd::id const id = kd::generate_token(random_engine);
+
+    auto const resource = std::make_shared< int >(0);
+    callbacks_.push_callback(id, [ resource ]
+            (kd::response_callbacks::endpoint_type const&
+            , kd::header const&
+            , kd::buffer::const_iterator
+            , kd::buffer::const_iterator)
+    { throw std::runtime_error{ "response" }; });
+    EXPECT_EQ(2, resource.use_count());
+
+    kd::response_callbacks::endpoint_type const s{};
+    kd::buffer const b;
+    kd::header const h{ kd::header::V1, kd::header::PING_RESPONSE
+                      , kd::id{}, id };
+    EXPECT_THROW(callbacks_.dispatch_response(s, h, b.begin(), b.end())
+                , std::runtime_error);
+    EXPECT_EQ(0, callbacks_.size());
+    EXPECT_EQ(1, resource.use_count());
+}
+
 }
@@ -129,7 +129,8 @@ TEST_F(response_router_test, known_messages_are_not_forwarded_when_late)
                                        , on_message_received
                                        , on_error );
 
-    io_service_.poll();
+    // The timeout expires on the next tick.
+    io_service_.run_one();
     EXPECT_EQ(0ULL, messages_received_count_ );
     EXPECT_EQ(1ULL, error_count_ );
 
@@ -144,4 +145,40 @@ TEST_F(response_router_test, known_messages_are_not_forwarded_when_late)
     EXPECT_EQ(1ULL, error_count_ );
 }
 
+TEST_F(response_router_test, unregistered_messages_are_not_forwarded)
+{
+    // Create the callbacks.
+    auto on_message_received = [ this ]
+            ( kd::response_callbacks::endpoint_type const& s
+            , kd::header const& h
+            , kd::buffer::const_iterator
+            , kd::buffer::const_iterator )
+    { ++ messages_received_count_; };
+
+    auto on_error = [ this ]
+        ( std::error_code const& failure )
+    { ++ error_count_; };
+
+    kd::header const h1{ kd::header::V1, kd::header::PING_REQUEST
+                       , kd::id{}, kd::id{ "1" } };
+
+    auto const timeout = router_.register_temporary_callback( h1.random_token_
+                                                            , std::chrono::hours{ 0 }
+                                                            , on_message_received
+                                                            , on_error );
+
+    EXPECT_TRUE(router_.unregister_temporary_callback( h1.random_token_, timeout ));
+    EXPECT_FALSE(router_.unregister_temporary_callback( h1.random_token_, timeout ));
+
+    kd::response_callbacks::endpoint_type const s{};
+    kd::buffer const b;
+
+    // Neither the timeout nor the response are reported.
+    router_.handle_new_response( s, h1, b.begin(), b.end() );
+
+    io_service_.poll();
+    EXPECT_EQ(0ULL, messages_received_count_ );
+    EXPECT_EQ(0ULL, error_count_ );
+}
+
 }
@@ -0,0 +1,107 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "kademlia/ring_buffer.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+
+TEST(ring_buffer_test, values_are_popped_in_push_order)
+{
+    kd::ring_buffer< std::string > buffer{ 4 };
+    EXPECT_EQ(4, buffer.capacity());
+
+    EXPECT_TRUE(buffer.try_push("a"));
+    EXPECT_TRUE(buffer.try_push("b"));
+
+    std::string value;
+    EXPECT_TRUE(buffer.try_pop(value));
+    EXPECT_EQ("a", value);
+    EXPECT_TRUE(buffer.try_pop(value));
+    EXPECT_EQ("b", value);
+    EXPECT_FALSE(buffer.try_pop(value));
+}
+
+TEST(ring_buffer_test, full_buffer_rejects_values)
+{
+    kd::ring_buffer< int > buffer{ 2 };
+
+    EXPECT_TRUE(buffer.try_push(1));
+    EXPECT_TRUE(buffer.try_push(2));
+    EXPECT_FALSE(buffer.try_push(3));
+
+    // Cells are reused once popped.
+    int value = 0;
+    EXPECT_TRUE(buffer.try_pop(value));
+    EXPECT_EQ(1, value);
+    EXPECT_TRUE(buffer.try_push(3));
+    EXPECT_TRUE(buffer.try_pop(value));
+    EXPECT_EQ(2, value);
+    EXPECT_TRUE(buffer.try_pop(value));
+    EXPECT_EQ(3, value);
+}
+
+TEST(ring_buffer_test, can_be_shared_by_several_producers)
+{
+    kd::ring_buffer< int > buffer{ 64 };
+    auto const PRODUCERS_COUNT = 4, VALUES_COUNT = 1000;
+
+    std::vector< std::thread > producers;
+    for (auto p = 0; p != PRODUCERS_COUNT; ++ p)
+        producers.emplace_back([ &buffer, p, VALUES_COUNT ]
+        {
+            for (auto i = 0; i != VALUES_COUNT; ++ i)
+                while (! buffer.try_push(p * VALUES_COUNT + i))
+                    std::this_thread::yield();
+        });
+
+    // Each producer values must be received in order.
+    std::vector< int > next(PRODUCERS_COUNT);
+    for (auto count = 0; count != PRODUCERS_COUNT * VALUES_COUNT; )
+    {
+        int value;
+        if (! buffer.try_pop(value))
+            continue;
+
+        auto const producer = value / VALUES_COUNT;
+        EXPECT_EQ(next[producer], value % VALUES_COUNT);
+        next[producer] = value % VALUES_COUNT + 1;
+        ++ count;
+    }
+
+    for (auto & p : producers)
+        p.join();
+}
+
+}
+
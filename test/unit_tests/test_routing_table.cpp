@@ -23,6 +23,11 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
 #include "common.hpp"
 #include "peer_factory.hpp"
 #include "kademlia/routing_table.hpp"
@@ -52,35 +57,55 @@ TEST(routing_table_test, is_empty_on_construction)
  *  Test test_routing_table::push()
  */
 
-TEST(routing_table_test, largest_k_bucket_can_receive_unlimited_peers)
+TEST(routing_table_test, k_bucket_covering_own_id_is_split)
 {
-    // My id is 128 bit assigned to 0.
+    // My id is 160 bit assigned to 0.
     kd::id const my_id;
-    // Each bucket can contain up to 4 peers.
+    // Each bucket can contain up to 2 peers.
     std::size_t const bucket_size = 2;
 
     test_routing_table rt{ my_id, bucket_size };
+    EXPECT_EQ(1, rt.k_bucket_count());
 
     // This peer will be associated with every id.
     // Unicity applies only to id, not peer.
     auto const test_peer(create_endpoint());
 
-    // Theses should go into high bucket.
+    // Theses fill the unique bucket.
     EXPECT_TRUE(rt.push(kd::id{ "10" }, test_peer));
     EXPECT_TRUE(rt.push(kd::id{ "11" }, test_peer));
+    EXPECT_EQ(1, rt.k_bucket_count());
 
-    // While theses go to a lower bucket.
+    // As the full bucket covers my id, it is split.
     EXPECT_TRUE(rt.push(kd::id{ "20" }, test_peer));
     EXPECT_TRUE(rt.push(kd::id{ "21" }, test_peer));
-    // This one should flag the lower bucket as the largest.
-    EXPECT_TRUE(rt.push(kd::id{ "22" }, test_peer));
-    // This one can be saved as the largest bucket
-    // is allowed to exceed bucket_size.
-    EXPECT_TRUE(rt.push(kd::id{ "23" }, test_peer));
+    EXPECT_LT(1, rt.k_bucket_count());
+
+    // This one can't go into the "2x" bucket as it is full
+    // and is farther from my id than the 2 closest peers.
+    auto const k_bucket_count = rt.k_bucket_count();
+    EXPECT_FALSE(rt.push(kd::id{ "22" }, test_peer));
+    EXPECT_EQ(k_bucket_count, rt.k_bucket_count());
+    EXPECT_EQ(4, rt.peer_count());
+}
+
+TEST(routing_table_test, k_bucket_holding_closest_peers_is_split)
+{
+    test_routing_table rt{ kd::id{}, 2 };
+    auto const test_peer(create_endpoint());
+
+    EXPECT_TRUE(rt.push(kd::id{ "10" }, test_peer));
+    EXPECT_TRUE(rt.push(kd::id{ "30" }, test_peer));
+    EXPECT_TRUE(rt.push(kd::id{ "38" }, test_peer));
 
-    // This one can't go into first bucket as it is full
-    // and is not the largest bucket.
-    EXPECT_TRUE(! rt.push(kd::id{ "12" }, test_peer));
+    // The "3x" bucket doesn't cover my id but "20"
+    // would be one of the 2 closest peers.
+    EXPECT_TRUE(rt.push(kd::id{ "20" }, test_peer));
+    EXPECT_EQ(4, rt.peer_count());
+
+    // While "31" wouldn't.
+    EXPECT_FALSE(rt.push(kd::id{ "31" }, test_peer));
+    EXPECT_EQ(4, rt.peer_count());
 }
 
 TEST(routing_table_test, discards_already_pushed_ids)
@@ -98,6 +123,20 @@ TEST(routing_table_test, discards_already_pushed_ids)
     EXPECT_EQ(rt.peer_count(), 1);
 }
 
+TEST(routing_table_test, pushing_a_known_peer_updates_its_endpoint)
+{
+    test_routing_table rt{ kd::id{} };
+    kd::id const test_id{ "1" };
+
+    EXPECT_TRUE(rt.push(test_id, create_endpoint("192.168.0.1")));
+    EXPECT_FALSE(rt.push(test_id, create_endpoint("192.168.0.2")));
+    EXPECT_EQ(rt.peer_count(), 1);
+
+    auto const& closest = rt.closest(test_id, 1);
+    ASSERT_EQ(1, closest.size());
+    EXPECT_EQ(create_endpoint("192.168.0.2"), closest[0].second);
+}
+
 
 /**
  *  Test test_routing_table::find()
@@ -205,6 +244,94 @@ TEST(routing_table_test, iterator_skip_empty_k_bucket)
     EXPECT_TRUE(i == rt.end());
 }
 
+/**
+ *  Test test_routing_table::closest()
+ */
+
+TEST(routing_table_test, closest_is_empty_on_empty_routing_table)
+{
+    test_routing_table rt{ kd::id{} };
+    EXPECT_TRUE(rt.closest(kd::id{ "1" }, 20).empty());
+}
+
+TEST(routing_table_test, closest_returns_peers_ordered_by_distance)
+{
+    std::default_random_engine random_engine;
+
+    test_routing_table rt{ kd::id(random_engine) };
+    std::vector< kd::id > pushed_ids;
+    for (auto i = 0; i < 1000; ++ i)
+    {
+        kd::id const new_id(random_engine);
+        if (rt.push(new_id, create_endpoint()))
+            pushed_ids.push_back(new_id);
+    }
+
+    for (auto i = 0; i < 100; ++ i)
+    {
+        kd::id const target(random_engine);
+
+        auto is_closer = [ &target ] (kd::id const& a, kd::id const& b)
+        { return kd::distance(a, target) < kd::distance(b, target); };
+        std::sort(pushed_ids.begin(), pushed_ids.end(), is_closer);
+
+        auto const& closest = rt.closest(target, 20);
+        ASSERT_EQ(20, closest.size());
+        for (std::size_t j = 0; j != closest.size(); ++ j)
+            EXPECT_EQ(pushed_ids[j], closest[j].first);
+    }
+}
+
+TEST(routing_table_test, closest_returns_at_most_max_count_peers)
+{
+    test_routing_table rt{ kd::id{} };
+    EXPECT_TRUE(rt.push(kd::id{ "1" }, create_endpoint()));
+    EXPECT_TRUE(rt.push(kd::id{ "2" }, create_endpoint()));
+    EXPECT_TRUE(rt.push(kd::id{ "4" }, create_endpoint()));
+
+    auto const& closest = rt.closest(kd::id{ "6" }, 2);
+    ASSERT_EQ(2, closest.size());
+    EXPECT_EQ(kd::id{ "4" }, closest[0].first);
+    EXPECT_EQ(kd::id{ "2" }, closest[1].first);
+
+    EXPECT_EQ(3, rt.closest(kd::id{ "6" }, 20).size());
+    EXPECT_TRUE(rt.closest(kd::id{ "6" }, 0).empty());
+}
+
+TEST(routing_table_test, copy_closest_matches_closest)
+{
+    test_routing_table rt{ kd::id{} };
+    EXPECT_TRUE(rt.push(kd::id{ "1" }, create_endpoint()));
+    EXPECT_TRUE(rt.push(kd::id{ "2" }, create_endpoint()));
+    EXPECT_TRUE(rt.push(kd::id{ "4" }, create_endpoint()));
+
+    auto const& closest = rt.closest(kd::id{ "6" }, 2);
+
+    // The result of closest() is left untouched.
+    test_routing_table::closest_peers_type peers{ closest[0] };
+    rt.copy_closest(kd::id{ "1" }, 20, peers);
+    ASSERT_EQ(3, peers.size());
+    EXPECT_EQ(kd::id{ "1" }, peers[0].first);
+
+    rt.copy_closest(kd::id{ "6" }, 2, peers);
+    EXPECT_EQ(closest, peers);
+}
+
+TEST(routing_table_test, closest_skips_empty_and_removed_k_buckets)
+{
+    test_routing_table rt{ kd::id{}, 1 };
+    EXPECT_TRUE(rt.push(kd::id{ "1" }, create_endpoint("192.168.0.1")));
+    EXPECT_TRUE(rt.push(kd::id{ "2" }, create_endpoint("192.168.0.2")));
+    EXPECT_TRUE(rt.push(kd::id{ "4" }, create_endpoint("192.168.0.3")));
+    EXPECT_TRUE(rt.remove(kd::id{ "2" }));
+
+    auto const& closest = rt.closest(kd::id{ "2" }, 20);
+    ASSERT_EQ(2, closest.size());
+    EXPECT_EQ(kd::id{ "1" }, closest[0].first);
+    EXPECT_EQ(create_endpoint("192.168.0.1"), closest[0].second);
+    EXPECT_EQ(kd::id{ "4" }, closest[1].first);
+}
+
 
 /**
  *  Test test_routing_table::remove()
@@ -225,6 +352,197 @@ TEST(routing_table_test, can_remove_a_peer)
     EXPECT_TRUE(rt.find(test_id) == rt.end());
 }
 
+TEST(routing_table_test, can_push_a_removed_peer_again)
+{
+    test_routing_table rt{ kd::id{}, 2 };
+    auto test_peer(create_endpoint());
+    kd::id const test_id1{ "2" };
+    kd::id const test_id2{ "3" };
+    EXPECT_TRUE(rt.push(test_id1, test_peer));
+    EXPECT_TRUE(rt.push(test_id2, test_peer));
+
+    // Remove the first peer of the bucket.
+    EXPECT_TRUE(rt.remove(test_id1));
+    EXPECT_FALSE(rt.remove(test_id1));
+    EXPECT_EQ(rt.peer_count(), 1);
+
+    // The remaining one is still reachable.
+    auto i = rt.find(test_id2);
+    EXPECT_TRUE(i != rt.end());
+    EXPECT_EQ(test_id2, i->first);
+
+    // And the slot can be reused.
+    EXPECT_TRUE(rt.push(test_id1, test_peer));
+    EXPECT_EQ(rt.peer_count(), 2);
+}
+
+/**
+ *  Test test_routing_table::flag_peer_as_unresponsive()
+ */
+
+/**
+ *  Fill the "2x" bucket which can't be split.
+ */
+void
+fill_first_bucket
+    ( test_routing_table & rt )
+{
+    auto const test_peer(create_endpoint());
+
+    // These are the closest peers from my id.
+    EXPECT_TRUE(rt.push(kd::id{ "10" }, test_peer));
+    EXPECT_TRUE(rt.push(kd::id{ "11" }, test_peer));
+
+    EXPECT_TRUE(rt.push(kd::id{ "20" }, test_peer));
+    EXPECT_TRUE(rt.push(kd::id{ "21" }, test_peer));
+}
+
+bool
+contains
+    ( test_routing_table & rt
+    , kd::id const& peer_id )
+{
+    auto const& closest = rt.closest(peer_id, 1);
+    return ! closest.empty() && closest.front().first == peer_id;
+}
+
+TEST(routing_table_test, unresponsive_peer_is_replaced_by_cached_peer)
+{
+    test_routing_table rt{ kd::id{}, 2 };
+    fill_first_bucket(rt);
+
+    // The bucket is full, this one is cached.
+    EXPECT_FALSE(rt.push(kd::id{ "22" }, create_endpoint()));
+    EXPECT_FALSE(contains(rt, kd::id{ "22" }));
+
+    EXPECT_TRUE(rt.flag_peer_as_unresponsive(kd::id{ "20" }));
+    EXPECT_FALSE(contains(rt, kd::id{ "20" }));
+    EXPECT_TRUE(contains(rt, kd::id{ "22" }));
+    EXPECT_EQ(4, rt.peer_count());
+
+    // The cache is now empty.
+    EXPECT_FALSE(rt.flag_peer_as_unresponsive(kd::id{ "21" }));
+    EXPECT_TRUE(contains(rt, kd::id{ "21" }));
+}
+
+TEST(routing_table_test, stale_peer_is_replaced_by_new_peer)
+{
+    test_routing_table rt{ kd::id{}, 2 };
+    fill_first_bucket(rt);
+
+    // No replacement is available, the peer is kept.
+    EXPECT_FALSE(rt.flag_peer_as_unresponsive(kd::id{ "21" }));
+    EXPECT_TRUE(contains(rt, kd::id{ "21" }));
+
+    // But it is replaced as soon as a new peer shows up.
+    EXPECT_TRUE(rt.push(kd::id{ "22" }, create_endpoint()));
+    EXPECT_FALSE(contains(rt, kd::id{ "21" }));
+    EXPECT_TRUE(contains(rt, kd::id{ "20" }));
+    EXPECT_TRUE(contains(rt, kd::id{ "22" }));
+    EXPECT_EQ(4, rt.peer_count());
+}
+
+TEST(routing_table_test, unresponsive_peer_is_evicted_after_max_failures)
+{
+    test_routing_table rt{ kd::id{} };
+    kd::id const test_id{ "1" };
+    EXPECT_TRUE(rt.push(test_id, create_endpoint()));
+
+    for (auto i = 1; i != test_routing_table::MAX_PEER_FAILURES_COUNT; ++ i)
+        EXPECT_FALSE(rt.flag_peer_as_unresponsive(test_id));
+
+    EXPECT_TRUE(rt.flag_peer_as_unresponsive(test_id));
+    EXPECT_EQ(0, rt.peer_count());
+    EXPECT_FALSE(rt.flag_peer_as_unresponsive(test_id));
+}
+
+TEST(routing_table_test, seen_peer_failures_are_forgotten)
+{
+    test_routing_table rt{ kd::id{} };
+    kd::id const test_id{ "1" };
+    EXPECT_TRUE(rt.push(test_id, create_endpoint()));
+
+    for (auto i = 1; i != test_routing_table::MAX_PEER_FAILURES_COUNT; ++ i)
+        EXPECT_FALSE(rt.flag_peer_as_unresponsive(test_id));
+
+    // The peer sent a message.
+    EXPECT_FALSE(rt.push(test_id, create_endpoint()));
+
+    EXPECT_FALSE(rt.flag_peer_as_unresponsive(test_id));
+    EXPECT_EQ(1, rt.peer_count());
+}
+
+TEST(routing_table_test, round_trip_time_is_smoothed)
+{
+    using duration = test_routing_table::duration;
+    using std::chrono::milliseconds;
+
+    test_routing_table rt{ kd::id{} };
+    kd::id const test_id{ "1" };
+
+    // Unknown peers have no round trip time.
+    EXPECT_FALSE(rt.record_round_trip_time(test_id, milliseconds{ 80 }));
+    EXPECT_EQ(duration::zero(), rt.get_round_trip_time(test_id));
+
+    EXPECT_TRUE(rt.push(test_id, create_endpoint()));
+    EXPECT_EQ(duration::zero(), rt.get_round_trip_time(test_id));
+
+    // The first sample is used as is.
+    EXPECT_TRUE(rt.record_round_trip_time(test_id, milliseconds{ 80 }));
+    EXPECT_EQ(milliseconds{ 80 }, rt.get_round_trip_time(test_id));
+
+    // Then each sample weights 1/8.
+    EXPECT_TRUE(rt.record_round_trip_time(test_id, milliseconds{ 160 }));
+    EXPECT_EQ(milliseconds{ 90 }, rt.get_round_trip_time(test_id));
+}
+
+TEST(routing_table_test, responses_reset_failures_count)
+{
+    test_routing_table rt{ kd::id{} };
+    kd::id const test_id{ "1" };
+    EXPECT_TRUE(rt.push(test_id, create_endpoint()));
+    EXPECT_EQ(0, rt.get_failures_count(test_id));
+
+    EXPECT_FALSE(rt.flag_peer_as_unresponsive(test_id));
+    EXPECT_FALSE(rt.flag_peer_as_unresponsive(test_id));
+    EXPECT_EQ(2, rt.get_failures_count(test_id));
+
+    EXPECT_TRUE(rt.record_round_trip_time(test_id, std::chrono::milliseconds{ 10 }));
+    EXPECT_EQ(0, rt.get_failures_count(test_id));
+}
+
+TEST(routing_table_test, request_timeout_follows_round_trip_time)
+{
+    using std::chrono::milliseconds;
+
+    test_routing_table rt{ kd::id{} };
+    kd::id const test_id{ "1" };
+
+    // Unknown peers use the default timeout.
+    EXPECT_EQ(kd::PEER_LOOKUP_TIMEOUT, rt.get_request_timeout(test_id));
+    EXPECT_TRUE(rt.push(test_id, create_endpoint()));
+    EXPECT_EQ(kd::PEER_LOOKUP_TIMEOUT, rt.get_request_timeout(test_id));
+
+    // Timeout doubles on each failure.
+    EXPECT_FALSE(rt.flag_peer_as_unresponsive(test_id));
+    EXPECT_EQ(2 * kd::PEER_LOOKUP_TIMEOUT, rt.get_request_timeout(test_id));
+
+    // First sample: 10ms + 4 * 10ms / 2.
+    EXPECT_TRUE(rt.record_round_trip_time(test_id, milliseconds{ 10 }));
+    EXPECT_EQ(milliseconds{ 30 }, rt.get_request_timeout(test_id));
+
+    // As the variation vanishes, the timeout reaches its lower bound.
+    for (auto i = 0; i != 20; ++ i)
+        EXPECT_TRUE(rt.record_round_trip_time(test_id, milliseconds{ 10 }));
+    EXPECT_EQ(kd::MIN_PEER_LOOKUP_TIMEOUT, rt.get_request_timeout(test_id));
+
+    // And slow peers reach the upper bound.
+    kd::id const slow_id{ "2" };
+    EXPECT_TRUE(rt.push(slow_id, create_endpoint()));
+    EXPECT_TRUE(rt.record_round_trip_time(slow_id, milliseconds{ 1000 }));
+    EXPECT_EQ(kd::MAX_PEER_LOOKUP_TIMEOUT, rt.get_request_timeout(slow_id));
+}
+
 /**
  *  Test operator<<()
  */
@@ -26,6 +26,7 @@
 
 #include "kademlia/error.hpp"
 #include "kademlia/session.hpp"
+#include "kademlia/session_impl.hpp"
 #include "common.hpp"
 #include "network.hpp"
 #include "gtest/gtest.h"
@@ -108,5 +109,24 @@ TEST(SessionTest, first_session_run_can_be_aborted)
     EXPECT_TRUE(result.get() == k::RUN_ABORTED);
 }
 
+TEST(SessionTest, multithreaded_session_run_can_be_aborted)
+{
+    std::uint16_t const port1 = k::test::get_temporary_listening_port();
+    std::uint16_t const port2 = k::test::get_temporary_listening_port(port1);
+    k::detail::session_impl s{ k::endpoint{ "127.0.0.1", port1 }
+                             , k::endpoint{ "::1", port2 }
+                             , 1, 4 };
+
+    // Each run's threads must all notice the abort.
+    for (auto i = 0; i != 20; ++ i)
+    {
+        auto result = std::async(std::launch::async
+                                , &k::detail::session_impl::run, &s);
+        s.abort();
+
+        EXPECT_TRUE(result.get() == k::RUN_ABORTED);
+    }
+}
+
 
 }
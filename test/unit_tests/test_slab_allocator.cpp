@@ -0,0 +1,111 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <cstring>
+#include <vector>
+
+#include "common.hpp"
+#include "kademlia/slab_allocator.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+
+TEST(slab_allocator_test, blobs_of_any_size_can_be_stored)
+{
+    kd::slab_allocator allocator;
+    EXPECT_EQ(0, allocator.get_reserved_bytes_count());
+
+    std::vector< std::size_t > const sizes{ 0, 1, 16, 17, 256, 257, 1000
+                                          , kd::slab_allocator::MAX_SLOT_SIZE
+                                          , kd::slab_allocator::MAX_SLOT_SIZE + 1 };
+
+    std::vector< kd::slab_allocator::handle > handles;
+    for (std::size_t i = 0; i != sizes.size(); ++ i)
+    {
+        handles.push_back(allocator.allocate(sizes[ i ]));
+        std::memset(allocator.get(handles.back()), int(i), sizes[ i ]);
+    }
+
+    for (std::size_t i = 0; i != sizes.size(); ++ i)
+    {
+        auto const data = allocator.get(handles[ i ]);
+        for (std::size_t j = 0; j != sizes[ i ]; ++ j)
+            ASSERT_EQ(i, data[ j ]);
+    }
+
+    EXPECT_LE(kd::slab_allocator::MAX_SLOT_SIZE * 2 + 1
+             , allocator.get_reserved_bytes_count());
+}
+
+TEST(slab_allocator_test, released_blobs_are_reused)
+{
+    kd::slab_allocator allocator;
+
+    auto const small = allocator.allocate(10);
+    auto const large = allocator.allocate(kd::slab_allocator::MAX_SLOT_SIZE + 1);
+    auto const reserved_bytes_count = allocator.get_reserved_bytes_count();
+
+    allocator.release(small);
+    // Sizes of the same class share the slots.
+    EXPECT_EQ(small, allocator.allocate(16));
+
+    allocator.release(large);
+    EXPECT_GT(reserved_bytes_count, allocator.get_reserved_bytes_count());
+    EXPECT_EQ(large, allocator.allocate(kd::slab_allocator::MAX_SLOT_SIZE + 2));
+}
+
+TEST(slab_allocator_test, slabs_grow_with_the_blobs_count)
+{
+    kd::slab_allocator allocator;
+
+    // The first slab is small.
+    allocator.allocate(16);
+    EXPECT_EQ(kd::slab_allocator::FIRST_SLAB_SIZE
+             , allocator.get_reserved_bytes_count());
+
+    std::vector< kd::slab_allocator::handle > handles;
+    auto const COUNT = 100000U;
+    for (std::uint32_t i = 0; i != COUNT; ++ i)
+    {
+        handles.push_back(allocator.allocate(sizeof(i)));
+        std::memcpy(allocator.get(handles.back()), &i, sizeof(i));
+    }
+
+    for (std::uint32_t i = 0; i != COUNT; ++ i)
+    {
+        std::uint32_t value;
+        std::memcpy(&value, allocator.get(handles[ i ]), sizeof(value));
+        ASSERT_EQ(i, value);
+    }
+
+    // Slabs stop doubling at SLAB_SIZE.
+    EXPECT_GE((COUNT + 1) * 16 + kd::slab_allocator::SLAB_SIZE
+             , allocator.get_reserved_bytes_count());
+}
+
+}
+
@@ -32,6 +32,7 @@
 #include "kademlia/ip_endpoint.hpp"
 #include "kademlia/store_value_task.hpp"
 #include "gtest/gtest.h"
+#include <chrono>
 #include <vector>
 
 
@@ -105,6 +106,10 @@ TEST_F(store_value_task_test, can_notify_error_when_unique_peer_fails_to_respond
     // Task didn't send any more message.
     EXPECT_TRUE(! tracker_.has_sent_message());
 
+    // Task reported p1 as unresponsive.
+    ASSERT_EQ(1, routing_table_.unresponsive_ids_.size());
+    EXPECT_EQ(p1.id_, routing_table_.unresponsive_ids_.front());
+
     // Task notified the error.
     EXPECT_EQ(1, callback_call_count_);
     EXPECT_TRUE(failure_ == k::INITIAL_PEER_FAILED_TO_RESPOND);
@@ -137,6 +142,9 @@ TEST_F(store_value_task_test, can_notify_error_when_all_peers_fail_to_respond)
     // Task didn't send any more message.
     EXPECT_TRUE(! tracker_.has_sent_message());
 
+    // Task reported p1 & p2 as unresponsive.
+    EXPECT_EQ(2, routing_table_.unresponsive_ids_.size());
+
     // Task notified the error.
     EXPECT_EQ(1, callback_call_count_);
     EXPECT_TRUE(failure_ == k::INITIAL_PEER_FAILED_TO_RESPOND);
@@ -285,4 +293,43 @@ TEST_F(store_value_task_test, can_skip_corrupted_response)
 }
 
 
+TEST_F(store_value_task_test, can_query_low_latency_peers_first)
+{
+    kd::id const chosen_key{};
+    kd::buffer const data{ 1, 2, 3, 4 };
+    routing_table_.expected_ids_.emplace_back(chosen_key);
+
+    // All peers are as close to the key.
+    auto p1 = create_and_add_peer("192.168.1.1", kd::id{ "4" });
+    auto p2 = create_and_add_peer("192.168.1.2", kd::id{ "5" });
+    auto p3 = create_and_add_peer("192.168.1.3", kd::id{ "6" });
+    auto p4 = create_and_add_peer("192.168.1.4", kd::id{ "7" });
+    routing_table_.round_trip_times_[ p2.id_ ] = std::chrono::milliseconds{ 30 };
+    routing_table_.round_trip_times_[ p3.id_ ] = std::chrono::milliseconds{ 20 };
+    routing_table_.round_trip_times_[ p4.id_ ] = std::chrono::milliseconds{ 10 };
+
+    kd::start_store_value_task< data_type >(chosen_key
+                                           , data
+                                           , tracker_
+                                           , routing_table_
+                                           , std::ref(*this)
+                                           , true);
+    io_service_.poll();
+
+    // Task asked the fastest peers first and p1,
+    // whose latency is unknown, once p4 failed.
+    kd::find_peer_request_body const fv{ chosen_key };
+    EXPECT_TRUE(tracker_.has_sent_message(p4.endpoint_, fv));
+    EXPECT_TRUE(tracker_.has_sent_message(p3.endpoint_, fv));
+    EXPECT_TRUE(tracker_.has_sent_message(p2.endpoint_, fv));
+    EXPECT_TRUE(tracker_.has_sent_message(p1.endpoint_, fv));
+
+    // Task didn't send any more message.
+    EXPECT_TRUE(! tracker_.has_sent_message());
+
+    // Task notified the error.
+    EXPECT_EQ(1, callback_call_count_);
+    EXPECT_TRUE(failure_ == k::INITIAL_PEER_FAILED_TO_RESPOND);
+}
+
 }
@@ -0,0 +1,135 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "kademlia/submission_queue.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+
+TEST(submission_queue_test, values_are_drained_in_push_order)
+{
+    kd::submission_queue< std::string > queue;
+
+    queue.push("a");
+    queue.push("b");
+
+    std::vector< std::string > values;
+    auto consume = [ &values ](std::string & v) { values.push_back(v); };
+    EXPECT_TRUE(queue.drain(consume, 16));
+    EXPECT_EQ((std::vector< std::string >{ "a", "b" }), values);
+
+    EXPECT_TRUE(queue.drain(consume, 16));
+    EXPECT_EQ(2, values.size());
+}
+
+TEST(submission_queue_test, consumer_is_woken_up_once_per_drain)
+{
+    kd::submission_queue< int > queue;
+
+    EXPECT_TRUE(queue.push(1));
+    EXPECT_FALSE(queue.push(2));
+
+    auto consume = [](int &) { };
+    EXPECT_TRUE(queue.drain(consume, 16));
+
+    EXPECT_TRUE(queue.push(3));
+}
+
+TEST(submission_queue_test, drain_is_bounded)
+{
+    kd::submission_queue< int > queue;
+    for (auto i = 0; i != 5; ++ i)
+        queue.push(i);
+
+    std::vector< int > values;
+    auto consume = [ &values ](int & v) { values.push_back(v); };
+    EXPECT_FALSE(queue.drain(consume, 2));
+    EXPECT_EQ(2, values.size());
+
+    // The consumer drains again by itself.
+    EXPECT_FALSE(queue.push(5));
+    EXPECT_FALSE(queue.drain(consume, 2));
+    EXPECT_TRUE(queue.drain(consume, 2));
+    EXPECT_EQ((std::vector< int >{ 0, 1, 2, 3, 4, 5 }), values);
+}
+
+TEST(submission_queue_test, undrained_values_are_destroyed)
+{
+    auto const value = std::make_shared< int >(1);
+    {
+        kd::submission_queue< std::shared_ptr< int > > queue;
+        queue.push(value);
+        queue.push(value);
+
+        auto consume = [](std::shared_ptr< int > &) { };
+        queue.drain(consume, 1);
+        EXPECT_EQ(2, value.use_count());
+    }
+
+    EXPECT_EQ(1, value.use_count());
+}
+
+TEST(submission_queue_test, can_be_filled_by_several_producers)
+{
+    kd::submission_queue< int > queue;
+    auto const PRODUCERS_COUNT = 4, VALUES_COUNT = 1000;
+
+    std::vector< std::thread > producers;
+    for (auto p = 0; p != PRODUCERS_COUNT; ++ p)
+        producers.emplace_back([ &queue, p, VALUES_COUNT ]
+        {
+            for (auto i = 0; i != VALUES_COUNT; ++ i)
+                queue.push(p * VALUES_COUNT + i);
+        });
+
+    // Each producer values must be received in order.
+    std::vector< int > next(PRODUCERS_COUNT);
+    auto count = 0;
+    auto consume = [ & ](int & value)
+    {
+        auto const producer = value / VALUES_COUNT;
+        EXPECT_EQ(next[producer], value % VALUES_COUNT);
+        next[producer] = value % VALUES_COUNT + 1;
+        ++ count;
+    };
+
+    while (count != PRODUCERS_COUNT * VALUES_COUNT)
+        queue.drain(consume, 64);
+
+    for (auto & p : producers)
+        p.join();
+}
+
+}
+
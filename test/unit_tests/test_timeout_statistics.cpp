@@ -0,0 +1,125 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <chrono>
+
+#include "common.hpp"
+#include "kademlia/timeout_statistics.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+
+using std::chrono::milliseconds;
+using std::chrono::microseconds;
+
+TEST(timeout_statistics_test, is_empty_on_construction)
+{
+    kd::timeout_statistics const s;
+    EXPECT_EQ(0, s.get_count());
+    EXPECT_EQ(kd::timeout_statistics::duration::zero(), s.get_min());
+    EXPECT_EQ(kd::timeout_statistics::duration::zero(), s.get_max());
+    EXPECT_EQ(kd::timeout_statistics::duration::zero(), s.get_mean());
+
+    for (std::size_t i = 0; i != kd::timeout_statistics::BUCKETS_COUNT; ++ i)
+        EXPECT_EQ(0, s.get_bucket_count(i));
+}
+
+TEST(timeout_statistics_test, can_record_timeouts)
+{
+    kd::timeout_statistics s;
+    s.record(milliseconds{ 20 });
+    s.record(milliseconds{ 200 });
+    s.record(milliseconds{ 80 });
+
+    EXPECT_EQ(3, s.get_count());
+    EXPECT_EQ(milliseconds{ 20 }, s.get_min());
+    EXPECT_EQ(milliseconds{ 200 }, s.get_max());
+    EXPECT_EQ(milliseconds{ 100 }, s.get_mean());
+}
+
+TEST(timeout_statistics_test, timeouts_are_counted_by_power_of_2_ms)
+{
+    kd::timeout_statistics s;
+    s.record(microseconds{ 500 });
+    s.record(milliseconds{ 1 });
+    s.record(milliseconds{ 3 });
+    s.record(milliseconds{ 4 });
+    s.record(milliseconds{ 200 });
+    s.record(std::chrono::hours{ 1 });
+
+    EXPECT_EQ(milliseconds{ 0 }, kd::timeout_statistics::get_bucket_lower_bound(0));
+    EXPECT_EQ(milliseconds{ 1 }, kd::timeout_statistics::get_bucket_lower_bound(1));
+    EXPECT_EQ(milliseconds{ 128 }, kd::timeout_statistics::get_bucket_lower_bound(8));
+
+    EXPECT_EQ(1, s.get_bucket_count(0));
+    EXPECT_EQ(1, s.get_bucket_count(1));
+    EXPECT_EQ(1, s.get_bucket_count(2));
+    EXPECT_EQ(1, s.get_bucket_count(3));
+    EXPECT_EQ(1, s.get_bucket_count(8));
+    EXPECT_EQ(1, s.get_bucket_count(kd::timeout_statistics::BUCKETS_COUNT - 1));
+}
+
+TEST(timeout_statistics_test, can_be_copied_into_session_statistics)
+{
+    kd::timeout_statistics s;
+    s.record(milliseconds{ 20 });
+    s.record(milliseconds{ 40 });
+
+    auto const c = s.get_statistics();
+    EXPECT_EQ(2, c.requests_count_);
+    EXPECT_EQ(milliseconds{ 20 }, c.min_timeout_);
+    EXPECT_EQ(milliseconds{ 40 }, c.max_timeout_);
+    EXPECT_EQ(milliseconds{ 30 }, c.mean_timeout_);
+    EXPECT_EQ(1, c.timeouts_counts_[ 5 ]);
+    EXPECT_EQ(1, c.timeouts_counts_[ 6 ]);
+}
+
+TEST(timeout_statistics_test, can_merge_session_statistics)
+{
+    kd::timeout_statistics s1;
+    s1.record(milliseconds{ 20 });
+    kd::timeout_statistics s2;
+    s2.record(milliseconds{ 40 });
+    s2.record(milliseconds{ 60 });
+    kd::timeout_statistics const s3;
+
+    kd::timeout_statistics::statistics total{};
+    kd::timeout_statistics::merge(total, s1.get_statistics());
+    kd::timeout_statistics::merge(total, s2.get_statistics());
+    kd::timeout_statistics::merge(total, s3.get_statistics());
+
+    EXPECT_EQ(3, total.requests_count_);
+    EXPECT_EQ(milliseconds{ 20 }, total.min_timeout_);
+    EXPECT_EQ(milliseconds{ 60 }, total.max_timeout_);
+    EXPECT_EQ(milliseconds{ 40 }, total.mean_timeout_);
+    EXPECT_EQ(1, total.timeouts_counts_[ 5 ]);
+    EXPECT_EQ(2, total.timeouts_counts_[ 6 ]);
+}
+
+}
+
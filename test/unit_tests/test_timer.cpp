@@ -26,13 +26,16 @@
 #include "common.hpp"
 #include "kademlia/error_impl.hpp"
 #include "kademlia/timer.hpp"
+#include "simulator/virtual_clock.hpp"
 #include "gtest/gtest.h"
+#include <stdexcept>
 #include <vector>
 
 namespace {
 
 namespace k = kademlia;
 namespace kd = k::detail;
+namespace t = k::test;
 
 
 TEST(timer_construct_test, can_be_constructed_using_a_reactor)
@@ -103,5 +106,77 @@ TEST_F(timer_test, multiple_associations_can_be_added)
     // A timeout (infinite) is still in flight atm.
 }
 
+TEST_F(timer_test, cancelled_associations_are_not_called)
+{
+    auto on_expiration = [ this ] (void)
+    { ++ timeouts_received_; };
+
+    auto const immediate = kd::timer::duration::zero();
+    auto const h = manager_.expires_from_now(immediate, on_expiration);
+    EXPECT_TRUE(manager_.cancel(h));
+    EXPECT_FALSE(manager_.cancel(h));
+
+    // The task is still executed but doesn't call the callback.
+    EXPECT_EQ(1, io_service_.run_one());
+    EXPECT_EQ(0, timeouts_received_);
+}
+
+TEST_F(timer_test, timeouts_expire_when_the_virtual_time_is_advanced)
+{
+    kd::basic_timer< t::virtual_clock > manager{ io_service_ };
+    auto const start = t::virtual_clock::now();
+
+    auto on_expiration = [ this ] (void)
+    { ++ timeouts_received_; };
+
+    auto const timeout = std::chrono::milliseconds(100);
+    manager.expires_from_now(timeout, on_expiration);
+    EXPECT_GE(start + timeout, t::virtual_timer::get_next_expiration_time());
+
+    // The io_service doesn't wait for virtual timers.
+    EXPECT_EQ(0, io_service_.poll());
+    t::virtual_timer::expire_timers();
+    EXPECT_EQ(0, io_service_.poll());
+
+    t::virtual_clock::advance_to(start + timeout);
+    t::virtual_timer::expire_timers();
+    EXPECT_EQ(t::virtual_clock::time_point::max()
+             , t::virtual_timer::get_next_expiration_time());
+
+    EXPECT_EQ(1, io_service_.poll());
+    EXPECT_EQ(1, timeouts_received_);
+}
+
+TEST_F(timer_test, remaining_timeouts_expire_after_a_callback_throws)
+{
+    kd::basic_timer< t::virtual_clock > manager{ io_service_ };
+    auto const start = t::virtual_clock::now();
+
+    auto thrown = false;
+    auto on_expiration = [ this, &thrown ] (void)
+    {
+        if (! thrown)
+        {
+            thrown = true;
+            throw std::runtime_error{ "expiration" };
+        }
+        ++ timeouts_received_;
+    };
+
+    auto const timeout = std::chrono::milliseconds(100);
+    manager.expires_from_now(timeout, on_expiration);
+    manager.expires_from_now(timeout, on_expiration);
+
+    t::virtual_clock::advance_to(start + timeout);
+    t::virtual_timer::expire_timers();
+    EXPECT_THROW(io_service_.poll(), std::runtime_error);
+    EXPECT_EQ(0, timeouts_received_);
+
+    // The remaining timeout is still scheduled.
+    t::virtual_timer::expire_timers();
+    io_service_.poll();
+    EXPECT_EQ(1, timeouts_received_);
+}
+
 
 }
@@ -0,0 +1,314 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "common.hpp"
+#include "kademlia/timing_wheel.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+
+using std::chrono::milliseconds;
+using std::chrono::microseconds;
+
+struct timing_wheel_test : public ::testing::Test
+{
+    timing_wheel_test()
+        : origin_{ kd::timing_wheel::clock::now() }
+        , wheel_{ origin_ }
+        , expired_{}
+    { }
+
+    void
+    schedule
+        ( kd::timing_wheel::duration const& timeout
+        , int value )
+    { wheel_.schedule(origin_ + timeout, [ this, value ] { expired_.push_back(value); }); }
+
+    kd::timing_wheel::time_point origin_;
+    kd::timing_wheel wheel_;
+    std::vector< int > expired_;
+};
+
+TEST_F(timing_wheel_test, is_empty_on_construction)
+{
+    EXPECT_TRUE(wheel_.empty());
+    EXPECT_EQ(0, wheel_.size());
+
+    wheel_.expire(origin_ + std::chrono::hours{ 1 });
+    EXPECT_TRUE(expired_.empty());
+}
+
+TEST_F(timing_wheel_test, callbacks_are_called_once_expired)
+{
+    schedule(milliseconds{ 10 }, 10);
+    schedule(milliseconds{ 5 }, 5);
+    schedule(milliseconds{ 300 }, 300);
+    schedule(milliseconds{ 70000 }, 70000);
+    EXPECT_EQ(4, wheel_.size());
+    EXPECT_GE(origin_ + milliseconds{ 5 }, wheel_.get_next_expiration_time());
+
+    wheel_.expire(origin_ + milliseconds{ 4 });
+    EXPECT_TRUE(expired_.empty());
+
+    wheel_.expire(origin_ + milliseconds{ 12 });
+    EXPECT_EQ((std::vector< int >{ 5, 10 }), expired_);
+
+    wheel_.expire(origin_ + milliseconds{ 300 });
+    EXPECT_EQ((std::vector< int >{ 5, 10, 300 }), expired_);
+    EXPECT_GE(origin_ + milliseconds{ 70000 }, wheel_.get_next_expiration_time());
+
+    wheel_.expire(origin_ + milliseconds{ 69999 });
+    EXPECT_EQ(3, expired_.size());
+
+    wheel_.expire(origin_ + milliseconds{ 70000 });
+    EXPECT_EQ((std::vector< int >{ 5, 10, 300, 70000 }), expired_);
+    EXPECT_TRUE(wheel_.empty());
+}
+
+TEST_F(timing_wheel_test, timeouts_are_rounded_up_to_the_tick)
+{
+    schedule(microseconds{ 1500 }, 1);
+    EXPECT_EQ(origin_ + milliseconds{ 2 }, wheel_.get_next_expiration_time());
+
+    wheel_.expire(origin_ + microseconds{ 1500 });
+    EXPECT_TRUE(expired_.empty());
+
+    wheel_.expire(origin_ + microseconds{ 1999 });
+    EXPECT_TRUE(expired_.empty());
+
+    wheel_.expire(origin_ + milliseconds{ 2 });
+    EXPECT_EQ(1, expired_.size());
+}
+
+TEST_F(timing_wheel_test, timeouts_never_expire_before_their_deadline)
+{
+    std::default_random_engine random_engine{ 1 };
+    std::uniform_int_distribution< std::int64_t > timeouts{ 0, 50000 };
+    std::uniform_int_distribution< std::int64_t > steps{ 1, 700 };
+
+    std::size_t const count = 10000;
+    std::vector< kd::timing_wheel::time_point > expirations;
+    std::size_t early_calls_count = 0;
+    kd::timing_wheel::time_point now = origin_;
+
+    for (std::size_t i = 0; i != count; ++ i)
+    {
+        expirations.push_back(origin_ + microseconds{ timeouts(random_engine) });
+        auto const expiration = expirations.back();
+        wheel_.schedule(expiration, [ &early_calls_count, &now, expiration ]
+        { if (now < expiration) ++ early_calls_count; });
+    }
+
+    // Walk with steps unaligned on the ticks.
+    while (! wheel_.empty())
+    {
+        now += microseconds{ steps(random_engine) };
+        wheel_.expire(now);
+    }
+
+    EXPECT_EQ(0, early_calls_count);
+}
+
+TEST_F(timing_wheel_test, expired_timeouts_expire_on_next_call)
+{
+    wheel_.expire(origin_ + milliseconds{ 10 });
+
+    schedule(milliseconds{ 5 }, 5);
+    EXPECT_GE(origin_ + milliseconds{ 10 }, wheel_.get_next_expiration_time());
+
+    wheel_.expire(origin_ + milliseconds{ 10 });
+    EXPECT_EQ((std::vector< int >{ 5 }), expired_);
+    EXPECT_TRUE(wheel_.empty());
+}
+
+TEST_F(timing_wheel_test, callbacks_can_schedule_timeouts)
+{
+    auto const now = origin_ + milliseconds{ 10 };
+
+    wheel_.schedule(now, [ this, now ]
+    {
+        expired_.push_back(1);
+        // Already expired timeouts are delayed to the next tick.
+        wheel_.schedule(now, [ this ] { expired_.push_back(2); });
+    });
+
+    wheel_.expire(now);
+    EXPECT_EQ((std::vector< int >{ 1 }), expired_);
+
+    wheel_.expire(now + milliseconds{ 1 });
+    EXPECT_EQ((std::vector< int >{ 1, 2 }), expired_);
+    EXPECT_TRUE(wheel_.empty());
+}
+
+TEST_F(timing_wheel_test, throwing_callbacks_dont_stall_the_wheel)
+{
+    auto thrown = false;
+    auto const on_expiration = [ this, &thrown ]
+    {
+        if (! thrown)
+        {
+            thrown = true;
+            throw std::runtime_error{ "expiration" };
+        }
+        expired_.push_back(10);
+    };
+    wheel_.schedule(origin_ + milliseconds{ 10 }, on_expiration);
+    wheel_.schedule(origin_ + milliseconds{ 10 }, on_expiration);
+    schedule(milliseconds{ 20 }, 20);
+
+    EXPECT_THROW(wheel_.expire(origin_ + milliseconds{ 10 }), std::runtime_error);
+    EXPECT_EQ(2, wheel_.size());
+    EXPECT_GE(origin_ + milliseconds{ 10 }, wheel_.get_next_expiration_time());
+
+    // The wheel is no longer expiring, hence an already
+    // expired timeout is called on the next expiration.
+    schedule(milliseconds{ 5 }, 5);
+    wheel_.expire(origin_ + milliseconds{ 10 });
+    std::sort(expired_.begin(), expired_.end());
+    EXPECT_EQ((std::vector< int >{ 5, 10 }), expired_);
+
+    wheel_.expire(origin_ + milliseconds{ 20 });
+    EXPECT_EQ(20, expired_.back());
+    EXPECT_TRUE(wheel_.empty());
+}
+
+TEST_F(timing_wheel_test, cancelled_timeouts_are_not_called)
+{
+    auto const on_expiration = [ this ] { expired_.push_back(1); };
+    auto const h1 = wheel_.schedule(origin_ + milliseconds{ 10 }, on_expiration);
+    auto const h2 = wheel_.schedule(origin_ + milliseconds{ 500 }, on_expiration);
+    EXPECT_EQ(2, wheel_.size());
+
+    EXPECT_TRUE(wheel_.cancel(h1));
+    EXPECT_FALSE(wheel_.cancel(h1));
+    EXPECT_EQ(1, wheel_.size());
+
+    // The entry of h1 is reused, h1 must not cancel the new timeout.
+    auto const h3 = wheel_.schedule(origin_ + milliseconds{ 10 }, on_expiration);
+    EXPECT_FALSE(wheel_.cancel(h1));
+
+    wheel_.expire(origin_ + milliseconds{ 10 });
+    EXPECT_EQ(1, expired_.size());
+    EXPECT_FALSE(wheel_.cancel(h3));
+
+    EXPECT_TRUE(wheel_.cancel(h2));
+    EXPECT_TRUE(wheel_.empty());
+
+    wheel_.expire(origin_ + milliseconds{ 500 });
+    EXPECT_EQ(1, expired_.size());
+}
+
+TEST_F(timing_wheel_test, callbacks_can_cancel_timeouts)
+{
+    // Each callback cancels the other one.
+    kd::timing_wheel::handle h1{}, h2{};
+    h1 = wheel_.schedule(origin_ + milliseconds{ 10 }, [ this, &h2 ]
+    {
+        expired_.push_back(1);
+        EXPECT_TRUE(wheel_.cancel(h2));
+    });
+    h2 = wheel_.schedule(origin_ + milliseconds{ 10 }, [ this, &h1 ]
+    {
+        expired_.push_back(2);
+        EXPECT_TRUE(wheel_.cancel(h1));
+    });
+
+    wheel_.expire(origin_ + milliseconds{ 10 });
+    EXPECT_EQ(1, expired_.size());
+    EXPECT_TRUE(wheel_.empty());
+}
+
+TEST_F(timing_wheel_test, timeouts_expire_at_their_tick)
+{
+    std::default_random_engine random_engine{ 1 };
+    std::uniform_int_distribution< std::int64_t > timeouts{ 1000, 100000000 };
+
+    std::size_t const count = 10000;
+    std::vector< kd::timing_wheel::time_point > expirations;
+    std::vector< kd::timing_wheel::time_point > calls( count );
+    kd::timing_wheel::time_point now = origin_;
+
+    for (std::size_t i = 0; i != count; ++ i)
+    {
+        expirations.push_back(origin_ + microseconds{ timeouts(random_engine) });
+        wheel_.schedule(expirations.back(), [ &calls, &now, i ] { calls[ i ] = now; });
+    }
+
+    // Walk from an expiration to the next.
+    while (! wheel_.empty())
+    {
+        now = wheel_.get_next_expiration_time();
+        wheel_.expire(now);
+    }
+
+    for (std::size_t i = 0; i != count; ++ i)
+    {
+        EXPECT_LE(expirations[ i ], calls[ i ]);
+        EXPECT_GT(expirations[ i ] + milliseconds{ 1 }, calls[ i ]);
+    }
+}
+
+TEST_F(timing_wheel_test, callbacks_are_destroyed_once_expired_or_cancelled)
+{
+    auto const resource = std::make_shared< int >(0);
+    // As large as the callbacks of the response_router.
+    std::array< char, 96 > padding{};
+
+    std::vector< kd::timing_wheel::handle > handles;
+    {
+        kd::timing_wheel wheel{ origin_ };
+
+        // The pool grows, hence callbacks are moved between entries.
+        for (int i = 0; i != 100; ++ i)
+            handles.push_back(wheel.schedule(origin_ + milliseconds{ 1 + i }
+                                            , [ resource, padding ] { ++ *resource; }));
+        EXPECT_EQ(101, resource.use_count());
+
+        EXPECT_TRUE(wheel.cancel(handles[ 0 ]));
+        EXPECT_EQ(100, resource.use_count());
+
+        wheel.expire(origin_ + milliseconds{ 50 });
+        EXPECT_EQ(49, *resource);
+        EXPECT_EQ(51, resource.use_count());
+    }
+
+    // The remaining callbacks were destroyed with the wheel.
+    EXPECT_EQ(49, *resource);
+    EXPECT_EQ(1, resource.use_count());
+}
+
+}
+
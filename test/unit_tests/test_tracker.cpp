@@ -0,0 +1,177 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "common.hpp"
+#include "boost/asio/io_service.hpp"
+#include "kademlia/buffer_pool.hpp"
+#include "kademlia/ip_endpoint.hpp"
+#include "kademlia/message.hpp"
+#include "kademlia/tracker.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+
+/**
+ *  Keeps the sent messages and their completion
+ *  callbacks, called when the test chooses to.
+ */
+struct network_stub
+{
+    using endpoint_type = kd::ip_endpoint;
+
+    using on_message_sent_type = std::function< void ( std::error_code const& ) >;
+
+    kd::pooled_buffer
+    acquire_buffer
+        ( void )
+    { return kd::pooled_buffer{}; }
+
+    template< typename OnMessageSent >
+    void
+    send
+        ( kd::pooled_buffer const& message
+        , endpoint_type const&
+        , OnMessageSent const& on_message_sent )
+    {
+        messages_.push_back( *message );
+        on_messages_sent_.push_back( on_message_sent );
+    }
+
+    std::vector< kd::buffer > messages_;
+    std::vector< on_message_sent_type > on_messages_sent_;
+};
+
+using tracker_type = kd::tracker< std::default_random_engine, network_stub >;
+
+struct tracker_test: public ::testing::Test
+{
+    tracker_test()
+        : io_service_{}
+        , network_{}
+        , random_engine_{}
+        , tracker_{ io_service_, kd::id{ "1" }, network_, random_engine_ }
+        , responses_count_{}
+        , failures_{}
+    { }
+
+    void
+    send_request
+        ( std::chrono::milliseconds const& timeout )
+    {
+        auto on_response_received = [ this ]
+            ( kd::ip_endpoint const&
+            , kd::header const&
+            , kd::buffer::const_iterator
+            , kd::buffer::const_iterator )
+        { ++ responses_count_; };
+
+        auto on_error = [ this ]
+            ( std::error_code const& failure )
+        { failures_.push_back( failure ); };
+
+        tracker_.send_request( kd::find_peer_request_body{ kd::id{ "2" } }
+                             , kd::ip_endpoint{}, timeout
+                             , on_response_received, on_error );
+    }
+
+    void
+    receive_response
+        ( void )
+    {
+        ASSERT_EQ( 1, network_.messages_.size() );
+
+        kd::header request;
+        auto i = network_.messages_.front().cbegin();
+        ASSERT_FALSE( kd::deserialize( i, network_.messages_.front().cend(), request ) );
+
+        kd::header const response{ kd::header::V1, kd::header::FIND_PEER_RESPONSE
+                                 , kd::id{ "2" }, request.random_token_ };
+        kd::buffer const body;
+        tracker_.handle_new_response( kd::ip_endpoint{}, response
+                                    , body.begin(), body.end() );
+    }
+
+    boost::asio::io_service io_service_;
+    network_stub network_;
+    std::default_random_engine random_engine_;
+    tracker_type tracker_;
+    std::size_t responses_count_;
+    std::vector< std::error_code > failures_;
+};
+
+TEST_F(tracker_test, responses_received_before_the_request_is_sent_are_forwarded)
+{
+    send_request( std::chrono::hours{ 1 } );
+    ASSERT_EQ( 1, network_.on_messages_sent_.size() );
+
+    // Another thread may receive the response first.
+    receive_response();
+    EXPECT_EQ( 1, responses_count_ );
+
+    network_.on_messages_sent_.front()( std::error_code{} );
+    io_service_.poll();
+    EXPECT_EQ( 1, responses_count_ );
+    EXPECT_TRUE( failures_.empty() );
+}
+
+TEST_F(tracker_test, failed_requests_are_reported_once)
+{
+    send_request( std::chrono::milliseconds{ 0 } );
+    ASSERT_EQ( 1, network_.on_messages_sent_.size() );
+
+    auto const failure = std::make_error_code( std::errc::network_unreachable );
+    network_.on_messages_sent_.front()( failure );
+    ASSERT_EQ( 1, failures_.size() );
+    EXPECT_EQ( failure, failures_.front() );
+
+    // Neither the timeout nor a late response are reported.
+    io_service_.poll();
+    receive_response();
+    EXPECT_EQ( 1, failures_.size() );
+    EXPECT_EQ( 0, responses_count_ );
+}
+
+TEST_F(tracker_test, requests_timeouts_are_reported)
+{
+    send_request( std::chrono::milliseconds{ 0 } );
+    network_.on_messages_sent_.front()( std::error_code{} );
+
+    // The timeout expires on the next tick.
+    io_service_.run_one();
+    ASSERT_EQ( 1, failures_.size() );
+    EXPECT_TRUE( std::errc::timed_out == failures_.front() );
+
+    receive_response();
+    EXPECT_EQ( 0, responses_count_ );
+}
+
+}
@@ -0,0 +1,206 @@
+// Copyright (c) 2013-2014, David Keller
+// All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the University of California, Berkeley nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY DAVID KELLER AND CONTRIBUTORS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE REGENTS AND CONTRIBUTORS BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "kademlia/id.hpp"
+#include "kademlia/value_store.hpp"
+#include "simulator/virtual_clock.hpp"
+#include "gtest/gtest.h"
+
+namespace {
+
+namespace k = kademlia;
+namespace kd = k::detail;
+namespace t = k::test;
+
+using test_value_store = kd::concurrent_value_store< kd::id, std::string >;
+
+using bounded_store = kd::bounded_value_store< kd::id, std::string >;
+
+using virtual_bounded_store = kd::bounded_value_store< kd::id
+                                                     , std::string
+                                                     , t::virtual_clock >;
+
+/// The bytes accounted for a value of size bytes.
+std::size_t
+get_bytes_count(std::size_t size)
+{ return sizeof(kd::id) + size; }
+
+TEST(bounded_value_store_test, counts_values_and_bytes)
+{
+    bounded_store store;
+    EXPECT_EQ(0, store.size());
+
+    EXPECT_TRUE(store.assign(kd::id{ "1" }, "ab"));
+    EXPECT_TRUE(store.assign(kd::id{ "2" }, "cde"));
+    EXPECT_TRUE(store.assign(kd::id{ "1" }, "f"));
+
+    auto const s = store.get_statistics();
+    EXPECT_EQ(2, s.values_count_);
+    EXPECT_EQ(get_bytes_count(3) + get_bytes_count(1), s.bytes_count_);
+    EXPECT_EQ(0, s.evictions_count_);
+    EXPECT_EQ(0, s.expirations_count_);
+
+    std::string value;
+    EXPECT_TRUE(store.find(kd::id{ "1" }, value));
+    EXPECT_EQ("f", value);
+}
+
+TEST(bounded_value_store_test, evicts_the_least_recently_used_values)
+{
+    bounded_store store{ 3 * get_bytes_count(1) };
+
+    store.assign(kd::id{ "1" }, "a");
+    store.assign(kd::id{ "2" }, "b");
+    store.assign(kd::id{ "3" }, "c");
+
+    // "1" becomes the most recently used, hence "2" is evicted.
+    std::string value;
+    EXPECT_TRUE(store.find(kd::id{ "1" }, value));
+    EXPECT_TRUE(store.assign(kd::id{ "4" }, "d"));
+
+    EXPECT_FALSE(store.find(kd::id{ "2" }, value));
+    EXPECT_TRUE(store.find(kd::id{ "1" }, value));
+    EXPECT_TRUE(store.find(kd::id{ "3" }, value));
+    EXPECT_TRUE(store.find(kd::id{ "4" }, value));
+
+    auto const s = store.get_statistics();
+    EXPECT_EQ(3, s.values_count_);
+    EXPECT_EQ(3 * get_bytes_count(1), s.bytes_count_);
+    EXPECT_EQ(1, s.evictions_count_);
+}
+
+TEST(bounded_value_store_test, rejects_values_exceeding_the_budget)
+{
+    bounded_store store{ get_bytes_count(2) };
+
+    EXPECT_TRUE(store.assign(kd::id{ "1" }, "ab"));
+    EXPECT_FALSE(store.assign(kd::id{ "1" }, "abc"));
+
+    std::string value;
+    EXPECT_FALSE(store.find(kd::id{ "1" }, value));
+    EXPECT_EQ(0, store.get_statistics().bytes_count_);
+}
+
+TEST(bounded_value_store_test, values_expire_after_their_ttl)
+{
+    auto const start = t::virtual_clock::now();
+
+    virtual_bounded_store store{ 1024, std::chrono::seconds(10) };
+    store.assign(kd::id{ "1" }, "a");
+
+    t::virtual_clock::advance_to(start + std::chrono::seconds(5));
+    // Saving again postpones the expiration.
+    store.assign(kd::id{ "2" }, "b");
+    store.assign(kd::id{ "1" }, "c");
+
+    std::string value;
+    t::virtual_clock::advance_to(start + std::chrono::seconds(10));
+    EXPECT_TRUE(store.find(kd::id{ "1" }, value));
+    EXPECT_TRUE(store.find(kd::id{ "2" }, value));
+
+    // Expired values are removed when found
+    // and from the oldest on assignment.
+    t::virtual_clock::advance_to(start + std::chrono::seconds(15));
+    EXPECT_FALSE(store.find(kd::id{ "2" }, value));
+    store.assign(kd::id{ "3" }, "d");
+
+    auto const s = store.get_statistics();
+    EXPECT_EQ(1, s.values_count_);
+    EXPECT_EQ(get_bytes_count(1), s.bytes_count_);
+    EXPECT_EQ(2, s.expirations_count_);
+}
+
+TEST(concurrent_value_store_test, values_can_be_assigned_and_found)
+{
+    test_value_store store;
+    EXPECT_EQ(0, store.size());
+
+    std::string value;
+    EXPECT_FALSE(store.find(kd::id{ "1" }, value));
+
+    store.assign(kd::id{ "1" }, "a");
+    store.assign(kd::id{ "2" }, "b");
+    store.assign(kd::id{ "1" }, "c");
+    EXPECT_EQ(2, store.size());
+
+    EXPECT_TRUE(store.find(kd::id{ "1" }, value));
+    EXPECT_EQ("c", value);
+    EXPECT_TRUE(store.find(kd::id{ "2" }, value));
+    EXPECT_EQ("b", value);
+}
+
+TEST(concurrent_value_store_test, shared_values_outlive_their_replacement)
+{
+    kd::shared_buffer b{};
+    {
+        test_value_store store;
+        EXPECT_FALSE(store.find_shared(kd::id{ "1" }));
+
+        store.assign(kd::id{ "1" }, "abc");
+        b = store.find_shared(kd::id{ "1" });
+        ASSERT_TRUE(bool(b));
+
+        store.assign(kd::id{ "1" }, "def");
+        store.assign(kd::id{ "2" }, "ghi");
+    }
+
+    // The store is gone, not the bytes of b.
+    EXPECT_EQ("abc", std::string(b.data_, b.data_ + b.size_));
+}
+
+TEST(concurrent_value_store_test, can_be_shared_by_several_threads)
+{
+    test_value_store store;
+    auto const THREADS_COUNT = 4, VALUES_COUNT = 500;
+
+    std::vector< std::thread > threads;
+    for (auto t = 0; t != THREADS_COUNT; ++ t)
+        threads.emplace_back([ &store, t, VALUES_COUNT ]
+        {
+            std::default_random_engine random_engine{ std::uint32_t(t + 1) };
+            std::string value;
+            for (auto i = 0; i != VALUES_COUNT; ++ i)
+            {
+                kd::id const key(random_engine);
+                store.assign(key, std::to_string(i));
+                EXPECT_TRUE(store.find(key, value));
+            }
+        });
+
+    for (auto & t : threads)
+        t.join();
+
+    EXPECT_EQ(THREADS_COUNT * VALUES_COUNT, store.size());
+}
+
+}
+
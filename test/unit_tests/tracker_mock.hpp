@@ -27,6 +27,7 @@
 #define KADEMLIA_TEST_HELPERS_TRACKER_MOCK_HPP
 
 #include "boost/asio/io_service.hpp"
+#include "kademlia/clock.hpp"
 #include "kademlia/error_impl.hpp"
 #include "kademlia/message.hpp"
 #include "kademlia/message_serializer.hpp"
@@ -42,6 +43,9 @@ public:
     ///
     using endpoint_type = detail::ip_endpoint;
 
+    ///
+    using clock_type = detail::clock;
+
 public:
     /**
      *